@@ -2,6 +2,7 @@
 #include "cabin.h"
 #include "jni.h"
 #include "object.h"
+#include "inline_cache.h"
 
 void show_usage(const char *name);
 void show_version_and_copyright();
@@ -10,6 +11,11 @@ static char main_class_name[FILENAME_MAX] = { 0 };
 static char *main_func_args[METHOD_PARAMETERS_MAX_COUNT];
 static int main_func_args_count = 0;
 
+// 传递给虚拟机的参数，e.g. -Xms64m -Xmx512m
+#define VM_OPTIONS_MAX_COUNT 16
+static JavaVMOption vm_options[VM_OPTIONS_MAX_COUNT];
+static int vm_options_count = 0;
+
 static void parse_command_line(int argc, char *argv[])
 {
     // 可执行程序的名字为 argv[0]
@@ -28,6 +34,23 @@ static void parse_command_line(int argc, char *argv[])
                     JVM_PANIC("缺少参数：%s\n", name);
                 }
                 set_classpath(argv[i]);
+            } else if (strncmp(name, "-Xms", 4) == 0 || strncmp(name, "-Xmx", 4) == 0) {
+                if (parse_memory_size(name + 4) == 0) {
+                    JVM_PANIC("Invalid heap size: %s\n", name);
+                }
+                if (vm_options_count >= VM_OPTIONS_MAX_COUNT) {
+                    JVM_PANIC("Too many options.\n");
+                }
+                vm_options[vm_options_count++].optionString = argv[i];
+            } else if (strcmp(name, "-XX:+UseStringDeduplication") == 0
+                        || strcmp(name, "-XX:-UseStringDeduplication") == 0
+                        || strcmp(name, "-XX:+UseEpsilonGC") == 0 || strcmp(name, "-XX:-UseEpsilonGC") == 0
+                        || strcmp(name, "-XX:+PrintInlineCacheStatistics") == 0
+                        || strcmp(name, "-XX:-PrintInlineCacheStatistics") == 0) {
+                if (vm_options_count >= VM_OPTIONS_MAX_COUNT) {
+                    JVM_PANIC("Too many options.\n");
+                }
+                vm_options[vm_options_count++].optionString = argv[i];
             } else if (strcmp(name, "-help") == 0 || strcmp(name, "-?") == 0) {
                 show_usage(vm_name);
                 exit(0);
@@ -63,7 +86,13 @@ int main(int argc, char* argv[])
     time(&time1);
     
     parse_command_line(argc, argv);
-    JNI_CreateJavaVM(&g_vm, (void **) &g_jni_env, NULL);
+    JavaVMInitArgs vm_init_args = {
+        .version = JNI_VERSION_1_6,
+        .nOptions = vm_options_count,
+        .options = vm_options,
+        .ignoreUnrecognized = JNI_FALSE,
+    };
+    JNI_CreateJavaVM(&g_vm, (void **) &g_jni_env, &vm_init_args);
 
     if (main_class_name[0] == 0) {  // empty  todo
         JVM_PANIC("no input file\n");
@@ -105,6 +134,9 @@ int main(int argc, char* argv[])
 
     // todo main_thread 退出，做一些清理工作。
 
+    if (g_print_inline_cache_statistics)
+        print_inline_cache_statistics();
+
     time_t time2;
     time(&time2);
 
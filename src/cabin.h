@@ -22,8 +22,15 @@
 #define JVM_MUST_SUPPORT_CLASSFILE_MAJOR_VERSION 60
 #define JVM_MUST_SUPPORT_CLASSFILE_MINOR_VERSION 65535
 
-// size of heap
-#define VM_HEAP_SIZE (512*1024*1024) // 512Mb
+// default size of heap, can be set by -Xms and -Xmx
+#define VM_INIT_HEAP_SIZE (64*1024*1024)  // 64Mb
+#define VM_MAX_HEAP_SIZE  (512*1024*1024) // 512Mb
+// size of young generation(nursery), included in heap size, 不超过最大堆的1/4
+#define VM_YOUNG_SIZE (32*1024*1024) // 32Mb
+
+// 对象中的引用压缩为32位（见 object.h 中的 Compressed oops），此时最大堆不能超过约 32Gb.
+// 去掉此定义则使用64位的引用。
+#define COMPRESSED_OOPS
 
 // every thread has a vm stack
 #define VM_STACK_SIZE (512*1024)     // 512Kb
@@ -121,9 +128,19 @@ extern struct property {
 extern int g_properties_count;
 
 typedef struct {
-
+    size_t init_heap_size; // -Xms
+    size_t max_heap_size;  // -Xmx
+    bool string_dedup;     // -XX:+UseStringDeduplication
+    bool epsilon_gc;       // -XX:+UseEpsilonGC，见 heap.h
+    bool print_ic_stats;   // -XX:+PrintInlineCacheStatistics，见 inline_cache.h
 } InitArgs;
 
+/*
+ * 解析内存大小，e.g. 1048576, 1024k, 64m, 1g
+ * 格式错误返回0
+ */
+size_t parse_memory_size(const char *str);
+
 // jvms规定函数最多有255个参数，this也算，long和double占两个长度
 #define METHOD_PARAMETERS_MAX_COUNT 255
 
@@ -134,6 +151,7 @@ typedef struct {
 
 #define MAIN_THREAD_NAME "main" // name of main thread
 #define GC_THREAD_NAME "gc"     // name of gc thread
+#define STRING_DEDUP_THREAD_NAME "string dedup"
 
 #define vm_malloc malloc
 #define vm_calloc(len) calloc(1, len)
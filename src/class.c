@@ -9,33 +9,185 @@
 #include "convert.h"
 
 
-// 计算字段的个数，同时给它们编号
-static void calc_fields_id(Class *c)
+// 实例变量占用的字节数
+static int field_size(const Field *f)
+{
+    switch (f->descriptor[0]) {
+        case 'Z': case 'B': return 1;
+        case 'C': case 'S': return 2;
+        case 'I': case 'F': return 4;
+        case 'J': case 'D': return 8;
+        default: return sizeof(heapref_t);
+    }
+}
+
+#define align_up(n, a) (((n) + (a) - 1) & ~((a) - 1))
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * 在 @annos 中查找 @Contended 注解，返回其 contention group（value 的值，默认为 ""），没有返回 NULL.
+ */
+static const utf8_t *contended_group(ConstantPool *cp, const Annotation *annos, u2 count)
+{
+    for (u2 i = 0; i < count; i++) {
+        const utf8_t *type = cp_utf8(cp, annos[i].type_index);
+        if (!utf8_equals(type, S(sig_jdk_internal_vm_annotation_Contended))
+                    && !utf8_equals(type, S(sig_sun_misc_Contended)))
+            continue;
+
+        for (u2 j = 0; j < annos[i].element_value_pairs_count; j++) {
+            const ElementValuePair *pair = annos[i].element_value_pairs + j;
+            if (pair->value.tag == 's' && utf8_equals(cp_utf8(cp, pair->element_name_index), S(value)))
+                return cp_utf8(cp, pair->value.const_value_index);
+        }
+        return "";
+    }
+    return NULL;
+}
+
+/*
+ * @Contended 实例变量按 contention group 分组放在其他实例变量之后，
+ * 每组前后各填充一个缓存行，所以无论对象的地址如何（对象会被 gc 移动，无法保持缓存行对齐），
+ * 同一缓存行中不会有其他组或者其他实例变量的数据，避免伪共享。
+ * 没有指定 group（""）的每个实例变量单独一组，类被 @Contended 注解时它的所有实例变量为一组。
+ * 返回末尾（包括最后的填充）。
+ */
+static int layout_contended_fields(Class *c, const utf8_t **groups, int off)
+{
+    c->contended_start = off;
+
+    for (int i = 0; i < c->fields_count; i++) {
+        if (groups[i] == NULL || c->fields[i].id >= 0)
+            continue;
+
+        // 放置和 fields[i] 同组的实例变量
+        off += CACHE_LINE_SIZE;
+        for (int size = 8; size >= 1; size /= 2) {
+            for (int j = i; j < c->fields_count; j++) {
+                Field *f = c->fields + j;
+                if (groups[j] == NULL || f->id >= 0 || field_size(f) != size)
+                    continue;
+                if (j != i && (groups[i][0] == 0 || !utf8_equals(groups[i], groups[j])))
+                    continue;
+
+                off = align_up(off, size);
+                f->id = off;
+                off += size;
+            }
+        }
+    }
+
+    return off + CACHE_LINE_SIZE;
+}
+
+/*
+ * 布局实例变量，计算它们在对象中的偏移（Field.id）
+ *
+ * 按大小从大到小（long/double/引用，int/float，short/char，byte/boolean）依次放置，
+ * 每个字段按自身大小对齐，放在第一个足够大的空隙中（包括父类留下的空隙），没有则追加到末尾。
+ * @Contended 实例变量最后放置，见 layout_contended_fields.
+ */
+static void layout_fields(Class *c)
 {
     assert(c != NULL);
 
-    int ins_id = 0;
+    int base = sizeof(Object);
     if (c->super_class != NULL) {
-        ins_id = c->super_class->inst_fields_count;
+        base = c->super_class->inst_size;
     }
 
-    // for (Field *f: fields) {
-    //     if (!f->isStatic()) {
-    //         f->id = ins_id++;
-    //         if (f->category_two)
-    //             ins_id++;
-    //     }
-    // }
+    int limit = base;
+    for (int i = 0; i < c->fields_count; i++) {
+        if (!IS_STATIC(c->fields + i))
+            limit += 2*field_size(c->fields + i); // 对齐最多浪费一个字段的大小
+    }
+
+    // @Contended 实例变量的 contention group
+    const utf8_t *class_group = contended_group(&c->cp, c->rt_visi_annos, c->rt_visi_annos_count);
+    const utf8_t *groups[c->fields_count + 1];
+    bool has_contended = false;
     for (int i = 0; i < c->fields_count; i++) {
         Field *f = c->fields + i;
-        if (!IS_STATIC(f)) {
-            f->id = ins_id++;
-            if (f->category_two)
-                ins_id++;
+        groups[i] = NULL;
+        // 静态变量的值保存在 Field 中（static_value），不在这里布局，@Contended 对其不起作用
+        if (IS_STATIC(f))
+            continue;
+        if (class_group != NULL) {
+            groups[i] = c->class_name;
+        } else {
+            groups[i] = contended_group(&c->cp, f->rt_visi_annos, f->rt_visi_annos_count);
         }
+        has_contended |= groups[i] != NULL;
     }
 
-    c->inst_fields_count = ins_id;
+    // 已占用的字节，父类 @Contended 区域中的空隙也不能使用
+    bool *used = vm_calloc(limit * sizeof(bool));
+    memset(used, true, sizeof(Object));
+    for (Class *clazz = c->super_class; clazz != NULL; clazz = clazz->super_class) {
+        for (int i = 0; i < clazz->fields_count; i++) {
+            Field *f = clazz->fields + i;
+            if (!IS_STATIC(f))
+                memset(used + f->id, true, field_size(f));
+        }
+        if (clazz->contended_start > 0)
+            memset(used + clazz->contended_start, true, clazz->inst_size - clazz->contended_start);
+    }
+
+    int end = base;
+    for (int size = 8; size >= 1; size /= 2) {
+        for (int i = 0; i < c->fields_count; i++) {
+            Field *f = c->fields + i;
+            if (IS_STATIC(f) || groups[i] != NULL || field_size(f) != size)
+                continue;
+
+            int off = sizeof(Object);
+            for (; off < end; off += size) {
+                if (memchr(used + off, true, size) == NULL)
+                    break;
+            }
+            // off >= end 时追加到末尾
+            memset(used + off, true, size);
+            f->id = off;
+            if (off + size > end)
+                end = off + size;
+        }
+    }
+
+    free(used);
+
+    if (has_contended)
+        end = layout_contended_fields(c, groups, end);
+    c->inst_size = end;
+}
+
+// 设置 gc 需要的类的属性（见 Class.ref_type, Class.has_finalizer），在父类和方法都解析之后调用
+static void set_gc_attrs(Class *c)
+{
+    Class *super = c->super_class;
+    if (super != NULL) {
+        c->ref_type = super->ref_type;
+        c->has_finalizer = super->has_finalizer;
+    }
+
+    if (c->loader == BOOT_CLASS_LOADER) {
+        if (utf8_equals(c->class_name, S(java_lang_ref_SoftReference)))
+            c->ref_type = REF_SOFT;
+        else if (utf8_equals(c->class_name, S(java_lang_ref_WeakReference)))
+            c->ref_type = REF_WEAK;
+        else if (utf8_equals(c->class_name, S(java_lang_ref_FinalReference)))
+            c->ref_type = REF_FINAL;
+        else if (utf8_equals(c->class_name, S(java_lang_ref_PhantomReference)))
+            c->ref_type = REF_PHANTOM;
+    }
+
+    for (u2 i = 0; i < c->methods_count; i++) {
+        Method *m = c->methods + i;
+        if (!IS_STATIC(m) && utf8_equals(m->name, S(finalize)) && utf8_equals(m->descriptor, S(___V))) {
+            // 只有一条 return 指令的 finalize() 无需调用，比如 Object.finalize()
+            c->has_finalizer = m->code != NULL && !(m->code_len == 1 && m->code[0] == JVM_OPC_return);
+        }
+    }
 }
 
 static void parse_attribute(Class *c, BytecodeReader *r)
@@ -127,12 +279,83 @@ static void parse_attribute(Class *c, BytecodeReader *r)
     }
 }
 
+// 子类 @c 中的同名同描述符的方法能否覆盖父类的方法 @super_m
+static bool can_override(const Class *c, const Method *super_m)
+{
+    if (IS_PUBLIC(super_m) || IS_PROTECTED(super_m))
+        return true;
+    // package private 方法只能被同一运行时包（包名和类加载器都相同）中的类覆盖
+    const Class *s = super_m->clazz;
+    return c->loader == s->loader && utf8_equals(c->pkg_name, s->pkg_name);
+}
+
+// @c 及其所有父接口中定义的方法的数量，有重复的
+static size_t count_interface_methods(const Class *c)
+{
+    size_t n = c->methods_count;
+    for (u2 i = 0; i < c->interfaces_count; i++)
+        n += count_interface_methods(c->interfaces[i]);
+    return n;
+}
+
+/*
+ * 类没有实现的接口方法（default 方法，或者抽象类中的 miranda 方法）也要占用 vtable 中的一项，
+ * invokevirtual 通过此类（或其子类）调用接口方法时，才能按 vtable_index 分派。
+ * vtable 中放的是接口方法的副本，副本只是 vtable_index 不同，执行的还是接口中的代码。
+ * 副本不在 Class.methods 中，反射看不到它们。
+ */
+static void add_interface_methods(Class *c, Class *ifc)
+{
+    for (u2 i = 0; i < ifc->methods_count; i++) {
+        Method *im = ifc->methods + i;
+        if (!is_virtual_method(im))
+            continue;
+
+        size_t j = 0;
+        for (; j < c->vtable_len; j++) {
+            Method *m = c->vtable[j];
+            if (utf8_equals(m->name, im->name) && utf8_equals(m->descriptor, im->descriptor))
+                break;
+        }
+
+        if (j < c->vtable_len) {
+            Method *m = c->vtable[j];
+            // 类中的方法优先
+            if (!IS_INTERFACE(m->clazz) || m->clazz == im->clazz)
+                continue;
+            // 接口之间选最具体的，即子接口中的（包括子接口重新声明的 abstract 方法）
+            if (is_subclass_of(m->clazz, im->clazz))
+                continue;
+            // 互不继承的接口，已有的 default 方法优先
+            if (!is_subclass_of(im->clazz, m->clazz) && (!IS_ABSTRACT(m) || IS_ABSTRACT(im)))
+                continue;
+        }
+
+        Method *copy = vm_malloc(sizeof(*copy));
+        memcpy(copy, im, sizeof(*copy));
+        copy->vtable_index = j;
+        c->vtable[j] = copy;
+        if (j == c->vtable_len)
+            c->vtable_len++;
+    }
+
+    for (u2 i = 0; i < ifc->interfaces_count; i++)
+        add_interface_methods(c, ifc->interfaces[i]);
+}
+
 static void create_vtable(Class *c)
 {
     assert(c != NULL && c->vtable == NULL);
 
+    // 接口的方法由 itable 分派，接口不需要 vtable
+    if (IS_INTERFACE(c))
+        return;
+
     size_t super_vtable_len = c->vtable_len = c->super_class != NULL ? c->super_class->vtable_len : 0;
-    c->vtable = vm_malloc(sizeof(Method *) * (super_vtable_len + c->methods_count));
+    size_t max_len = super_vtable_len + c->methods_count;
+    for (u2 i = 0; i < c->interfaces_count; i++)
+        max_len += count_interface_methods(c->interfaces[i]);
+    c->vtable = vm_malloc(sizeof(Method *) * max_len);
 
     if (c->super_class != NULL) {
         // 将父类的vtable复制过来
@@ -144,173 +367,127 @@ static void create_vtable(Class *c)
         if (!is_virtual_method(m))
             continue;
 
-        // 判断有没有重写父类的方法
-        size_t j = 0;
-        for (; j < super_vtable_len; j++) {
-            if (utf8_equals(c->vtable[j]->name, m->name) 
-                && utf8_equals(c->vtable[j]->descriptor, m->descriptor)) {
+        // 判断有没有重写父类的方法。
+        // 一个方法可能同时重写多项，比如重写了不同包中父类的 package private 方法，
+        // 而中间的类（在另一个包中）又定义了同名的 public 方法。
+        m->vtable_index = -1;
+        for (size_t j = 0; j < super_vtable_len; j++) {
+            Method *super_m = c->vtable[j];
+            if (utf8_equals(super_m->name, m->name) 
+                    && utf8_equals(super_m->descriptor, m->descriptor) && can_override(c, super_m)) {
                 // 重写了父类的方法，更新
-                assert(c->vtable[j]->vtable_index == j);
-                m->vtable_index = j;
                 c->vtable[j] = m;
-                break;
+                if (m->vtable_index < 0)
+                    m->vtable_index = j;
             }
         }
 
-        if (j == super_vtable_len) {
+        if (m->vtable_index < 0) {
             // 子类定义了要给新方法，加到 vtable 后面
             c->vtable[c->vtable_len] = m;
             m->vtable_index = c->vtable_len;
             c->vtable_len++;
         }
     }
-}
-
-static void create_itable(Class *c)
-{
 
+    // 父类已经加入的接口方法在上面已经复制过来了
+    for (u2 i = 0; i < c->interfaces_count; i++)
+        add_interface_methods(c, c->interfaces[i]);
 }
 
-/*
-// void Class::createVtable()
-// {
-//     assert(vtable.empty());
-
-//     if (super_class == NULL) {
-//         int i = 0;
-//         for (auto &m : methods) {
-//             if (m->isVirtual()) {
-//                 vtable.push_back(m);
-//                 m->vtable_index = i++;
-//             }
-//         }
-//         return;
-//     }
-
-//     // 将父类的vtable复制过来
-//     vtable.assign(super_class->vtable.begin(), super_class->vtable.end());
-
-//     for (auto m : methods) {
-//         if (m->isVirtual()) {
-//             auto iter = find_if(vtable.begin(), vtable.end(), [=](Method *m0){
-//                 return utf8::equals(m->name, m0->name) && utf8::equals(m->descriptor, m0->descriptor); });
-//             if (iter != vtable.end()) {
-//                 // 重写了父类的方法，更新
-//                 m->vtable_index = (*iter)->vtable_index;
-//                 *iter = m;
-//             } else {
-//                 // 子类定义了要给新方法，加到 vtable 后面
-//                 vtable.push_back(m);
-//                 m->vtable_index = vtable.size() - 1;
-//             }
-//         }
-//     }
-// }
-*/
-#if 0
-Class::ITable::ITable(const Class::ITable &itable)
+Method *lookup_vtable_method(Class *c, const utf8_t *name, const utf8_t *descriptor)
 {
-    interfaces.assign(itable.interfaces.begin(), itable.interfaces.end());
-    methods.assign(itable.methods.begin(), itable.methods.end());
-}
+    assert(c != NULL && name != NULL && descriptor != NULL);
 
-Class::ITable& Class::ITable::operator=(const Class::ITable &itable)
-{
-    interfaces.assign(itable.interfaces.begin(), itable.interfaces.end());
-    methods.assign(itable.methods.begin(), itable.methods.end());
-    return *this;
+    // 后面的项是子类中加入的，从后往前找
+    for (size_t i = c->vtable_len; i > 0; i--) {
+        Method *m = c->vtable[i - 1];
+        if (utf8_equals(m->name, name) && utf8_equals(m->descriptor, descriptor))
+            return m;
+    }
+    return NULL;
 }
 
-void Class::ITable::add(const ITable &itable)
+Method *lookup_itable_method(Class *c, const Method *m)
 {
-    for (auto ifc: itable.interfaces) {
-        interfaces.emplace_back(ifc.first, methods.size());  
-        for (auto m: itable.methods) 
-            methods.push_back(m);
+    assert(c != NULL && m != NULL && m->itable_index >= 0);
+
+    struct itable *t = &c->itable;
+    for (u2 i = 0; i < t->interfaces_count; i++) {
+        if (t->interfaces[i].clazz == m->clazz) {
+            assert(t->interfaces[i].offset + m->itable_index < t->methods_count);
+            return t->methods[t->interfaces[i].offset + m->itable_index];
+        }
     }
+    return NULL;
 }
 
-Method *Class::findFromITable(Class *interface_class, int itable_index)
+// 把接口 @ifc 和它的父接口加入 @c 的 itable.interfaces 中，已经有的不再加入
+static void add_itable_interface(Class *c, Class *ifc, u2 *capacity)
 {
-    assert(interface_class != NULL && interface_class->isInterface());
+    assert(IS_INTERFACE(ifc));
 
-    for (auto interface: itable.interfaces) {
-        if (interface.first->equals(interface_class)) {
-            size_t offset = interface.second;
-            assert(offset + itable_index < itable.methods.size());
-            return itable.methods[offset + itable_index];
-        }
+    struct itable *t = &c->itable;
+    for (u2 i = 0; i < t->interfaces_count; i++) {
+        if (t->interfaces[i].clazz == ifc)
+            return;
     }
 
-    return NULL;
+    if (t->interfaces_count == *capacity) {
+        *capacity = *capacity == 0 ? 8 : *capacity*2;
+        t->interfaces = vm_realloc(t->interfaces, *capacity * sizeof(*t->interfaces));
+    }
+    t->interfaces[t->interfaces_count].clazz = ifc;
+    t->interfaces[t->interfaces_count].offset = t->methods_count;
+    t->interfaces_count++;
+    t->methods_count += ifc->itable.methods_count;
+
+    for (u2 i = 0; i < ifc->interfaces_count; i++)
+        add_itable_interface(c, ifc->interfaces[i], capacity);
 }
 
-void Class::createItable()
+static void create_itable(Class *c)
 {
-    if (isInterface()) {
-        // 接口间的继承虽然用 extends 关键字（可以同时继承多个接口），但被继承的接口不是子接口的 super_class，
-        // 而是在子接口的 interfaces 里面。所以接口的 super_class 就是 java/lang/Object 
-
-        for (Class *super_interface: interfaces) {
-            itable.add(super_interface->itable);
-        }
+    assert(c != NULL);
 
-        itable.interfaces.emplace_back(this, itable.methods.size());
-        int index = 0;
-        for (Method *m : methods) {
-            // todo default 方法怎么处理？进不进 itable？
-            // todo 调用 default 方法 生成什么调用指令？
-            m->itable_index = index++;
-            itable.methods.push_back(m);
+    if (IS_INTERFACE(c)) {
+        // 接口只给自己的方法编号，父接口的方法由父接口编号。
+        // 接口间的继承虽然用 extends 关键字，但被继承的接口不是子接口的 super_class，而是在子接口的 interfaces 里面。
+        for (u2 i = 0; i < c->methods_count; i++) {
+            Method *m = c->methods + i;
+            if (is_virtual_method(m)) // 包括 default 方法
+                m->itable_index = c->itable.methods_count++;
         }
-        
         return;
     }
 
-    /* parse non interface class */
-
-    if (super_class != NULL) {
-        itable = super_class->itable;
+    u2 capacity = 0;
+    if (c->super_class != NULL) {
+        struct itable *st = &c->super_class->itable;
+        for (u2 i = 0; i < st->interfaces_count; i++)
+            add_itable_interface(c, st->interfaces[i].clazz, &capacity);
     }
+    for (u2 i = 0; i < c->interfaces_count; i++)
+        add_itable_interface(c, c->interfaces[i], &capacity);
 
-    for (auto ifc : interfaces) {
-        for (auto tmp : itable.interfaces) {
-            if (ifc->equals(tmp.first)) {
-                // 此接口已经在 itable.interfaces 中了
-                goto next;
-            }
-        }
+    if (c->itable.methods_count == 0)
+        return;
 
-        // 发现一个新实现的接口
-        itable.interfaces.emplace_back(ifc, itable.methods.size());
-        // 检查新实现接口的方法是不是已经被重写了
-        for (auto m: ifc->methods) {
-            for (auto m0: itable.methods) {
-                if (utf8::equals(m->name, m0->name) && utf8::equals(m->descriptor, m0->descriptor)) {
-                    m = m0; // 重写了接口方法，更新
-                    break;
-                }
-            }
-            itable.methods.push_back(m);
-        }
-next:;
-    }
-    
-    // 遍历 itable.methods，检查有没有接口函数在本类中被重写了。
-    for (size_t i = 0; i < itable.methods.size(); i++) {
-        auto m = itable.methods[i];
-        for (auto m0 : methods) {
-            if (utf8::equals(m->name, m0->name) && utf8::equals(m->descriptor, m0->descriptor)) {
-                //m0->itable_index = m->itable_index;
-                itable.methods[i] = m0; // 重写了接口方法，更新
-                break;
-            }
+    // 接口方法的实现已经都在 vtable 中了，包括最具体的 default 方法和没有实现的接口方法（见 create_vtable）
+    c->itable.methods = vm_malloc(c->itable.methods_count * sizeof(Method *));
+    for (u2 i = 0; i < c->itable.interfaces_count; i++) {
+        Class *ifc = c->itable.interfaces[i].clazz;
+        Method **methods = c->itable.methods + c->itable.interfaces[i].offset;
+        for (u2 j = 0; j < ifc->methods_count; j++) {
+            Method *m = ifc->methods + j;
+            if (m->itable_index < 0)
+                continue;
+            Method *impl = lookup_vtable_method(c, m->name, m->descriptor);
+            methods[m->itable_index] = impl != NULL ? impl : m;
         }
     }
 }
 
-#endif
-
 // static void gen_indep_interfaces(Class *c)
 // {
 //     if (c->super_class != NULL) {
@@ -515,8 +692,6 @@ Class *define_class(jref class_loader, u1 *bytecode, size_t len)
         }
     }
 
-    calc_fields_id(c);
-
     // parse methods
     c->methods_count = bcr_readu2(&r);
     if (c->methods_count > 0) {
@@ -528,10 +703,12 @@ Class *define_class(jref class_loader, u1 *bytecode, size_t len)
 
     parse_attribute(c, &r); // parse class attributes
 
-#if 0
-    createVtable(); // todo 接口有没有必要创建 vtable
-    createItable();
-#endif
+    // 类的 @Contended 注解在 class attributes 中
+    layout_fields(c);
+    set_gc_attrs(c);
+
+    create_vtable(c);
+    create_itable(c);
     // gen_indep_interfaces(this);
 
     if (g_class_class != NULL) {
@@ -617,10 +794,9 @@ Class *define_array_class(Object *loader, const char *class_name)
     c->interfaces[0] = load_boot_class(S(java_lang_Cloneable));
     c->interfaces[1] = load_boot_class(S(java_io_Serializable));
 
-#if 0
-    createVtable();  
-    createItable();
-#endif
+    // 数组类没有定义方法，vtable 和 Object 的一样
+    create_vtable(c);
+    create_itable(c);
     // gen_indep_interfaces(this);
 
     if (g_class_class != NULL) {
@@ -636,11 +812,10 @@ void gen_class_object(Class *c)
     assert(c != NULL);
     if (c->java_mirror == NULL) {
         assert(g_class_class != NULL);
-        // static size_t size = sizeof(ClsObj) + g_class_class->inst_fields_count * sizeof(slot_t);
+        // static size_t size = sizeof(ClsObj) + g_class_class->inst_size;
 
         // Class Object不在堆上分配，因为此对象无需gc。
-        c->java_mirror = create_local_object(g_class_class);
-        c->java_mirror->jvm_mirror = c;
+        c->java_mirror = create_class_object(c);
 
         // private final ClassLoader classLoader;
         set_ref_field(c->java_mirror, "classLoader", S(sig_java_lang_ClassLoader), c->loader);
@@ -673,13 +848,13 @@ bool class_equals(const Class *c1, const Class *c2)
 size_t non_array_object_size(const Class *c) 
 {
     assert(!is_array_class(c));
-    return sizeof(Object) + c->inst_fields_count*sizeof(slot_t);
+    return align_up((size_t) c->inst_size, sizeof(slot_t));
 }
 
 size_t array_object_size(Class *c, jint arr_len)
 {
     assert(is_array_class(c));
-    return sizeof(Object) + get_ele_size(c)*arr_len;
+    return sizeof(Object) + ARRAY_LENGTH_SIZE + get_ele_size(c)*arr_len;
 }
 
 Field *lookup_field(Class *c, const utf8_t *name, const utf8_t *descriptor)
@@ -833,11 +1008,10 @@ bool inject_inst_field(Class *c, const utf8_t *name, const utf8_t *descriptor)
 
     // auto f = new (c->fields + c->fields_count - 1) Field(c, name, descriptor, flags);
 
-    f->id = c->inst_fields_count;
-
-    c->inst_fields_count++;
-    if (f->category_two)
-        c->inst_fields_count++;
+    // 追加到末尾
+    int size = field_size(f);
+    f->id = align_up(c->inst_size, size);
+    c->inst_size = f->id + size;
 
     return true;
 }
@@ -1213,7 +1387,7 @@ size_t get_ele_size(Class *c)
         } else if (t == 'D') {
             c->array.ele_size = sizeof(jdouble);
         } else {
-            c->array.ele_size = sizeof(jref);
+            c->array.ele_size = sizeof(heapref_t);
         }
     }
 
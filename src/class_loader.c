@@ -7,6 +7,7 @@
 #include "class_loader.h"
 #include "interpreter.h"
 #include "encoding.h"
+#include "thread.h"
 
 
 #define JDK_MODULES_MAX_COUNT 512 // big enough
@@ -214,6 +215,10 @@ static PHM boot_classes;  // todo 加读写锁
 // const Object *
 static PHS loaders;
 
+// 非 boot class loader 加载的所有类
+// <const Object *, PHM<const utf8_t *, Class *> *>
+static PHM loader_classes;
+
 static void add_class_to_class_loader(Object *class_loader, Class *c)
 {
     assert(c != NULL);
@@ -222,12 +227,16 @@ static void add_class_to_class_loader(Object *class_loader, Class *c)
         return;
     }
 
+    // loaders 以地址散列，class loader 不能移动
+    pin_object(class_loader);
     phs_add(&loaders, class_loader);
 
-    if (class_loader->classes == NULL) {
-        class_loader->classes = phm_create((point_hash_func)utf8_hash, (point_equal_func)utf8_equals);
+    PHM *classes = get_loaded_classes(class_loader);
+    if (classes == NULL) {
+        classes = phm_create((point_hash_func)utf8_hash, (point_equal_func)utf8_equals);
+        phm_insert(&loader_classes, class_loader, classes);
     }
-    phm_insert(class_loader->classes, c->class_name, c);
+    phm_insert(classes, c->class_name, c);
 
     // Invoked by the VM to record every loaded class with this loader.
     // void addClass(Class<?> c);
@@ -252,7 +261,8 @@ static void inject_fields(Class *c)
     if (utf8_equals(c->class_name, "java/lang/invoke/ResolvedMethodName")) {
         //@Injected JVM_Method* vmtarget;
         //@Injected Class<?>    vmholder;
-        bool b1 = inject_inst_field(c, "vmtarget", S(sig_java_lang_Object));
+        // vmtarget 保存的是 Method *，不是堆中的对象，用 long 类型保存，gc 不会扫描它
+        bool b1 = inject_inst_field(c, "vmtarget", S(J));
         bool b2 = inject_inst_field(c, "vmholder", S(sig_java_lang_Class));
         if (!b1 || !b2) {
             JVM_PANIC("inject fields error"); // todo
@@ -364,8 +374,9 @@ Class *find_loaded_class(Object *class_loader, const utf8_t *name)
     }
 
     // is not boot classLoader
-    if (class_loader->classes != NULL) {
-        return (Class *) phm_find(class_loader->classes, name);
+    PHM *classes = get_loaded_classes(class_loader);
+    if (classes != NULL) {
+        return (Class *) phm_find(classes, name);
     }
 
     // not find
@@ -401,8 +412,8 @@ Class *load_class(Object *class_loader, const utf8_t *name)
     slot_t *slot = exec_java(m, (slot_t[]) { rslot(class_loader), rslot(alloc_string(dot_name)) });
     assert(slot != NULL);
     jclsRef co = slot_get_ref(slot);
-    assert(co != NULL && co->jvm_mirror != NULL);
-    c = co->jvm_mirror;
+    assert(co != NULL && jvm_mirror(co) != NULL);
+    c = jvm_mirror(co);
     add_class_to_class_loader(class_loader, c);
     // init_class(c); /////////// todo /////////////////////////////////////////
     return c;
@@ -411,7 +422,7 @@ Class *load_class(Object *class_loader, const utf8_t *name)
 Class *define_class1(jref class_loader, jref name,
                      jarrRef bytecode, jint off, jint len, jref protection_domain, jref source)
 {
-    u1 *data = (u1 *) bytecode->data;
+    u1 *data = (u1 *) array_data(bytecode);
     Class *c = define_class(class_loader, data + off, len);
     // c->class_name和name是否相同 todo
 //    printvm("class_name: %s\n", c->class_name);
@@ -426,7 +437,7 @@ Class *init_class(Class *c)
         return c;
     }
 
-    pthread_mutex_lock(&c->clinit_mutex);
+    safe_mutex_lock(&c->clinit_mutex);
     if (c->inited) { // 需要再次判断 inited，有可能被其他线程置为 true
         pthread_mutex_unlock(&c->clinit_mutex);
         return c;
@@ -493,6 +504,7 @@ void init_class_loader()
     init_classpath();
     
     phs_init(&loaders, NULL, NULL);
+    phm_init(&loader_classes, NULL, NULL);
     phs_init(&boot_packages, (point_hash_func) utf8_hash, (point_equal_func) utf8_equals);
     phm_init(&boot_classes, (point_hash_func) utf8_hash, (point_equal_func) utf8_equals);
 
@@ -521,4 +533,10 @@ PHM *get_all_boot_classes()
 PHS *get_all_class_loaders()
 {
     return &loaders;
+}
+
+PHM *get_loaded_classes(Object *class_loader)
+{
+    assert(class_loader != BOOT_CLASS_LOADER);
+    return (PHM *) phm_find(&loader_classes, class_loader);
 }
\ No newline at end of file
@@ -90,6 +90,9 @@ struct point_hash_map *get_all_boot_classes();
 
 struct point_hash_set *get_all_class_loaders();
 
+// 非 boot class loader 加载的所有类，还没有加载过类时返回 NULL
+struct point_hash_map *get_loaded_classes(Object *class_loader);
+
 // void printBootLoadedClasses();
 // void printClassLoader(Object *class_loader);
 
@@ -2,6 +2,7 @@
 #include "cabin.h"
 #include "object.h"
 #include "constants.h"
+#include "thread.h"
 
 void cp_init(ConstantPool *cp, Class *clazz, u2 size)
 {
@@ -25,7 +26,7 @@ void cp_release(ConstantPool *cp)
     free(cp->info);
 }
 
-#define LOCK   pthread_mutex_lock(&cp->mutex);
+#define LOCK   safe_mutex_lock(&cp->mutex);
 #define UNLOCK pthread_mutex_unlock(&cp->mutex);
 
 u1 cp_get_type(ConstantPool *cp, u2 i)
@@ -224,7 +225,14 @@ Method *resolve_method(ConstantPool *cp, u2 i)
     } else {
         Class *c = resolve_class(cp, cp_method_class_index(cp, i));
         utf8_t *name = cp_method_name(cp, i);
-        m = lookup_method(c, name, cp_method_type(cp, i));
+        utf8_t *descriptor = cp_method_type(cp, i);
+        m = lookup_method(c, name, descriptor);
+        if ((m == NULL || IS_INTERFACE(m->clazz)) && !IS_INTERFACE(c)) {
+            // 从接口继承的方法，用此类 vtable 中的副本，invokevirtual 才能按 vtable_index 分派
+            Method *vm = lookup_vtable_method(c, name, descriptor);
+            if (vm != NULL)
+                m = vm;
+        }
         if (m == NULL) {
             m = get_declared_poly_method(c, name);
         }
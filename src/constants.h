@@ -451,6 +451,26 @@ enum {
     JVM_OPC_jsr_w               = 201,
     JVM_OPC_breakpoint          = 202,
 
+    // 虚拟机内部使用的快速指令，由解释器在指令第一次执行后改写得到（见 interpreter.c 中的 Quickening）
+    JVM_OPC_getfield_b_quick        = 203, // byte, boolean
+    JVM_OPC_getfield_c_quick        = 204,
+    JVM_OPC_getfield_s_quick        = 205,
+    JVM_OPC_getfield_i_quick        = 206, // int, float
+    JVM_OPC_getfield_l_quick        = 207, // long, double
+    JVM_OPC_getfield_a_quick        = 208,
+    JVM_OPC_putfield_b_quick        = 209,
+    JVM_OPC_putfield_z_quick        = 210,
+    JVM_OPC_putfield_c_quick        = 211, // char, short
+    JVM_OPC_putfield_i_quick        = 212, // int, float
+    JVM_OPC_putfield_l_quick        = 213, // long, double
+    JVM_OPC_putfield_a_quick        = 214,
+    JVM_OPC_getstatic_quick         = 215,
+    JVM_OPC_putstatic_quick         = 216,
+    JVM_OPC_invokevirtual_quick     = 217,
+    JVM_OPC_invokenonvirtual_quick  = 218, // 静态绑定的 invokevirtual 和 invokespecial
+    JVM_OPC_invokestatic_quick      = 219,
+    JVM_OPC_invokeinterface_quick   = 220,
+
     JVM_OPC_impdep1             = 254,
     JVM_OPC_impdep2             = 255,
     JVM_OPC_invokenative        = JVM_OPC_impdep1,
@@ -661,7 +681,26 @@ enum {
    3,   /* ifnull */                    \
    3,   /* ifnonnull */                 \
    5,   /* goto_w */                    \
-   5    /* jsr_w */                     \
+   5,   /* jsr_w */                     \
+   1,   /* breakpoint */                \
+   3,   /* getfield_b_quick */          \
+   3,   /* getfield_c_quick */          \
+   3,   /* getfield_s_quick */          \
+   3,   /* getfield_i_quick */          \
+   3,   /* getfield_l_quick */          \
+   3,   /* getfield_a_quick */          \
+   3,   /* putfield_b_quick */          \
+   3,   /* putfield_z_quick */          \
+   3,   /* putfield_c_quick */          \
+   3,   /* putfield_i_quick */          \
+   3,   /* putfield_l_quick */          \
+   3,   /* putfield_a_quick */          \
+   3,   /* getstatic_quick */           \
+   3,   /* putstatic_quick */           \
+   3,   /* invokevirtual_quick */       \
+   3,   /* invokenonvirtual_quick */    \
+   3,   /* invokestatic_quick */        \
+   5    /* invokeinterface_quick */     \
 }
 
 #define JVM_OPCODE_NAME_INITIALIZER { \
@@ -735,9 +774,13 @@ enum {
  \
         /* Reserved [0xca ... 0xff] */ \
         "breakpoint", \
-        "unused", "unused", "unused", "unused", "unused", "unused", "unused", "unused", \
-        "unused", "unused", "unused", "unused", "unused", "unused", "unused", "unused", \
-        "unused", "unused", "unused", "unused", "unused", "unused", "unused", "unused", \
+        "getfield_b_quick", "getfield_c_quick", "getfield_s_quick", "getfield_i_quick", \
+        "getfield_l_quick", "getfield_a_quick", \
+        "putfield_b_quick", "putfield_z_quick", "putfield_c_quick", "putfield_i_quick", \
+        "putfield_l_quick", "putfield_a_quick", \
+        "getstatic_quick", "putstatic_quick", \
+        "invokevirtual_quick", "invokenonvirtual_quick", "invokestatic_quick", "invokeinterface_quick", \
+        "unused", "unused", "unused", "unused", "unused", "unused", \
         "unused", "unused", "unused", "unused", "unused", "unused", "unused", "unused", \
         "unused", "unused", "unused", "unused", "unused", "unused", "unused", "unused", \
         "unused", "unused", "unused", "unused", "unused", "unused", "unused", "unused", \
@@ -0,0 +1,51 @@
+#include <assert.h>
+#include "cabin.h"
+#include "deque.h"
+
+static DequeArray *new_array(intptr_t capacity)
+{
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+    DequeArray *a = vm_malloc(sizeof(DequeArray) + capacity*sizeof(void *));
+    a->capacity = capacity;
+    a->prev = NULL;
+    return a;
+}
+
+void deque_init(Deque *d, intptr_t capacity)
+{
+    assert(d != NULL);
+    d->top = d->bottom = 0;
+    d->array = new_array(capacity);
+}
+
+void deque_destroy(Deque *d)
+{
+    assert(d != NULL);
+    deque_trim(d);
+    free(d->array);
+    d->array = NULL;
+}
+
+void deque_trim(Deque *d)
+{
+    assert(d != NULL);
+    DequeArray *a = d->array->prev;
+    d->array->prev = NULL;
+    while (a != NULL) {
+        DequeArray *prev = a->prev;
+        free(a);
+        a = prev;
+    }
+}
+
+DequeArray *deque_grow(Deque *d, intptr_t top, intptr_t bottom)
+{
+    DequeArray *old = d->array;
+    DequeArray *a = new_array(old->capacity * 2);
+    for (intptr_t i = top; i < bottom; i++) {
+        a->buf[i & (a->capacity - 1)] = old->buf[i & (old->capacity - 1)];
+    }
+    a->prev = old;
+    __atomic_store_n(&d->array, a, __ATOMIC_RELEASE);
+    return a;
+}
@@ -0,0 +1,104 @@
+#ifndef CABIN_DEQUE_H
+#define CABIN_DEQUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Chase-Lev work-stealing deque.
+ *
+ * 只有所有者线程可以在 bottom 端 push/pop（LIFO），
+ * 其他线程可以同时在 top 端 steal（FIFO）。
+ * 满时所有者线程将数组扩大一倍，旧的数组可能仍在被窃取者读取，所以先不释放，
+ * 由 deque_trim 在没有并发访问时释放。
+ *
+ * 参考：
+ *  Chase, Lev. Dynamic Circular Work-Stealing Deque. SPAA 2005.
+ *  Lê, Pop, Cohen, Zappa Nardelli. Correct and Efficient Work-Stealing for Weak Memory Models. PPoPP 2013.
+ */
+
+typedef struct deque_array {
+    intptr_t capacity; // 2的幂
+    struct deque_array *prev; // 扩容前的数组
+    void *buf[];
+} DequeArray;
+
+typedef struct {
+    intptr_t top;
+    intptr_t bottom;
+    DequeArray *array;
+} Deque;
+
+void deque_init(Deque *d, intptr_t capacity);
+void deque_destroy(Deque *d);
+
+// 释放扩容留下的旧数组，调用时不能有其他线程访问 @d
+void deque_trim(Deque *d);
+
+DequeArray *deque_grow(Deque *d, intptr_t top, intptr_t bottom);
+
+static inline void deque_push(Deque *d, void *x)
+{
+    intptr_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    intptr_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    DequeArray *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+    if (b - t > a->capacity - 1) {
+        a = deque_grow(d, t, b);
+    }
+    __atomic_store_n(&a->buf[b & (a->capacity - 1)], x, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+// 只能由所有者线程调用，空时返回 NULL
+static inline void *deque_pop(Deque *d)
+{
+    intptr_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    DequeArray *a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    intptr_t t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+    if (t > b) {
+        // 空
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    void *x = __atomic_load_n(&a->buf[b & (a->capacity - 1)], __ATOMIC_RELAXED);
+    if (t == b) {
+        // 最后一个元素，和窃取者竞争
+        if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false,
+                                         __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            x = NULL;
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return x;
+}
+
+// 任意线程都可以调用，空或者竞争失败时返回 NULL
+static inline void *deque_steal(Deque *d)
+{
+    intptr_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    intptr_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b)
+        return NULL;
+
+    DequeArray *a = __atomic_load_n(&d->array, __ATOMIC_ACQUIRE);
+    void *x = __atomic_load_n(&a->buf[t & (a->capacity - 1)], __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return NULL;
+    return x;
+}
+
+static inline bool deque_is_empty(Deque *d)
+{
+    intptr_t t = __atomic_load_n(&d->top, __ATOMIC_SEQ_CST);
+    intptr_t b = __atomic_load_n(&d->bottom, __ATOMIC_SEQ_CST);
+    return t >= b;
+}
+
+#endif // CABIN_DEQUE_H
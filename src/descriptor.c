@@ -172,11 +172,11 @@ char *unparse_method_descriptor(jarrRef ptypes /*Class *[]*/, jclsRef rtype)
     } else {
         dynstr_copy(&desc, "(");
 
-        for (int i = 0; i < ptypes->arr_len; i++) {
-            jclsRef co = array_get(jclsRef, ptypes, i);
+        for (int i = 0; i < array_len(ptypes); i++) {
+            jclsRef co = array_get_ref(ptypes, i);
             assert(co != NULL);
-            convert_type_to_desc(co->jvm_mirror, &desc);
-            // oss << convertTypeToDesc(co->jvm_mirror);        
+            convert_type_to_desc(jvm_mirror(co), &desc);
+            // oss << convertTypeToDesc(jvm_mirror(co));        
         }
 
         dynstr_concat(&desc, ")");
@@ -185,7 +185,7 @@ char *unparse_method_descriptor(jarrRef ptypes /*Class *[]*/, jclsRef rtype)
     if (rtype == NULL) { // no return value
         dynstr_concat(&desc, "V");
     } else {
-        convert_type_to_desc(rtype->jvm_mirror, &desc);
+        convert_type_to_desc(jvm_mirror(rtype), &desc);
     }
 
     return desc.buf;
@@ -0,0 +1,1123 @@
+#include <assert.h>
+#include <string.h>
+#include "cabin.h"
+#include "escape.h"
+#include "constants.h"
+#include "class_loader.h"
+#include "encoding.h"
+#include "interpreter.h"
+#include "object.h"
+#include "thread.h"
+
+/*
+ * 字节码上的数据流分析。
+ *
+ * 值（Value）是它可能指向的被跟踪对象的集合：第i位表示第i个对象来源，
+ * 来源是引用类型的参数，或者 new 指令（分配点），最多跟踪64个，超出的不跟踪。
+ * 0 表示不指向任何被跟踪的对象（基本类型，null，其他来源的引用）。
+ *
+ * 1. 计算每条指令处活跃的局部变量（只关心引用，所以 aload 是 use，store 是 def）。
+ * 2. 以基本块为单位迭代到不动点，状态是 locals 和 stack 中的值，合并时丢弃已死亡的局部变量。
+ *    过程中记录逃逸的来源（escaped），以及执行 new 时上一个对象仍然活着的分配点（reused）。
+ *
+ * 不支持 jsr/ret，局部变量超过64个或者操作数栈过深的方法不分析。
+ */
+
+// 一个 Frame 中栈上对象最多占用的空间
+#define LOCAL_OBJS_MAX_SIZE 1024
+#define MAX_STACK_ANALYZED 256
+
+static const u1 opcode_len[JVM_OPC_MAX+1] = JVM_OPCODE_LENGTH_INITIALIZER;
+
+// 所有参数都逃逸，没有栈上分配点
+static EscapeInfo all_escape = { ~(u8) 0, NULL, 0, 0 };
+
+// 正在分析的方法（包括递归调用）的结果，保守的视为所有参数都逃逸
+static EscapeInfo analyzing = { ~(u8) 0, NULL, 0, 0 };
+
+typedef u8 Value;
+
+#define BIT(i) ((i) < 64 ? (u8) 1 << (i) : 0)
+
+typedef struct analyzer {
+    Method *m;
+    ConstantPool *cp;
+    const u1 *code;
+    size_t code_len;
+    int max_locals;
+    int max_stack;
+
+    bool *insn_start;
+    u8 *live;      // live[pc]: pc 处活跃的局部变量
+    int *block;    // block[pc]: 以 pc 开始的基本块的编号，不是基本块的开始时为-1
+    size_t *block_pc;
+    int blocks_count;
+
+    // 每个基本块入口处的 locals 和 stack，以及 stack 的深度（-1 表示还未到达）
+    Value *states;
+    int *sps;
+
+    int *worklist;
+    int worklist_len;
+    bool *queued;
+
+    // successors 的结果
+    size_t *succ;
+    int succ_capacity;
+    bool ends_block;
+
+    int sources_count;
+    size_t source_pc[64]; // 分配点的位置，参数为 SIZE_MAX
+    int arg_source[64];   // 参数 slot 对应的来源，-1 表示不是引用或者不跟踪
+
+    Value escaped;
+    Value reused;
+    bool failed;
+} Analyzer;
+
+static inline u2 read_u2(const u1 *p)
+{
+    return (u2) ((p[0] << 8) | p[1]);
+}
+
+static inline s4 read_s4(const u1 *p)
+{
+    return (s4) (((u4) p[0] << 24) | ((u4) p[1] << 16) | ((u4) p[2] << 8) | p[3]);
+}
+
+// pc 处指令的长度，指令不完整时返回0
+static size_t insn_len(const u1 *code, size_t code_len, size_t pc)
+{
+    u1 op = original_opcode(code[pc]); // 可能已被解释器改写
+    size_t len;
+
+    if (op == JVM_OPC_tableswitch || op == JVM_OPC_lookupswitch) {
+        size_t p = (pc + 4) & ~(size_t) 3; // 跳过 padding
+        if (p + 12 > code_len)
+            return 0;
+        if (op == JVM_OPC_tableswitch) {
+            s4 low = read_s4(code + p + 4);
+            s4 high = read_s4(code + p + 8);
+            if (high < low)
+                return 0;
+            len = p + 12 + ((size_t) ((int64_t) high - low) + 1)*4 - pc;
+        } else {
+            s4 npairs = read_s4(code + p + 4);
+            if (npairs < 0)
+                return 0;
+            len = p + 8 + (size_t) npairs*8 - pc;
+        }
+    } else if (op == JVM_OPC_wide) {
+        if (pc + 1 >= code_len)
+            return 0;
+        len = code[pc + 1] == JVM_OPC_iinc ? 6 : 4;
+    } else {
+        len = opcode_len[op];
+    }
+
+    return len > 0 && pc + len <= code_len ? len : 0;
+}
+
+static void add_succ(Analyzer *a, int *n, int64_t target)
+{
+    if (*n == a->succ_capacity) {
+        a->succ_capacity = a->succ_capacity == 0 ? 16 : a->succ_capacity*2;
+        a->succ = vm_realloc(a->succ, a->succ_capacity*sizeof(*a->succ));
+    }
+    a->succ[(*n)++] = (size_t) target;
+}
+
+/*
+ * pc 处指令的后继（不包括异常处理），保存在 a->succ 中，返回个数。
+ * a->ends_block 表示此指令是否结束基本块（跳转，返回，抛出异常）。
+ * 不支持的指令返回-1.
+ */
+static int successors(Analyzer *a, size_t pc, size_t len)
+{
+    const u1 *code = a->code;
+    u1 op = original_opcode(code[pc]); // 可能已被解释器改写
+    int n = 0;
+    a->ends_block = true;
+
+    switch (op) {
+        case JVM_OPC_ifeq: case JVM_OPC_ifne: case JVM_OPC_iflt:
+        case JVM_OPC_ifge: case JVM_OPC_ifgt: case JVM_OPC_ifle:
+        case JVM_OPC_if_icmpeq: case JVM_OPC_if_icmpne: case JVM_OPC_if_icmplt:
+        case JVM_OPC_if_icmpge: case JVM_OPC_if_icmpgt: case JVM_OPC_if_icmple:
+        case JVM_OPC_if_acmpeq: case JVM_OPC_if_acmpne:
+        case JVM_OPC_ifnull: case JVM_OPC_ifnonnull:
+            add_succ(a, &n, pc + len);
+            add_succ(a, &n, (int64_t) pc + (s2) read_u2(code + pc + 1));
+            break;
+        case JVM_OPC_goto:
+            add_succ(a, &n, (int64_t) pc + (s2) read_u2(code + pc + 1));
+            break;
+        case JVM_OPC_goto_w:
+            add_succ(a, &n, (int64_t) pc + read_s4(code + pc + 1));
+            break;
+        case JVM_OPC_tableswitch: {
+            size_t p = (pc + 4) & ~(size_t) 3;
+            add_succ(a, &n, (int64_t) pc + read_s4(code + p));
+            s4 low = read_s4(code + p + 4);
+            s4 high = read_s4(code + p + 8);
+            for (int64_t i = 0; i <= (int64_t) high - low; i++)
+                add_succ(a, &n, (int64_t) pc + read_s4(code + p + 12 + i*4));
+            break;
+        }
+        case JVM_OPC_lookupswitch: {
+            size_t p = (pc + 4) & ~(size_t) 3;
+            add_succ(a, &n, (int64_t) pc + read_s4(code + p));
+            s4 npairs = read_s4(code + p + 4);
+            for (s4 i = 0; i < npairs; i++)
+                add_succ(a, &n, (int64_t) pc + read_s4(code + p + 8 + i*8 + 4));
+            break;
+        }
+        case JVM_OPC_ireturn: case JVM_OPC_lreturn: case JVM_OPC_freturn:
+        case JVM_OPC_dreturn: case JVM_OPC_areturn: case JVM_OPC_return:
+        case JVM_OPC_athrow:
+            break;
+        case JVM_OPC_jsr: case JVM_OPC_jsr_w: case JVM_OPC_ret:
+            return -1;
+        case JVM_OPC_wide:
+            if (code[pc + 1] == JVM_OPC_ret)
+                return -1;
+            // fall through
+        default:
+            a->ends_block = false;
+            add_succ(a, &n, pc + len);
+            break;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (a->succ[i] >= a->code_len || !a->insn_start[a->succ[i]])
+            return -1;
+    }
+    return n;
+}
+
+// pc 处的指令读取（@use）和写入（@def）的局部变量
+static void local_use_def(const u1 *code, size_t code_len, size_t pc, u8 *use, u8 *def)
+{
+    u1 op = code[pc];
+    int index = pc + 1 < code_len ? code[pc + 1] : 0;
+    if (op == JVM_OPC_wide) {
+        op = code[pc + 1];
+        index = read_u2(code + pc + 2);
+    }
+
+    *use = *def = 0;
+    switch (op) {
+        case JVM_OPC_aload:
+            *use = BIT(index);
+            break;
+        case JVM_OPC_aload_0: case JVM_OPC_aload_1: case JVM_OPC_aload_2: case JVM_OPC_aload_3:
+            *use = BIT(op - JVM_OPC_aload_0);
+            break;
+        case JVM_OPC_istore: case JVM_OPC_fstore: case JVM_OPC_astore:
+            *def = BIT(index);
+            break;
+        case JVM_OPC_lstore: case JVM_OPC_dstore:
+            *def = BIT(index) | BIT(index + 1);
+            break;
+        case JVM_OPC_istore_0: case JVM_OPC_istore_1: case JVM_OPC_istore_2: case JVM_OPC_istore_3:
+            *def = BIT(op - JVM_OPC_istore_0);
+            break;
+        case JVM_OPC_fstore_0: case JVM_OPC_fstore_1: case JVM_OPC_fstore_2: case JVM_OPC_fstore_3:
+            *def = BIT(op - JVM_OPC_fstore_0);
+            break;
+        case JVM_OPC_astore_0: case JVM_OPC_astore_1: case JVM_OPC_astore_2: case JVM_OPC_astore_3:
+            *def = BIT(op - JVM_OPC_astore_0);
+            break;
+        case JVM_OPC_lstore_0: case JVM_OPC_lstore_1: case JVM_OPC_lstore_2: case JVM_OPC_lstore_3:
+            *def = BIT(op - JVM_OPC_lstore_0) | BIT(op - JVM_OPC_lstore_0 + 1);
+            break;
+        case JVM_OPC_dstore_0: case JVM_OPC_dstore_1: case JVM_OPC_dstore_2: case JVM_OPC_dstore_3:
+            *def = BIT(op - JVM_OPC_dstore_0) | BIT(op - JVM_OPC_dstore_0 + 1);
+            break;
+        default:
+            break;
+    }
+}
+
+// 覆盖 pc 的异常处理器入口处活跃的局部变量
+static u8 handlers_live(Analyzer *a, size_t pc)
+{
+    u8 live = 0;
+    for (u2 i = 0; i < a->m->exception_tables_len; i++) {
+        struct exception_table *et = a->m->exception_tables + i;
+        if (et->start_pc <= pc && pc < et->end_pc)
+            live |= a->live[et->handler_pc];
+    }
+    return live;
+}
+
+static bool compute_liveness(Analyzer *a)
+{
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t pc = a->code_len; pc-- > 0;) {
+            if (!a->insn_start[pc])
+                continue;
+
+            size_t len = insn_len(a->code, a->code_len, pc);
+            int n = successors(a, pc, len);
+            if (n < 0)
+                return false;
+
+            u8 out = 0;
+            for (int i = 0; i < n; i++)
+                out |= a->live[a->succ[i]];
+
+            u8 use, def;
+            local_use_def(a->code, a->code_len, pc, &use, &def);
+            // 异常可能在写入局部变量之前发生
+            u8 in = (out & ~def) | use | handlers_live(a, pc);
+            if (in != a->live[pc]) {
+                a->live[pc] = in;
+                changed = true;
+            }
+        }
+    }
+    return true;
+}
+
+// 划分基本块
+static bool find_blocks(Analyzer *a)
+{
+    size_t pc = 0;
+    while (pc < a->code_len) {
+        size_t len = insn_len(a->code, a->code_len, pc);
+        if (len == 0)
+            return false;
+        a->insn_start[pc] = true;
+        pc += len;
+    }
+
+    bool *leader = vm_calloc(a->code_len*sizeof(bool));
+    leader[0] = true;
+    bool ok = true;
+
+    for (pc = 0; pc < a->code_len && ok; pc++) {
+        if (!a->insn_start[pc])
+            continue;
+        size_t len = insn_len(a->code, a->code_len, pc);
+        int n = successors(a, pc, len);
+        if (n < 0) {
+            ok = false;
+            break;
+        }
+        if (a->ends_block) {
+            for (int i = 0; i < n; i++)
+                leader[a->succ[i]] = true;
+            if (pc + len < a->code_len)
+                leader[pc + len] = true;
+        }
+    }
+
+    for (u2 i = 0; i < a->m->exception_tables_len && ok; i++) {
+        struct exception_table *et = a->m->exception_tables + i;
+        if (et->start_pc >= et->end_pc || et->end_pc > a->code_len
+                || et->handler_pc >= a->code_len || !a->insn_start[et->handler_pc])
+            ok = false;
+        else
+            leader[et->handler_pc] = true;
+    }
+
+    a->blocks_count = 0;
+    for (pc = 0; pc < a->code_len; pc++) {
+        if (leader[pc] && a->insn_start[pc]) {
+            a->block[pc] = a->blocks_count;
+            a->block_pc[a->blocks_count++] = pc;
+        } else {
+            a->block[pc] = -1;
+        }
+    }
+
+    free(leader);
+    return ok;
+}
+
+// 将状态合并到 @target 处的基本块入口，丢弃在那里已死亡的局部变量
+static void merge(Analyzer *a, size_t target, const Value *locals, const Value *stack, int sp)
+{
+    int b = a->block[target];
+    assert(b >= 0);
+
+    Value *s = a->states + (size_t) b * (a->max_locals + a->max_stack);
+    u8 live = a->live[target];
+    bool changed = false;
+
+    if (a->sps[b] < 0) {
+        a->sps[b] = sp;
+        memset(s, 0, (a->max_locals + a->max_stack)*sizeof(Value));
+        changed = true;
+    } else if (a->sps[b] != sp) {
+        a->failed = true; // 不同路径上的栈深度不同
+        return;
+    }
+
+    for (int i = 0; i < a->max_locals; i++) {
+        Value v = (live & BIT(i)) != 0 ? locals[i] : 0;
+        if ((s[i] | v) != s[i]) {
+            s[i] |= v;
+            changed = true;
+        }
+    }
+    for (int i = 0; i < sp; i++) {
+        Value *t = s + a->max_locals + i;
+        if ((*t | stack[i]) != *t) {
+            *t |= stack[i];
+            changed = true;
+        }
+    }
+
+    if (changed && !a->queued[b]) {
+        a->queued[b] = true;
+        a->worklist[a->worklist_len++] = b;
+    }
+}
+
+static Value site_value(Analyzer *a, size_t pc)
+{
+    for (int i = 0; i < a->sources_count; i++) {
+        if (a->source_pc[i] == pc)
+            return BIT(i);
+    }
+    return 0;
+}
+
+// 类还没有被加载时返回 NULL，不会触发类的加载
+static Class *find_loaded(Object *loader, const utf8_t *name)
+{
+    if (name[0] == '[')
+        return NULL;
+    Class *c = find_loaded_class(loader, name);
+    if (c == NULL && loader != BOOT_CLASS_LOADER)
+        c = find_loaded_class(BOOT_CLASS_LOADER, name);
+    return c;
+}
+
+static Class *class_ref(ConstantPool *cp, u2 index)
+{
+    Class *c = NULL;
+    const utf8_t *name = NULL;
+
+    safe_mutex_lock(&cp->mutex);
+    if (cp->type[index] == JVM_CONSTANT_ResolvedClass)
+        c = (Class *) cp->info[index];
+    else if (cp->type[index] == JVM_CONSTANT_Class)
+        name = cp_class_name(cp, index);
+    pthread_mutex_unlock(&cp->mutex);
+
+    if (c == NULL && name != NULL)
+        c = find_loaded(cp->clazz->loader, name);
+    return c;
+}
+
+static const utf8_t *field_ref(ConstantPool *cp, u2 index)
+{
+    const utf8_t *descriptor = NULL;
+
+    safe_mutex_lock(&cp->mutex);
+    if (cp->type[index] == JVM_CONSTANT_ResolvedField)
+        descriptor = ((Field *) cp->info[index])->descriptor;
+    else if (cp->type[index] == JVM_CONSTANT_Fieldref)
+        descriptor = cp_field_type(cp, index);
+    pthread_mutex_unlock(&cp->mutex);
+    return descriptor;
+}
+
+/*
+ * 常量池 @index 处被调用方法的描述符，失败返回 NULL.
+ * @callee: 可以静态确定，并且其类已被加载的目标方法，否则为 NULL
+ */
+static const utf8_t *method_ref(ConstantPool *cp, u1 opcode, u2 index, Method **callee)
+{
+    Method *m = NULL;
+    const utf8_t *class_name = NULL;
+    const utf8_t *name = NULL;
+    const utf8_t *descriptor = NULL;
+    *callee = NULL;
+
+    safe_mutex_lock(&cp->mutex);
+    switch (cp->type[index]) {
+        case JVM_CONSTANT_ResolvedMethod:
+            m = (Method *) cp->info[index];
+            descriptor = m->descriptor;
+            break;
+        case JVM_CONSTANT_Methodref:
+            class_name = cp_method_class_name(cp, index);
+            name = cp_method_name(cp, index);
+            descriptor = cp_method_type(cp, index);
+            break;
+        case JVM_CONSTANT_ResolvedInterfaceMethod:
+            descriptor = ((Method *) cp->info[index])->descriptor;
+            break;
+        case JVM_CONSTANT_InterfaceMethodref:
+            descriptor = cp_interface_method_type(cp, index);
+            break;
+        case JVM_CONSTANT_InvokeDynamic:
+            descriptor = cp_invoke_dynamic_method_type(cp, index);
+            break;
+        default:
+            break;
+    }
+    pthread_mutex_unlock(&cp->mutex);
+
+    if (m == NULL && class_name != NULL) {
+        Class *c = find_loaded(cp->clazz->loader, class_name);
+        if (c != NULL)
+            m = lookup_method(c, name, descriptor);
+        if (m == NULL)
+            return descriptor;
+        // final 类的对象就是此类的对象，方法的分派结果是确定的
+        if (opcode == JVM_OPC_invokevirtual && !IS_FINAL(m) && !IS_PRIVATE(m) && !IS_FINAL(c))
+            return descriptor;
+    }
+
+    if (m == NULL)
+        return descriptor;
+    if (is_signature_polymorphic(m))
+        return NULL; // 调用点的描述符已经丢失了
+
+    switch (opcode) {
+        case JVM_OPC_invokestatic:
+            if (IS_STATIC(m))
+                *callee = m;
+            break;
+        case JVM_OPC_invokespecial:
+            // 超类中的 final 方法不会被覆盖，也是确定的（invokevirtual 调用 final 方法改写后的快速指令也按 invokespecial 分析）
+            if (!IS_STATIC(m) && (IS_PRIVATE(m) || IS_FINAL(m) || utf8_equals(m->name, S(object_init))))
+                *callee = m;
+            break;
+        case JVM_OPC_invokevirtual:
+            // 已解析的方法无法得知引用的类，只有 private 和 final 方法是确定的
+            if (!IS_STATIC(m) && (IS_PRIVATE(m) || IS_FINAL(m) || IS_FINAL(m->clazz)))
+                *callee = m;
+            break;
+        default:
+            break;
+    }
+    return descriptor;
+}
+
+/*
+ * 方法描述符中参数占用的 slot 数。
+ * @refs: 第i位表示第i个 slot 是引用
+ * @ret_slots: 返回值占用的 slot 数
+ */
+static int parse_descriptor(const utf8_t *d, u8 *refs, int *ret_slots)
+{
+    assert(d != NULL && *d == '(');
+    int slots = 0;
+    *refs = 0;
+
+    for (d++; *d != ')';) {
+        switch (*d) {
+            case 'J': case 'D':
+                slots += 2;
+                d++;
+                break;
+            case '[':
+                while (*d == '[')
+                    d++;
+                if (*d != 'L') {
+                    d++;
+                    *refs |= BIT(slots);
+                    slots++;
+                    break;
+                }
+                // fall through
+            case 'L':
+                d = strchr(d, ';') + 1;
+                *refs |= BIT(slots);
+                slots++;
+                break;
+            default:
+                slots++;
+                d++;
+                break;
+        }
+    }
+
+    d++;
+    *ret_slots = *d == 'V' ? 0 : (*d == 'J' || *d == 'D') ? 2 : 1;
+    return slots;
+}
+
+#define field_slots(d) (((d)[0] == 'J' || (d)[0] == 'D') ? 2 : 1)
+#define is_ref_type(d) ((d)[0] == 'L' || (d)[0] == '[')
+
+// 模拟执行 pc 处的指令，失败返回 false
+static bool execute(Analyzer *a, size_t pc, Value *locals, Value *stack, int *sp_ptr)
+{
+    const u1 *code = a->code;
+    u1 op = original_opcode(code[pc]); // 可能已被解释器改写
+    int sp = *sp_ptr;
+    int index;
+    Value v, v1, v2, v3, v4;
+
+#define POP(n)  do { if (sp < (n)) return false; sp -= (n); } while (false)
+#define PUSH(n) do { if (sp + (n) > a->max_stack) return false; \
+                     for (int _i = 0; _i < (n); _i++) stack[sp++] = 0; } while (false)
+#define POPV(x) do { if (sp < 1) return false; (x) = stack[--sp]; } while (false)
+#define PUSHV(x) do { if (sp >= a->max_stack) return false; stack[sp++] = (x); } while (false)
+#define LOCAL(i) do { if ((i) >= a->max_locals) return false; } while (false)
+#define ESCAPE(x) (a->escaped |= (x))
+
+    switch (op) {
+        case JVM_OPC_nop:
+        case JVM_OPC_iinc:
+        case JVM_OPC_checkcast:
+        case JVM_OPC_goto:
+        case JVM_OPC_goto_w:
+        case JVM_OPC_return:
+            break;
+
+        case JVM_OPC_aconst_null:
+        case JVM_OPC_iconst_m1: case JVM_OPC_iconst_0: case JVM_OPC_iconst_1: case JVM_OPC_iconst_2:
+        case JVM_OPC_iconst_3: case JVM_OPC_iconst_4: case JVM_OPC_iconst_5:
+        case JVM_OPC_fconst_0: case JVM_OPC_fconst_1: case JVM_OPC_fconst_2:
+        case JVM_OPC_bipush: case JVM_OPC_sipush:
+        case JVM_OPC_ldc: case JVM_OPC_ldc_w:
+        case JVM_OPC_iload: case JVM_OPC_fload:
+        case JVM_OPC_iload_0: case JVM_OPC_iload_1: case JVM_OPC_iload_2: case JVM_OPC_iload_3:
+        case JVM_OPC_fload_0: case JVM_OPC_fload_1: case JVM_OPC_fload_2: case JVM_OPC_fload_3:
+            PUSH(1);
+            break;
+
+        case JVM_OPC_lconst_0: case JVM_OPC_lconst_1:
+        case JVM_OPC_dconst_0: case JVM_OPC_dconst_1:
+        case JVM_OPC_ldc2_w:
+        case JVM_OPC_lload: case JVM_OPC_dload:
+        case JVM_OPC_lload_0: case JVM_OPC_lload_1: case JVM_OPC_lload_2: case JVM_OPC_lload_3:
+        case JVM_OPC_dload_0: case JVM_OPC_dload_1: case JVM_OPC_dload_2: case JVM_OPC_dload_3:
+            PUSH(2);
+            break;
+
+        case JVM_OPC_aload:
+            index = code[pc + 1];
+            LOCAL(index);
+            PUSHV(locals[index]);
+            break;
+        case JVM_OPC_aload_0: case JVM_OPC_aload_1: case JVM_OPC_aload_2: case JVM_OPC_aload_3:
+            index = op - JVM_OPC_aload_0;
+            LOCAL(index);
+            PUSHV(locals[index]);
+            break;
+
+        case JVM_OPC_astore:
+            index = code[pc + 1];
+            LOCAL(index);
+            POPV(locals[index]);
+            break;
+        case JVM_OPC_astore_0: case JVM_OPC_astore_1: case JVM_OPC_astore_2: case JVM_OPC_astore_3:
+            index = op - JVM_OPC_astore_0;
+            LOCAL(index);
+            POPV(locals[index]);
+            break;
+
+        case JVM_OPC_istore: case JVM_OPC_fstore:
+            index = code[pc + 1];
+            goto store1;
+        case JVM_OPC_istore_0: case JVM_OPC_istore_1: case JVM_OPC_istore_2: case JVM_OPC_istore_3:
+            index = op - JVM_OPC_istore_0;
+            goto store1;
+        case JVM_OPC_fstore_0: case JVM_OPC_fstore_1: case JVM_OPC_fstore_2: case JVM_OPC_fstore_3:
+            index = op - JVM_OPC_fstore_0;
+        store1:
+            LOCAL(index);
+            POP(1);
+            locals[index] = 0;
+            break;
+
+        case JVM_OPC_lstore: case JVM_OPC_dstore:
+            index = code[pc + 1];
+            goto store2;
+        case JVM_OPC_lstore_0: case JVM_OPC_lstore_1: case JVM_OPC_lstore_2: case JVM_OPC_lstore_3:
+            index = op - JVM_OPC_lstore_0;
+            goto store2;
+        case JVM_OPC_dstore_0: case JVM_OPC_dstore_1: case JVM_OPC_dstore_2: case JVM_OPC_dstore_3:
+            index = op - JVM_OPC_dstore_0;
+        store2:
+            LOCAL(index + 1);
+            POP(2);
+            locals[index] = locals[index + 1] = 0;
+            break;
+
+        case JVM_OPC_wide:
+            op = code[pc + 1];
+            index = read_u2(code + pc + 2);
+            switch (op) {
+                case JVM_OPC_iload: case JVM_OPC_fload:
+                    LOCAL(index);
+                    PUSH(1);
+                    break;
+                case JVM_OPC_lload: case JVM_OPC_dload:
+                    LOCAL(index + 1);
+                    PUSH(2);
+                    break;
+                case JVM_OPC_aload:
+                    LOCAL(index);
+                    PUSHV(locals[index]);
+                    break;
+                case JVM_OPC_astore:
+                    LOCAL(index);
+                    POPV(locals[index]);
+                    break;
+                case JVM_OPC_istore: case JVM_OPC_fstore:
+                    goto store1;
+                case JVM_OPC_lstore: case JVM_OPC_dstore:
+                    goto store2;
+                case JVM_OPC_iinc:
+                    break;
+                default:
+                    return false;
+            }
+            break;
+
+        case JVM_OPC_iaload: case JVM_OPC_faload: case JVM_OPC_aaload:
+        case JVM_OPC_baload: case JVM_OPC_caload: case JVM_OPC_saload:
+        case JVM_OPC_iadd: case JVM_OPC_fadd: case JVM_OPC_isub: case JVM_OPC_fsub:
+        case JVM_OPC_imul: case JVM_OPC_fmul: case JVM_OPC_idiv: case JVM_OPC_fdiv:
+        case JVM_OPC_irem: case JVM_OPC_frem:
+        case JVM_OPC_ishl: case JVM_OPC_ishr: case JVM_OPC_iushr:
+        case JVM_OPC_iand: case JVM_OPC_ior: case JVM_OPC_ixor:
+        case JVM_OPC_fcmpl: case JVM_OPC_fcmpg:
+        case JVM_OPC_l2i: case JVM_OPC_l2f: case JVM_OPC_d2i: case JVM_OPC_d2f:
+            POP(2);
+            PUSH(1);
+            break;
+
+        case JVM_OPC_laload: case JVM_OPC_daload:
+        case JVM_OPC_lneg: case JVM_OPC_dneg:
+        case JVM_OPC_l2d: case JVM_OPC_d2l:
+            POP(2);
+            PUSH(2);
+            break;
+
+        case JVM_OPC_ladd: case JVM_OPC_dadd: case JVM_OPC_lsub: case JVM_OPC_dsub:
+        case JVM_OPC_lmul: case JVM_OPC_dmul: case JVM_OPC_ldiv: case JVM_OPC_ddiv:
+        case JVM_OPC_lrem: case JVM_OPC_drem:
+        case JVM_OPC_land: case JVM_OPC_lor: case JVM_OPC_lxor:
+            POP(4);
+            PUSH(2);
+            break;
+
+        case JVM_OPC_lshl: case JVM_OPC_lshr: case JVM_OPC_lushr:
+            POP(3);
+            PUSH(2);
+            break;
+
+        case JVM_OPC_ineg: case JVM_OPC_fneg:
+        case JVM_OPC_i2f: case JVM_OPC_f2i:
+        case JVM_OPC_i2b: case JVM_OPC_i2c: case JVM_OPC_i2s:
+        case JVM_OPC_newarray: case JVM_OPC_anewarray:
+        case JVM_OPC_arraylength:
+        case JVM_OPC_instanceof:
+            POP(1);
+            PUSH(1);
+            break;
+
+        case JVM_OPC_i2l: case JVM_OPC_i2d: case JVM_OPC_f2l: case JVM_OPC_f2d:
+            POP(1);
+            PUSH(2);
+            break;
+
+        case JVM_OPC_lcmp: case JVM_OPC_dcmpl: case JVM_OPC_dcmpg:
+            POP(4);
+            PUSH(1);
+            break;
+
+        case JVM_OPC_pop:
+        case JVM_OPC_ifeq: case JVM_OPC_ifne: case JVM_OPC_iflt:
+        case JVM_OPC_ifge: case JVM_OPC_ifgt: case JVM_OPC_ifle:
+        case JVM_OPC_ifnull: case JVM_OPC_ifnonnull:
+        case JVM_OPC_tableswitch: case JVM_OPC_lookupswitch:
+        case JVM_OPC_ireturn: case JVM_OPC_freturn:
+            POP(1);
+            break;
+
+        case JVM_OPC_pop2:
+        case JVM_OPC_if_icmpeq: case JVM_OPC_if_icmpne: case JVM_OPC_if_icmplt:
+        case JVM_OPC_if_icmpge: case JVM_OPC_if_icmpgt: case JVM_OPC_if_icmple:
+        case JVM_OPC_if_acmpeq: case JVM_OPC_if_acmpne:
+        case JVM_OPC_lreturn: case JVM_OPC_dreturn:
+            POP(2);
+            break;
+
+        case JVM_OPC_iastore: case JVM_OPC_fastore:
+        case JVM_OPC_bastore: case JVM_OPC_castore: case JVM_OPC_sastore:
+            POP(3);
+            break;
+
+        case JVM_OPC_lastore: case JVM_OPC_dastore:
+            POP(4);
+            break;
+
+        case JVM_OPC_aastore:
+            POPV(v);
+            POP(2);
+            ESCAPE(v);
+            break;
+
+        case JVM_OPC_dup:
+            POPV(v1);
+            PUSHV(v1); PUSHV(v1);
+            break;
+        case JVM_OPC_dup_x1:
+            POPV(v1); POPV(v2);
+            PUSHV(v1); PUSHV(v2); PUSHV(v1);
+            break;
+        case JVM_OPC_dup_x2:
+            POPV(v1); POPV(v2); POPV(v3);
+            PUSHV(v1); PUSHV(v3); PUSHV(v2); PUSHV(v1);
+            break;
+        case JVM_OPC_dup2:
+            POPV(v1); POPV(v2);
+            PUSHV(v2); PUSHV(v1); PUSHV(v2); PUSHV(v1);
+            break;
+        case JVM_OPC_dup2_x1:
+            POPV(v1); POPV(v2); POPV(v3);
+            PUSHV(v2); PUSHV(v1); PUSHV(v3); PUSHV(v2); PUSHV(v1);
+            break;
+        case JVM_OPC_dup2_x2:
+            POPV(v1); POPV(v2); POPV(v3); POPV(v4);
+            PUSHV(v2); PUSHV(v1); PUSHV(v4); PUSHV(v3); PUSHV(v2); PUSHV(v1);
+            break;
+        case JVM_OPC_swap:
+            POPV(v1); POPV(v2);
+            PUSHV(v1); PUSHV(v2);
+            break;
+
+        case JVM_OPC_areturn:
+        case JVM_OPC_athrow:
+        case JVM_OPC_monitorenter:
+        case JVM_OPC_monitorexit:
+            POPV(v);
+            ESCAPE(v);
+            break;
+
+        case JVM_OPC_getstatic:
+        case JVM_OPC_putstatic:
+        case JVM_OPC_getfield:
+        case JVM_OPC_putfield: {
+            index = read_u2(code + pc + 1);
+            if (index >= a->cp->size)
+                return false;
+            const utf8_t *d = field_ref(a->cp, index);
+            if (d == NULL)
+                return false;
+            if (op == JVM_OPC_getfield)
+                POP(1);
+            if (op == JVM_OPC_getstatic || op == JVM_OPC_getfield) {
+                PUSH(field_slots(d));
+                break;
+            }
+            if (is_ref_type(d)) {
+                POPV(v);
+                ESCAPE(v);
+            } else {
+                POP(field_slots(d));
+            }
+            if (op == JVM_OPC_putfield)
+                POP(1); // 写入栈上的对象不会使其逃逸
+            break;
+        }
+
+        case JVM_OPC_invokevirtual:
+        case JVM_OPC_invokespecial:
+        case JVM_OPC_invokestatic:
+        case JVM_OPC_invokeinterface:
+        case JVM_OPC_invokedynamic: {
+            index = read_u2(code + pc + 1);
+            if (index >= a->cp->size)
+                return false;
+            Method *callee;
+            const utf8_t *d = method_ref(a->cp, op, index, &callee);
+            if (d == NULL)
+                return false;
+
+            u8 refs;
+            int ret_slots;
+            int n = parse_descriptor(d, &refs, &ret_slots);
+            if (op != JVM_OPC_invokestatic && op != JVM_OPC_invokedynamic)
+                n++; // this
+            if (sp < n)
+                return false;
+
+            EscapeInfo *info = callee != NULL ? get_escape_info(callee) : &all_escape;
+            for (int i = 0; i < n; i++) {
+                if (arg_escapes(info, i))
+                    ESCAPE(stack[sp - n + i]);
+            }
+            sp -= n;
+            PUSH(ret_slots);
+            break;
+        }
+
+        case JVM_OPC_new:
+            v = site_value(a, pc);
+            if (v != 0) {
+                // 上一次在这里创建的对象还活着
+                for (int i = 0; i < sp; i++) {
+                    if ((stack[i] & v) != 0)
+                        a->reused |= v;
+                }
+                for (int i = 0; i < a->max_locals; i++) {
+                    if ((a->live[pc] & BIT(i)) != 0 && (locals[i] & v) != 0)
+                        a->reused |= v;
+                }
+            }
+            PUSHV(v);
+            break;
+
+        case JVM_OPC_multianewarray:
+            POP(code[pc + 3]);
+            PUSH(1);
+            break;
+
+        default:
+            return false; // jsr, ret, breakpoint...
+    }
+
+#undef POP
+#undef PUSH
+#undef POPV
+#undef PUSHV
+#undef LOCAL
+#undef ESCAPE
+
+    *sp_ptr = sp;
+    return true;
+}
+
+static void interpret_block(Analyzer *a, int b, Value *locals, Value *stack)
+{
+    memcpy(locals, a->states + (size_t) b * (a->max_locals + a->max_stack),
+                (a->max_locals + a->max_stack)*sizeof(Value));
+    int sp = a->sps[b];
+    const Value exception = 0;
+
+    for (size_t pc = a->block_pc[b];;) {
+        for (u2 i = 0; i < a->m->exception_tables_len; i++) {
+            struct exception_table *et = a->m->exception_tables + i;
+            if (et->start_pc <= pc && pc < et->end_pc)
+                merge(a, et->handler_pc, locals, &exception, 1);
+        }
+
+        size_t len = insn_len(a->code, a->code_len, pc);
+        if (!execute(a, pc, locals, stack, &sp)) {
+            a->failed = true;
+            return;
+        }
+
+        int n = successors(a, pc, len);
+        if (n < 0) {
+            a->failed = true;
+            return;
+        }
+        if (a->ends_block) {
+            for (int i = 0; i < n; i++)
+                merge(a, a->succ[i], locals, stack, sp);
+            return;
+        }
+
+        pc += len;
+        if (a->block[pc] >= 0) {
+            merge(a, pc, locals, stack, sp);
+            return;
+        }
+    }
+}
+
+// 分配点的类可以在栈上创建对象
+static bool local_allocatable(Class *c)
+{
+    // Reference 和要执行 finalize() 的对象由 gc 特殊处理（见 gc.c 中的 Reference processing）
+    return c != NULL && !IS_INTERFACE(c) && !IS_ABSTRACT(c) && !is_array_class(c) && c != g_class_class
+                && c->ref_type == REF_NONE && !c->has_finalizer;
+}
+
+static EscapeInfo *build_info(Analyzer *a)
+{
+    EscapeInfo *info = vm_calloc(sizeof(EscapeInfo));
+
+    for (int i = 0; i < a->m->arg_slot_count && i < 64; i++) {
+        int s = a->arg_source[i];
+        if (s < 0 || (a->escaped & BIT(s)) != 0)
+            info->escaping_args |= BIT(i);
+    }
+
+    for (int i = 0; i < a->sources_count; i++) {
+        if (a->source_pc[i] == SIZE_MAX || ((a->escaped | a->reused) & BIT(i)) != 0)
+            continue;
+
+        size_t pc = a->source_pc[i];
+        u2 index = read_u2(a->code + pc + 1);
+        Class *c = index < a->cp->size ? class_ref(a->cp, index) : NULL;
+        if (!local_allocatable(c))
+            continue;
+
+        size_t size = heap_align(non_array_object_size(c));
+        if (info->local_objs_size + size > LOCAL_OBJS_MAX_SIZE)
+            continue;
+
+        info->sites = vm_realloc(info->sites, (info->sites_count + 1)*sizeof(EscapeSite));
+        info->sites[info->sites_count++] = (EscapeSite) { (u2) pc, c, info->local_objs_size };
+        info->local_objs_size += size;
+    }
+
+    return info;
+}
+
+static EscapeInfo *analyze(Method *m)
+{
+    if (IS_NATIVE(m) || IS_ABSTRACT(m) || m->code == NULL || m->code_len == 0
+            || m->max_locals > 64 || m->max_stack > MAX_STACK_ANALYZED || m->arg_slot_count > m->max_locals)
+        return &all_escape;
+
+    Analyzer a;
+    memset(&a, 0, sizeof(a));
+    a.m = m;
+    a.cp = &m->clazz->cp;
+    a.code = m->code;
+    a.code_len = m->code_len;
+    a.max_locals = m->max_locals;
+    a.max_stack = m->max_stack;
+
+    a.insn_start = vm_calloc(a.code_len*sizeof(bool));
+    a.live = vm_calloc(a.code_len*sizeof(u8));
+    a.block = vm_malloc(a.code_len*sizeof(int));
+    a.block_pc = vm_malloc(a.code_len*sizeof(size_t));
+
+    EscapeInfo *info = &all_escape;
+    Value *cur = NULL;
+
+    if (!find_blocks(&a) || !compute_liveness(&a))
+        goto out;
+
+    // 对象来源：引用类型的参数，然后是各个分配点
+    Value *entry = vm_calloc((a.max_locals + a.max_stack)*sizeof(Value));
+    u8 refs;
+    int ret_slots;
+    parse_descriptor(m->descriptor, &refs, &ret_slots);
+    if (!IS_STATIC(m))
+        refs = (refs << 1) | 1;
+    for (int i = 0; i < 64; i++)
+        a.arg_source[i] = -1;
+    for (int i = 0; i < m->arg_slot_count; i++) {
+        if ((refs & BIT(i)) != 0 && a.sources_count < 64) {
+            a.arg_source[i] = a.sources_count;
+            a.source_pc[a.sources_count] = SIZE_MAX;
+            entry[i] = BIT(a.sources_count);
+            a.sources_count++;
+        }
+    }
+    for (size_t pc = 0; pc < a.code_len && a.sources_count < 64; pc++) {
+        if (a.insn_start[pc] && a.code[pc] == JVM_OPC_new)
+            a.source_pc[a.sources_count++] = pc;
+    }
+
+    // synchronized 方法锁住了 this
+    if (IS_SYNCHRONIZED(m) && !IS_STATIC(m) && a.arg_source[0] >= 0)
+        a.escaped |= BIT(a.arg_source[0]);
+
+    a.states = vm_malloc((size_t) a.blocks_count * (a.max_locals + a.max_stack)*sizeof(Value));
+    a.sps = vm_malloc(a.blocks_count*sizeof(int));
+    for (int i = 0; i < a.blocks_count; i++)
+        a.sps[i] = -1;
+    a.worklist = vm_malloc(a.blocks_count*sizeof(int));
+    a.queued = vm_calloc(a.blocks_count*sizeof(bool));
+
+    merge(&a, 0, entry, NULL, 0);
+    free(entry);
+
+    cur = vm_malloc((a.max_locals + a.max_stack)*sizeof(Value));
+    while (a.worklist_len > 0 && !a.failed) {
+        int b = a.worklist[--a.worklist_len];
+        a.queued[b] = false;
+        interpret_block(&a, b, cur, cur + a.max_locals);
+    }
+
+    if (!a.failed)
+        info = build_info(&a);
+
+out:
+    free(cur);
+    free(a.insn_start);
+    free(a.live);
+    free(a.block);
+    free(a.block_pc);
+    free(a.states);
+    free(a.sps);
+    free(a.worklist);
+    free(a.queued);
+    free(a.succ);
+    return info;
+}
+
+EscapeInfo *get_escape_info(Method *m)
+{
+    assert(m != NULL);
+
+    EscapeInfo *info = __atomic_load_n(&m->escape_info, __ATOMIC_ACQUIRE);
+    if (info != NULL)
+        return info;
+
+    EscapeInfo *expected = NULL;
+    if (!__atomic_compare_exchange_n(&m->escape_info, &expected, &analyzing,
+                                     false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return expected; // 其他线程正在分析，或者已经分析完了
+
+    info = analyze(m);
+    __atomic_store_n(&m->escape_info, info, __ATOMIC_RELEASE);
+    return info;
+}
+
+static EscapeSite *find_site(EscapeInfo *info, size_t pc)
+{
+    int low = 0, high = info->sites_count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (info->sites[mid].pc == pc)
+            return info->sites + mid;
+        if (info->sites[mid].pc < pc)
+            low = mid + 1;
+        else
+            high = mid - 1;
+    }
+    return NULL;
+}
+
+Object *alloc_local_object(Frame *f, Class *c, size_t pc)
+{
+    assert(f != NULL && c != NULL);
+
+    EscapeInfo *info = get_escape_info(f->method);
+    if (info->sites_count == 0)
+        return NULL;
+
+    EscapeSite *site = find_site(info, pc);
+    if (site == NULL || site->clazz != c)
+        return NULL;
+
+    if (f->local_objs == NULL) {
+        // 当前 Frame 在栈顶，其后的虚拟机栈是空闲的，栈上的对象放在操作数栈的最大深度之后
+        Thread *t = get_current_thread();
+        assert(t->top_frame == f);
+        u1 *p = (u1 *) heap_align((uintptr_t) ((slot_t *) (f + 1) + f->method->max_stack));
+        if (p + info->local_objs_size > t->vm_stack + VM_STACK_SIZE)
+            return NULL;
+        memset(p, 0, info->local_objs_size);
+        f->local_objs = p;
+        f->local_objs_end = p + info->local_objs_size;
+    }
+
+    Object *o = (Object *) (f->local_objs + site->offset);
+    memset(o, 0, non_array_object_size(c));
+    o->mark = MARK_UNLOCKED;
+    o->clazz = c;
+    return o;
+}
@@ -0,0 +1,52 @@
+#ifndef CABIN_ESCAPE_H
+#define CABIN_ESCAPE_H
+
+#include "cabin.h"
+
+struct frame;
+
+/*
+ * Escape analysis
+ *
+ * 方法第一次执行 new 指令时分析其字节码（方法的链接是延迟的，见 get_escape_info），
+ * 找出创建的对象不会逃逸出方法的分配点：对象不会被写入属性（包括静态属性）或数组，
+ * 不会被返回或抛出，不会被用作锁，也不会被传给可能使其逃逸的方法。
+ * 被调用的方法只有静态绑定（invokestatic, invokespecial, private/final 方法）并且其类已加载时才被分析，
+ * 其他的调用都视为参数逃逸。
+ *
+ * 这些对象分配在当前 Frame 之后的虚拟机栈中（见 Frame.local_objs），随 Frame 弹出而回收。
+ * 每个分配点在 Frame 中占用固定的位置，再次执行时复用，分析保证此时上一个对象已经死亡
+ * （没有活跃的局部变量或操作数栈上的值指向它）。
+ *
+ * 栈上的对象不在堆中，gc 把其中的引用当作根精确扫描（见 gc.c 中的 visit_precise_roots），
+ * 写入其中的引用不需要记录在 remembered set 中（见 object.h 中的 write_barrier）。
+ */
+
+typedef struct escape_site {
+    u2 pc;        // new 指令的位置
+    Class *clazz;
+    size_t offset; // 对象在 Frame.local_objs 中的偏移
+} EscapeSite;
+
+typedef struct escape_info {
+    // 第i位为1表示第i个参数 slot 中的引用可能逃逸，第64个及之后的 slot 都视为逃逸
+    u8 escaping_args;
+
+    // 可以栈上分配的分配点，按 pc 排序
+    EscapeSite *sites;
+    int sites_count;
+    size_t local_objs_size;
+} EscapeInfo;
+
+// 方法 @m 的分析结果，还未分析时先分析。不能分析的方法（native, abstract...）所有参数都逃逸。
+EscapeInfo *get_escape_info(Method *m);
+
+#define arg_escapes(info, i) ((i) >= 64 || ((info)->escaping_args & ((u8) 1 << (i))) != 0)
+
+/*
+ * 为栈顶的 Frame @f 中位于 @pc 的 new 指令创建类 @c 的对象。
+ * 此分配点不能栈上分配时返回 NULL，由调用者在堆中分配。
+ */
+Object *alloc_local_object(struct frame *f, Class *c, size_t pc);
+
+#endif // CABIN_ESCAPE_H
@@ -64,8 +64,8 @@ void print_stack_trace(Object *e)
     // [Ljava/lang/Object;
     jref backtrace = get_ref_field(e, "backtrace", "Ljava/lang/Object;");
     assert(backtrace != NULL);
-    for (int i = 0; i < backtrace->arr_len; i++) {
-        jref element = array_get(jref, backtrace, i); // java.lang.StackTraceElement
+    for (int i = 0; i < array_len(backtrace); i++) {
+        jref element = array_get_ref(backtrace, i); // java.lang.StackTraceElement
 
         // private String declaringClass;
         // private String methodName;
@@ -21,6 +21,8 @@ void init_field(Field *f, Class *c, BytecodeReader *r)
     f->category_two = (f->descriptor[0] == 'J' || f->descriptor[0]== 'D');
     f->deprecated = false;
     f->signature = NULL;
+    f->rt_visi_annos = f->rt_invisi_annos = NULL;
+    f->rt_visi_annos_count = f->rt_invisi_annos_count = 0;
 
     if (IS_STATIC(f)) {
         memset(&f->static_value, 0, sizeof(f->static_value));
@@ -95,6 +97,8 @@ void init_field0(Field *f, Class *c, const utf8_t *name, const utf8_t *descripto
     f->category_two = (descriptor[0] == 'J' || descriptor[0]== 'D');
     f->deprecated = false;
     f->signature = NULL;
+    f->rt_visi_annos = f->rt_invisi_annos = NULL;
+    f->rt_visi_annos_count = f->rt_invisi_annos_count = 0;
 
     if (IS_STATIC(f)) {
         memset(&f->static_value, 0, sizeof(f->static_value));
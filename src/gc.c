@@ -1,138 +1,1603 @@
 #include <assert.h>
+#include <string.h>
+#include <sched.h>
+#include <sys/time.h>
 #include "cabin.h"
+#include "gc.h"
+#include "deque.h"
+#include "sysinfo.h"
 #include "heap.h"
-#include "cabin.h"
 #include "object.h"
+#include "thread.h"
+#include "jni.h"
+#include "class_loader.h"
+#include "monitor.h"
+#include "escape.h"
+#include "string_dedup.h"
+
+/*
+ * Generational gc. 分为新生代和老年代（见 heap.h）。
+ *
+ * minor gc（scavenge）：
+ *   将新生代中存活的对象复制到老年代（晋升），并更新所有指向它们的引用。
+ *   只被保守扫描到的对象（见下 a, b）和被固定的对象（pin_object）不能移动，留在新生代原处。
+ *   老年代到新生代的引用由 write barrier 记录在 remembered set 中（对象粒度），
+ *   minor gc 时 remembered set 中的对象作为根被扫描，所以 minor gc 的停顿只和新生代中存活的对象有关。
+ *   老年代空间不足，无法晋升的对象也留在原处，之后紧接着执行一次 full gc.
+ *
+ * full gc：先执行一次 minor gc，再对整个堆执行 stop-the-world mark-sweep.
+ *   mark 阶段由多个 gc 线程并行执行（见 Parallel mark）。
+ *
+ * concurrent mark：老年代占用率较高时，由 gc 线程和 mutator 并发标记老年代（见 Concurrent mark）。
+ *
+ * 可作为GC Roots对象的包括如下几种：
+ *  a. 虚拟机栈中引用的对象（lvars, ostack, 以及 Frame 中的 JNI 局部引用表）。
+ *     slot 是无类型的（没有 stack map），所以虚拟机栈是保守扫描的：
+ *     只有恰好指向某个对象起始地址的 slot 才被当作引用。
+ *  b. 本地线程栈（包括被压栈的寄存器）中引用的对象，
+ *     即 native 方法和虚拟机自身的 C 代码持有的引用。同样是保守扫描，允许指向对象内部（比如 array_data(arr)）。
+ *  c. 类静态属性引用的对象，类对象（java_mirror，保存在本地内存）中引用的对象，
+ *     常量池中已解析的字符串，以及 Class 中保存的其他引用。
+ *  d. 字符串池中的字符串。
+ *  e. JNI 全局引用。
+ *  f. class loaders，线程对象，以及虚拟机持有的其他全局对象（包括 Reference 的 pending list）。
+ *  g. 栈上分配的对象（见 escape.h）中引用的对象。
+ *
+ * 堆中对象之间的引用是精确扫描的（由 Field 的描述符确定哪些是引用）。
+ * full gc 时 java.lang.ref.Reference 中的 referent 不是强引用（见 Reference processing）。
+ */
+
+static pthread_mutex_t gc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// 已完成的 gc 次数（包括 minor gc 和 full gc）
+static size_t gc_count = 0;
+static size_t full_gc_count = 0;
+
+/*
+ * 保守扫描时可以作为对象的地址上界：minor gc 时是新生代的末尾，full gc 时是堆的末尾，
+ * full gc 时大对象也可以被找到。
+ */
+static address find_end;
+static bool find_large_objects;
+
+static void set_find_range(bool young_only)
+{
+    find_end = young_only ? g_heap->old : g_heap->mem + g_heap->size;
+    find_large_objects = !young_only;
+}
+
+/*
+ * 如果 @p 指向 [g_heap->mem, find_end) 中的某个对象（或者大对象），返回此对象，否则返回 NULL。
+ * 使用堆的对象起始地址位图（见 heap.h）校验保守扫描得到的引用。
+ * @interior: 是否接受指向对象内部的指针。
+ */
+static Object *find_object(address p, bool interior)
+{
+    if (find_large_objects && is_in_los(g_heap, p)) {
+        address o = los_find(g_heap, p);
+        return o != 0 && (interior || o == p) ? (Object *) o : NULL;
+    }
+
+    if (p < g_heap->mem || p >= find_end)
+        return NULL;
+
+    if ((p & (HEAP_ALIGNMENT - 1)) == 0 && heap_is_start(g_heap, p))
+        return (Object *) p;
+
+    if (!interior)
+        return NULL;
+
+    // 向前查找最近的对象起始地址
+    size_t i = heap_bit_index(g_heap, p);
+    size_t word = i >> 6;
+    u8 bits = g_heap->starts[word] & (i % 64 == 63 ? ~0ULL : ((1ULL << (i % 64 + 1)) - 1));
+    while (bits == 0) {
+        if (word == 0)
+            return NULL;
+        bits = g_heap->starts[--word];
+    }
+
+    size_t start_index = word*64 + 63 - __builtin_clzll(bits);
+    Object *o = (Object *) (g_heap->mem + start_index*HEAP_ALIGNMENT);
+    if (p < (address) o + object_size(o))
+        return o;
+    return NULL; // p 指向空闲内存
+}
+
+/* 灰色对象（已访问但还未扫描其中引用的对象） */
+
+static jref *gray_stack;
+static size_t gray_stack_len;
+static size_t gray_stack_capacity;
+
+static void push_gray(jref o)
+{
+    if (gray_stack_len == gray_stack_capacity) {
+        gray_stack_capacity = gray_stack_capacity == 0 ? 1024 : gray_stack_capacity*2;
+        gray_stack = vm_realloc(gray_stack, gray_stack_capacity*sizeof(*gray_stack));
+    }
+    gray_stack[gray_stack_len++] = o;
+}
+
+static pthread_mutex_t ref_field_ids_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// 并行 mark 时多个 gc 线程可能同时扫描同一个类的对象
+static int *calc_ref_field_ids(Class *c)
+{
+    pthread_mutex_lock(&ref_field_ids_mutex);
+    if (c->ref_field_ids != NULL) {
+        pthread_mutex_unlock(&ref_field_ids_mutex);
+        return c->ref_field_ids;
+    }
+
+    int count = 0;
+    for (Class *clazz = c; clazz != NULL; clazz = clazz->super_class) {
+        for (u2 i = 0; i < clazz->fields_count; i++) {
+            Field *f = clazz->fields + i;
+            if (!IS_STATIC(f) && !is_prim_field(f))
+                count++;
+        }
+    }
+
+    int *ids = vm_malloc((count > 0 ? count : 1) * sizeof(*ids));
+    int k = 0;
+    for (Class *clazz = c; clazz != NULL; clazz = clazz->super_class) {
+        for (u2 i = 0; i < clazz->fields_count; i++) {
+            Field *f = clazz->fields + i;
+            if (!IS_STATIC(f) && !is_prim_field(f))
+                ids[k++] = f->id;
+        }
+    }
+
+    c->ref_fields_count = count;
+    __atomic_store_n(&c->ref_field_ids, ids, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&ref_field_ids_mutex);
+    return ids;
+}
 
 /*
- * 分析一个可达的对象
+ * 访问对象中的所有引用
  */
-static void analysis_reachable_object(jref obj)
-{
-    assert (obj != NULL);
-
-    if (is_ref_array_class(obj->clazz)) {
-        jarrRef arr = obj;
-        assert(arr != NULL);
-        for (int i = 0; i < arr->arr_len; i++) {
-            jref o = array_get(jref, arr, i);
-            if (o != NULL) {
-                o->accessible = 1; // 此对象可达
-                analysis_reachable_object(o);
+// 对象中的引用可能是压缩的（见 object.h），解码后交给 @visit，被 @visit 修改了才写回
+static inline void visit_heapref(heapref_t *slot, void (* visit)(jref *))
+{
+#ifdef COMPRESSED_OOPS
+    jref o = load_ref(slot);
+    jref n = o;
+    visit(&n);
+    if (n != o)
+        store_ref(slot, n);
+#else
+    visit(slot);
+#endif
+}
+
+static void visit_object_refs(jref obj, void (* visit)(jref *))
+{
+    assert(obj != NULL && obj->clazz != NULL);
+    Class *c = obj->clazz;
+
+    if (is_array_class(c)) {
+        if (is_ref_array_class(c)) {
+            heapref_t *data = (heapref_t *) array_data(obj);
+            for (jsize i = 0; i < array_len(obj); i++) {
+                visit_heapref(data + i, visit);
             }
         }
-    } else {
-        int count = obj->clazz->inst_fields_count;
-        for (int i = 0; i < count; i++) {
-            slot_t *slot = obj->data + i;
-            // todo  这里要先判断 slot 存放的是不是 jref
-            jref o = slot_get_ref(slot);
-            o->accessible = 1;
-            analysis_reachable_object(o);
+        return;
+    }
+
+    int *ids = __atomic_load_n(&c->ref_field_ids, __ATOMIC_ACQUIRE);
+    if (ids == NULL)
+        ids = calc_ref_field_ids(c);
+
+    for (int i = 0; i < c->ref_fields_count; i++) {
+        visit_heapref((heapref_t *) ((u1 *) obj + ids[i]), visit);
+    }
+}
+
+// Reference 对象中除了 referent 之外的引用（见 Reference processing）
+static int referent_offset;
+
+static void visit_reference_refs(jref ref, void (* visit)(jref *))
+{
+    Class *c = ref->clazz;
+    int *ids = __atomic_load_n(&c->ref_field_ids, __ATOMIC_ACQUIRE);
+    if (ids == NULL)
+        ids = calc_ref_field_ids(c);
+
+    for (int i = 0; i < c->ref_fields_count; i++) {
+        if (ids[i] != referent_offset)
+            visit_heapref((heapref_t *) ((u1 *) ref + ids[i]), visit);
+    }
+}
+
+// 栈上分配的对象（见 escape.h）不在堆中，其中的引用是根
+static void visit_local_objects(Frame *f, void (* visit)(jref *))
+{
+    EscapeInfo *info = f->method->escape_info;
+    for (int i = 0; i < info->sites_count; i++) {
+        Object *o = (Object *) (f->local_objs + info->sites[i].offset);
+        if (o->clazz != NULL) // NULL 表示还未执行过此分配点
+            visit_object_refs(o, visit);
+    }
+}
+
+/*
+ * 保守扫描一段内存，内存中每个字（按指针对齐）都被视为可能的引用。
+ */
+static void scan_conservatively(const void *begin, const void *end, bool interior, void (* found)(jref))
+{
+    address p = ((address) begin + sizeof(address) - 1) & ~(sizeof(address) - 1);
+    for (; p + sizeof(address) <= (address) end; p += sizeof(address)) {
+        Object *o = find_object(*(address *) p, interior);
+        if (o != NULL)
+            found(o);
+    }
+}
+
+static void visit_conservative_roots(void (* found)(jref))
+{
+    for (int i = 0; i < g_all_threads_count; i++) {
+        Thread *t = g_all_threads[i];
+        if (t->detached)
+            continue;
+
+        // 虚拟机栈：|lvars|Frame|ostack|, |lvars|Frame|ostack| ...
+        if (t->top_frame != NULL) {
+            scan_conservatively(t->vm_stack, (void *) get_frame_end_address(t->top_frame), false, found);
+        }
+
+        // 本地线程栈（栈向低地址增长）
+        if (t->native_stack_base != NULL && t->native_stack_top != NULL) {
+            assert(t->native_stack_top < t->native_stack_base);
+            scan_conservatively(t->native_stack_top, t->native_stack_base, true, found);
+        }
+    }
+}
+
+static void visit_class_roots(Class *c, void (* visit)(jref *))
+{
+    assert(c != NULL);
+
+    // 1. 类静态属性引用的对象
+    for (u2 i = 0; i < c->fields_count; i++) {
+        Field *f = c->fields + i;
+        if (IS_STATIC(f) && !is_prim_field(f)) {
+            visit(&f->static_value.r);
+        }
+    }
+
+    // 2. 类对象中引用的对象（类对象本身不在堆中）
+    if (c->java_mirror != NULL) {
+        visit(&c->java_mirror);
+        if (!is_in_heap(g_heap, (address) c->java_mirror))
+            visit_object_refs(c->java_mirror, visit);
+    }
+
+    visit(&c->loader);
+    visit(&c->enclosing.name);
+    visit(&c->enclosing.descriptor);
+    if (c == g_class_class) {
+        visit(&c->class.module);
+    }
+
+    // 3. 常量池中已解析的字符串
+    for (u2 i = 1; i < c->cp.size; i++) {
+        if (c->cp.type[i] == JVM_CONSTANT_ResolvedString) {
+            visit((jref *) &c->cp.info[i]);
         }
     }
 }
 
 /*
- * 判断对象是否可达(GC Roots Analysis)
- *
- * 可作为GC Roots对象的包括如下几种：
-    a.虚拟机栈(栈桢中的本地变量表)中的引用的对象  todo 操作栈中的引用的对象呢？？？？？
-    b.方法区中的类静态属性引用的对象
-    c.方法区中的常量引用的对象
-    d.本地方法栈中JNI的引用的对象
-    e.ClassObject对象（保存在本地内存）中所引用的对象
+ * 已被 full gc 处理，等待 Reference Handler 线程取走的 Reference（见 Reference processing），
+ * 以 Reference.discovered 链接，最后一个的 discovered 为 NULL.
  */
-static void reachability_analysis()
+static jref pending_list;
+static jref pending_tail;
+static pthread_mutex_t pending_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pending_cond = PTHREAD_COND_INITIALIZER;
+
+/*
+ * 访问所有可以精确扫描的根（即除了线程栈之外的所有根）。
+ */
+static void visit_precise_roots(void (* visit)(jref *))
 {
-#if 0    
-    /****** 虚拟机栈(栈桢中的本地变量表)中的引用的对象 ******/
     for (int i = 0; i < g_all_threads_count; i++) {
-        for (Frame *frame = g_all_threads[i]->top_frame; frame != NULL; frame = frame->prev) {
-            slot_t *lvars = frame->lvars;
-            u2 max_locals = frame->method->max_locals;
-            for (u2 j = 0; j < max_locals; j++) {
-                // todo 这里要先判断 locals[j] 存放的是不是 jref
-//                jref o = RSLOT(lvars + j);
-//                o->accessible = 1;
-//                analysisObject(o);
+        Thread *t = g_all_threads[i];
+        if (!t->detached) {
+            visit(&t->tobj);
+            visit(&t->exception);
+            for (Frame *f = t->top_frame; f != NULL; f = f->prev) {
+                if (f->local_objs != NULL)
+                    visit_local_objects(f, visit);
+            }
+        }
+    }
+
+    PHM *boot_classes = get_all_boot_classes();
+    PHM_TRAVERSAL(boot_classes, Class *, c, {
+        visit_class_roots(c, visit);
+    });
+
+    PHS_TRAVERSAL(get_all_class_loaders(), jref, loader, {
+        if (loader != BOOT_CLASS_LOADER) {
+            // class loader 是固定的（见 add_class_to_class_loader），不会被移动
+            jref l = loader;
+            visit(&l);
+            assert(l == loader);
+            PHM *classes = get_loaded_classes(loader);
+            if (classes != NULL) {
+                PHM_TRAVERSAL(classes, Class *, c, {
+                    visit_class_roots(c, visit);
+                });
             }
+        }
+    });
 
-            // todo How about frame->ostack？？？？
+    // 字符串池以字符串的内容散列，可以直接更新其中的引用
+    PHS *str_pool = g_string_class != NULL ? g_string_class->string.str_pool : NULL;
+    if (str_pool != NULL) {
+        for (int i = 0; i < str_pool->phm.capacity; i++) {
+            for (struct point_hash_map_node *node = str_pool->phm.table[i]; node != NULL; node = node->next) {
+                visit((jref *) &node->key);
+            }
         }
     }
 
-    /****** 类静态属性引用的对象 和 类对象中引用的对象 ******/
-    const unordered_set<const Object *> &loaders = getAllClassLoaders();
-    for (const Object *loader: loaders) {
-        unordered_map<const utf8_t *, Class *, Utf8Hash, Utf8Comparator> *classes;
-        if (loader == BOOT_CLASS_LOADER) {
-            classes = getAllBootClasses();
-        } else {
-            classes = loader->classes;
+    visit_jni_global_refs(visit);
+
+    visit(&pending_list);
+    visit(&pending_tail);
+
+    visit(&g_sys_thread_group);
+    visit(&g_app_class_loader);
+    visit(&g_platform_class_loader);
+}
+
+// mark word 中的锁状态可能同时被 mutator 以 CAS 修改（见 monitor.c），gc 位要原子的设置
+#define set_flag_atomic(o, bit) __atomic_fetch_or(&(o)->mark, (bit), __ATOMIC_RELAXED)
+
+/* Remembered set */
+
+static pthread_mutex_t remset_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static jref *remset;
+static size_t remset_len;
+static size_t remset_capacity;
+
+static void remset_add(jref o)
+{
+    assert(o != NULL && !is_remembered(o));
+    set_flag_atomic(o, MARK_REMEMBERED);
+    if (remset_len == remset_capacity) {
+        remset_capacity = remset_capacity == 0 ? 1024 : remset_capacity*2;
+        remset = vm_realloc(remset, remset_capacity*sizeof(*remset));
+    }
+    remset[remset_len++] = o;
+}
+
+void remember_object(Object *o)
+{
+    assert(o != NULL && !is_in_young(g_heap, (address) o));
+    if (g_heap->epsilon) // 没有新生代
+        return;
+
+    pthread_mutex_lock(&remset_mutex);
+    if (!is_remembered(o))
+        remset_add(o);
+    pthread_mutex_unlock(&remset_mutex);
+}
+
+void pin_object(Object *o)
+{
+    assert(o != NULL);
+
+    set_flag_atomic(o, MARK_PINNED);
+}
+
+/* Scavenge */
+
+/*
+ * 对象移动后的新地址保存在原对象的 mark word 中（见 object.h），原来的 mark word 被覆盖。
+ * minor gc 时原对象已被复制，副本中保留着原来的 mark word；
+ * 压缩时需要保留的 mark word 另外保存（见 preserve_mark）。
+ */
+#define is_forwarded(o) (((o)->mark & MARK_LOCK_MASK) == MARK_FORWARDED)
+#define forwardee(o) ((jref) ((o)->mark & ~(uintptr_t) 0xf))
+#define set_forwardee(o, f) ((o)->mark = (uintptr_t) (f) | MARK_FORWARDED)
+
+static bool promotion_failed;
+
+// 新生代中的对象 @o 不移动，扫描其中的引用
+static void keep_in_place(jref o)
+{
+    assert(is_in_young(g_heap, (address) o));
+    if (!heap_mark(g_heap, o))
+        push_gray(o);
+}
+
+static jref evacuate(jref o)
+{
+    assert(is_in_young(g_heap, (address) o));
+
+    if (is_forwarded(o))
+        return forwardee(o);
+    if (heap_is_marked(g_heap, o)) // 留在原处的对象
+        return o;
+
+    if (is_pinned(o)) {
+        keep_in_place(o);
+        return o;
+    }
+
+    size_t size = object_size(o);
+    jref copy = heap_try_malloc(g_heap, size);
+    if (copy == NULL) {
+        promotion_failed = true;
+        keep_in_place(o);
+        return o;
+    }
+
+    memcpy(copy, o, size);
+    copy->mark &= ~MARK_GC_BITS; // 保留锁状态和 identity hash
+    if (g_concurrent_marking)
+        heap_mark(g_heap, copy); // 并发标记期间晋升的对象直接标记为存活（见 Concurrent mark）
+
+    // 被复制的对象不标记，young_sweep 时回收
+    set_forwardee(o, copy);
+
+    if (g_string_dedup && copy->clazz == g_string_class)
+        string_dedup_enqueue(copy);
+
+    push_gray(copy);
+    return copy;
+}
+
+// 扫描一个对象时，是否有引用仍指向新生代（被固定的对象）
+static bool young_ref_found;
+
+static void scavenge_ref(jref *ref)
+{
+    jref o = *ref;
+    if (o != NULL && is_in_young(g_heap, (address) o)) {
+        *ref = o = evacuate(o);
+        if (is_in_young(g_heap, (address) o))
+            young_ref_found = true;
+    }
+}
+
+static void scavenge_object(jref o)
+{
+    young_ref_found = false;
+    visit_object_refs(o, scavenge_ref);
+    if (young_ref_found && !is_in_young(g_heap, (address) o) && !is_remembered(o)) {
+        // 仍然引用了新生代中的对象，下次 minor gc 时还要扫描
+        remset_add(o);
+    }
+}
+
+static size_t sizeof_object(address p)
+{
+    Object *o = (Object *) p;
+    assert(o->clazz != NULL);
+    return object_size(o);
+}
+
+// minor gc 后对象 @o 的地址，已死亡返回 NULL
+static jref scavenged_address(jref o)
+{
+    if (!is_in_young(g_heap, (address) o))
+        return o;
+    if (is_forwarded(o))
+        return forwardee(o);
+    return heap_is_marked(g_heap, o) ? o : NULL;
+}
+
+static void scavenge()
+{
+    set_find_range(true);
+
+    // 1. 保守扫描到的对象都不能移动
+    visit_conservative_roots(keep_in_place);
+
+    // 2. 精确的根
+    visit_precise_roots(scavenge_ref);
+
+    // 3. remembered set 中的对象，扫描时重新生成
+    jref *old_remset = remset;
+    size_t old_remset_len = remset_len;
+    remset = NULL;
+    remset_len = remset_capacity = 0;
+    for (size_t i = 0; i < old_remset_len; i++) {
+        old_remset[i]->mark &= ~MARK_REMEMBERED;
+    }
+    for (size_t i = 0; i < old_remset_len; i++) {
+        scavenge_object(old_remset[i]);
+    }
+    free(old_remset);
+
+    // 4. 复制所有可达的对象
+    while (gray_stack_len > 0) {
+        jref o = gray_stack[--gray_stack_len];
+        scavenge_object(o);
+    }
+
+    sweep_monitors(scavenged_address);
+
+    // 留在原处的对象被标记了，其他的（包括已被复制到老年代的）都被回收
+    young_sweep(g_heap, sizeof_object, NULL);
+}
+
+/*
+ * Parallel mark
+ *
+ * 执行 gc 的线程（0号）先标记所有的根，放入自己的 deque，然后唤醒其他的 gc 线程一起 mark.
+ * 每个 gc 线程有一个 work-stealing deque（见 deque.h），保存灰色对象，
+ * 自己的 deque 空了就随机从其他线程的 deque 中窃取。
+ * 所有线程都空闲且所有 deque 都为空时 mark 结束。
+ *
+ * gc 线程不是 Java 线程，不在 g_all_threads 中，也不执行 Java 代码。
+ */
+
+#define MARK_WORKERS_MAX 32
+#define MARK_DEQUE_INIT_CAPACITY 4096
+
+typedef struct {
+    Deque deque;
+    u4 seed; // 随机选择窃取的对象
+} MarkWorker;
+
+static MarkWorker *mark_workers;
+static int mark_workers_count; // 包括0号
+
+// 当前 gc 线程
+static _Thread_local MarkWorker *current_worker;
+
+static pthread_mutex_t mark_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mark_start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t mark_done_cond = PTHREAD_COND_INITIALIZER;
+static size_t mark_epoch = 0;
+static int mark_running; // 还在 mark 的gc线程数（不包括0号）
+static int idle_workers;
+
+// 并发标记只标记老年代中的对象，新生代的标记位由 minor gc 使用
+static bool marking_old_only = false;
+
+/*
+ * 大的引用数组（都在大对象空间中）分块扫描，每块 ARRAY_CHUNK_LEN 个元素。
+ * deque 中最低位为 1 的项是数组的扫描任务，扫描进度保存在大对象头部（scan_index）。
+ * 取得任务的线程先领取一块，还有剩余就把任务重新压入自己的 deque，其他线程可以窃取。
+ */
+#define ARRAY_CHUNK_LEN 4096
+#define ARRAY_TASK_TAG 1
+
+static void mark_object(jref o)
+{
+    if (o == NULL)
+        return;
+
+    if (is_in_los(g_heap, (address) o)) {
+        // 大对象的标记在其头部
+        if (los_is_marked((address) o) || los_mark((address) o))
+            return;
+        if (is_array_class(o->clazz) && is_ref_array_class(o->clazz) && array_len(o) > ARRAY_CHUNK_LEN) {
+            large_object_of(o)->scan_index = 0;
+            deque_push(&current_worker->deque, (void *) ((uintptr_t) o | ARRAY_TASK_TAG));
+            return;
         }
+        deque_push(&current_worker->deque, o);
+        return;
+    }
+
+    // 不在堆中的"引用"无需标记：
+    // 比如类对象（java_mirror）
+    if (!is_in_heap(g_heap, (address) o) || heap_is_marked(g_heap, o))
+        return;
+    if (marking_old_only && is_in_young(g_heap, (address) o))
+        return;
+
+    // 此对象可达，可能有多个 gc 线程同时标记此对象，只有一个成功
+    if (heap_mark(g_heap, o))
+        return;
+    deque_push(&current_worker->deque, o);
+}
+
+static void mark_ref(jref *ref)
+{
+    mark_object(*ref);
+}
+
+// full gc 标记之后（或标记期间）对象 @o 是否已被标记，不在堆中的对象视为已标记
+static bool is_marked_live(jref o)
+{
+    if (is_in_los(g_heap, (address) o))
+        return los_is_marked((address) o);
+    return !is_in_heap(g_heap, (address) o) || heap_is_marked(g_heap, o);
+}
+
+/*
+ * Reference processing
+ *
+ * full gc 标记时发现（discover）java.lang.ref.Reference 对象：referent 还未被标记的 Reference 暂不扫描其 referent，
+ * 按引用强度（见 Class.ref_type）记录在 discovered_refs 中。标记结束后从强到弱依次处理：
+ *  1. SoftReference: 按 LRU 策略保留一部分，保留的 referent（及其可达的对象）被标记。
+ *     距上次被访问（SoftReference.get() 更新 timestamp）超过 堆的空闲空间(MB) * SOFT_REF_LRU_MS_PER_MB 毫秒的不保留，
+ *     所以堆越满，软引用被清除得越快。内存即将耗尽时（见 last_ditch_gc）清除所有的软引用。
+ *  2. 不保留的 SoftReference 和 WeakReference: referent 未被标记的，清除其 referent.
+ *  3. FinalReference（java.lang.ref.Finalizer，见 Class.has_finalizer）: referent 未被标记的，
+ *     标记 referent（及其可达的对象），finalize() 执行时对象是完整的。referent 由 Finalizer 线程调用 finalize() 之后清除。
+ *  4. PhantomReference: referent 在 finalize 之后仍未被标记的，清除其 referent.
+ * 2, 3, 4 中处理的 Reference 放入 pending list，由 Reference Handler 线程取走（见 get_and_clear_pending_references），
+ * 放入各自的 ReferenceQueue. Finalizer 的 queue 由 Finalizer 线程处理。
+ *
+ * 第1、3步标记时不再发现 Reference，其中的 referent 都视为强引用。
+ * minor gc 和并发标记也把 referent 视为强引用，只有 full gc 清除 referent.
+ */
+
+#define SOFT_REF_LRU_MS_PER_MB 1000
+
+static bool discovering_refs = false;
+static bool clear_all_soft_refs = false;
+
+// java.lang.ref.Reference 中其他实例变量的偏移（referent_offset 见 visit_reference_refs），
+// 在 Reference 类加载之后第一次 full gc 时计算
+static int next_offset;
+static int discovered_offset;
+
+// SoftReference.timestamp 和 static long SoftReference.clock
+static int timestamp_offset;
+static Field *soft_ref_clock;
+
+typedef struct {
+    jref *refs;
+    size_t len;
+    size_t capacity;
+} RefList;
+
+static RefList discovered_refs[REF_PHANTOM + 1];
+static pthread_mutex_t discovered_refs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define referent_addr(ref)   ((heapref_t *) ((u1 *) (ref) + referent_offset))
+#define next_addr(ref)       ((heapref_t *) ((u1 *) (ref) + next_offset))
+#define discovered_addr(ref) ((heapref_t *) ((u1 *) (ref) + discovered_offset))
+
+// 返回是否可以发现 Reference（Reference 类已加载）
+static bool init_reference_offsets()
+{
+    if (referent_offset != 0)
+        return true;
+
+    Class *c = find_loaded_class(BOOT_CLASS_LOADER, S(java_lang_ref_Reference));
+    if (c == NULL)
+        return false;
+
+    Field *referent = get_declared_field(c, "referent");
+    Field *next = get_declared_field(c, "next");
+    Field *discovered = get_declared_field(c, "discovered");
+    if (referent == NULL || next == NULL || discovered == NULL) {
+        JVM_PANIC("wrong java.lang.ref.Reference");
+    }
+    next_offset = next->id;
+    discovered_offset = discovered->id;
+    referent_offset = referent->id;
+    return true;
+}
+
+// 在 mark 中扫描 Reference 对象 @ref 时调用，返回 true 表示已被发现，暂不扫描其 referent
+static bool discover_reference(jref ref)
+{
+    jref referent = load_ref(referent_addr(ref));
+    if (referent == NULL || is_marked_live(referent))
+        return false;
+
+    // 已在 pending list 或 ReferenceQueue 中的 Reference 不再处理
+    if (load_ref(discovered_addr(ref)) != NULL || ref == pending_tail || load_ref(next_addr(ref)) != NULL)
+        return false;
+
+    RefList *l = discovered_refs + ref->clazz->ref_type;
+    pthread_mutex_lock(&discovered_refs_mutex);
+    if (l->len == l->capacity) {
+        l->capacity = l->capacity == 0 ? 256 : l->capacity*2;
+        l->refs = vm_realloc(l->refs, l->capacity*sizeof(*l->refs));
+    }
+    l->refs[l->len++] = ref;
+    pthread_mutex_unlock(&discovered_refs_mutex);
+    return true;
+}
+
+// 扫描已标记的对象 @o
+static void scan_object(jref o)
+{
+    if (discovering_refs && o->clazz->ref_type != REF_NONE && discover_reference(o))
+        visit_reference_refs(o, mark_ref);
+    else
+        visit_object_refs(o, mark_ref);
+}
+
+// 执行从 deque 中取出的任务：对象或大数组的扫描任务
+static void scan_task(void *task)
+{
+    if (((uintptr_t) task & ARRAY_TASK_TAG) == 0) {
+        scan_object(task);
+        return;
+    }
+
+    jref a = (jref) ((uintptr_t) task & ~(uintptr_t) ARRAY_TASK_TAG);
+    size_t len = array_len(a);
+    size_t i = __atomic_fetch_add(&large_object_of(a)->scan_index, ARRAY_CHUNK_LEN, __ATOMIC_RELAXED);
+    if (i >= len)
+        return;
+    size_t end = i + ARRAY_CHUNK_LEN;
+    if (end < len)
+        deque_push(&current_worker->deque, task);
+    else
+        end = len;
+
+    heapref_t *data = (heapref_t *) array_data(a);
+    for (; i < end; i++) {
+        visit_heapref(data + i, mark_ref);
+    }
+}
+
+/*
+ * 老年代中被保守扫描到的对象，压缩时不能移动。
+ * mark 之后按地址排序。
+ */
+static jref *immovables;
+static size_t immovables_len;
+static size_t immovables_capacity;
 
-        assert(classes != NULL);
-        for (auto &x: *(classes)) {
-            Class *c = x.second;
+static void mark_conservative_root(jref o)
+{
+    mark_object(o);
 
-            // 1. 分析类静态属性引用的对象
+    if (is_in_old(g_heap, (address) o)) {
+        if (immovables_len == immovables_capacity) {
+            immovables_capacity = immovables_capacity == 0 ? 1024 : immovables_capacity*2;
+            immovables = vm_realloc(immovables, immovables_capacity*sizeof(*immovables));
+        }
+        immovables[immovables_len++] = o;
+    }
+}
 
-            // for (Field *f: c->fields) {
-            //     if (!f->isStatic() || f->isPrim())
-            //         continue;
+static int cmp_address(const void *a, const void *b)
+{
+    address x = *(const address *) a;
+    address y = *(const address *) b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
 
-            //     // static and reference field of a class
-            //     jref o = f->static_value.r;
-            //     o->accessible = 1;
-            //     analysisReachableObject(o);
-            // }
-            for (u2 i = 0; i < c->fields_count; i++) {
-                Field *f = c->fields + i;
-                if (!ACC_IS_STATIC(f->access_flags) || is_prim_field(f))
-                    continue;
+static void *steal_work(MarkWorker *w)
+{
+    for (int n = 0; n < 2*mark_workers_count; n++) {
+        // xorshift
+        w->seed ^= w->seed << 13;
+        w->seed ^= w->seed >> 17;
+        w->seed ^= w->seed << 5;
+        MarkWorker *victim = mark_workers + w->seed % mark_workers_count;
+        if (victim == w)
+            continue;
+        void *task = deque_steal(&victim->deque);
+        if (task != NULL)
+            return task;
+    }
+    return NULL;
+}
 
-                // static and reference field of a class
-                jref o = f->static_value.r;
-                o->accessible = 1;
-                analysisReachableObject(o);
+/*
+ * 自己的 deque 为空并且窃取失败时调用。
+ * 所有线程都空闲时返回 true；有 deque 不为空时返回 false，继续窃取。
+ * 一个线程空闲时它的 deque 一定为空，所以所有线程都空闲后不会再有新的灰色对象。
+ */
+static bool offer_termination()
+{
+    __atomic_add_fetch(&idle_workers, 1, __ATOMIC_SEQ_CST);
+    for (;;) {
+        if (__atomic_load_n(&idle_workers, __ATOMIC_SEQ_CST) == mark_workers_count)
+            return true;
+        for (int i = 0; i < mark_workers_count; i++) {
+            if (!deque_is_empty(&mark_workers[i].deque)) {
+                __atomic_sub_fetch(&idle_workers, 1, __ATOMIC_SEQ_CST);
+                return false;
             }
+        }
+        sched_yield();
+    }
+}
 
-            // 2. 分析类对象中引用的对象
-            ClsObj *co = c->java_mirror;
-            assert(co->accessible = 1);
-            analysis_reachable_object(co);
+static void mark_loop(MarkWorker *w)
+{
+    assert(current_worker == w);
+    do {
+        void *task;
+        while ((task = deque_pop(&w->deque)) != NULL || (task = steal_work(w)) != NULL) {
+            scan_task(task);
         }
+    } while (!offer_termination());
+}
+
+static void *mark_worker_main(void *arg)
+{
+    MarkWorker *w = arg;
+    current_worker = w;
+    size_t epoch = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&mark_mutex);
+        while (epoch == mark_epoch) {
+            pthread_cond_wait(&mark_start_cond, &mark_mutex);
+        }
+        epoch = mark_epoch;
+        pthread_mutex_unlock(&mark_mutex);
+
+        mark_loop(w);
+
+        pthread_mutex_lock(&mark_mutex);
+        if (--mark_running == 0)
+            pthread_cond_signal(&mark_done_cond);
+        pthread_mutex_unlock(&mark_mutex);
     }
 
-    // todo ..... c,d 中的判断
-#endif    
+    return NULL;
 }
 
-void gc()
+// 第一次 full gc 时创建 gc 线程
+static void init_mark_workers()
 {
-    assert(g_heap != NULL);
-    lock_heap(g_heap);
+    int n = processor_number();
+    if (n < 1)
+        n = 1;
+    if (n > MARK_WORKERS_MAX)
+        n = MARK_WORKERS_MAX;
+
+    mark_workers = vm_calloc(n * sizeof(*mark_workers));
+    for (int i = 0; i < n; i++) {
+        deque_init(&mark_workers[i].deque, MARK_DEQUE_INIT_CAPACITY);
+        mark_workers[i].seed = 2463534242u + i;
+    }
+
+    mark_workers_count = 1;
+    for (int i = 1; i < n; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, mark_worker_main, mark_workers + i) != 0)
+            break; // 用已经创建的线程 mark
+        pthread_detach(tid);
+        mark_workers_count++;
+    }
+}
+
+// 所有 gc 线程一起标记0号 deque 中的对象可达的对象
+static void parallel_mark()
+{
+    MarkWorker *w = mark_workers; // 0号
+    assert(current_worker == w);
+
+    pthread_mutex_lock(&mark_mutex);
+    idle_workers = 0;
+    mark_running = mark_workers_count - 1;
+    mark_epoch++;
+    pthread_cond_broadcast(&mark_start_cond);
+    pthread_mutex_unlock(&mark_mutex);
+
+    mark_loop(w);
+
+    // 等待其他 gc 线程退出 mark_loop
+    pthread_mutex_lock(&mark_mutex);
+    while (mark_running > 0) {
+        pthread_cond_wait(&mark_done_cond, &mark_mutex);
+    }
+    pthread_mutex_unlock(&mark_mutex);
+
+    for (int i = 0; i < mark_workers_count; i++) {
+        assert(deque_is_empty(&mark_workers[i].deque));
+        deque_trim(&mark_workers[i].deque);
+    }
+}
+
+static jlong current_time_millis()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (jlong) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// 堆（包括大对象空间）中还可以分配的空间
+static size_t free_heap_size()
+{
+    size_t used = (g_heap->mem + g_heap->size - g_heap->old) - g_heap->free_bytes + g_heap->los_bytes;
+    return used < g_heap->max_size ? g_heap->max_size - used : 0;
+}
+
+// 将 @ref 放入 pending list（由 @head, @tail 表示）
+static void enqueue_pending(jref ref, jref *head, jref *tail)
+{
+    store_ref(discovered_addr(ref), *head);
+    write_barrier(ref, *head);
+    if (*head == NULL)
+        *tail = ref;
+    *head = ref;
+}
+
+// 发现了软引用时 SoftReference 类一定已经加载
+static void init_soft_reference_fields()
+{
+    if (soft_ref_clock != NULL)
+        return;
+
+    Class *c = find_loaded_class(BOOT_CLASS_LOADER, S(java_lang_ref_SoftReference));
+    assert(c != NULL);
+    Field *timestamp = get_declared_field(c, "timestamp");
+    Field *clock = get_declared_field(c, "clock");
+    if (timestamp == NULL || clock == NULL) {
+        JVM_PANIC("wrong java.lang.ref.SoftReference");
+    }
+    timestamp_offset = timestamp->id;
+    soft_ref_clock = clock;
+}
+
+// 清除 @type 的 referent 未被标记的 Reference
+static void clear_unreachable_referents(RefType type, jref *head, jref *tail)
+{
+    RefList *l = discovered_refs + type;
+    for (size_t i = 0; i < l->len; i++) {
+        jref ref = l->refs[i];
+        jref referent = load_ref(referent_addr(ref));
+        if (referent != NULL && !is_marked_live(referent)) {
+            store_ref(referent_addr(ref), NULL);
+            enqueue_pending(ref, head, tail);
+        }
+    }
+    l->len = 0;
+}
+
+// 在 mark 之后调用，见 Reference processing
+static void process_references()
+{
+    jref head = NULL, tail = NULL;
+
+    // 1. 保留一部分软引用，不保留的留在 discovered_refs[REF_SOFT] 中
+    RefList *soft = discovered_refs + REF_SOFT;
+    if (soft->len > 0 && !clear_all_soft_refs) {
+        init_soft_reference_fields();
+        jlong clock = soft_ref_clock->static_value.j;
+        jlong max_interval = (jlong) (free_heap_size() / (1024*1024)) * SOFT_REF_LRU_MS_PER_MB;
+        size_t n = 0;
+        for (size_t i = 0; i < soft->len; i++) {
+            jref ref = soft->refs[i];
+            jlong timestamp = *(jlong *) ((u1 *) ref + timestamp_offset);
+            if (clock - timestamp <= max_interval)
+                mark_object(load_ref(referent_addr(ref)));
+            else
+                soft->refs[n++] = ref;
+        }
+        soft->len = n;
+        parallel_mark();
+    }
+
+    // 2.
+    clear_unreachable_referents(REF_SOFT, &head, &tail);
+    clear_unreachable_referents(REF_WEAK, &head, &tail);
+
+    // 3. 要执行 finalize() 的对象重新标记（二次标记）
+    RefList *final = discovered_refs + REF_FINAL;
+    if (final->len > 0) {
+        for (size_t i = 0; i < final->len; i++) {
+            jref ref = final->refs[i];
+            jref referent = load_ref(referent_addr(ref));
+            if (!is_marked_live(referent)) {
+                mark_object(referent);
+                enqueue_pending(ref, &head, &tail);
+            }
+        }
+        final->len = 0;
+        parallel_mark();
+    }
+
+    // 4.
+    clear_unreachable_referents(REF_PHANTOM, &head, &tail);
+
+    for (int i = 0; i <= REF_PHANTOM; i++) {
+        assert(discovered_refs[i].len == 0);
+    }
+
+    if (head != NULL) {
+        pthread_mutex_lock(&pending_mutex);
+        store_ref(discovered_addr(tail), pending_list);
+        write_barrier(tail, pending_list);
+        if (pending_list == NULL)
+            pending_tail = tail;
+        pending_list = head;
+        pthread_cond_broadcast(&pending_cond);
+        pthread_mutex_unlock(&pending_mutex);
+    }
+
+    if (soft_ref_clock != NULL)
+        soft_ref_clock->static_value.j = current_time_millis();
+}
+
+static void mark()
+{
+    if (mark_workers == NULL)
+        init_mark_workers();
+
+    current_worker = mark_workers; // 0号
+
+    // 根在0号线程中标记
+    immovables_len = 0;
+    visit_conservative_roots(mark_conservative_root);
+    qsort(immovables, immovables_len, sizeof(*immovables), cmp_address);
+    visit_precise_roots(mark_ref);
+
+    discovering_refs = init_reference_offsets();
+    parallel_mark();
+    if (discovering_refs) {
+        discovering_refs = false;
+        process_references();
+    }
+    current_worker = NULL;
+}
+
+/* Sweep */
 
-    // todo 是不是要先将全部对象视为不可达？？？？ 然后再判断，可达的予以标记？？？？
+// full gc 标记之后对象 @o 的地址（压缩时为其新地址），已死亡返回 NULL
+static jref marked_address(jref o)
+{
+    if (is_in_los(g_heap, (address) o))
+        return los_is_marked((address) o) ? o : NULL;
+    if (!is_in_heap(g_heap, (address) o))
+        return o;
+    if (marking_old_only && is_in_young(g_heap, (address) o))
+        return o;
+    if (!heap_is_marked(g_heap, o))
+        return NULL;
+    return is_in_old(g_heap, (address) o) && is_forwarded(o) ? forwardee(o) : o;
+}
+
+/*
+ * Compact（Lisp2）
+ *
+ * 1. 按地址顺序计算每个存活对象的新地址（保存在 mark word 中，见 forwardee），
+ *    被固定的和被保守扫描到的对象不能移动，其他对象向低地址滑动，
+ *    所以对象之间的顺序不变，也不会越过不能移动的对象。
+ *    不移动的对象不设置新地址；要移动的对象如果有锁状态或 gc 位，其 mark word 先保存起来，移动后恢复。
+ * 2. 更新所有引用：精确的根，老年代、大对象空间和新生代中存活的对象，remembered set.
+ *    保守扫描到的根指向的都是不能移动的对象，无需更新。大对象不移动。
+ * 3. 按地址顺序移动对象（heap_slide），重建空闲块。
+ */
+
+// 老年代的空闲空间中，不在最大空闲块中的比例超过此值时压缩老年代
+#define COMPACT_THRESHOLD 0.5
+// 空闲空间太少时不值得压缩
+#define COMPACT_MIN_FREE_BYTES (1024*1024)
+
+static address compact_ptr;
+static size_t next_immovable;
+
+typedef struct {
+    jref obj; // 对象的新地址
+    uintptr_t mark;
+} PreservedMark;
+
+static PreservedMark *preserved_marks;
+static size_t preserved_marks_len;
+static size_t preserved_marks_capacity;
+
+static void preserve_mark(jref to, uintptr_t mark)
+{
+    if (preserved_marks_len == preserved_marks_capacity) {
+        preserved_marks_capacity = preserved_marks_capacity == 0 ? 1024 : preserved_marks_capacity*2;
+        preserved_marks = vm_realloc(preserved_marks, preserved_marks_capacity*sizeof(*preserved_marks));
+    }
+    preserved_marks[preserved_marks_len++] = (PreservedMark) { to, mark };
+}
+
+static void compute_new_address(address p)
+{
+    Object *o = (Object *) p;
+    size_t size = heap_align(object_size(o));
+
+    while (next_immovable < immovables_len && (address) immovables[next_immovable] < p)
+        next_immovable++;
+
+    bool immovable = is_pinned(o)
+                || (next_immovable < immovables_len && (address) immovables[next_immovable] == p);
+    address to = immovable ? p : compact_ptr;
+    assert(to <= p);
+    if (to != p) {
+        if (o->mark != MARK_UNLOCKED)
+            preserve_mark((jref) to, o->mark);
+        set_forwardee(o, to);
+    }
+    compact_ptr = to + size;
+}
+
+static void update_ref(jref *ref)
+{
+    jref o = *ref;
+    if (o != NULL && is_in_old(g_heap, (address) o)) {
+        assert(heap_is_marked(g_heap, o));
+        if (is_forwarded(o))
+            *ref = forwardee(o);
+    }
+}
+
+static void update_object_refs(address p)
+{
+    visit_object_refs((Object *) p, update_ref);
+}
+
+static size_t slide_object(address p, address *to)
+{
+    Object *o = (Object *) p;
+    size_t size = object_size(o);
+
+    if (!is_forwarded(o)) {
+        *to = p;
+        return size;
+    }
+
+    jref f = forwardee(o);
+    o->mark = MARK_UNLOCKED; // 需要保留的 mark word 在移动后恢复
+    *to = (address) f;
+    return size;
+}
+
+static void compact()
+{
+    compact_ptr = g_heap->old;
+    next_immovable = 0;
+    old_walk_marked(g_heap, compute_new_address);
+
+    visit_precise_roots(update_ref);
+    old_walk_marked(g_heap, update_object_refs);
+    los_walk_marked(g_heap, update_object_refs);
+    young_walk_marked(g_heap, update_object_refs);
+    for (size_t i = 0; i < remset_len; i++) {
+        update_ref(remset + i);
+    }
+
+    sweep_monitors(marked_address);
+    string_dedup_sweep(marked_address);
+    heap_slide(g_heap, slide_object, NULL);
+
+    for (size_t i = 0; i < preserved_marks_len; i++) {
+        preserved_marks[i].obj->mark = preserved_marks[i].mark;
+    }
+    preserved_marks_len = 0;
+}
+
+static bool is_fragmented()
+{
+    size_t free_bytes = g_heap->free_bytes;
+    if (free_bytes < COMPACT_MIN_FREE_BYTES)
+        return false;
+    size_t largest = heap_largest_free_block(g_heap);
+    return (double) (free_bytes - largest) / free_bytes > COMPACT_THRESHOLD;
+}
+
+// 死亡的对象从 remembered set 中移除
+static void filter_remset()
+{
+    size_t n = 0;
+    for (size_t i = 0; i < remset_len; i++) {
+        jref o = remset[i];
+        if (is_marked_live(o))
+            remset[n++] = o;
+    }
+    remset_len = n;
+}
 
-    address mem = g_heap->mem;
-    const address end = mem + g_heap->size;
+static void mark_sweep(bool compaction)
+{
+    // 并发清除还没有完成的部分中还有上次 remark 的标记位
+    heap_sweep_finish(g_heap);
+
+    compaction = compaction || is_fragmented();
 
-    while (mem < end) {
-        mem = jump_freelist(g_heap, mem);
+    set_find_range(false);
+    mark();
 
-        Object *obj = (Object *) mem;
-        obj->accessible = 0;
-//        if (!accessible(obj)) {
-//            obj->marked = 1;
-//            // todo 调用 finalize() 后进行二次标记，然后才可以归还
-//            heap_free(g_heap, mem, obj->size());
-//        }
-        mem += object_size(obj);
+    // Reference 和要执行 finalize() 的对象已在 mark 中处理（见 Reference processing）
+    filter_remset();
+
+    if (compaction) {
+        compact();
+    } else {
+        sweep_monitors(marked_address);
+        string_dedup_sweep(marked_address);
+        heap_sweep(g_heap, sizeof_object, NULL);
     }
+    los_sweep(g_heap, NULL);
+    young_sweep(g_heap, sizeof_object, NULL);
+
+    // 根据存活对象的多少扩张或收缩老年代
+    heap_resize(g_heap);
+}
+
+static void begin_pause(Thread *self)
+{
+    stop_the_world(self);
+    lock_heap(g_heap);
 
-    reachability_analysis();
+    // TLAB 中未使用的部分没有对象，遍历堆之前还给堆
+    for (int i = 0; i < g_all_threads_count; i++) {
+        tlab_retire(g_heap, &g_all_threads[i]->tlab);
+    }
+}
 
+static void end_pause(Thread *self)
+{
     unlock_heap(g_heap);
+    start_the_world(self);
+}
+
+/*
+ * Concurrent mark
+ *
+ * 1. initial mark（stop-the-world）：先执行一次 minor gc，然后标记根，
+ *    并扫描新生代中剩余的对象（只被保守扫描到或者被固定的对象），打开 SATB write barrier.
+ * 2. concurrent mark：gc 线程和 mutator 并发，标记0号 deque 和 SATB 缓冲区中的对象可达的对象。
+ *    只标记老年代，新生代中的对象不会被压入 deque（标记开始后才分配的对象不需要扫描），
+ *    所以 minor gc 移动新生代中的对象不影响并发标记，gc 线程只需在安全点上等待 minor gc 结束。
+ * 3. remark（stop-the-world）：处理所有线程的 SATB 缓冲区，
+ *    重新标记精确的根（JNI 全局引用，字符串池等没有 write barrier），并行标记剩余的对象，
+ *    然后只处理 monitor 表，去重表和 remembered set，开始并发清除（heap_sweep_begin）。
+ * 4. concurrent sweep：gc 线程和 mutator 并发，逐块清除老年代和大对象空间（见 heap_sweep_begin），
+ *    每块之间检查安全点，最后调整老年代的大小。
+ */
+
+// 老年代（已提交部分）占用率超过此值时开始并发标记
+#define CONCURRENT_MARK_THRESHOLD 0.75
+
+#define SATB_BUFFER_SIZE 256
+
+// 并发标记时，每标记这么多个对象检查一次安全点
+#define CONCURRENT_MARK_STEP 256
+
+volatile bool g_concurrent_marking = false;
+
+enum { CM_IDLE, CM_REQUESTED, CM_MARKING };
+static int cm_state = CM_IDLE;
+static pthread_mutex_t cm_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cm_cond = PTHREAD_COND_INITIALIZER;
+
+// 并发标记期间发生了 full gc，本次标记被放弃
+static bool cm_aborted;
+
+// 线程已满的 SATB 缓冲区中的对象
+static pthread_mutex_t satb_mutex = PTHREAD_MUTEX_INITIALIZER;
+static jref *satb_queue;
+static size_t satb_queue_len;
+static size_t satb_queue_capacity;
+
+static void satb_queue_add(jref *objs, size_t n)
+{
+    pthread_mutex_lock(&satb_mutex);
+    if (satb_queue_len + n > satb_queue_capacity) {
+        satb_queue_capacity = satb_queue_capacity == 0 ? 1024 : satb_queue_capacity*2;
+        if (satb_queue_capacity < satb_queue_len + n)
+            satb_queue_capacity = satb_queue_len + n;
+        satb_queue = vm_realloc(satb_queue, satb_queue_capacity*sizeof(*satb_queue));
+    }
+    memcpy(satb_queue + satb_queue_len, objs, n*sizeof(*objs));
+    satb_queue_len += n;
+    pthread_mutex_unlock(&satb_mutex);
+}
+
+void satb_enqueue(Object *o)
+{
+    assert(o != NULL);
+
+    Thread *t = get_current_thread();
+    if (t == NULL) {
+        satb_queue_add(&o, 1);
+        return;
+    }
+
+    if (t->satb_buf == NULL)
+        t->satb_buf = vm_malloc(SATB_BUFFER_SIZE * sizeof(*t->satb_buf));
+    if (t->satb_len == SATB_BUFFER_SIZE) {
+        satb_queue_add(t->satb_buf, t->satb_len);
+        t->satb_len = 0;
+    }
+    t->satb_buf[t->satb_len++] = o;
+}
+
+// 标记 satb_queue 中的对象，返回是否有对象
+static bool drain_satb_queue()
+{
+    pthread_mutex_lock(&satb_mutex);
+    jref *q = satb_queue;
+    size_t len = satb_queue_len;
+    satb_queue = NULL;
+    satb_queue_len = satb_queue_capacity = 0;
+    pthread_mutex_unlock(&satb_mutex);
+
+    for (size_t i = 0; i < len; i++) {
+        mark_object(q[i]);
+    }
+    free(q);
+    return len > 0;
+}
+
+// 在 stop-the-world 中调用
+static void abort_concurrent_mark()
+{
+    assert(g_concurrent_marking);
+    g_concurrent_marking = false;
+    marking_old_only = false;
+    cm_aborted = true;
+
+    for (int i = 0; i < g_all_threads_count; i++) {
+        g_all_threads[i]->satb_len = 0;
+    }
+    pthread_mutex_lock(&satb_mutex);
+    satb_queue_len = 0;
+    pthread_mutex_unlock(&satb_mutex);
+
+    Deque *d = &mark_workers[0].deque;
+    while (deque_pop(d) != NULL)
+        ;
+    deque_trim(d);
+
+    // 已标记的对象（包括标记期间分配的），老年代的起止都按 HEAP_COMMIT_GRANULARITY 对齐
+    size_t from = heap_bit_index(g_heap, g_heap->old) / 64;
+    size_t to = heap_bit_index(g_heap, g_heap->mem + g_heap->size) / 64;
+    memset(g_heap->marks + from, 0, (to - from) * sizeof(*g_heap->marks));
+    los_clear_marks(g_heap);
+}
+
+// minor gc 之后调用，老年代占用率过高时唤醒 gc 线程
+static void request_concurrent_mark()
+{
+    size_t committed = g_heap->mem + g_heap->size - g_heap->old;
+    if (committed - g_heap->free_bytes < CONCURRENT_MARK_THRESHOLD * committed)
+        return;
+
+    pthread_mutex_lock(&cm_mutex);
+    if (cm_state == CM_IDLE) {
+        cm_state = CM_REQUESTED;
+        pthread_cond_signal(&cm_cond);
+    }
+    pthread_mutex_unlock(&cm_mutex);
+}
+
+static void collect(bool full, bool compaction, bool clear_soft_refs)
+{
+    assert(g_heap != NULL);
+
+    if (g_heap->epsilon) // 不回收内存（见 heap.h）
+        return;
+
+    Thread *self = get_current_thread();
+    if (self == NULL) {
+        // 虚拟机还没有初始化完成，无法枚举 GC Roots
+        return;
+    }
+
+    size_t count = full ? full_gc_count : gc_count;
+
+    // 等待其他线程的 gc 时处于安全区域
+    enter_safe_region(self);
+    pthread_mutex_lock(&gc_mutex);
+    leave_safe_region(self);
+
+    if (count != (full ? full_gc_count : gc_count)) {
+        // 等待期间其他线程已经完成了一次 gc
+        pthread_mutex_unlock(&gc_mutex);
+        return;
+    }
+
+    begin_pause(self);
+
+    promotion_failed = false;
+    scavenge();
+
+    if (full || promotion_failed) {
+        if (g_concurrent_marking)
+            abort_concurrent_mark();
+        clear_all_soft_refs = clear_soft_refs;
+        mark_sweep(compaction);
+        clear_all_soft_refs = false;
+        full_gc_count++;
+    } else if (!g_concurrent_marking) {
+        request_concurrent_mark();
+    }
+
+    gc_count++;
+
+    end_pause(self);
+    pthread_mutex_unlock(&gc_mutex);
+}
+
+static void scan_young_object(address p)
+{
+    visit_object_refs((Object *) p, mark_ref);
+}
+
+// 返回是否开始了并发标记
+static bool initial_mark(Thread *self)
+{
+    enter_safe_region(self);
+    pthread_mutex_lock(&gc_mutex);
+    leave_safe_region(self);
+
+    begin_pause(self);
+
+    promotion_failed = false;
+    scavenge();
+    gc_count++;
+
+    bool started = false;
+    if (promotion_failed) {
+        mark_sweep(false);
+        full_gc_count++;
+    } else {
+        if (mark_workers == NULL)
+            init_mark_workers();
+        current_worker = mark_workers; // 0号
+        marking_old_only = true;
+        cm_aborted = false;
+
+        set_find_range(false);
+        visit_conservative_roots(mark_object);
+        visit_precise_roots(mark_ref);
+
+        // minor gc 后新生代中剩余的对象
+        young_walk(g_heap, scan_young_object);
+
+        g_concurrent_marking = true;
+        started = true;
+    }
+
+    end_pause(self);
+    pthread_mutex_unlock(&gc_mutex);
+    return started;
+}
+
+// 返回 false 表示本次标记已被放弃
+static bool concurrent_mark(Thread *self)
+{
+    Deque *d = &mark_workers[0].deque;
+
+    for (;;) {
+        for (int i = 0; i < CONCURRENT_MARK_STEP; i++) {
+            void *task = deque_pop(d);
+            if (task == NULL)
+                break;
+            scan_task(task);
+        }
+
+        // minor gc 不移动老年代中的对象，deque 中的对象在安全点前后不变
+        safepoint_poll(self);
+        if (cm_aborted)
+            return false;
+
+        if (deque_is_empty(d) && !drain_satb_queue())
+            return true;
+    }
+}
+
+static void remark(Thread *self)
+{
+    enter_safe_region(self);
+    pthread_mutex_lock(&gc_mutex);
+    leave_safe_region(self);
+
+    begin_pause(self);
+
+    if (!cm_aborted) { // 等待 gc_mutex 期间可能发生了 full gc
+        assert(g_concurrent_marking);
+        g_concurrent_marking = false;
+
+        for (int i = 0; i < g_all_threads_count; i++) {
+            Thread *t = g_all_threads[i];
+            for (int j = 0; j < t->satb_len; j++) {
+                mark_object(t->satb_buf[j]);
+            }
+            t->satb_len = 0;
+        }
+        drain_satb_queue();
+
+        visit_precise_roots(mark_ref);
+        parallel_mark();
+
+        sweep_monitors(marked_address); // 新生代中的对象没有被标记
+        string_dedup_sweep(marked_address);
+        marking_old_only = false;
+
+        filter_remset();
+        heap_sweep_begin(g_heap, sizeof_object);
+        full_gc_count++;
+    }
+
+    end_pause(self);
+    pthread_mutex_unlock(&gc_mutex);
+}
+
+static void concurrent_sweep(Thread *self)
+{
+    // 清除期间发生的 full gc 会清除剩余的部分（见 mark_sweep）
+    while (heap_sweep_step(g_heap)) {
+        safepoint_poll(self);
+    }
+    heap_resize(g_heap);
+}
+
+void concurrent_gc_loop()
+{
+    Thread *self = get_current_thread();
+    assert(self != NULL);
+
+    for (;;) {
+        // 等待期间处于安全区域
+        enter_safe_region(self);
+        pthread_mutex_lock(&cm_mutex);
+        while (cm_state != CM_REQUESTED) {
+            pthread_cond_wait(&cm_cond, &cm_mutex);
+        }
+        cm_state = CM_MARKING;
+        pthread_mutex_unlock(&cm_mutex);
+        leave_safe_region(self);
+
+        if (initial_mark(self) && concurrent_mark(self)) {
+            remark(self);
+            concurrent_sweep(self);
+        }
+
+        pthread_mutex_lock(&cm_mutex);
+        cm_state = CM_IDLE;
+        pthread_mutex_unlock(&cm_mutex);
+    }
+}
+
+void gc()
+{
+    collect(true, false, false);
+}
+
+void minor_gc()
+{
+    collect(false, false, false);
+}
+
+void compact_gc()
+{
+    collect(true, true, false);
+}
+
+void last_ditch_gc()
+{
+    collect(true, true, true);
+}
+
+jref get_and_clear_pending_references()
+{
+    pthread_mutex_lock(&pending_mutex);
+    jref list = pending_list;
+    pending_list = pending_tail = NULL;
+    pthread_mutex_unlock(&pending_mutex);
+    return list;
+}
+
+bool has_pending_references()
+{
+    return __atomic_load_n(&pending_list, __ATOMIC_ACQUIRE) != NULL;
+}
+
+void wait_for_pending_references()
+{
+    Thread *self = get_current_thread();
+    assert(self != NULL);
+
+    // 等待期间处于安全区域，gc 可以执行（并放入新的 Reference）
+    enter_safe_region(self);
+    pthread_mutex_lock(&pending_mutex);
+    while (pending_list == NULL) {
+        pthread_cond_wait(&pending_cond, &pending_mutex);
+    }
+    pthread_mutex_unlock(&pending_mutex);
+    leave_safe_region(self);
 }
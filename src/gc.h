@@ -0,0 +1,72 @@
+#ifndef CABIN_GC_H
+#define CABIN_GC_H
+
+#include "cabin.h"
+
+/*
+ * Generational gc.
+ *
+ * minor gc: 复制新生代中存活的对象到老年代（晋升），只被保守扫描到的对象留在新生代原处。
+ * 当新生代无法分配新的 TLAB 时自动调用。
+ *
+ * full gc: 先执行一次 minor gc，再对整个堆执行 stop-the-world mark-sweep，mark 由多个 gc 线程并行执行。
+ * 当老年代无法满足分配请求时自动调用，也可由 System.gc() 调用。
+ * 老年代碎片过多时（见 COMPACT_THRESHOLD），以滑动压缩（mark-compact）代替清除。
+ *
+ * 调用线程必须是已注册的 Java 线程（见 create_thread），否则不执行 gc。
+ */
+void gc();
+void minor_gc();
+
+// 执行一次 full gc，并且一定压缩老年代。
+void compact_gc();
+
+// 执行一次压缩老年代的 full gc，并清除所有的软引用。抛出 OutOfMemoryError 之前最后的尝试。
+void last_ditch_gc();
+
+/*
+ * Reference processing
+ *
+ * full gc 按引用强度处理 java.lang.ref.Reference 对象（见 gc.c），
+ * 被清除的 Reference 以及 referent 要执行 finalize() 的 FinalReference 放入 pending list，
+ * 由 Reference Handler 线程（见 java.lang.ref.Reference）取走并放入各自的 ReferenceQueue.
+ */
+
+// 取走整个 pending list（以 Reference.discovered 链接），为空时返回 NULL
+jref get_and_clear_pending_references();
+bool has_pending_references();
+
+// 阻塞当前线程直到 pending list 不为空
+void wait_for_pending_references();
+
+/*
+ * 老年代（或堆外）对象 @o 中写入了新生代对象的引用，将 @o 记入 remembered set，
+ * minor gc 时 @o 作为根被扫描。由 write barrier 调用（见 object.h）。
+ */
+void remember_object(Object *o);
+
+/*
+ * Concurrent mark
+ *
+ * 老年代占用率超过 CONCURRENT_MARK_THRESHOLD 时，gc 线程（见 init.c）在 mutator 运行的同时标记老年代，
+ * 只在开始（initial mark）和结束（remark）时 stop-the-world.
+ * 标记期间使用 snapshot-at-the-beginning（SATB）write barrier：
+ * 引用被覆盖之前记录其旧值（见 object.h 中的 pre_write_barrier），保证标记开始时可达的对象都被标记。
+ * 标记期间在老年代中分配（包括晋升）的对象直接被标记为存活。
+ * 标记期间如果发生 full gc，本次并发标记被放弃。
+ */
+extern volatile bool g_concurrent_marking;
+
+// 记录被覆盖的引用 @o，由 pre_write_barrier 调用
+void satb_enqueue(Object *o);
+
+// gc 线程的主循环，不返回
+void concurrent_gc_loop();
+
+/*
+ * 固定对象 @o，此后 gc 不会移动它（但不影响 @o 是否存活）。
+ * 地址被 gc 之外的数据结构持有的对象需要固定，比如 JNI 全局引用，class loaders.
+ */
+void pin_object(Object *o);
+
+#endif // CABIN_GC_H
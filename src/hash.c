@@ -42,7 +42,7 @@ static inline Node *node_create(size_t hash, const void *key, void *value)
 #undef POS
 
 #define HASH(_key) (this->key_hash == NULL ? (size_t) (_key) : this->key_hash(_key))
-#define EQUALS(_k1, _k2) (this->key_equals == NULL ? ((_k2) == (_k2)) : this->key_equals(_k1, _k2))
+#define EQUALS(_k1, _k2) (this->key_equals == NULL ? ((_k1) == (_k2)) : this->key_equals(_k1, _k2))
 #define POS(_hash_value) ((_hash_value) % (this)->capacity)
 
 void phm_init(PHM *this, point_hash_func key_hash, point_equal_func key_equals)
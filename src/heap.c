@@ -1,97 +1,773 @@
 #include <assert.h>
 #include <string.h>
 #include "heap.h"
+#include "gc.h"
 #include "cabin.h"
+#include "thread.h"
+#include "sysinfo.h"
 
-typedef struct heap_node Node;
+/*
+ * 空闲块的头部。
+ * 第二个字的最低位总是1（FREE_TAG），便于调试时区分空闲块和对象（对象的第二个字是 clazz 指针）。
+ * 遍历堆使用对象起始地址位图（见 heap.h），不需要读取空闲块。
+ */
+typedef struct free_block {
+    size_t len;
+    uintptr_t tagged_next; // 小块链表中的下一个空闲块 | FREE_TAG
+    // 以下两个字段只有大块使用
+    struct free_block *left;
+    struct free_block *right;
+} FreeBlock;
 
-static Node *create_node(address head, size_t len, Node *next)
+#define FREE_TAG ((uintptr_t) 1)
+
+#define next_block(b) ((FreeBlock *) ((b)->tagged_next & ~FREE_TAG))
+
+#define SMALL_CLASS(len) ((len) / HEAP_ALIGNMENT - 1)
+
+static_assert(SMALL_CLASSES_COUNT <= 64, "small_lists_bitmap");
+static_assert(sizeof(FreeBlock) <= SMALL_BLOCK_MAX, "large block");
+
+/* Treap of large blocks. 优先级由地址散列得到，不用保存 */
+
+static inline uintptr_t priority(FreeBlock *b)
+{
+    return ((uintptr_t) b >> 4) * 0x9E3779B97F4A7C15ULL;
+}
+
+static inline bool block_less(FreeBlock *a, FreeBlock *b)
+{
+    return a->len < b->len || (a->len == b->len && a < b);
+}
+
+static FreeBlock *rotate_left(FreeBlock *root)
+{
+    FreeBlock *r = root->right;
+    root->right = r->left;
+    r->left = root;
+    return r;
+}
+
+static FreeBlock *rotate_right(FreeBlock *root)
+{
+    FreeBlock *l = root->left;
+    root->left = l->right;
+    l->right = root;
+    return l;
+}
+
+static FreeBlock *tree_insert(FreeBlock *root, FreeBlock *b)
+{
+    if (root == NULL) {
+        b->left = b->right = NULL;
+        return b;
+    }
+
+    if (block_less(b, root)) {
+        root->left = tree_insert(root->left, b);
+        if (priority(root->left) > priority(root))
+            root = rotate_right(root);
+    } else {
+        root->right = tree_insert(root->right, b);
+        if (priority(root->right) > priority(root))
+            root = rotate_left(root);
+    }
+    return root;
+}
+
+// @b must be in the tree
+static FreeBlock *tree_remove(FreeBlock *root, FreeBlock *b)
+{
+    assert(root != NULL);
+
+    if (root == b) {
+        if (root->left == NULL)
+            return root->right;
+        if (root->right == NULL)
+            return root->left;
+        // 将 b 旋转到叶子上再删除
+        if (priority(root->left) > priority(root->right)) {
+            root = rotate_right(root);
+            root->right = tree_remove(root->right, b);
+        } else {
+            root = rotate_left(root);
+            root->left = tree_remove(root->left, b);
+        }
+        return root;
+    }
+
+    if (block_less(b, root))
+        root->left = tree_remove(root->left, b);
+    else
+        root->right = tree_remove(root->right, b);
+    return root;
+}
+
+// 最小的不小于 len 的空闲块，没有返回 NULL
+static FreeBlock *tree_best_fit(FreeBlock *root, size_t len)
+{
+    FreeBlock *best = NULL;
+    while (root != NULL) {
+        if (root->len >= len) {
+            best = root;
+            root = root->left;
+        } else {
+            root = root->right;
+        }
+    }
+    return best;
+}
+
+/* Free blocks */
+
+static inline void format_free_block(address p, size_t len, FreeBlock *next)
+{
+    assert(len > 0 && len % HEAP_ALIGNMENT == 0);
+    FreeBlock *b = (FreeBlock *) p;
+    b->len = len;
+    b->tagged_next = (uintptr_t) next | FREE_TAG;
+}
+
+// 将老年代中的 [p, p+len) 记为空闲块，调用者持有 heap 锁
+static void add_free_block(Heap *heap, address p, size_t len)
+{
+    assert(is_in_old(heap, p));
+
+    FreeBlock *b = (FreeBlock *) p;
+    if (len <= SMALL_BLOCK_MAX) {
+        size_t i = SMALL_CLASS(len);
+        format_free_block(p, len, heap->small_lists[i]);
+        heap->small_lists[i] = b;
+        heap->small_lists_bitmap |= 1ULL << i;
+    } else {
+        format_free_block(p, len, NULL);
+        heap->large_tree = tree_insert(heap->large_tree, b);
+    }
+    heap->free_bytes += len;
+    if (p + len == heap->mem + heap->size)
+        heap->tail = b;
+}
+
+static FreeBlock *pop_small_block(Heap *heap, size_t i)
+{
+    FreeBlock *b = heap->small_lists[i];
+    assert(b != NULL);
+    heap->small_lists[i] = next_block(b);
+    if (heap->small_lists[i] == NULL)
+        heap->small_lists_bitmap &= ~(1ULL << i);
+    return b;
+}
+
+// 从空闲链表中移除 @b，调用者持有 heap 锁
+static void remove_free_block(Heap *heap, FreeBlock *b)
 {
-    Node *n = vm_malloc(sizeof(Node));
-    n->head = head;
-    n->len = len;
-    n->next = next;
-    return n;
+    if (b->len <= SMALL_BLOCK_MAX) {
+        size_t i = SMALL_CLASS(b->len);
+        if (heap->small_lists[i] == b) {
+            pop_small_block(heap, i);
+        } else {
+            FreeBlock *prev = heap->small_lists[i];
+            while (next_block(prev) != b)
+                prev = next_block(prev);
+            prev->tagged_next = b->tagged_next;
+        }
+    } else {
+        heap->large_tree = tree_remove(heap->large_tree, b);
+    }
+
+    heap->free_bytes -= b->len;
+    if (heap->tail == b)
+        heap->tail = NULL;
 }
 
-Heap *create_heap()
+static void clear_free_blocks(Heap *heap)
 {
+    memset(heap->small_lists, 0, sizeof(heap->small_lists));
+    heap->small_lists_bitmap = 0;
+    heap->large_tree = NULL;
+    heap->free_bytes = 0;
+    heap->tail = NULL;
+}
+
+#define align_up(n, a) (((n) + (a) - 1) / (a) * (a))
+
+address g_narrow_oop_base;
+
+// 堆中 @offset 处对应位图中的字节偏移，HEAP_COMMIT_GRANULARITY 对应的位图大小是页的整数倍
+#define BITMAP_OFFSET(offset) ((offset) / HEAP_ALIGNMENT / 8)
+
+// 提交堆中 [offset, offset+len) 对应的位图
+static bool commit_bitmaps(Heap *heap, size_t offset, size_t len)
+{
+    return os_commit_memory((u1 *) heap->starts + BITMAP_OFFSET(offset), BITMAP_OFFSET(len))
+            && os_commit_memory((u1 *) heap->marks + BITMAP_OFFSET(offset), BITMAP_OFFSET(len));
+}
+
+static void uncommit_bitmaps(Heap *heap, size_t offset, size_t len)
+{
+    os_uncommit_memory((u1 *) heap->starts + BITMAP_OFFSET(offset), BITMAP_OFFSET(len));
+    os_uncommit_memory((u1 *) heap->marks + BITMAP_OFFSET(offset), BITMAP_OFFSET(len));
+}
+
+static Heap *create_epsilon_heap(size_t init_size, size_t max_size)
+{
+    Heap *h = vm_calloc(sizeof(Heap));
+
+    h->mem = (address) os_reserve_memory(heap_reserved_size(max_size));
+    if (h->mem == 0) {
+        free(h);
+        return NULL;
+    }
+    if (!os_commit_memory((void *) h->mem, init_size)) {
+        os_release_memory((void *) h->mem, heap_reserved_size(max_size));
+        free(h);
+        return NULL;
+    }
+
+    assert(h->mem % HEAP_ALIGNMENT == 0);
+    h->size = init_size;
+    h->init_size = init_size;
+    h->max_size = max_size;
+    h->old = h->mem; // 没有新生代
+    h->young_top = h->young_end = h->mem;
+    clear_free_blocks(h);
+
+    h->epsilon = true;
+    h->epsilon_top = h->mem;
+
+    // 不使用大对象空间，但保留其地址空间，使永久区的位置不变
+    h->los_mem = h->mem + max_size;
+    h->perm_mem = h->los_mem + max_size;
+    h->perm_top = h->perm_end = h->perm_mem;
+
+    g_narrow_oop_base = h->mem - HEAP_ALIGNMENT;
+
+    pthread_mutex_init(&h->mutex, &g_pthread_mutexattr_recursive);
+
+    return h;
+}
+
+Heap *create_heap(size_t init_size, size_t max_size, bool epsilon)
+{
+    max_size = align_up(max_size, HEAP_COMMIT_GRANULARITY);
+    size_t young_size = VM_YOUNG_SIZE;
+    if (young_size > max_size/4)
+        young_size = align_up(max_size/4, HEAP_COMMIT_GRANULARITY);
+    init_size = align_up(init_size, HEAP_COMMIT_GRANULARITY);
+    if (!epsilon && init_size < young_size + HEAP_COMMIT_GRANULARITY)
+        init_size = young_size + HEAP_COMMIT_GRANULARITY;
+    if (init_size > max_size)
+        return NULL;
+
+#ifdef COMPRESSED_OOPS
+    if (heap_reserved_size(max_size) > NARROW_OOP_RANGE)
+        return NULL;
+#endif
+
+    if (epsilon)
+        return create_epsilon_heap(init_size, max_size);
+
     Heap *h = vm_malloc(sizeof(Heap));
 
-    h->size = VM_HEAP_SIZE;
-    h->mem = (address) vm_malloc(h->size);
-    h->freelist = create_node(h->mem, h->size, NULL);
-    
+    h->mem = (address) os_reserve_memory(heap_reserved_size(max_size));
+    if (h->mem == 0) {
+        free(h);
+        return NULL;
+    }
+    h->starts = os_reserve_memory(BITMAP_OFFSET(max_size));
+    h->marks = os_reserve_memory(BITMAP_OFFSET(max_size));
+    if (h->starts == NULL || h->marks == NULL
+                || !os_commit_memory((void *) h->mem, init_size) || !commit_bitmaps(h, 0, init_size)) {
+        if (h->starts != NULL)
+            os_release_memory(h->starts, BITMAP_OFFSET(max_size));
+        if (h->marks != NULL)
+            os_release_memory(h->marks, BITMAP_OFFSET(max_size));
+        os_release_memory((void *) h->mem, heap_reserved_size(max_size));
+        free(h);
+        return NULL;
+    }
+
+    assert(h->mem % HEAP_ALIGNMENT == 0);
+    h->size = init_size;
+    h->init_size = init_size;
+    h->max_size = max_size;
+    h->old = h->mem + young_size;
+
+    // 整个新生代是一个 hole
+    h->young_top = h->mem;
+    h->young_end = h->old;
+    h->next_hole = NULL;
+    h->young_free_bytes = young_size;
+
+    clear_free_blocks(h);
+    add_free_block(h, h->old, h->size - young_size);
+
+    h->los_mem = h->mem + max_size;
+    h->large_objects = NULL;
+    h->los_bytes = 0;
+
+    h->perm_mem = h->los_mem + max_size;
+    h->perm_top = h->perm_end = h->perm_mem;
+
+    h->epsilon = false;
+    h->epsilon_top = 0;
+
+    h->sweep_top = h->sweep_end = h->sweep_free_start = 0;
+    h->sweep_size = NULL;
+    h->los_sweep_pending = false;
+
+    g_narrow_oop_base = h->mem - HEAP_ALIGNMENT;
+
     pthread_mutex_init(&h->mutex, &g_pthread_mutexattr_recursive);
 
     return h;
 }
 
 void destroy_heap(Heap *heap)
-{    
-    for (Node *p = heap->freelist; p != NULL;) {
-        Node *t = p->next;
-        free(p);
-        p = t;
+{
+    if (!heap->epsilon) {
+        os_release_memory(heap->starts, BITMAP_OFFSET(heap->max_size));
+        os_release_memory(heap->marks, BITMAP_OFFSET(heap->max_size));
+    }
+    os_release_memory((void *) heap->mem, heap_reserved_size(heap->max_size));
+    free(heap);
+}
+
+/*
+ * 老年代扩张至少 @bytes 字节，调用者持有 heap 锁。
+ * 新提交的内存和末尾的空闲块合并。
+ */
+static bool heap_expand(Heap *heap, size_t bytes)
+{
+    bytes = align_up(bytes, HEAP_COMMIT_GRANULARITY);
+    if (bytes > heap->max_size - heap->size - heap->los_bytes)
+        return false;
+
+    address end = heap->mem + heap->size;
+    if (!os_commit_memory((void *) end, bytes))
+        return false;
+    if (!commit_bitmaps(heap, heap->size, bytes)) {
+        os_uncommit_memory((void *) end, bytes);
+        return false;
     }
 
-    free((void *) heap->mem);
+    address p = end;
+    size_t len = bytes;
+    FreeBlock *tail = heap->tail;
+    if (tail != NULL) {
+        remove_free_block(heap, tail);
+        p = (address) tail;
+        len += tail->len;
+    }
+
+    heap->size += bytes;
+    add_free_block(heap, p, len);
+    return true;
 }
 
-#define IS_IN(heap, p) (heap->mem <= p && p < heap->mem + heap->size)
+/*
+ * 老年代末尾的空闲内存还给操作系统，至多 @bytes 字节，调用者持有 heap 锁。
+ */
+static void heap_shrink(Heap *heap, size_t bytes)
+{
+    FreeBlock *tail = heap->tail;
+    if (tail == NULL)
+        return;
 
-address jump_freelist(Heap *heap, address p)
+    if (bytes > tail->len)
+        bytes = tail->len;
+    if (bytes > heap->size - heap->init_size)
+        bytes = heap->size - heap->init_size;
+    bytes = bytes / HEAP_COMMIT_GRANULARITY * HEAP_COMMIT_GRANULARITY;
+    if (bytes == 0)
+        return;
+
+    address p = (address) tail;
+    size_t len = tail->len - bytes;
+    remove_free_block(heap, tail);
+
+    heap->size -= bytes;
+    os_uncommit_memory((void *) (heap->mem + heap->size), bytes);
+    uncommit_bitmaps(heap, heap->size, bytes); // 空闲内存对应的位都是0
+    if (len > 0)
+        add_free_block(heap, p, len);
+}
+
+void heap_resize(Heap *heap)
 {
     assert(heap != NULL);
-    assert(IS_IN(heap, p));
+    lock_heap(heap);
+
+    size_t committed = heap->mem + heap->size - heap->old;
+    size_t used = committed - heap->free_bytes;
+    double free_ratio = (double) heap->free_bytes / committed;
 
-    Node *curr = heap->freelist;
-    for (; curr != NULL; curr = curr->next) {
-        if (p < curr->head)
-            return p; // p is not in freelist
-        address offset = p - curr->head;
-        if (0 <= offset && offset <= curr->len) {
-            // p is in freelist, jump
-            return p + curr->len;
+    if (free_ratio < HEAP_MIN_FREE_RATIO) {
+        size_t desired = (size_t) (used / (1 - HEAP_MIN_FREE_RATIO));
+        size_t bytes = desired - committed;
+        if (bytes > heap->max_size - heap->size - heap->los_bytes)
+            bytes = heap->max_size - heap->size - heap->los_bytes;
+        if (bytes > 0)
+            heap_expand(heap, bytes);
+    } else if (free_ratio > HEAP_MAX_FREE_RATIO) {
+        size_t desired = (size_t) (used / (1 - HEAP_MAX_FREE_RATIO));
+        heap_shrink(heap, committed - desired);
+    }
+
+    unlock_heap(heap);
+}
+
+static void *heap_malloc0(Heap *heap, size_t len)
+{
+    assert(heap != NULL);
+    assert(len > 0 && len % HEAP_ALIGNMENT == 0);
+    lock_heap(heap);
+
+    FreeBlock *b = NULL;
+    if (len <= SMALL_BLOCK_MAX) {
+        // 大小恰好合适的或者更大的小块
+        size_t i = SMALL_CLASS(len);
+        uint64_t bits = heap->small_lists_bitmap & (~0ULL << i);
+        if (bits != 0) {
+            b = pop_small_block(heap, __builtin_ctzll(bits));
+        }
+    }
+
+    if (b == NULL) {
+        b = tree_best_fit(heap->large_tree, len);
+        if (b == NULL) {
+            unlock_heap(heap);
+            return NULL;
         }
+        heap->large_tree = tree_remove(heap->large_tree, b);
     }
 
-    return p; // p is not in freelist
+    if (b == heap->tail)
+        heap->tail = NULL; // 如果有剩余部分，add_free_block 会重新设置
+
+    size_t block_len = b->len;
+    assert(block_len >= len);
+    heap->free_bytes -= block_len;
+    if (block_len > len) {
+        // 剩余部分放回空闲链表
+        add_free_block(heap, (address) b + len, block_len - len);
+    }
+
+    heap_set_start(heap, b);
+    unlock_heap(heap);
+    return b;
 }
 
-void *heap_malloc(Heap *heap, size_t len)
+void *heap_try_malloc(Heap *heap, size_t len)
 {
     assert(heap != NULL);
+    len = heap_align(len);
+
+    void *p = heap_malloc0(heap, len);
+    // 并发清除还没有完成时，先清除一块再试（见 heap_sweep_begin）
+    while (p == NULL && heap_sweep_step(heap))
+        p = heap_malloc0(heap, len);
+    return p;
+}
+
+void *young_malloc(Heap *heap, size_t min_len, size_t max_len, size_t *len)
+{
+    assert(heap != NULL && len != NULL);
+    assert(0 < min_len && min_len <= max_len);
+    min_len = heap_align(min_len);
+    max_len = heap_align(max_len);
+
     lock_heap(heap);
 
-    void *p = NULL;
-    Node *prev = NULL;
-    Node *curr = heap->freelist;
-    for (; curr != NULL; prev = curr, curr = curr->next) {
-        if (curr->len == len) {
-            if (prev != NULL) {
-                prev->next = curr->next;
-            } else {
-                assert(curr == heap->freelist);
-                heap->freelist = curr->next;
-            }
-            p = (void *) curr->head;
-            free(curr);
+    while (heap->young_end - heap->young_top < min_len) {
+        // 当前 hole 剩余的部分太小（已经是格式化的空闲块），留到下次 minor gc 再回收
+        heap->young_free_bytes -= heap->young_end - heap->young_top;
+        FreeBlock *h = heap->next_hole;
+        if (h == NULL) {
+            heap->young_top = heap->young_end;
+            unlock_heap(heap);
+            return NULL;
+        }
+        heap->young_top = (address) h;
+        heap->young_end = (address) h + h->len;
+        heap->next_hole = next_block(h);
+    }
+
+    address p = heap->young_top;
+    size_t n = heap->young_end - p;
+    if (n > max_len)
+        n = max_len;
+    heap->young_top += n;
+    heap->young_free_bytes -= n;
+
+    unlock_heap(heap);
+
+    memset((void *) p, 0, n);
+    *len = n;
+    return (void *) p;
+}
+
+/* Permanent space */
+
+void *perm_malloc(Heap *heap, size_t len)
+{
+    len = heap_align(len);
+
+    lock_heap(heap);
+    address p = heap->perm_top;
+    if (len > heap->perm_mem + PERM_SPACE_SIZE - p) {
+        unlock_heap(heap);
+        return NULL;
+    }
+
+    if (p + len > heap->perm_end) {
+        // 新提交的内存由操作系统清零
+        size_t bytes = align_up(p + len - heap->perm_end, HEAP_COMMIT_GRANULARITY);
+        if (!os_commit_memory((void *) heap->perm_end, bytes)) {
+            unlock_heap(heap);
+            return NULL;
+        }
+        heap->perm_end += bytes;
+    }
+
+    heap->perm_top = p + len;
+    unlock_heap(heap);
+    return (void *) p;
+}
+
+/* Large object space */
+
+// 在大对象空间中分配，失败返回 NULL
+static void *los_malloc0(Heap *heap, size_t len)
+{
+    size_t region_len = align_up(LARGE_OBJECT_HEADER_SIZE + len, (size_t) page_size());
+
+    lock_heap(heap);
+    if (region_len > heap->max_size - heap->size - heap->los_bytes) {
+        unlock_heap(heap);
+        return NULL;
+    }
+
+    // first fit，找到第一个足够大的空隙
+    address p = heap->los_mem;
+    LargeObject **prev = &heap->large_objects;
+    for (; *prev != NULL; prev = &(*prev)->next) {
+        if ((address) *prev - p >= region_len)
+            break;
+        p = (address) *prev + (*prev)->region_len;
+    }
+    if (*prev == NULL && heap->los_mem + heap->max_size - p < region_len) {
+        unlock_heap(heap);
+        return NULL;
+    }
+
+    if (!os_commit_memory((void *) p, region_len)) {
+        unlock_heap(heap);
+        return NULL;
+    }
+
+    LargeObject *lo = (LargeObject *) p;
+    lo->len = len;
+    lo->region_len = region_len;
+    lo->marked = heap->los_sweep_pending; // 并发清除之前分配的大对象不能被清除
+    lo->next = *prev;
+    *prev = lo;
+    heap->los_bytes += region_len;
+
+    unlock_heap(heap);
+    return (void *) (p + LARGE_OBJECT_HEADER_SIZE);
+}
+
+static void *los_malloc(Heap *heap, size_t len)
+{
+    void *p = los_malloc0(heap, len);
+    if (p == NULL) {
+        gc();
+        p = los_malloc0(heap, len);
+    }
+    if (p == NULL) {
+        // 清除所有的软引用后再试一次
+        last_ditch_gc();
+        p = los_malloc0(heap, len);
+    }
+
+    if (p != NULL)
+        return p; // 新提交的内存已清零
+
+//    throw "java_lang_OutOfMemoryError";
+    JVM_PANIC("java_lang_OutOfMemoryError");
+}
+
+address los_find(Heap *heap, address p)
+{
+    assert(heap != NULL);
+    if (!is_in_los(heap, p))
+        return 0;
+
+    address o = 0;
+    lock_heap(heap);
+    for (LargeObject *lo = heap->large_objects; lo != NULL && (address) lo <= p; lo = lo->next) {
+        address start = (address) lo + LARGE_OBJECT_HEADER_SIZE;
+        if (start <= p && p < start + lo->len) {
+            o = start;
+            break;
+        }
+    }
+    unlock_heap(heap);
+    return o;
+}
+
+void los_walk_marked(Heap *heap, void (* visit)(address p))
+{
+    assert(heap != NULL && visit != NULL);
+    lock_heap(heap);
+    for (LargeObject *lo = heap->large_objects; lo != NULL; lo = lo->next) {
+        if (lo->marked)
+            visit((address) lo + LARGE_OBJECT_HEADER_SIZE);
+    }
+    unlock_heap(heap);
+}
+
+void los_sweep(Heap *heap, void (* dead)(address p))
+{
+    assert(heap != NULL);
+    lock_heap(heap);
 
-            goto over;
+    LargeObject **prev = &heap->large_objects;
+    while (*prev != NULL) {
+        LargeObject *lo = *prev;
+        if (lo->marked) {
+            lo->marked = false;
+            prev = &lo->next;
+            continue;
         }
 
-        if (curr->len > len) {
-            p = (void *) (curr->head);
-            curr->head += len;
-            curr->len -= len;
+        if (dead != NULL)
+            dead((address) lo + LARGE_OBJECT_HEADER_SIZE);
+        *prev = lo->next;
+        heap->los_bytes -= lo->region_len;
+        os_uncommit_memory(lo, lo->region_len);
+    }
+    heap->los_sweep_pending = false;
+
+    unlock_heap(heap);
+}
 
-            goto over;
+void los_clear_marks(Heap *heap)
+{
+    assert(heap != NULL);
+    lock_heap(heap);
+    for (LargeObject *lo = heap->large_objects; lo != NULL; lo = lo->next) {
+        lo->marked = false;
+    }
+    unlock_heap(heap);
+}
+
+/* Epsilon */
+
+static void epsilon_out_of_memory(Heap *heap, size_t len)
+{
+    fprintf(stderr, "Terminating due to java.lang.OutOfMemoryError: Java heap space "
+                    "(epsilon heap of %zu bytes exhausted, requested %zu bytes)\n", heap->max_size, len);
+    exit(1);
+}
+
+// 确保 [p, p+len) 已经提交
+static void epsilon_commit(Heap *heap, address p, size_t len)
+{
+    if (p + len > heap->mem + __atomic_load_n(&heap->size, __ATOMIC_ACQUIRE)) {
+        lock_heap(heap);
+        if (p + len > heap->mem + heap->size) {
+            size_t bytes = align_up(p + len - (heap->mem + heap->size), HEAP_COMMIT_GRANULARITY);
+            if (bytes > heap->max_size - heap->size)
+                bytes = heap->max_size - heap->size;
+            if (!os_commit_memory((void *) (heap->mem + heap->size), bytes)) {
+                unlock_heap(heap);
+                epsilon_out_of_memory(heap, len);
+            }
+            __atomic_store_n(&heap->size, heap->size + bytes, __ATOMIC_RELEASE);
         }
+        unlock_heap(heap);
     }
+}
 
-over:
-    unlock_heap(g_heap);
+// 申请的内存已清零（新提交的内存由操作系统清零，并且不会被重复使用）
+static void *epsilon_malloc(Heap *heap, size_t len)
+{
+    assert(len > 0 && len % HEAP_ALIGNMENT == 0);
+
+    address p = __atomic_fetch_add(&heap->epsilon_top, len, __ATOMIC_RELAXED);
+    address end = heap->mem + heap->max_size;
+    if (p > end || len > end - p)
+        epsilon_out_of_memory(heap, len); // 失败后 epsilon_top 越过了 end，之后的申请都失败
+
+    epsilon_commit(heap, p, len);
+    return (void *) p;
+}
+
+/*
+ * 为 TLAB 申请一块内存，堆中剩余的空间不足 TLAB_SIZE 时只申请剩余的部分，
+ * 至少申请 len 字节。大小存入 *size。
+ */
+static void *epsilon_malloc_tlab(Heap *heap, size_t len, size_t *size)
+{
+    address end = heap->mem + heap->max_size;
+    address p = __atomic_load_n(&heap->epsilon_top, __ATOMIC_RELAXED);
+    size_t n;
+    do {
+        if (p > end || len > end - p)
+            return epsilon_malloc(heap, len); // 必定失败
+        n = end - p < TLAB_SIZE ? end - p : TLAB_SIZE;
+    } while (!__atomic_compare_exchange_n(&heap->epsilon_top, &p, p + n,
+                                          true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    epsilon_commit(heap, p, n);
+    *size = n;
+    return (void *) p;
+}
+
+void *heap_malloc(Heap *heap, size_t len)
+{
+    assert(heap != NULL);
+    len = heap_align(len);
+
+    if (heap->epsilon)
+        return epsilon_malloc(heap, len);
+
+    Thread *thrd = get_current_thread();
+    if (thrd != NULL)
+        safepoint_poll(thrd);
+
+    if (len >= LARGE_OBJECT_SIZE)
+        return los_malloc(heap, len);
+
+    void *p = heap_malloc0(heap, len);
+    while (p == NULL && heap_sweep_step(heap)) {
+        // 并发清除还没有完成，先清除一块再试（见 heap_sweep_begin）
+        if (thrd != NULL)
+            safepoint_poll(thrd);
+        p = heap_malloc0(heap, len);
+    }
+    if (p == NULL) {
+        gc();
+        p = heap_malloc0(heap, len);
+    }
+    if (p == NULL) {
+        lock_heap(heap);
+        if (heap_expand(heap, len))
+            p = heap_malloc0(heap, len);
+        unlock_heap(heap);
+    }
+    if (p == NULL && heap->free_bytes >= len) {
+        // 空闲空间足够，只是没有足够大的连续空间
+        compact_gc();
+        p = heap_malloc0(heap, len);
+    }
+    if (p == NULL) {
+        // 清除所有的软引用后再试一次
+        last_ditch_gc();
+        p = heap_malloc0(heap, len);
+    }
 
     if (p != NULL) {
         memset(p, 0, len);
@@ -99,89 +775,423 @@ over:
     }
 
 //    throw "java_lang_OutOfMemoryError";
-    JVM_PANIC("java_lang_OutOfMemoryError"); // todo 堆可以扩张
+    JVM_PANIC("java_lang_OutOfMemoryError");
+}
+
+void *tlab_alloc_slow(Heap *heap, TLAB *tlab, size_t len)
+{
+    assert(heap != NULL && tlab != NULL);
+
+    if (heap->epsilon) {
+        // TLAB 剩余的部分直接丢弃
+        if (len > TLAB_SIZE/4)
+            return epsilon_malloc(heap, len);
+        size_t n;
+        u1 *p = epsilon_malloc_tlab(heap, len, &n);
+        tlab->top = (address) (p + len);
+        tlab->end = (address) (p + n);
+        return p;
+    }
+
+    if (len > TLAB_SIZE/4) {
+        // 大对象直接在老年代中分配，不浪费 TLAB 的剩余空间，也避免在 minor gc 时复制
+        return heap_malloc(heap, len);
+    }
+
+    Thread *thrd = get_current_thread();
+    if (thrd != NULL)
+        safepoint_poll(thrd);
+
+    tlab_retire(heap, tlab);
+
+    size_t n;
+    u1 *p = young_malloc(heap, len, TLAB_SIZE, &n);
+    if (p == NULL) {
+        minor_gc();
+        p = young_malloc(heap, len, TLAB_SIZE, &n);
+    }
+    if (p == NULL) {
+        // 新生代被固定的对象占满了，退化为直接在老年代中分配（必要时执行 gc）
+        return heap_malloc(heap, len);
+    }
+
+    tlab->top = (address) (p + len);
+    tlab->end = (address) (p + n);
+    heap_set_start(heap, p);
+    return p;
+}
+
+void tlab_retire(Heap *heap, TLAB *tlab)
+{
+    assert(heap != NULL && tlab != NULL);
+
+    if (!heap->epsilon && tlab->top < tlab->end) {
+        heap_free(heap, tlab->top, tlab->end - tlab->top);
+    }
+    tlab->top = tlab->end = 0;
 }
 
 void heap_free(Heap *heap, address p, size_t len)
-{    
+{
     assert(heap != NULL);
-    assert(IS_IN(heap, p));
+    assert(is_in_heap(heap, p));
+    len = heap_align(len);
+
+    heap_clear_start(heap, p);
+    // 新生代中的空闲内存没有对象起始地址位，下次 minor gc 时自然合并到 holes 中
+    if (is_in_young(heap, p))
+        return;
+
+    lock_heap(heap);
+    // 还没有被并发清除的部分，清除时会被当作空闲内存
+    if (heap->sweep_top == 0 || p < heap->sweep_top)
+        add_free_block(heap, p, len);
+    unlock_heap(heap);
+}
+
+size_t heap_free_memory(Heap *heap)
+{
+    assert(heap != NULL);
+    if (heap->epsilon) {
+        address top = __atomic_load_n(&heap->epsilon_top, __ATOMIC_RELAXED);
+        address end = heap->mem + heap->size;
+        return top < end ? end - top : 0;
+    }
+    return heap->free_bytes + heap->young_free_bytes;
+}
+
+size_t heap_largest_free_block(Heap *heap)
+{
+    assert(heap != NULL);
+    lock_heap(heap);
+
+    size_t len = 0;
+    FreeBlock *b = heap->large_tree;
+    if (b != NULL) {
+        while (b->right != NULL)
+            b = b->right;
+        len = b->len;
+    } else if (heap->small_lists_bitmap != 0) {
+        len = (64 - __builtin_clzll(heap->small_lists_bitmap)) * HEAP_ALIGNMENT;
+    }
+
+    unlock_heap(heap);
+    return len;
+}
+
+static void print_tree(FreeBlock *root)
+{
+    if (root != NULL) {
+        print_tree(root->left);
+        printf("%p,%zu|", (void *) root, root->len);
+        print_tree(root->right);
+    }
+}
+
+void print_heap_info(Heap *heap)
+{
+    assert(heap != NULL);
+
+    lock_heap(heap);
+
+    printf("young free bytes: %zu\n", heap->young_free_bytes);
+    printf("old free bytes: %zu\n", heap->free_bytes);
+    printf("large object space bytes: %zu\n", heap->los_bytes);
+    for (int i = 0; i < SMALL_CLASSES_COUNT; i++) {
+        size_t count = 0;
+        for (FreeBlock *b = heap->small_lists[i]; b != NULL; b = next_block(b))
+            count++;
+        if (count > 0)
+            printf("small blocks(%d): %zu\n", (i + 1)*HEAP_ALIGNMENT, count);
+    }
+
+    printf("large blocks: \n|");
+    print_tree(heap->large_tree);
+    printf("\n");
+
+    unlock_heap(heap);
+}
 
+#define bit_address(heap, word, bit) ((heap)->mem + ((word)*64 + (bit)) * HEAP_ALIGNMENT)
+
+// [from, to) 在位图中对应的字的范围，区域的边界总是按64位对齐（新生代和老年代的边界按 1MB 对齐）
+#define WORD_RANGE(heap, from, to, first, last) \
+    assert(heap_bit_index(heap, from) % 64 == 0 && heap_bit_index(heap, to) % 64 == 0); \
+    size_t first = heap_bit_index(heap, from) / 64; \
+    size_t last = heap_bit_index(heap, to) / 64
+
+/*
+ * 遍历 [from, to) 中的对象，@marked_only 为 true 时只遍历被标记的对象。
+ * 调用者持有 heap 锁。
+ */
+static void walk_range(Heap *heap, address from, address to, bool marked_only, void (* visit)(address p))
+{
+    WORD_RANGE(heap, from, to, first, last);
+    for (size_t w = first; w < last; w++) {
+        uint64_t bits = heap->starts[w];
+        if (marked_only)
+            bits &= heap->marks[w];
+        for (; bits != 0; bits &= bits - 1) {
+            visit(bit_address(heap, w, __builtin_ctzll(bits)));
+        }
+    }
+}
+
+void heap_walk(Heap *heap, void (* visit)(address p))
+{
+    assert(heap != NULL && visit != NULL);
+    lock_heap(heap);
+    walk_range(heap, heap->mem, heap->mem + heap->size, false, visit);
+    unlock_heap(heap);
+}
+
+void young_walk(Heap *heap, void (* visit)(address p))
+{
+    assert(heap != NULL && visit != NULL);
     lock_heap(heap);
+    walk_range(heap, heap->mem, heap->old, false, visit);
+    unlock_heap(heap);
+}
+
+void old_walk(Heap *heap, void (* visit)(address p))
+{
+    assert(heap != NULL && visit != NULL);
+    lock_heap(heap);
+    walk_range(heap, heap->old, heap->mem + heap->size, false, visit);
+    unlock_heap(heap);
+}
 
-    Node *prev = NULL;
-    Node *curr = heap->freelist;
-    for (; curr != NULL; prev = curr, curr = curr->next) {
-        if (p > curr->head)
+void young_walk_marked(Heap *heap, void (* visit)(address p))
+{
+    assert(heap != NULL && visit != NULL);
+    lock_heap(heap);
+    walk_range(heap, heap->mem, heap->old, true, visit);
+    unlock_heap(heap);
+}
+
+void old_walk_marked(Heap *heap, void (* visit)(address p))
+{
+    assert(heap != NULL && visit != NULL);
+    lock_heap(heap);
+    walk_range(heap, heap->old, heap->mem + heap->size, true, visit);
+    unlock_heap(heap);
+}
+
+// 清零 [from, to) 对应的标记位图
+static void clear_marks(Heap *heap, address from, address to)
+{
+    WORD_RANGE(heap, from, to, first, last);
+    memset(heap->marks + first, 0, (last - first) * sizeof(*heap->marks));
+}
+
+void heap_slide(Heap *heap, size_t (* visit)(address p, address *to), void (* dead)(address p))
+{
+    assert(heap != NULL && visit != NULL);
+    lock_heap(heap);
+
+    clear_free_blocks(heap);
+
+    // 只会写入 free_ptr 之下的内存，新的起始地址位也只会写入已经处理过的字
+    address free_ptr = heap->old;
+    const address end = heap->mem + heap->size;
+
+    WORD_RANGE(heap, heap->old, end, first, last);
+    for (size_t w = first; w < last; w++) {
+        uint64_t all = heap->starts[w];
+        if (all == 0)
             continue;
 
-        assert(p + len <= curr->head);
-        if (prev == NULL) {
-            assert(curr == heap->freelist);
-            if (p + len == curr->head) { // 空间右连续
-                curr->head = p;
-                curr->len += len;
-                goto over;
-            } else { // 右不连续
-                heap->freelist = create_node(p, len, curr);
-                goto over;
-            }
+        uint64_t live = all & heap->marks[w];
+        if (dead != NULL) {
+            for (uint64_t d = all & ~live; d != 0; d &= d - 1)
+                dead(bit_address(heap, w, __builtin_ctzll(d)));
         }
+        heap->starts[w] = 0;
 
-        assert(prev != NULL);
-        assert(prev->head + prev->len <= p);
-        if (prev->head + prev->len == p) {
-            if (p + len == curr->head) {
-                // 左右都连续
-                prev->len += (len + curr->len);
-                prev->next = curr->next;
-                free(curr);
-                goto over;
-            } else {
-                // 左连续，右不连续
-                prev->len += len;
-                goto over;
-            }
-        } else {
-            if (p + len == curr->head) {
-                // 左不连续，右连续
-                curr->len += len;
-                curr->head = p;
-                goto over;
-            } else {
-                // 左右都不连续
-                prev->next = create_node(p, len, curr);
-                goto over;
+        for (; live != 0; live &= live - 1) {
+            address p = bit_address(heap, w, __builtin_ctzll(live));
+            address to = 0;
+            size_t len = heap_align(visit(p, &to));
+            assert(len > 0);
+            assert(free_ptr <= to && to <= p);
+            if (free_ptr < to) {
+                // 无法移动的对象之前的空隙
+                add_free_block(heap, free_ptr, to - free_ptr);
             }
+            if (to != p)
+                memmove((void *) to, (void *) p, len);
+            heap->starts[heap_bit_index(heap, to) / 64] |= 1ULL << (heap_bit_index(heap, to) % 64);
+            free_ptr = to + len;
         }
     }
 
-over:
-    unlock_heap(g_heap);
+    if (free_ptr < end)
+        add_free_block(heap, free_ptr, end - free_ptr);
+    clear_marks(heap, heap->old, end);
+
+    unlock_heap(heap);
 }
 
-size_t heap_free_memory(Heap *heap)
+/*
+ * 清除 [from, to)：存活（被标记）的对象之间的空间交给 @add_run，
+ * 死亡对象的起始地址位被清除，标记位图被清零。调用者持有 heap 锁。
+ * 只访问存活对象（获取其大小）和死亡对象（如果 @dead 不为 NULL），不访问空闲内存。
+ */
+/*
+ * 同 sweep_range，@free_start 是 [from, to) 之前的空闲区间的起始地址，
+ * 返回末尾的空闲区间的起始地址（可能不小于 @to，即最后一个存活对象越过了 @to），末尾的空闲区间不加入。
+ */
+static address sweep_range0(Heap *heap, address from, address to, address free_start,
+                        size_t (* size)(address p), void (* dead)(address p),
+                        void (* add_run)(Heap *, address, size_t))
 {
-    assert(heap != NULL);
+    WORD_RANGE(heap, from, to, first, last);
+    for (size_t w = first; w < last; w++) {
+        uint64_t all = heap->starts[w];
+        if (all == 0)
+            continue;
+
+        uint64_t live = all & heap->marks[w];
+        if (dead != NULL) {
+            // 必须在 add_run 写入空闲块的头部之前
+            for (uint64_t d = all & ~live; d != 0; d &= d - 1)
+                dead(bit_address(heap, w, __builtin_ctzll(d)));
+        }
+        heap->starts[w] = live;
 
-    size_t free_mem = 0;
-    for (Node *node = heap->freelist; node != NULL; node = node->next) {
-        free_mem += node->len;
+        for (; live != 0; live &= live - 1) {
+            address p = bit_address(heap, w, __builtin_ctzll(live));
+            assert(p >= free_start);
+            if (p > free_start)
+                add_run(heap, free_start, p - free_start);
+            free_start = p + heap_align(size(p));
+        }
     }
-    return free_mem;
+
+    clear_marks(heap, from, to);
+    return free_start;
 }
 
-void print_heap_info(Heap *heap)
+static void sweep_range(Heap *heap, address from, address to,
+                        size_t (* size)(address p), void (* dead)(address p),
+                        void (* add_run)(Heap *, address, size_t))
+{
+    address free_start = sweep_range0(heap, from, to, from, size, dead, add_run);
+    if (free_start < to)
+        add_run(heap, free_start, to - free_start);
+}
+
+void heap_sweep(Heap *heap, size_t (* size)(address p), void (* dead)(address p))
+{
+    assert(heap != NULL && size != NULL);
+    lock_heap(heap);
+
+    // 直接重建所有空闲链表
+    clear_free_blocks(heap);
+    sweep_range(heap, heap->old, heap->mem + heap->size, size, dead, add_free_block);
+
+    unlock_heap(heap);
+}
+
+// heap_sweep_step 每次清除的大小，按位图的字对齐
+#define HEAP_SWEEP_STEP (1024*1024)
+
+void heap_sweep_begin(Heap *heap, size_t (* size)(address p))
+{
+    assert(heap != NULL && size != NULL);
+    lock_heap(heap);
+    assert(heap->sweep_top == 0);
+
+    // 未清除部分的空闲内存没有起始地址位，清除时会重新加入
+    clear_free_blocks(heap);
+    heap->sweep_top = heap->sweep_free_start = heap->old;
+    heap->sweep_end = heap->mem + heap->size;
+    heap->sweep_size = size;
+    heap->los_sweep_pending = true;
+
+    unlock_heap(heap);
+}
+
+bool heap_sweep_step(Heap *heap)
 {
     assert(heap != NULL);
+    lock_heap(heap);
 
+    if (heap->sweep_top == 0) {
+        unlock_heap(heap);
+        return false;
+    }
+
+    if (heap->los_sweep_pending) {
+        los_sweep(heap, NULL);
+        unlock_heap(heap);
+        return true;
+    }
+
+    address from = heap->sweep_top;
+    address to = heap->sweep_end - from > HEAP_SWEEP_STEP ? from + HEAP_SWEEP_STEP : heap->sweep_end;
+    heap->sweep_free_start = sweep_range0(heap, from, to, heap->sweep_free_start,
+                                            heap->sweep_size, NULL, add_free_block);
+    heap->sweep_top = to;
+
+    if (to == heap->sweep_end) {
+        address p = heap->sweep_free_start;
+        if (p < to) {
+            size_t len = to - p;
+            // 清除期间老年代扩张出来的空闲块
+            FreeBlock *tail = heap->tail;
+            if ((address) tail == to) {
+                remove_free_block(heap, tail);
+                len += tail->len;
+            }
+            add_free_block(heap, p, len);
+        }
+        heap->sweep_top = heap->sweep_end = heap->sweep_free_start = 0;
+    }
+
+    bool more = heap->sweep_top != 0;
+    unlock_heap(heap);
+    return more;
+}
+
+void heap_sweep_finish(Heap *heap)
+{
+    while (heap_sweep_step(heap))
+        ;
+}
+
+static FreeBlock *first_hole;
+static FreeBlock *last_hole;
+
+static void add_hole(Heap *heap, address p, size_t len)
+{
+    format_free_block(p, len, NULL);
+    if (last_hole == NULL) {
+        first_hole = (FreeBlock *) p;
+    } else {
+        last_hole->tagged_next = p | FREE_TAG;
+    }
+    last_hole = (FreeBlock *) p;
+    heap->young_free_bytes += len;
+}
+
+void young_sweep(Heap *heap, size_t (* size)(address p), void (* dead)(address p))
+{
+    assert(heap != NULL && size != NULL);
     lock_heap(heap);
 
-    printf("freelist: \n|");
-    for (Node *node = heap->freelist; node != NULL; node = node->next) {
-        printf("%p,", (void *) node->head);
-        printf("%zu|", node->len);
+    first_hole = last_hole = NULL;
+    heap->young_free_bytes = 0;
+    sweep_range(heap, heap->mem, heap->old, size, dead, add_hole);
+
+    if (first_hole == NULL) {
+        heap->young_top = heap->young_end = heap->old;
+        heap->next_hole = NULL;
+    } else {
+        heap->young_top = (address) first_hole;
+        heap->young_end = (address) first_hole + first_hole->len;
+        heap->next_hole = next_block(first_hole);
     }
 
-    unlock_heap(g_heap);
-}
\ No newline at end of file
+    unlock_heap(heap);
+}
@@ -3,27 +3,179 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <pthread.h>
 
 typedef uintptr_t address;
 
+/*
+ * 堆中所有内存块的起始地址和长度都按 HEAP_ALIGNMENT 对齐，gc 按此粒度遍历和扫描堆。
+ * 空闲块至少需要两个字（len 和 tag），按 16 字节对齐保证分割内存块时不会产生无法记录的碎片。
+ */
+#define HEAP_ALIGNMENT 16
+#define HEAP_ALIGNMENT_SHIFT 4
+#define heap_align(len) (((len) + HEAP_ALIGNMENT - 1) & ~((size_t) HEAP_ALIGNMENT - 1))
+
+/*
+ * Segregated fit.
+ *
+ * 空闲块的信息直接保存在空闲块中（in-band），不需要另外申请内存。
+ * 不大于 SMALL_BLOCK_MAX 的空闲块按大小（HEAP_ALIGNMENT 的整数倍）分类，
+ * 每类一个链表，另用一个位图记录哪些链表非空，分配和释放都是 O(1) 的。
+ * 更大的空闲块保存在一棵以 (len, address) 为键的 treap 中，best fit，O(log n).
+ */
+#define SMALL_BLOCK_MAX 1024
+#define SMALL_CLASSES_COUNT (SMALL_BLOCK_MAX / HEAP_ALIGNMENT) // 不能超过 64
+
+/*
+ * 堆分为新生代（nursery）和老年代两部分：
+ * ----------------------------------------------
+ * |  young: [mem, old)  |  old: [old, mem+size) |
+ * ----------------------------------------------
+ * 新生代以移动指针的方式分配（线程从中切分 TLAB），minor gc 时存活的对象被复制到老年代。
+ * 被保守扫描到的对象不能移动，留在新生代原处，
+ * minor gc 后新生代就由这些对象和它们之间的空闲块（hole）组成，holes 按地址顺序链接。
+ *
+ * 老年代由空闲链表管理，较大的对象直接在老年代中分配。
+ * 不小于 LARGE_OBJECT_SIZE 的对象在大对象空间（large object space）中分配，见下面。
+ *
+ * 创建堆时保留 max_size 大小的地址空间，只提交其中的 size 字节（新生代全部提交），
+ * 老年代按需扩张（提交更多内存），full gc 后空闲空间过多时收缩（末尾的空闲内存还给操作系统）。
+ * 老年代和大对象空间已提交的内存之和不超过 max_size.
+ *
+ * 堆，大对象空间和永久区在同一段保留的地址空间中依次排列：
+ * -------------------------------------------------------------------------------
+ * |  heap: [mem, mem+max_size)  |  los: [los_mem, +max_size)  |  perm: [perm_mem, +PERM_SPACE_SIZE) |
+ * -------------------------------------------------------------------------------
+ * 所有对象都在这段地址空间中，对象中的引用可以压缩为相对其起始地址的32位偏移（见 object.h 中的 Compressed oops）。
+ *
+ * Epsilon 模式（-XX:+UseEpsilonGC）：不回收内存，适用于在 gc 发生之前就结束的短任务。
+ * 没有新生代（old == mem），所有对象都在 [mem, mem+max_size) 中以原子的移动指针的方式分配（epsilon_top），
+ * 线程仍从中切分 TLAB. 内存按需提交（由操作系统清零），不使用空闲链表，大对象空间和位图，不执行 gc，
+ * 空间耗尽时以 OutOfMemoryError 终止虚拟机。
+ */
 typedef struct heap {
     address mem;
-    size_t size; // 堆总大小，以字节为单位。
+    size_t size; // 已提交的大小，以字节为单位，[mem, mem+size) 是可用的。
+    size_t init_size; // -Xms，收缩时不小于此值
+    size_t max_size;  // -Xmx，保留的地址空间大小
+
+    address old; // 老年代的起始地址
+
+    // 新生代中当前 hole 的 [young_top, young_end) 可用于分配
+    address young_top;
+    address young_end;
+    struct free_block *next_hole;
+    size_t young_free_bytes; // 新生代中所有 holes 的大小之和
 
-    struct heap_node {
-        address head;
-        size_t len;
-        struct heap_node *next;
-    } *freelist;
+    /* 老年代的空闲块 */
+
+    // 第 i 个链表中空闲块的大小都为 (i+1)*HEAP_ALIGNMENT
+    struct free_block *small_lists[SMALL_CLASSES_COUNT];
+    uint64_t small_lists_bitmap; // 第 i 位为1表示第 i 个链表非空
+
+    struct free_block *large_tree;
+
+    size_t free_bytes; // 所有空闲块的大小之和
+    struct free_block *tail; // 结束于 mem+size 的空闲块，没有为 NULL
+
+    /*
+     * 对象起始地址位图（object-start table）和标记位图，
+     * 每 HEAP_ALIGNMENT 字节对应一位，覆盖整个保留的地址空间，随堆一起提交。
+     *
+     * 分配对象（heap_malloc, heap_try_malloc, tlab_alloc）时设置对象的起始地址位，
+     * heap_sweep, young_sweep, heap_slide 清除死亡对象的起始地址位，所以空闲内存中没有起始地址位。
+     * 标记位图由 gc 设置，heap_sweep, young_sweep, heap_slide 处理完一个区域后将其清零。
+     * 遍历堆只需扫描位图，不需要访问空闲内存和死亡的对象。
+     */
+    uint64_t *starts;
+    uint64_t *marks;
+
+    /*
+     * Large object space
+     * 每个大对象单独占用一段按页对齐的内存，从另外保留的 [los_mem, los_mem+max_size) 中 first fit 分配，
+     * 分配时才提交，新提交的内存由操作系统清零，不需要 memset.
+     * 大对象属于老年代（被老年代的 gc 回收，作为 remembered set 的成员），但不会被移动，
+     * 死亡后其内存立即还给操作系统。
+     */
+    address los_mem;
+    struct large_object *large_objects; // 按地址排序
+    size_t los_bytes; // 已提交的大小
+
+    /*
+     * Permanent space
+     * 不被 gc 管理的对象（java.lang.Class 对象，见 create_class_object）在这里以移动指针的方式分配，
+     * 不会被移动和释放，按需以 HEAP_COMMIT_GRANULARITY 为单位提交，不计入 max_size.
+     */
+    address perm_mem;
+    address perm_top;
+    address perm_end; // 已提交部分的末尾
+
+    bool epsilon;
+    address epsilon_top; // 只在 epsilon 模式下使用
+
+    /*
+     * 并发清除（见 heap_sweep_begin），[sweep_top, sweep_end) 是老年代中还没有清除的部分，
+     * sweep_top 为 NULL 表示没有在清除。sweep_free_start 是已清除部分末尾还没有加入空闲链表的空闲区间的起始地址。
+     */
+    address sweep_top;
+    address sweep_end;
+    address sweep_free_start;
+    size_t (* sweep_size)(address p);
+    bool los_sweep_pending; // 大对象空间还没有清除，此期间分配的大对象直接标记为存活
 
     pthread_mutex_t mutex;
 } Heap;
 
-Heap *create_heap();
+#define heap_bit_index(heap, p) (((address) (p) - (heap)->mem) / HEAP_ALIGNMENT)
+
+static inline bool bitmap_test(const uint64_t *bitmap, size_t i)
+{
+    return (bitmap[i >> 6] >> (i & 63)) & 1;
+}
+
+// 原子的设置第 i 位，返回其原来的值
+static inline bool bitmap_set(uint64_t *bitmap, size_t i)
+{
+    uint64_t mask = 1ULL << (i & 63);
+    return (__atomic_fetch_or(bitmap + (i >> 6), mask, __ATOMIC_RELAXED) & mask) != 0;
+}
+
+static inline void bitmap_clear(uint64_t *bitmap, size_t i)
+{
+    __atomic_fetch_and(bitmap + (i >> 6), ~(1ULL << (i & 63)), __ATOMIC_RELAXED);
+}
+
+#define heap_set_start(heap, p) bitmap_set((heap)->starts, heap_bit_index(heap, p))
+#define heap_clear_start(heap, p) bitmap_clear((heap)->starts, heap_bit_index(heap, p))
+#define heap_is_start(heap, p) bitmap_test((heap)->starts, heap_bit_index(heap, p))
+
+// 标记对象 @p，返回 @p 之前是否已被标记
+#define heap_mark(heap, p) bitmap_set((heap)->marks, heap_bit_index(heap, p))
+#define heap_is_marked(heap, p) bitmap_test((heap)->marks, heap_bit_index(heap, p))
+
+// 扩张和收缩的粒度
+#define HEAP_COMMIT_GRANULARITY (1024*1024)
+
+// full gc 后，老年代空闲空间的比例小于 MIN_FREE_RATIO 时扩张，大于 MAX_FREE_RATIO 时收缩
+#define HEAP_MIN_FREE_RATIO 0.4
+#define HEAP_MAX_FREE_RATIO 0.7
+
+// @epsilon: 是否为 epsilon 模式（见上）
+Heap *create_heap(size_t init_size, size_t max_size, bool epsilon);
 void destroy_heap(Heap *);
 
-// heap malloc
+/*
+ * 按 HEAP_MIN_FREE_RATIO 和 HEAP_MAX_FREE_RATIO 调整老年代已提交的大小，
+ * 由 full gc 在清除（或压缩）之后调用。
+ */
+void heap_resize(Heap *);
+
+/*
+ * heap malloc
+ * 在老年代中申请内存，申请的内存已清零。不小于 LARGE_OBJECT_SIZE 的在大对象空间中申请。
+ * 空间不足时执行 gc 后再次尝试。
+ */
 void *heap_malloc(Heap *heap, size_t len);
 
 // heap free
@@ -32,15 +184,168 @@ void heap_free(Heap *heap, address p, size_t len);
 #define lock_heap(heap) pthread_mutex_lock(&((heap)->mutex))
 #define unlock_heap(heap) pthread_mutex_unlock(&((heap)->mutex))
 
+#define is_in_heap(heap, p) ((heap)->mem <= (p) && (p) < (heap)->mem + (heap)->size)
+#define is_in_young(heap, p) ((heap)->mem <= (p) && (p) < (heap)->old)
+#define is_in_old(heap, p) ((heap)->old <= (p) && (p) < (heap)->mem + (heap)->size)
+#define is_in_los(heap, p) ((heap)->los_mem <= (p) && (p) < (heap)->los_mem + (heap)->max_size)
+
+#define PERM_SPACE_SIZE (64*1024*1024)
+
+// 在永久区中申请内存（已清零，按 HEAP_ALIGNMENT 对齐），永不释放。失败返回 NULL.
+void *perm_malloc(Heap *heap, size_t len);
+
+/*
+ * 对象中保存的压缩引用的基址（见 object.h 中的 Compressed oops），
+ * 为 mem - HEAP_ALIGNMENT，保证任何对象的压缩引用都不为0.
+ */
+extern address g_narrow_oop_base;
+
+// 可以用压缩引用访问的地址空间的大小
+#define NARROW_OOP_RANGE (((size_t) UINT32_MAX - 1) << HEAP_ALIGNMENT_SHIFT)
+
+// 最大堆为 @max_size 时保留的地址空间的大小
+#define heap_reserved_size(max_size) (2*(size_t) (max_size) + PERM_SPACE_SIZE)
+
+/*
+ * 从老年代中分配内存，但不执行 gc，也不检查安全点，申请的内存没有清零。
+ * 失败返回 NULL.
+ */
+void *heap_try_malloc(Heap *heap, size_t len);
+
+/*
+ * 从新生代中切分一块至少 @min_len，至多 @max_len 字节的内存（已清零），
+ * 实际长度由 @len 返回。新生代已满返回 NULL.
+ */
+void *young_malloc(Heap *heap, size_t min_len, size_t max_len, size_t *len);
+
+/*
+ * TLAB: Thread Local Allocation Buffer
+ *
+ * 每个线程从新生代中一次申请至多 TLAB_SIZE 大小（已清零）的内存，
+ * 之后线程在其中以移动指针的方式分配对象，不需要加锁。
+ * 新生代满时执行 minor gc.
+ * 大于 TLAB_SIZE/4 的对象直接在老年代中分配。
+ */
+#define TLAB_SIZE (256*1024)
+
+typedef struct tlab {
+    address top;
+    address end;
+} TLAB;
+
+void *tlab_alloc_slow(Heap *, TLAB *, size_t len);
+
+static inline void *tlab_alloc(Heap *heap, TLAB *tlab, size_t len)
+{
+    len = heap_align(len);
+    if (tlab->end - tlab->top >= len) {
+        void *p = (void *) tlab->top;
+        tlab->top += len;
+        if (!heap->epsilon)
+            heap_set_start(heap, p); // 相邻的 TLAB 可能共享位图中的一个字，原子的设置
+        return p;
+    }
+    return tlab_alloc_slow(heap, tlab, len);
+}
+
+/*
+ * 将 TLAB 中未使用的部分还给堆。
+ * gc 遍历堆之前要 retire 所有线程的 TLAB.
+ */
+void tlab_retire(Heap *, TLAB *);
+
+/*
+ * 按地址顺序遍历堆（新生代和老年代）中的所有对象（包括还没有被清除的死亡对象）。
+ */
+void heap_walk(Heap *, void (* visit)(address p));
+
+// 同 heap_walk，只遍历新生代
+void young_walk(Heap *, void (* visit)(address p));
+
+// 同 heap_walk，只遍历老年代
+void old_walk(Heap *, void (* visit)(address p));
+
+// 同 heap_walk，只遍历被标记的对象
+void young_walk_marked(Heap *, void (* visit)(address p));
+void old_walk_marked(Heap *, void (* visit)(address p));
+
 /*
- * 如果不在 freelist 里面，返回 p，
- * 负责跳过此 freelist's Node.
+ * 清除老年代：被标记的对象存活，其余的对象被释放（@dead 不为 NULL 时先对其调用 @dead）。
+ * 存活对象之间的空间重建为空闲块，所有空闲链表被整体重建。
+ * @size 返回存活对象的大小。结束后老年代的标记位图被清零。
  */
-address jump_freelist(Heap *, address p);
+void heap_sweep(Heap *, size_t (* size)(address p), void (* dead)(address p));
+
+/*
+ * 并发清除老年代和大对象空间（同 heap_sweep 和 los_sweep，没有 @dead），由 concurrent mark 的 remark 使用。
+ *
+ * heap_sweep_begin 在 stop-the-world 中调用，清空所有空闲链表，之后老年代中只有已清除部分的空闲块，
+ * 清除期间新分配（包括晋升）的对象都在已清除的部分中，不会被当作死亡对象。
+ * heap_sweep_step 不需要 stop-the-world，每次在 heap 锁中清除一块（第一次清除大对象空间），
+ * 返回是否还有没清除的部分。老年代中申请内存失败时，申请的线程也会先清除一块再重试。
+ * full gc 标记之前调用 heap_sweep_finish 清除剩余的部分（未清除部分的标记位还在）。
+ */
+void heap_sweep_begin(Heap *, size_t (* size)(address p));
+bool heap_sweep_step(Heap *);
+void heap_sweep_finish(Heap *);
+
+/*
+ * 清除新生代，同 heap_sweep。
+ * 存活对象之间的空间成为 holes，新生代从第一个 hole 开始重新分配。
+ */
+void young_sweep(Heap *, size_t (* size)(address p), void (* dead)(address p));
+
+/*
+ * 滑动压缩老年代（Lisp2 的最后一步）。
+ * 按地址顺序遍历老年代中被标记的对象，@visit 返回对象 p 的长度，并通过 @to 告知其新地址，
+ * 新地址不大于原地址，且按原地址的顺序单调递增。没有被标记的对象被释放（同 heap_sweep）。
+ * 对象被移动到新地址，其余空间重建为空闲块，起始地址位图随之更新，标记位图被清零。
+ */
+void heap_slide(Heap *, size_t (* visit)(address p, address *to), void (* dead)(address p));
+
+/* Large object space */
+
+// heap_malloc 申请不小于此值的内存时在大对象空间中分配
+#define LARGE_OBJECT_SIZE (512*1024)
+
+typedef struct large_object {
+    struct large_object *next;
+    size_t len; // 对象的大小
+    size_t region_len; // 占用的内存大小，页的整数倍
+    bool marked;
+    size_t scan_index; // gc 分块扫描大的引用数组时，下一块的起始下标
+} LargeObject;
+
+// 大对象的头部，放在占用的内存的最开始处，对象紧随其后
+#define LARGE_OBJECT_HEADER_SIZE heap_align(sizeof(LargeObject))
+#define large_object_of(p) ((LargeObject *) ((address) (p) - LARGE_OBJECT_HEADER_SIZE))
+
+// 标记大对象 @p，返回 @p 之前是否已被标记
+static inline bool los_mark(address p)
+{
+    return __atomic_exchange_n(&large_object_of(p)->marked, true, __ATOMIC_RELAXED);
+}
+
+#define los_is_marked(p) (large_object_of(p)->marked)
+
+// 如果 @p 指向某个大对象（包括指向其内部），返回此对象，否则返回 0
+address los_find(Heap *, address p);
+
+// 按地址顺序遍历被标记的大对象
+void los_walk_marked(Heap *, void (* visit)(address p));
+
+// 释放没有被标记的大对象（@dead 不为 NULL 时先对其调用 @dead），清除所有的标记
+void los_sweep(Heap *, void (* dead)(address p));
+
+// 清除所有大对象的标记
+void los_clear_marks(Heap *);
 
 // 堆还有多少剩余空间，以字节为单位。
 size_t heap_free_memory(Heap *);
 
+// 老年代中最大的空闲块的大小
+size_t heap_largest_free_block(Heap *);
+
 void print_heap_info(Heap *);
 
 #endif //CABIN_HEAP_H
@@ -1,3 +1,5 @@
+#include <ctype.h>
+#include <errno.h>
 #include "cabin.h"
 #include "heap.h"
 #include "jni.h"
@@ -8,6 +10,8 @@
 #include "object.h"
 #include "sysinfo.h"
 #include "encoding.h"
+#include "string_dedup.h"
+#include "inline_cache.h"
 
 Heap *g_heap;
 
@@ -34,7 +38,13 @@ void init_native();
 
 static void *gc_loop(void *arg)
 {
-    // todo
+    concurrent_gc_loop();
+    return NULL;
+}
+
+static void *dedup_loop(void *arg)
+{
+    string_dedup_loop();
     return NULL;
 }
 
@@ -87,9 +97,19 @@ void init_properties()
     }
 }
 
-static void init_heap()
+static void init_heap(const InitArgs *init_args)
 {
-    g_heap = create_heap();
+    if (init_args->init_heap_size > init_args->max_heap_size) {
+        JVM_PANIC("Initial heap size set to a larger value than the maximum heap size");
+    }
+
+#ifdef COMPRESSED_OOPS
+    if (heap_reserved_size(init_args->max_heap_size) > NARROW_OOP_RANGE) {
+        JVM_PANIC("Maximum heap size is too large for compressed oops");
+    }
+#endif
+
+    g_heap = create_heap(init_args->init_heap_size, init_args->max_heap_size, init_args->epsilon_gc);
     if (g_heap == NULL) {
         JVM_PANIC("init Heap failed"); // todo
     }
@@ -184,7 +204,33 @@ static void init_symbol()
     }
 }
 
-void init_jvm(JavaVMInitArgs *vm_init_args)
+size_t parse_memory_size(const char *str)
+{
+    assert(str != NULL);
+    if (!isdigit(*str))
+        return 0;
+
+    char *end;
+    errno = 0;
+    unsigned long long n = strtoull(str, &end, 10);
+    if (errno == ERANGE)
+        return 0;
+
+    int shift = 0;
+    switch (*end) {
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+        default: break;
+    }
+
+    // 移位后溢出的大小同样视为非法
+    if (*end != 0 || n > (UINT64_MAX >> shift))
+        return 0;
+    return (size_t) (n << shift);
+}
+
+void init_jvm(const InitArgs *init_args)
 {    
     pthread_mutexattr_init(&g_pthread_mutexattr_recursive);
     pthread_mutexattr_settype(&g_pthread_mutexattr_recursive, PTHREAD_MUTEX_RECURSIVE);
@@ -204,11 +250,14 @@ void init_jvm(JavaVMInitArgs *vm_init_args)
 
     read_jdk_version();
 
+    g_string_dedup = init_args->string_dedup;
+    g_print_inline_cache_statistics = init_args->print_ic_stats;
+
     /* order is important */
     init_utf8_pool();
     init_symbol();
     init_prims();
-    init_heap();
+    init_heap(init_args);
     init_properties();
     init_class_loader();
     init_native();
@@ -249,6 +298,9 @@ void init_jvm(JavaVMInitArgs *vm_init_args)
     Class *acc = load_boot_class("java/lang/reflect/AccessibleObject");
     init_class(acc);
 
+    // Reference 和 Finalizer 的 <clinit> 启动 Reference Handler 和 Finalizer 线程
+    init_class(load_boot_class(S(java_lang_ref_Finalizer)));
+
     //   todo "initPhase2 is not implement    
     // m = lookup_static_method(sys, "initPhase2", "(ZZ)I");
     // assert(m != NULL);
@@ -271,7 +323,10 @@ void init_jvm(JavaVMInitArgs *vm_init_args)
                                      S(sig_java_lang_ClassLoader), g_app_class_loader);
 
                                      
-    create_vm_thread(gc_loop, GC_THREAD_NAME); // gc thread
+    if (!g_heap->epsilon)
+        create_vm_thread(gc_loop, GC_THREAD_NAME); // gc thread
+    if (g_string_dedup && !g_heap->epsilon)
+        create_vm_thread(dedup_loop, STRING_DEDUP_THREAD_NAME);
     
     g_vm_initing = false;
     TRACE("init jvm is over.\n");
@@ -302,6 +357,14 @@ void show_usage(const char *name)
     printf("\t\t   :class print out information about class loading, etc.\n");// todo
     printf("\t\t   :gc print out results of garbage collection\n");
     printf("\t\t   :jni print out native method dynamic resolution\n");
+    printf("  -Xms<size>\t   set initial Java heap size, e.g. -Xms64m\n");
+    printf("  -Xmx<size>\t   set maximum Java heap size, e.g. -Xmx512m\n");
+    printf("  -XX:+UseStringDeduplication\n");
+    printf("\t\t   share the backing arrays of equal strings promoted by gc\n");
+    printf("  -XX:+UseEpsilonGC\n");
+    printf("\t\t   bump-pointer allocation without any gc, for short-lived programs\n");
+    printf("  -XX:+PrintInlineCacheStatistics\n");
+    printf("\t\t   print the states and hit rates of call site inline caches at exit\n");
     printf("  -version\t   print out version number and copyright information\n");// todo
     printf("  -? -help\t   print out this message\n");
 
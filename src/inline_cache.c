@@ -0,0 +1,91 @@
+#include <assert.h>
+#include <stdio.h>
+#include "cabin.h"
+#include "inline_cache.h"
+
+bool g_print_inline_cache_statistics = false;
+
+static pthread_mutex_t ic_mutex = PTHREAD_MUTEX_INITIALIZER;
+static InlineCache *all_caches;
+
+InlineCache *new_inline_cache(Method *m, size_t pc)
+{
+    assert(m != NULL && pc < m->code_len);
+
+    InlineCache **caches = __atomic_load_n(&m->inline_caches, __ATOMIC_ACQUIRE);
+    if (caches == NULL) {
+        InlineCache **expected = NULL;
+        caches = vm_calloc(m->code_len * sizeof(*caches));
+        if (!__atomic_compare_exchange_n(&m->inline_caches, &expected, caches,
+                                        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            // 其他线程已经创建了
+            free(caches);
+            caches = expected;
+        }
+    }
+
+    pthread_mutex_lock(&ic_mutex);
+    InlineCache *ic = caches[pc];
+    if (ic == NULL) {
+        ic = vm_calloc(sizeof(*ic));
+        ic->next = all_caches;
+        all_caches = ic;
+        __atomic_store_n(caches + pc, ic, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&ic_mutex);
+    return ic;
+}
+
+void inline_cache_update(InlineCache *ic, Class *c, Method *target)
+{
+    assert(ic != NULL && c != NULL && target != NULL);
+
+    pthread_mutex_lock(&ic_mutex);
+    ic->misses++;
+
+    int n = ic->count;
+    if (n == MEGAMORPHIC)
+        goto out;
+    for (int i = 0; i < n; i++) {
+        if (ic->classes[i] == c) // 其他线程已经加入了
+            goto out;
+    }
+
+    if (n == INLINE_CACHE_SIZE) {
+        __atomic_store_n(&ic->count, MEGAMORPHIC, __ATOMIC_RELEASE);
+    } else {
+        ic->classes[n] = c;
+        ic->targets[n] = target;
+        __atomic_store_n(&ic->count, n + 1, __ATOMIC_RELEASE);
+    }
+out:
+    pthread_mutex_unlock(&ic_mutex);
+}
+
+void print_inline_cache_statistics()
+{
+    size_t sites = 0, monomorphic = 0, polymorphic = 0, megamorphic = 0;
+    u8 hits = 0, misses = 0;
+
+    pthread_mutex_lock(&ic_mutex);
+    for (InlineCache *ic = all_caches; ic != NULL; ic = ic->next) {
+        if (ic->count == 0) // 调用还没有完成过，比如接收者为 null
+            continue;
+        sites++;
+        if (ic->count == MEGAMORPHIC)
+            megamorphic++;
+        else if (ic->count > 1)
+            polymorphic++;
+        else
+            monomorphic++;
+        hits += ic->hits;
+        misses += ic->misses;
+    }
+    pthread_mutex_unlock(&ic_mutex);
+
+    printf("Inline cache statistics (size %d):\n", INLINE_CACHE_SIZE);
+    printf("  call sites: %zu, monomorphic: %zu, polymorphic: %zu, megamorphic: %zu\n",
+                    sites, monomorphic, polymorphic, megamorphic);
+    printf("  hits: %llu, misses: %llu, hit rate: %.2f%%\n", (unsigned long long) hits,
+                    (unsigned long long) misses, hits + misses == 0 ? 0.0 : 100.0 * hits / (hits + misses));
+}
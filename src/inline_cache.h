@@ -0,0 +1,68 @@
+#ifndef CABIN_INLINE_CACHE_H
+#define CABIN_INLINE_CACHE_H
+
+#include "cabin.h"
+#include "meta.h"
+
+/*
+ * Inline cache
+ *
+ * invokevirtual 和 invokeinterface 的每个调用点有一个 inline cache，保存已经见过的
+ * (接收者的类 → 目标方法)，最多 INLINE_CACHE_SIZE 个。分派时先在其中查找接收者的类，
+ * 没有命中再查 vtable 或 itable（见 class.c 中的 create_vtable 和 create_itable），并把结果加入 cache。
+ * 见过超过 INLINE_CACHE_SIZE 个类的调用点成为 megamorphic 的，以后直接查表，不再更新 cache。
+ *
+ * 调用点的 cache 按 pc 保存在 Method.inline_caches 中（字节码之外的表），第一次执行时创建。
+ * 查找不加锁，更新加锁：先写入新的一项，再增加 count.
+ * 虚拟机不卸载类，cache 中的 Class 和 Method 一直有效。
+ *
+ * -XX:+PrintInlineCacheStatistics 在虚拟机退出时打印所有调用点的状态和命中、未命中次数，
+ * 用于调整 INLINE_CACHE_SIZE.
+ */
+
+#define INLINE_CACHE_SIZE 4
+#define MEGAMORPHIC (-1)
+
+typedef struct inline_cache {
+    Class *classes[INLINE_CACHE_SIZE];
+    Method *targets[INLINE_CACHE_SIZE];
+    int count; // 有效的项数，或者 MEGAMORPHIC
+
+    // 统计用，多线程同时执行时不精确
+    u4 hits;
+    u4 misses; // 包括 megamorphic 时的查表次数
+
+    struct inline_cache *next; // 所有调用点的 cache 链接在一起，用于统计
+} InlineCache;
+
+extern bool g_print_inline_cache_statistics;
+
+InlineCache *new_inline_cache(Method *m, size_t pc);
+
+// 方法 @m 中位于 @pc 的调用点的 inline cache
+static inline InlineCache *get_inline_cache(Method *m, size_t pc)
+{
+    InlineCache **caches = __atomic_load_n(&m->inline_caches, __ATOMIC_ACQUIRE);
+    InlineCache *ic = caches != NULL ? __atomic_load_n(caches + pc, __ATOMIC_ACQUIRE) : NULL;
+    return ic != NULL ? ic : new_inline_cache(m, pc);
+}
+
+// 接收者的类为 @c 时的目标方法，没有命中返回 NULL
+static inline Method *inline_cache_lookup(InlineCache *ic, Class *c)
+{
+    int n = __atomic_load_n(&ic->count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; i++) {
+        if (ic->classes[i] == c) {
+            ic->hits++;
+            return ic->targets[i];
+        }
+    }
+    return NULL;
+}
+
+// 没有命中时，查表得到目标方法 @target 后调用
+void inline_cache_update(InlineCache *ic, Class *c, Method *target);
+
+void print_inline_cache_statistics();
+
+#endif // CABIN_INLINE_CACHE_H
@@ -8,6 +8,9 @@
 #include "thread.h"
 #include "mh.h"
 #include "meta.h"
+#include "monitor.h"
+#include "escape.h"
+#include "inline_cache.h"
 #include "object.h"
 #include "exception.h"
 #include "bytecode_reader.h"
@@ -17,12 +20,14 @@
 static const char *instruction_names[] = JVM_OPCODE_NAME_INITIALIZER;
 
 #define PRINT_OPCODE VERBOSE("%d(0x%x), %s, pc = %d\n", \
-                        opcode, opcode, instruction_names[opcode], (int)frame->reader.pc);
+                        opcode, opcode, instruction_names[opcode], (int)reader->pc);
 
 static unsigned char opcode_len[JVM_OPC_MAX+1] = JVM_OPCODE_LENGTH_INITIALIZER;
 
 static void call_jni_method(Frame *frame);
 static bool checkcast(Class *s, Class *t);
+static u1 getfield_quick_opcode(const Field *f);
+static u1 putfield_quick_opcode(const Field *f);
 
 /*
  * 执行当前线程栈顶的frame
@@ -110,9 +115,17 @@ static slot_t *exec(jref *excep)
 #undef U
 #define U &&opc_unused
         &&opc_breakpoint, 
-        U, U, U, U, U,          // [0xcb ... 0xcf]
-        U, U, U, U, U, U, U, U, // [0xd0 ... 0xd7]
-        U, U, U, U, U, U, U, U, // [0xd8 ... 0xdf]
+
+        // Quick [0xcb ... 0xdc]
+        &&opc_getfield_b_quick, &&opc_getfield_c_quick, &&opc_getfield_s_quick,
+        &&opc_getfield_i_quick, &&opc_getfield_l_quick, &&opc_getfield_a_quick,
+        &&opc_putfield_b_quick, &&opc_putfield_z_quick, &&opc_putfield_c_quick,
+        &&opc_putfield_i_quick, &&opc_putfield_l_quick, &&opc_putfield_a_quick,
+        &&opc_getstatic_quick, &&opc_putstatic_quick,
+        &&opc_invokevirtual_quick, &&opc_invokenonvirtual_quick, 
+        &&opc_invokestatic_quick, &&opc_invokeinterface_quick,
+
+        U, U, U,                // [0xdd ... 0xdf]
         U, U, U, U, U, U, U, U, // [0xe0 ... 0xe7]
         U, U, U, U, U, U, U, U, // [0xe8 ... 0xef]
         U, U, U, U, U, U, U, U, // [0xf0 ... 0xf7]
@@ -128,18 +141,51 @@ static slot_t *exec(jref *excep)
     Method *resolved_method = NULL;
     int index;
 
-    BytecodeReader *reader = &frame->reader;
+    /*
+     * 当前 frame 的 pc（在 reader 中），ostack, lvars 和 cp 都放在局部变量中，编译器可以把它们放在寄存器里，
+     * 读写字节码和操作数栈时不用每次都经过 Frame.
+     * 只在方法调用、抛出异常和进入安全点，以及调用可能执行 Java 代码、遍历栈或读写操作数栈的函数之前，
+     * 才把 pc 和 ostack 写回 Frame（见 SAVE_STATE），切换 frame 时再从 Frame 中读出（见 CHANGE_FRAME）。
+     * 其他地方的 Frame.reader.pc 和 Frame.ostack 可能是旧的：
+     * 旧的 ostack 不低于操作数栈的底，由它算出的 frame 末尾（get_frame_end_address）仍不低于实际的栈顶，
+     * 所以 gc 的扫描范围和新 frame 的位置仍是对的。
+     */
+    BytecodeReader _reader = frame->reader;
+    BytecodeReader *reader = &_reader;
     Class *clazz = frame->method->clazz;
     ConstantPool *cp = &frame->method->clazz->cp;
-    // slot_t *ostack = frame->ostack;
+    slot_t *ostack = frame->ostack;
     slot_t *lvars = frame->lvars;
 
     jref _this = IS_STATIC(frame->method) ? (jref) clazz : slot_get_ref(lvars);
 
+/*
+ * 把 pc 和 ostack 写回 Frame.
+ * 解析、类的初始化、分配内存、加锁、创建异常等都可能执行 Java 代码、进入安全点或遍历栈，之前要先调用。
+ */
+#define SAVE_STATE \
+do { \
+    frame->reader.pc = reader->pc; \
+    frame->ostack = ostack; \
+} while(false)
+
+// 操作数栈
+#define pushi(_v) do { jint    _i = (_v); slot_set_int(ostack, _i);    ostack++;    } while(false)
+#define pushf(_v) do { jfloat  _f = (_v); slot_set_float(ostack, _f);  ostack++;    } while(false)
+#define pushl(_v) do { jlong   _l = (_v); slot_set_long(ostack, _l);   ostack += 2; } while(false)
+#define pushd(_v) do { jdouble _d = (_v); slot_set_double(ostack, _d); ostack += 2; } while(false)
+#define pushr(_v) do { jref    _r = (_v); slot_set_ref(ostack, _r);    ostack++;    } while(false)
+
+#define popi() (ostack--,    slot_get_int(ostack))
+#define popf() (ostack--,    slot_get_float(ostack))
+#define popl() (ostack -= 2, slot_get_long(ostack))
+#define popd() (ostack -= 2, slot_get_double(ostack))
+#define popr() (ostack--,    slot_get_ref(ostack))
+
 #define HANDLE_EXCEPTION0(_excep) \
 do { \
     assert(_excep != NULL); \
-    ostack_pushr(frame, _excep); \
+    pushr(_excep); \
     goto opc_athrow; \
 } while(false)  
 
@@ -154,6 +200,7 @@ do { \
 
 #define HANDLE_EXCEPTION(_excep_name, _msg) \
 do { \
+    SAVE_STATE; /* 异常的栈回溯要用到 pc */ \
     raise_exception(_excep_name, _msg); \
     jref _excep = exception_occurred(); \
     clear_exception(); \
@@ -166,20 +213,38 @@ do { \
         HANDLE_EXCEPTION(S(java_lang_NullPointerException), NULL); \
 } while(false) 
 
+// synchronized 方法：进入时锁住 this（静态方法为类对象）
+#define LOCK_SYNC_OBJ(f) \
+do { \
+    if (IS_SYNCHRONIZED((f)->method)) { \
+        (f)->sync_obj = IS_STATIC((f)->method) ? (f)->method->clazz->java_mirror : slot_get_ref((f)->lvars); \
+        object_lock((f)->sync_obj); \
+    } \
+} while(false)
+
+#define UNLOCK_SYNC_OBJ(f) \
+do { \
+    if ((f)->sync_obj != NULL) { \
+        object_unlock((f)->sync_obj); \
+        (f)->sync_obj = NULL; \
+    } \
+} while(false)
+
 #define CHANGE_FRAME(new_frame) \
 do { \
-    /*frame->ostack = ostack;  stack指针在变动，需要设置一下 todo */ \
     frame = new_frame; \
-    reader = &frame->reader; \
+    _reader = frame->reader; \
     clazz = frame->method->clazz; \
     cp = &frame->method->clazz->cp; \
-    /*ostack = frame->ostack; */                                     \
+    ostack = frame->ostack; \
     lvars = frame->lvars; \
     _this = IS_STATIC(frame->method) ? (jref) clazz : slot_get_ref(lvars); \
     TRACE("executing frame: %s", get_frame_info(frame)); \
 } while(false)
 
     u1 opcode;
+
+    LOCK_SYNC_OBJ(frame);
     
 #define DISPATCH \
 { \
@@ -188,58 +253,99 @@ do { \
     goto *handlers[opcode]; \
 }
 
+// 只在真的要进入安全点时写回状态，其他线程（比如 gc 或 Thread.getStackTrace）可能会读
+#define SAFEPOINT_POLL \
+do { \
+    if (g_safepoint_requested) { \
+        SAVE_STATE; \
+        safepoint(thread); \
+    } \
+} while(false)
+
+// 向后跳转时检查安全点，没有方法调用的循环也能及时响应 gc
+#define BRANCH(_offset, _opc_len) \
+do { \
+    if ((_offset) < 0) \
+        SAFEPOINT_POLL; \
+    bcr_skip(reader, (_offset) - (_opc_len)); \
+} while(false)
+
+/*
+ * Quickening
+ *
+ * getfield, putfield, getstatic, putstatic 和 invoke* 第一次执行完解析和检查后，
+ * 把指令改写为对应的快速指令（JVM_OPC_*_quick），以后再执行时直接从常量池中取出已解析的 Field 或 Method，
+ * 跳过解析（要加常量池的锁）、IS_STATIC 等检查和类的初始化。
+ * getfield/putfield 按属性的类型改写为不同的快速指令，直接按 Field.id（属性的偏移）读写。
+ *
+ * 只改写 opcode 这一个字节，操作数仍是常量池索引：其他线程可能正在执行同一条指令，
+ * 如果改写了操作数，读到旧 opcode 和新操作数的线程会把操作数当作常量池索引去解析。
+ * 常量池中已解析的项不会再改变，改写前的 release fence 保证看到快速指令的线程也能看到解析结果。
+ *
+ * getstatic, putstatic 和 invokestatic 只在类初始化完成后改写（类初始化期间 inited 已为 true），
+ * 否则其他线程执行快速指令时会跳过对初始化的等待。
+ */
+#define QUICKEN(_quick_opcode) \
+do { \
+    __atomic_thread_fence(__ATOMIC_RELEASE); \
+    bcr_setu1(reader, -opcode_len[opcode], _quick_opcode); \
+} while(false)
+
+// 快速指令的操作数是已解析的常量池项的索引
+#define RESOLVED(_type) ((_type *) cp->info[bcr_readu2(reader)])
+
 opc_nop:
     DISPATCH
 opc_aconst_null:
-    ostack_pushr(frame, NULL);
+    pushr(NULL);
     DISPATCH
 opc_iconst_m1:
-    ostack_pushi(frame, -1);
+    pushi(-1);
     DISPATCH
 opc_iconst_0:
-    ostack_pushi(frame, 0);
+    pushi(0);
     DISPATCH
 opc_iconst_1:
-    ostack_pushi(frame, 1);
+    pushi(1);
     DISPATCH
 opc_iconst_2:
-    ostack_pushi(frame, 2);
+    pushi(2);
     DISPATCH
 opc_iconst_3:
-    ostack_pushi(frame, 3);
+    pushi(3);
     DISPATCH
 opc_iconst_4:
-    ostack_pushi(frame, 4);
+    pushi(4);
     DISPATCH
 opc_iconst_5:
-    ostack_pushi(frame, 5);
+    pushi(5);
     DISPATCH
 opc_lconst_0:
-    ostack_pushl(frame, 0);
+    pushl(0);
     DISPATCH
 opc_lconst_1:
-    ostack_pushl(frame, 1);
+    pushl(1);
     DISPATCH
 opc_fconst_0:
-    ostack_pushf(frame, 0);
+    pushf(0);
     DISPATCH
 opc_fconst_1:
-    ostack_pushf(frame, 1);
+    pushf(1);
     DISPATCH
 opc_fconst_2:
-    ostack_pushf(frame, 2);
+    pushf(2);
     DISPATCH
 opc_dconst_0:
-    ostack_pushd(frame, 0);
+    pushd(0);
     DISPATCH
 opc_dconst_1:
-    ostack_pushd(frame, 1);
+    pushd(1);
     DISPATCH
 opc_bipush: // Byte Integer push
-    ostack_pushi(frame, bcr_reads1(reader));
+    pushi(bcr_reads1(reader));
     DISPATCH
 opc_sipush: // Short Integer push
-    ostack_pushi(frame, bcr_reads2(reader));
+    pushi(bcr_reads2(reader));
     DISPATCH
 opc_ldc:
     index = bcr_readu1(reader);
@@ -250,18 +356,20 @@ _ldc: {
     u1 type = cp_get_type(cp, index);
     switch (type) {
         case JVM_CONSTANT_Integer:
-            ostack_pushi(frame, cp_get_int(cp, index));
+            pushi(cp_get_int(cp, index));
             break;
         case JVM_CONSTANT_Float:
-            ostack_pushf(frame, cp_get_float(cp, index));
+            pushf(cp_get_float(cp, index));
             break;
         case JVM_CONSTANT_String:
         case JVM_CONSTANT_ResolvedString:
-            ostack_pushr(frame, resolve_string(cp, index));
+            SAVE_STATE;
+            pushr(resolve_string(cp, index));
             break;
         case JVM_CONSTANT_Class:
         case JVM_CONSTANT_ResolvedClass:
-            ostack_pushr(frame, resolve_class(cp, index)->java_mirror);
+            SAVE_STATE;
+            pushr(resolve_class(cp, index)->java_mirror);
             break;
         default:
             HANDLE_EXCEPTION(S(java_lang_UnknownError), NULL); // todo msg
@@ -275,11 +383,11 @@ opc_ldc2_w: {
     u1 type = cp_get_type(cp, index);
     switch (type) {
         case JVM_CONSTANT_Long:
-            ostack_pushl(frame, cp_get_long(cp, index));
+            pushl(cp_get_long(cp, index));
             break;
         case JVM_CONSTANT_Double:
 //             printvm("=====    %f\n", cp->getDouble(index));
-            ostack_pushd(frame, cp_get_double(cp, index));
+            pushd(cp_get_double(cp, index));
             break;
         default:
             HANDLE_EXCEPTION(S(java_lang_UnknownError), NULL); // todo msg
@@ -295,60 +403,60 @@ opc_aload:
 _iload:
 _fload:
 _aload:
-    *frame->ostack++ = lvars[index];
+    *ostack++ = lvars[index];
     DISPATCH
 opc_lload:
 opc_dload: 
     index = bcr_readu1(reader);
 _lload:
 _dload: 
-    *frame->ostack++ = lvars[index];
-    *frame->ostack++ = lvars[index + 1];
+    *ostack++ = lvars[index];
+    *ostack++ = lvars[index + 1];
     DISPATCH
 opc_iload_0:
 opc_fload_0:
 opc_aload_0:
-    *frame->ostack++ = lvars[0];
+    *ostack++ = lvars[0];
     DISPATCH
 opc_iload_1:
 opc_fload_1:
 opc_aload_1:
-    *frame->ostack++ = lvars[1];
+    *ostack++ = lvars[1];
     DISPATCH
 opc_iload_2:
 opc_fload_2:
 opc_aload_2:
-    *frame->ostack++ = lvars[2];
+    *ostack++ = lvars[2];
     DISPATCH
 opc_iload_3:
 opc_fload_3:
 opc_aload_3:
-    *frame->ostack++ = lvars[3];
+    *ostack++ = lvars[3];
     DISPATCH
 opc_lload_0:
 opc_dload_0:
-    *frame->ostack++ = lvars[0];
-    *frame->ostack++ = lvars[1];
+    *ostack++ = lvars[0];
+    *ostack++ = lvars[1];
     DISPATCH
 opc_lload_1:
 opc_dload_1:
-    *frame->ostack++ = lvars[1];
-    *frame->ostack++ = lvars[2];
+    *ostack++ = lvars[1];
+    *ostack++ = lvars[2];
     DISPATCH
 opc_lload_2:
 opc_dload_2:
-    *frame->ostack++ = lvars[2];
-    *frame->ostack++ = lvars[3];
+    *ostack++ = lvars[2];
+    *ostack++ = lvars[3];
     DISPATCH
 opc_lload_3:
 opc_dload_3:
-    *frame->ostack++ = lvars[3];
-    *frame->ostack++ = lvars[4];
+    *ostack++ = lvars[3];
+    *ostack++ = lvars[4];
     DISPATCH
     
 #define GET_AND_CHECK_ARRAY \
-    index = ostack_popi(frame); \
-    jarrRef arr = ostack_popr(frame); \
+    index = popi(); \
+    jarrRef arr = popr(); \
     NULL_POINTER_CHECK(arr); \
     if (!array_check_bounds(arr, index)) \
         HANDLE_EXCEPTION(S(java_lang_ArrayIndexOutOfBoundsException), NULL); /* todo msg */       
@@ -357,49 +465,49 @@ opc_dload_3:
 opc_iaload: {
     GET_AND_CHECK_ARRAY
     jint value = array_get(jint, arr, index);
-    ostack_pushi(frame, value);
+    pushi(value);
     DISPATCH
 }
 opc_faload: {
     GET_AND_CHECK_ARRAY
     jfloat value = array_get(jfloat, arr, index);
-    ostack_pushf(frame, value);
+    pushf(value);
     DISPATCH
 }
 opc_aaload: {
     GET_AND_CHECK_ARRAY
-    jref value = array_get(jref, arr, index);
-    ostack_pushr(frame, value);
+    jref value = array_get_ref(arr, index);
+    pushr(value);
     DISPATCH
 }
 opc_baload: {
     GET_AND_CHECK_ARRAY
     jint value = array_get(jbyte, arr, index);
-    ostack_pushi(frame, value);
+    pushi(value);
     DISPATCH
 }
 opc_caload: {
     GET_AND_CHECK_ARRAY
     jint value = array_get(jchar, arr, index);
-    ostack_pushi(frame, value);
+    pushi(value);
     DISPATCH
 }
 opc_saload: {
     GET_AND_CHECK_ARRAY
     jint value = array_get(jshort, arr, index);
-    ostack_pushi(frame, value);
+    pushi(value);
     DISPATCH
 }
 opc_laload: {
     GET_AND_CHECK_ARRAY
     jlong value = array_get(jlong, arr, index);
-    ostack_pushl(frame, value);
+    pushl(value);
     DISPATCH
 }
 opc_daload: {
     GET_AND_CHECK_ARRAY
     jdouble value = array_get(jdouble, arr, index);
-    ostack_pushd(frame, value);
+    pushd(value);
     DISPATCH
 }
 
@@ -410,79 +518,79 @@ opc_astore:
 _istore:
 _fstore:
 _astore:
-    lvars[index] = *--frame->ostack;
+    lvars[index] = *--ostack;
     DISPATCH
 opc_lstore:
 opc_dstore: 
     index = bcr_readu1(reader);
 _lstore:
 _dstore: 
-    lvars[index + 1] = *--frame->ostack;
-    lvars[index] = *--frame->ostack;
+    lvars[index + 1] = *--ostack;
+    lvars[index] = *--ostack;
     DISPATCH
 opc_istore_0:
 opc_fstore_0:
 opc_astore_0:
-    lvars[0] = *--frame->ostack;
+    lvars[0] = *--ostack;
     DISPATCH
 opc_istore_1:
 opc_fstore_1:
 opc_astore_1:
-    lvars[1] = *--frame->ostack;
+    lvars[1] = *--ostack;
     DISPATCH
 opc_istore_2:
 opc_fstore_2:
 opc_astore_2:
-    lvars[2] = *--frame->ostack;
+    lvars[2] = *--ostack;
     DISPATCH
 opc_istore_3:
 opc_fstore_3:
 opc_astore_3:
-    lvars[3] = *--frame->ostack;
+    lvars[3] = *--ostack;
     DISPATCH
 opc_lstore_0:
 opc_dstore_0:
-    lvars[1] = *--frame->ostack;
-    lvars[0] = *--frame->ostack;
+    lvars[1] = *--ostack;
+    lvars[0] = *--ostack;
     DISPATCH
 opc_lstore_1:
 opc_dstore_1:
-    lvars[2] = *--frame->ostack;
-    lvars[1] = *--frame->ostack;
+    lvars[2] = *--ostack;
+    lvars[1] = *--ostack;
     DISPATCH
 opc_lstore_2:
 opc_dstore_2:
-    lvars[3] = *--frame->ostack;
-    lvars[2] = *--frame->ostack;
+    lvars[3] = *--ostack;
+    lvars[2] = *--ostack;
     DISPATCH
 opc_lstore_3:
 opc_dstore_3:
-    lvars[4] = *--frame->ostack;
-    lvars[3] = *--frame->ostack;
+    lvars[4] = *--ostack;
+    lvars[3] = *--ostack;
     DISPATCH
 opc_iastore: {
-    jint value = ostack_popi(frame);
+    jint value = popi();
     GET_AND_CHECK_ARRAY
     // arr->setInt(index, value);
     array_set_int(arr, index, value);
     DISPATCH
 }
 opc_fastore: {
-    jfloat value = ostack_popf(frame);
+    jfloat value = popf();
     GET_AND_CHECK_ARRAY
     // arr->setFloat(index, value);
     array_set_float(arr, index, value);
     DISPATCH
 }
 opc_aastore: {
-    jref value = ostack_popr(frame);
+    jref value = popr();
     GET_AND_CHECK_ARRAY
     // arr->setRef(index, value);
     array_set_ref(arr, index, value);
     DISPATCH
 }
 opc_bastore: {
-    jint value = ostack_popi(frame);
+    jint value = popi();
     GET_AND_CHECK_ARRAY
     if (is_byte_array_class(arr->clazz)) {
         array_set_byte(arr, index, JINT_TO_JBYTE(value));
@@ -494,25 +602,25 @@ opc_bastore: {
     DISPATCH
 }
 opc_castore: {
-    jint value = ostack_popi(frame);
+    jint value = popi();
     GET_AND_CHECK_ARRAY
     array_set_char(arr, index, JINT_TO_JCHAR(value));
     DISPATCH
 }
 opc_sastore: {
-    jint value = ostack_popi(frame);
+    jint value = popi();
     GET_AND_CHECK_ARRAY
     array_set_short(arr, index, JINT_TO_JSHORT(value));
     DISPATCH
 }
 opc_lastore: {
-    jlong value = ostack_popl(frame);
+    jlong value = popl();
     GET_AND_CHECK_ARRAY
     array_set_long(arr, index, value);
     DISPATCH
 }
 opc_dastore: {
-    jdouble value = ostack_popd(frame);
+    jdouble value = popd();
     GET_AND_CHECK_ARRAY
     array_set_double(arr, index, value);
     DISPATCH
@@ -520,66 +628,66 @@ opc_dastore: {
 #undef GET_AND_CHECK_ARRAY
 
 opc_pop:
-    frame->ostack--;
+    ostack--;
     DISPATCH
 opc_pop2:
-    frame->ostack -= 2;
+    ostack -= 2;
     DISPATCH
 opc_dup:
-    frame->ostack[0] = frame->ostack[-1];
-    frame->ostack++;
+    ostack[0] = ostack[-1];
+    ostack++;
     DISPATCH
 opc_dup_x1:
-    frame->ostack[0] = frame->ostack[-1];
-    frame->ostack[-1] = frame->ostack[-2];
-    frame->ostack[-2] = frame->ostack[0];
-    frame->ostack++;
+    ostack[0] = ostack[-1];
+    ostack[-1] = ostack[-2];
+    ostack[-2] = ostack[0];
+    ostack++;
     DISPATCH
 opc_dup_x2:
-    frame->ostack[0] = frame->ostack[-1];
-    frame->ostack[-1] = frame->ostack[-2];
-    frame->ostack[-2] = frame->ostack[-3];
-    frame->ostack[-3] = frame->ostack[0];
-    frame->ostack++;
+    ostack[0] = ostack[-1];
+    ostack[-1] = ostack[-2];
+    ostack[-2] = ostack[-3];
+    ostack[-3] = ostack[0];
+    ostack++;
     DISPATCH
 opc_dup2:
-    frame->ostack[0] = frame->ostack[-2];
-    frame->ostack[1] = frame->ostack[-1];
-    frame->ostack += 2;
+    ostack[0] = ostack[-2];
+    ostack[1] = ostack[-1];
+    ostack += 2;
     DISPATCH
 opc_dup2_x1:
     // ..., value3, value2, value1 →
     // ..., value2, value1, value3, value2, value1
-    frame->ostack[1] = frame->ostack[-1];
-    frame->ostack[0] = frame->ostack[-2];
-    frame->ostack[-1] = frame->ostack[-3];
-    frame->ostack[-2] = frame->ostack[1];
-    frame->ostack[-3] = frame->ostack[0];
-    frame->ostack += 2;
+    ostack[1] = ostack[-1];
+    ostack[0] = ostack[-2];
+    ostack[-1] = ostack[-3];
+    ostack[-2] = ostack[1];
+    ostack[-3] = ostack[0];
+    ostack += 2;
     DISPATCH
 opc_dup2_x2:
     // ..., value4, value3, value2, value1 →
     // ..., value2, value1, value4, value3, value2, value1
-    frame->ostack[1] = frame->ostack[-1];
-    frame->ostack[0] = frame->ostack[-2];
-    frame->ostack[-1] = frame->ostack[-3];
-    frame->ostack[-2] = frame->ostack[-4];
-    frame->ostack[-3] = frame->ostack[1];
-    frame->ostack[-4] = frame->ostack[0];
-    frame->ostack += 2;
+    ostack[1] = ostack[-1];
+    ostack[0] = ostack[-2];
+    ostack[-1] = ostack[-3];
+    ostack[-2] = ostack[-4];
+    ostack[-3] = ostack[1];
+    ostack[-4] = ostack[0];
+    ostack += 2;
     DISPATCH
 opc_swap: {
-    slot_t tmp = frame->ostack[-1];
-    frame->ostack[-1] = frame->ostack[-2];
-    frame->ostack[-2] = tmp;
-    // swap(frame->ostack[-1], frame->ostack[-2]);
+    slot_t tmp = ostack[-1];
+    ostack[-1] = ostack[-2];
+    ostack[-2] = tmp;
+    // swap(ostack[-1], ostack[-2]);
     DISPATCH
 }
 #define BINARY_OP(type, t, oper) \
 do { \
-    type v2 = ostack_pop##t(frame); \
-    type v1 = ostack_pop##t(frame); \
-    ostack_push##t(frame, v1 oper v2); \
+    type v2 = pop##t(); \
+    type v1 = pop##t(); \
+    push##t(v1 oper v2); \
     DISPATCH \
 } while(false)
 
@@ -615,80 +723,80 @@ do { \
 } while(false)
 
 opc_idiv:
-    ZERO_DIVISOR_CHECK(slot_get_int(frame->ostack - 1));
+    ZERO_DIVISOR_CHECK(slot_get_int(ostack - 1));
     BINARY_OP(jint, i, /);
 opc_ldiv:
-    ZERO_DIVISOR_CHECK(slot_get_long(frame->ostack - 2));
+    ZERO_DIVISOR_CHECK(slot_get_long(ostack - 2));
     BINARY_OP(jlong, l, /);
 opc_fdiv:
-    ZERO_DIVISOR_CHECK(slot_get_float(frame->ostack - 1));
+    ZERO_DIVISOR_CHECK(slot_get_float(ostack - 1));
     BINARY_OP(jfloat, f, /);
 opc_ddiv:
-    ZERO_DIVISOR_CHECK(slot_get_double(frame->ostack - 2));
+    ZERO_DIVISOR_CHECK(slot_get_double(ostack - 2));
     BINARY_OP(jdouble, d, /);
 opc_irem: 
-    ZERO_DIVISOR_CHECK(slot_get_int(frame->ostack - 1));
+    ZERO_DIVISOR_CHECK(slot_get_int(ostack - 1));
     BINARY_OP(jint, i, %);
 opc_lrem:
-    ZERO_DIVISOR_CHECK(slot_get_long(frame->ostack - 2));
+    ZERO_DIVISOR_CHECK(slot_get_long(ostack - 2));
     BINARY_OP(jlong, l, %);
 #undef ZERO_DIVISOR_CHECK
 
 opc_frem: {
-    jfloat v2 = ostack_popf(frame);
-    jfloat v1 = ostack_popf(frame);
-    ostack_pushf(frame, fmod(v1, v2));
+    jfloat v2 = popf();
+    jfloat v1 = popf();
+    pushf(fmod(v1, v2));
     DISPATCH
 }
 opc_drem: {
-    jdouble v2 = ostack_popd(frame);
-    jdouble v1 = ostack_popd(frame);
-    ostack_pushd(frame, fmod(v1, v2));
+    jdouble v2 = popd();
+    jdouble v1 = popd();
+    pushd(fmod(v1, v2));
     DISPATCH
 }
 opc_ineg:
-    ostack_pushi(frame, -ostack_popi(frame));
+    pushi(-popi());
     DISPATCH
 opc_lneg:
-    ostack_pushl(frame, -ostack_popl(frame));
+    pushl(-popl());
     DISPATCH
 opc_fneg:
-    ostack_pushf(frame, -ostack_popf(frame));
+    pushf(-popf());
     DISPATCH
 opc_dneg:
-    ostack_pushd(frame, -ostack_popd(frame));
+    pushd(-popd());
     DISPATCH 
 opc_ishl: {
     // 与0x1f是因为低5位表示位移距离，位移距离实际上被限制在0到31之间。
-    jint shift = ostack_popi(frame) & 0x1f;
+    jint shift = popi() & 0x1f;
     assert(0 <= shift && shift <= 31);
-    jint x = ostack_popi(frame);
-    ostack_pushi(frame, x << shift);
+    jint x = popi();
+    pushi(x << shift);
     DISPATCH
 }
 opc_lshl: {
     // 与0x3f是因为低6位表示位移距离，位移距离实际上被限制在0到63之间。
-    jint shift = ostack_popi(frame) & 0x3f;
+    jint shift = popi() & 0x3f;
     assert(0 <= shift && shift <= 63);
-    jlong x = ostack_popl(frame);
-    ostack_pushl(frame, x << shift);
+    jlong x = popl();
+    pushl(x << shift);
     DISPATCH
 }
 opc_ishr: {
     // 算术右移 shift arithmetic right
     // 带符号右移。正数右移高位补0，负数右移高位补1。
     // 对应于Java中的 >>
-    jint shift = ostack_popi(frame) & 0x1f;
+    jint shift = popi() & 0x1f;
     assert(0 <= shift && shift <= 31);
-    jint x = ostack_popi(frame);
-    ostack_pushi(frame, x >> shift);
+    jint x = popi();
+    pushi(x >> shift);
     DISPATCH
 }
 opc_lshr: {
-    jint shift = ostack_popi(frame) & 0x3f;
+    jint shift = popi() & 0x3f;
     assert(0 <= shift && shift <= 63);
-    jlong x = ostack_popl(frame);
-    ostack_pushl(frame, x >> shift);
+    jlong x = popl();
+    pushl(x >> shift);
     DISPATCH
 }
 opc_iushr: {
@@ -696,19 +804,19 @@ opc_iushr: {
     // 无符号右移。无论是正数还是负数，高位通通补0。
     // 对应于Java中的 >>>
     // https://stackoverflow.com/questions/5253194/implementing-logical-right-shift-in-c/
-    jint shift = ostack_popi(frame) & 0x1f;
+    jint shift = popi() & 0x1f;
     assert(0 <= shift && shift <= 31);
-    jint x = ostack_popi(frame);
+    jint x = popi();
     int size = sizeof(jint) * 8 - 1; // bits count
-    ostack_pushi(frame, (x >> shift) & ~(((((jint)1) << size) >> shift) << 1));
+    pushi((x >> shift) & ~(((((jint)1) << size) >> shift) << 1));
     DISPATCH
 }
 opc_lushr: {
-    jint shift = ostack_popi(frame) & 0x3f;
+    jint shift = popi() & 0x3f;
     assert(0 <= shift && shift <= 63);
-    jlong x = ostack_popl(frame);
+    jlong x = popl();
     int size = sizeof(jlong) * 8 - 1; // bits count
-    ostack_pushl(frame, (x >> shift) & ~(((((jlong)1) << size) >> shift) << 1));
+    pushl((x >> shift) & ~(((((jlong)1) << size) >> shift) << 1));
     DISPATCH
 }
 opc_iand:
@@ -733,49 +841,49 @@ _wide_iinc:
     slot_set_int(lvars + index, slot_get_int(lvars + index) + bcr_reads2(reader)); 
     DISPATCH
 opc_i2l:
-    ostack_pushl(frame, ostack_popi(frame));
+    pushl(popi());
     DISPATCH
 opc_i2f:
-    ostack_pushf(frame, ostack_popi(frame));
+    pushf(popi());
     DISPATCH
 opc_i2d:
-    ostack_pushd(frame, ostack_popi(frame));
+    pushd(popi());
     DISPATCH
 opc_l2i:
-    ostack_pushi(frame, (jint) ostack_popl(frame));
+    pushi((jint) popl());
     DISPATCH
 opc_l2f:
-    ostack_pushf(frame, (jfloat) ostack_popl(frame));
+    pushf((jfloat) popl());
     DISPATCH
 opc_l2d:
-    ostack_pushd(frame, ostack_popl(frame));
+    pushd(popl());
     DISPATCH
 opc_f2i:
-   ostack_pushi(frame, (jint) ostack_popf(frame));
+   pushi((jint) popf());
     DISPATCH
 opc_f2l:
-    ostack_pushl(frame, (jlong) ostack_popf(frame));
+    pushl((jlong) popf());
     DISPATCH
 opc_f2d:
-    ostack_pushd(frame, ostack_popf(frame));
+    pushd(popf());
     DISPATCH
 opc_d2i:
-    ostack_pushi(frame, (jint) ostack_popd(frame));
+    pushi((jint) popd());
     DISPATCH
 opc_d2l:
-    ostack_pushl(frame, (jlong) ostack_popd(frame));
+    pushl((jlong) popd());
     DISPATCH
 opc_d2f:
-    ostack_pushf(frame, (jfloat) ostack_popd(frame));
+    pushf((jfloat) popd());
     DISPATCH
 opc_i2b:
-    ostack_pushi(frame, JINT_TO_JBYTE(ostack_popi(frame)));
+    pushi(JINT_TO_JBYTE(popi()));
     DISPATCH
 opc_i2c:
-    ostack_pushi(frame, JINT_TO_JCHAR(ostack_popi(frame)));
+    pushi(JINT_TO_JCHAR(popi()));
     DISPATCH
 opc_i2s:
-    ostack_pushi(frame, JINT_TO_JSHORT(ostack_popi(frame)));
+    pushi(JINT_TO_JSHORT(popi()));
     DISPATCH
 /*
  * NAN 与正常的的浮点数无法比较，即 即不大于 也不小于 也不等于。
@@ -786,9 +894,9 @@ opc_i2s:
 
 #define CMP(type, t, cmp_result) \
 do { \
-    type v2 = ostack_pop##t(frame); \
-    type v1 = ostack_pop##t(frame); \
-    ostack_pushi(frame, cmp_result); \
+    type v2 = pop##t(); \
+    type v1 = pop##t(); \
+    pushi(cmp_result); \
     DISPATCH \
 } while(false)
 
@@ -807,10 +915,10 @@ opc_dcmpg:
 
 #define IF_COND(cond, opc_len) \
 do { \
-    jint v = ostack_popi(frame); \
+    jint v = popi(); \
     jint offset = bcr_reads2(reader); \
     if (v cond 0) \
-        bcr_skip(reader, offset - opc_len); \
+        BRANCH(offset, opc_len); \
     DISPATCH \
 } while(false)
 
@@ -832,10 +940,10 @@ opc_ifle:
 #define IF_CMP_COND(type, t, cond, opc_len) \
 do { \
     s2 offset = bcr_reads2(reader); \
-    type v2 = ostack_pop##t(frame); \
-    type v1 = ostack_pop##t(frame); \
+    type v2 = pop##t(); \
+    type v1 = pop##t(); \
     if (v1 cond v2) \
-        bcr_skip(reader, offset - opc_len); \
+        BRANCH(offset, opc_len); \
     DISPATCH \
 } while(false)
 
@@ -860,7 +968,7 @@ opc_if_icmple:
 
 opc_goto: {
     s2 offset = bcr_reads2(reader);
-    bcr_skip(reader, offset - opcode_len[JVM_OPC_goto]);
+    BRANCH(offset, opcode_len[JVM_OPC_goto]);
     DISPATCH
 }
 
@@ -890,13 +998,15 @@ opc_tableswitch: {
     bcr_reads4s(reader, jump_offset_count, jump_offsets);
 
     // 弹出要判断的值
-    index = ostack_popi(frame);
+    index = popi();
     s4 offset;
     if (index < low || index > height) {
         offset = default_offset; // 没在 case 标识的范围内，跳转到 default 分支。
     } else {
         offset = jump_offsets[index - low]; // 找到对应的case了
     }
+    if (offset < 0)
+        SAFEPOINT_POLL;
 
     // The target address that can be calculated from each jump table
     // offset, as well as the one that can be calculated from default,
@@ -923,7 +1033,7 @@ opc_lookupswitch: {
     bcr_reads4s(reader, npairs * 2, match_offsets);
 
     // 弹出要判断的值
-    jint key = ostack_popi(frame);
+    jint key = popi();
     s4 offset = default_offset;
     for (int i = 0; i < npairs * 2; i += 2) {
         if (match_offsets[i] == key) { // 找到 case
@@ -932,6 +1042,9 @@ opc_lookupswitch: {
         }
     }
 
+    if (offset < 0)
+        SAFEPOINT_POLL;
+
     // The target address is calculated by adding the corresponding offset
     // to the address of the opcode of this lookupswitch instruction.
     reader->pc = saved_pc + offset;
@@ -953,80 +1066,91 @@ opc_return:
 _method_return: {
     TRACE("will return: %s", get_frame_info(frame));
     pop_frame(thread);
+    UNLOCK_SYNC_OBJ(frame);
     Frame *invoke_frame = thread->top_frame;
     TRACE("invoke frame: %s", invoke_frame == NULL ? "NULL" : get_frame_info(invoke_frame));
-    frame->ostack -= ret_value_slot_count;
-    slot_t *ret_value = frame->ostack;
+    ostack -= ret_value_slot_count;
+    slot_t *ret_value = ostack;
     if (frame->vm_invoke || invoke_frame == NULL) {
-        if (IS_SYNCHRONIZED(frame->method)) {
-//                        _this->unlock();
-        }
         return ret_value;
     }
 
     for (int i = 0; i < ret_value_slot_count; i++) {
         *invoke_frame->ostack++ = *ret_value++;
     }
-    if (IS_SYNCHRONIZED(frame->method)) {
-//                    _this->unlock();
-    }
     CHANGE_FRAME(invoke_frame);
     DISPATCH  
 }
+    Field *field;
 opc_getstatic: {
+    SAVE_STATE;
     index = bcr_readu2(reader);
-    Field *field = resolve_field(cp, index);
+    field = resolve_field(cp, index);
     if (!IS_STATIC(field)) {
         HANDLE_EXCEPTION(S(java_lang_IncompatibleClassChangeError), get_field_info(field));  
     }
 
     init_class(field->clazz);
-
-    *frame->ostack++ = field->static_value.data[0];
+    if (field->clazz->state == CLASS_INITED)
+        QUICKEN(JVM_OPC_getstatic_quick);
+    goto _getstatic;
+opc_getstatic_quick:
+    field = RESOLVED(Field);
+_getstatic:
+    *ostack++ = field->static_value.data[0];
     if (field->category_two) {
-        *frame->ostack++ = field->static_value.data[1];
+        *ostack++ = field->static_value.data[1];
     }
     DISPATCH
 }
 opc_putstatic: {
+    SAVE_STATE;
     index = bcr_readu2(reader);
-    Field *field = resolve_field(cp, index);
+    field = resolve_field(cp, index);
     if (!IS_STATIC(field)) {
         HANDLE_EXCEPTION(S(java_lang_IncompatibleClassChangeError), get_field_info(field));  
     }
 
     init_class(field->clazz);
-
+    if (field->clazz->state == CLASS_INITED)
+        QUICKEN(JVM_OPC_putstatic_quick);
+    goto _putstatic;
+opc_putstatic_quick:
+    field = RESOLVED(Field);
+_putstatic:
     if (field->category_two) {
-        frame->ostack -= 2;
-        field->static_value.data[0] = frame->ostack[0];
-        field->static_value.data[1] = frame->ostack[1];
+        ostack -= 2;
+        field->static_value.data[0] = ostack[0];
+        field->static_value.data[1] = ostack[1];
     } else {
-        field->static_value.data[0] = *--frame->ostack;
+        if (!is_prim_field(field))
+            pre_write_barrier_static(&field->static_value.r);
+        field->static_value.data[0] = *--ostack;
     }
 
     DISPATCH
 }                
 opc_getfield: {
+    SAVE_STATE;
     index = bcr_readu2(reader);
-    Field *field = resolve_field(cp, index);
+    field = resolve_field(cp, index);
     CHECK_EXCEPTION_OCCURRED
     if (IS_STATIC(field)) {
         HANDLE_EXCEPTION(S(java_lang_IncompatibleClassChangeError), get_field_info(field));  
     }
+    QUICKEN(getfield_quick_opcode(field));
 
-    jref obj = ostack_popr(frame);
+    jref obj = popr();
     NULL_POINTER_CHECK(obj);
 
-    *frame->ostack++ = obj->data[field->id];
-    if (field->category_two) {
-        *frame->ostack++ = obj->data[field->id + 1];
-    }
+    get_field_value0(obj, field, ostack);
+    ostack += field->category_two ? 2 : 1;
     DISPATCH
 }
 opc_putfield: {
+    SAVE_STATE;
     index = bcr_readu2(reader);
-    Field *field = resolve_field(cp, index);
+    field = resolve_field(cp, index);
     CHECK_EXCEPTION_OCCURRED
     if (IS_STATIC(field)) {
         HANDLE_EXCEPTION(S(java_lang_IncompatibleClassChangeError), get_field_info(field));  
@@ -1038,31 +1162,68 @@ opc_putfield: {
             HANDLE_EXCEPTION(S(java_lang_IllegalAccessError), get_field_info(field));   
         }
     }
+    QUICKEN(putfield_quick_opcode(field));
 
     if (field->category_two) {
-        frame->ostack -= 2;
+        ostack -= 2;
     } else {
-        frame->ostack--;
+        ostack--;
     }
-    slot_t *value = frame->ostack;
+    slot_t *value = ostack;
 
-    jref obj = ostack_popr(frame);
+    jref obj = popr();
     NULL_POINTER_CHECK(obj);
 
     set_field_value0(obj, field, value);
     DISPATCH
-}                   
+}
+
+#define GETFIELD_QUICK(_push, _get_field0) \
+{ \
+    field = RESOLVED(Field); \
+    jref obj = popr(); \
+    NULL_POINTER_CHECK(obj); \
+    _push(_get_field0(obj, field)); \
+    DISPATCH \
+}
+opc_getfield_b_quick: GETFIELD_QUICK(pushi, get_byte_field0)
+opc_getfield_c_quick: GETFIELD_QUICK(pushi, get_char_field0)
+opc_getfield_s_quick: GETFIELD_QUICK(pushi, get_short_field0)
+opc_getfield_i_quick: GETFIELD_QUICK(pushi, get_int_field0)   // float 按 int 的位复制
+opc_getfield_l_quick: GETFIELD_QUICK(pushl, get_long_field0)  // double 按 long 的位复制
+opc_getfield_a_quick: GETFIELD_QUICK(pushr, get_ref_field0)
+#undef GETFIELD_QUICK
+
+#define PUTFIELD_QUICK(_slots_count, _slot_get, _set_field0) \
+{ \
+    field = RESOLVED(Field); \
+    ostack -= (_slots_count); \
+    slot_t *value = ostack; \
+    jref obj = popr(); \
+    NULL_POINTER_CHECK(obj); \
+    _set_field0(obj, field, _slot_get(value)); \
+    DISPATCH \
+}
+opc_putfield_b_quick: PUTFIELD_QUICK(1, slot_get_byte, set_byte_field0)
+opc_putfield_z_quick: PUTFIELD_QUICK(1, slot_get_bool, set_bool_field0)
+opc_putfield_c_quick: PUTFIELD_QUICK(1, slot_get_short, set_short_field0) // char 和 short 都只写低16位
+opc_putfield_i_quick: PUTFIELD_QUICK(1, slot_get_int, set_int_field0)
+opc_putfield_l_quick: PUTFIELD_QUICK(2, slot_get_long, set_long_field0)
+opc_putfield_a_quick: PUTFIELD_QUICK(1, slot_get_ref, set_ref_field0)
+#undef PUTFIELD_QUICK
+    Method *m;
 opc_invokevirtual: {
+    SAVE_STATE;
     // invokevirtual指令用于调用对象的实例方法，根据对象的实际类型进行分派（虚方法分派）。
     index = bcr_readu2(reader);
-    Method *m = resolve_method(cp, index);
+    m = resolve_method(cp, index);
     CHECK_EXCEPTION_OCCURRED
 
     if (is_signature_polymorphic(m)) {
         assert(IS_NATIVE(m));
-//        frame->ostack -= m->arg_slot_count;
+//        ostack -= m->arg_slot_count;
         u2 arg_slots_count = cal_method_args_slots_count(m->descriptor, true);
-        frame->ostack -= arg_slots_count;
+        ostack -= arg_slots_count;
         resolved_method = m;
         assert(resolved_method);
         goto _invoke_method;
@@ -1072,31 +1233,45 @@ opc_invokevirtual: {
         HANDLE_EXCEPTION(S(java_lang_IncompatibleClassChangeError), get_method_info(m));  
     }
 
-    frame->ostack -= m->arg_slot_count;
-    jref obj = slot_get_ref(frame->ostack);
+    // private 和 final 方法不会被覆盖，不需要分派
+    if (IS_PRIVATE(m) || IS_FINAL(m) || IS_FINAL(m->clazz)) {
+        QUICKEN(JVM_OPC_invokenonvirtual_quick);
+        goto _invokenonvirtual;
+    }
+    QUICKEN(JVM_OPC_invokevirtual_quick);
+    goto _invokevirtual;
+opc_invokevirtual_quick:
+    m = RESOLVED(Method);
+_invokevirtual:
+    ostack -= m->arg_slot_count;
+    jref obj = slot_get_ref(ostack);
     NULL_POINTER_CHECK(obj);
 
-    if (IS_PRIVATE(m)) {
-        resolved_method = m;
-    } else {
-        // assert(m->vtable_index >= 0);
-        // assert(m->vtable_index < (int) obj->clazz->vtable.size());
-        // resolved_method = obj->clazz->vtable[m->vtable_index];
-        resolved_method = lookup_method(obj->clazz, m->name, m->descriptor);
+    // 先查调用点的 inline cache，没有命中再查 vtable
+    InlineCache *ic = get_inline_cache(frame->method, reader->pc - opcode_len[JVM_OPC_invokevirtual]);
+    resolved_method = inline_cache_lookup(ic, obj->clazz);
+    if (resolved_method == NULL) {
+        // obj 的类是 m 的类（或实现了 m 的接口）的子类，其 vtable 包含父类的 vtable，见 class.c 中的 create_vtable
+        assert(m->vtable_index >= 0);
+        assert((size_t) m->vtable_index < obj->clazz->vtable_len);
+        resolved_method = obj->clazz->vtable[m->vtable_index];
+        // assert(resolved_method == lookup_method(obj->clazz, m->name, m->descriptor));
         assert(resolved_method);
+        inline_cache_update(ic, obj->clazz, resolved_method);
+    }
+    if (IS_ABSTRACT(resolved_method)) {
+        HANDLE_EXCEPTION(S(java_lang_AbstractMethodError), get_method_info(resolved_method));  
     }
-    
-    // assert(resolved_method == obj->clazz->lookupMethod(m->name, m->descriptor));
-    assert(resolved_method);
     goto _invoke_method;
 }
 opc_invokespecial: {
+    SAVE_STATE;
     // invokespecial指令用于调用一些需要特殊处理的实例方法， 包括：
     // 1. 构造函数
     // 2. 私有方法
     // 3. 通过super关键字调用的超类方法，或者超接口中的默认方法。
     index = bcr_readu2(reader);
-    Method *m = resolve_method_or_interface_method(cp, index);
+    Method *resolved = m = resolve_method_or_interface_method(cp, index);
     CHECK_EXCEPTION_OCCURRED
 
     /*
@@ -1118,8 +1293,15 @@ opc_invokespecial: {
         HANDLE_EXCEPTION(S(java_lang_IncompatibleClassChangeError), get_method_info(m));  
     }
 
-    frame->ostack -= m->arg_slot_count;
-    jref obj = slot_get_ref(frame->ostack);
+    // 调用超类方法时要调用的不是常量池中解析出的方法，不改写
+    if (m == resolved)
+        QUICKEN(JVM_OPC_invokenonvirtual_quick);
+    goto _invokenonvirtual;
+opc_invokenonvirtual_quick:
+    m = RESOLVED(Method);
+_invokenonvirtual:
+    ostack -= m->arg_slot_count;
+    jref obj = slot_get_ref(ostack);
     NULL_POINTER_CHECK(obj);
 
     resolved_method = m;
@@ -1127,10 +1309,11 @@ opc_invokespecial: {
     goto _invoke_method;
 }
 opc_invokestatic: {
+    SAVE_STATE;
     // invokestatic指令用来调用静态方法。
     // 如果类还没有被初始化，会触发类的初始化。
     index = bcr_readu2(reader);
-    Method *m = resolve_method_or_interface_method(cp, index);
+    m = resolve_method_or_interface_method(cp, index);
     CHECK_EXCEPTION_OCCURRED
     if (IS_ABSTRACT(m)) {
         HANDLE_EXCEPTION(S(java_lang_AbstractMethodError), get_method_info(m));  
@@ -1145,13 +1328,19 @@ opc_invokestatic: {
     // }
 
     init_class(m->clazz);
-
-    frame->ostack -= m->arg_slot_count;
+    if (m->clazz->state == CLASS_INITED)
+        QUICKEN(JVM_OPC_invokestatic_quick);
+    goto _invokestatic;
+opc_invokestatic_quick:
+    m = RESOLVED(Method);
+_invokestatic:
+    ostack -= m->arg_slot_count;
     resolved_method = m;
     assert(resolved_method);
     goto _invoke_method;
 }            
 opc_invokeinterface: {
+    SAVE_STATE;
     index = bcr_readu2(reader);
 
     /*
@@ -1166,21 +1355,40 @@ opc_invokeinterface: {
      */
     bcr_readu1(reader);
 
-    Method *m = resolve_interface_method(cp, index);
+    m = resolve_interface_method(cp, index);
     CHECK_EXCEPTION_OCCURRED
-    assert(IS_INTERFACE(m->clazz));
-
+    if (!IS_INTERFACE(m->clazz) || IS_PRIVATE(m)) {
+        // 接口中的 private 方法和 Object 中的方法（用接口类型的引用调用 toString 等）不经过 itable，不改写
+        ostack -= m->arg_slot_count;
+        jref obj = slot_get_ref(ostack);
+        NULL_POINTER_CHECK(obj);
+        resolved_method = IS_PRIVATE(m) ? m : obj->clazz->vtable[m->vtable_index];
+        goto _invoke_method;
+    }
+    QUICKEN(JVM_OPC_invokeinterface_quick);
+    goto _invokeinterface;
+opc_invokeinterface_quick:
+    m = RESOLVED(Method);
+    bcr_skip(reader, 2); // count 和 0
+_invokeinterface:
     /* todo 本地方法 */
 
-    frame->ostack -= m->arg_slot_count;
-    jref obj = slot_get_ref(frame->ostack);
+    ostack -= m->arg_slot_count;
+    jref obj = slot_get_ref(ostack);
     NULL_POINTER_CHECK(obj);
 
-    // itable的实现还不对 todo
-    // resolved_method = obj->clazz->findFromITable(m->clazz, m->itable_index);
-    // assert(resolved_method != NULL);
-    // assert(resolved_method == obj->clazz->lookupMethod(m->name, m->descriptor));
-    resolved_method = lookup_method(obj->clazz, m->name, m->descriptor);
+    // 先查调用点的 inline cache，没有命中再查 itable
+    InlineCache *ic = get_inline_cache(frame->method, reader->pc - opcode_len[JVM_OPC_invokeinterface]);
+    resolved_method = inline_cache_lookup(ic, obj->clazz);
+    if (resolved_method == NULL) {
+        // 在 obj 的类实现的接口中找到 m 的接口，再按 itable_index 取出实现，见 class.c 中的 create_itable
+        resolved_method = lookup_itable_method(obj->clazz, m);
+        if (resolved_method == NULL) {
+            HANDLE_EXCEPTION(S(java_lang_IncompatibleClassChangeError), get_method_info(m));  
+        }
+        inline_cache_update(ic, obj->clazz, resolved_method);
+    }
+    // assert(resolved_method == lookup_method(obj->clazz, m->name, m->descriptor));
     if (IS_ABSTRACT(resolved_method)) {
         HANDLE_EXCEPTION(S(java_lang_AbstractMethodError), get_method_info(resolved_method));  
     }
@@ -1193,6 +1401,7 @@ opc_invokeinterface: {
     goto _invoke_method;
 }           
 opc_invokedynamic: {
+    SAVE_STATE;
     // JVM_PANIC("Don't support invokedynamic.\n"); ///////////////////////////////////////////
 
     u2 i = bcr_readu2(reader); // point to JVM_CONSTANT_InvokeDynamic_info
@@ -1242,11 +1451,11 @@ opc_invokedynamic: {
             slot_t _args[slots_count];
             slot_set_ref(_args, exact_method_handle);
             slots_count--; // 减去"this"
-            frame->ostack -= slots_count; // pop all args
-            memcpy(_args + 1, frame->ostack, slots_count * sizeof(slot_t));
+            ostack -= slots_count; // pop all args
+            memcpy(_args + 1, ostack, slots_count * sizeof(slot_t));
             // invoke exact method, invokedynamic completely execute over.
             slot_t *ret = exec_java(invokeExact, _args);
-            ostack_pushr(frame, slot_get_ref(ret));
+            pushr(slot_get_ref(ret));
             break;
         }
         case JVM_REF_newInvokeSpecial:
@@ -1263,7 +1472,9 @@ opc_invokenative: {
 
     // todo 不需要在这里做任何同步的操作
 
+    SAVE_STATE;
     call_jni_method(frame);
+    ostack = frame->ostack; // 返回值压在了 Frame 的操作数栈中
 
     // JNI 函数执行完毕，清空其局部引用表。
     for (int i = 0; i < frame->jni_local_ref_count; i++) {
@@ -1272,10 +1483,6 @@ opc_invokenative: {
     frame->jni_local_ref_count = 0;
 
     CHECK_EXCEPTION_OCCURRED
-
-    //    if (frame->method->isSynchronized()) {
-    //        _this->unlock();
-    //    }
     DISPATCH
 }
 //opc_invokehandle: {
@@ -1292,19 +1499,29 @@ opc_invokenative: {
 //}
 _invoke_method: {
     assert(resolved_method);
+    SAVE_STATE; // 参数已出栈，被调用者的 lvars 从这里开始，返回值也压到这里
+    safepoint_poll(thread);
     Frame *new_frame = alloc_frame(thread, resolved_method, false);
     TRACE("Alloc new frame: %s", get_frame_info(new_frame));
 
-    new_frame->lvars = frame->ostack; // todo 什么意思？？？？？？？？
-    CHANGE_FRAME(new_frame);
-    if (IS_SYNCHRONIZED(resolved_method)) {
-//        _this->unlock(); // todo why unlock 而不是 lock ................................................
+    if (frame->local_objs == NULL || IS_NATIVE(resolved_method)) {
+        // 参数就是被调用者的前几个局部变量，不用复制
+        new_frame->lvars = frame->ostack;
+    } else {
+        // 调用者的操作数栈之后是栈上的对象（见 escape.h），被调用者的局部变量会覆盖它们，
+        // 所以使用 alloc_frame 在 local_objs_end 之后分配的 lvars，复制参数。
+        // 本地方法不写局部变量，仍然直接使用调用者的操作数栈。
+        memcpy(new_frame->lvars, frame->ostack, resolved_method->arg_slot_count * sizeof(slot_t));
     }
+    CHANGE_FRAME(new_frame);
+    LOCK_SYNC_OBJ(frame);
     DISPATCH
 }
 opc_new: {
+    SAVE_STATE;
     // new指令专门用来创建类实例。数组由专门的指令创建
     // 如果类还没有被初始化，会触发类的初始化。
+    size_t new_pc = reader->pc - 1;
     Class *c = resolve_class(cp, bcr_readu2(reader));
     init_class(c);
 
@@ -1315,14 +1532,17 @@ opc_new: {
     // jref o = newObject(c);
     // if (strcmp(o->clazz->className, "java/lang/invoke/MemberName") == 0)
     //     printvm("%s\n", o->toString().c_str()); /////////////////////////////////////////////////////////////
-    // ostack_pushr(frame, o);
-    ostack_pushr(frame, alloc_object(c));
+    // pushr(o);
+    // 不会逃逸的对象在栈上分配（见 escape.h）
+    jref o = alloc_local_object(frame, c, new_pc);
+    pushr(o != NULL ? o : alloc_object(c));
     DISPATCH
 }
 opc_newarray: {
+    SAVE_STATE;
     // 创建一维基本类型数组。
     // 包括 boolean[], byte[], char[], short[], int[], long[], float[] 和 double[] 8种。
-    jint arr_len = ostack_popi(frame);
+    jint arr_len = popi();
     if (arr_len < 0) {
         // throw java_lang_NegativeArraySizeException("len is " + to_string(arr_len));
         HANDLE_EXCEPTION(S(java_lang_NegativeArraySizeException), NULL);  // todo msg
@@ -1330,12 +1550,13 @@ opc_newarray: {
 
     u1 arr_type = bcr_readu1(reader);
     Class *c = load_type_array_class((ArrayType) arr_type);
-    ostack_pushr(frame, alloc_array(c, arr_len));
+    pushr(alloc_array(c, arr_len));
     DISPATCH
 }
 opc_anewarray: {
+    SAVE_STATE;
     // 创建一维引用类型数组
-    jint arr_len = ostack_popi(frame);
+    jint arr_len = popi();
     if (arr_len < 0) {
         // throw java_lang_NegativeArraySizeException("len is " + to_string(arr_len));
         HANDLE_EXCEPTION(S(java_lang_NegativeArraySizeException), NULL);  // todo msg
@@ -1343,10 +1564,11 @@ opc_anewarray: {
 
     index = bcr_readu2(reader);
     Class *ac = array_class(resolve_class(cp, index));
-    ostack_pushr(frame, alloc_array(ac, arr_len));
+    pushr(alloc_array(ac, arr_len));
     DISPATCH
 }
 opc_multianewarray: {
+    SAVE_STATE;
     // 创建多维数组
     index = bcr_readu2(reader);
     Class *ac = resolve_class(cp, index);
@@ -1358,27 +1580,27 @@ opc_multianewarray: {
 
     jint lens[dim];
     for (int i = dim - 1; i >= 0; i--) {
-        lens[i] = ostack_popi(frame);
+        lens[i] = popi();
         if (lens[i] < 0) {
             // throw java_lang_NegativeArraySizeException("len is %d" + to_string(lens[i]));
             HANDLE_EXCEPTION(S(java_lang_NegativeArraySizeException), NULL);  // todo msg
         }
     }
-    ostack_pushr(frame, alloc_multi_array(ac, dim, lens));
+    pushr(alloc_multi_array(ac, dim, lens));
     DISPATCH
 }
 opc_arraylength: {
-    Object *o = ostack_popr(frame);
+    Object *o = popr();
     NULL_POINTER_CHECK(o);
     if (!is_array_object(o)) {
         HANDLE_EXCEPTION(S(java_lang_UnknownError), "not a array");
     }
     
-    ostack_pushi(frame, o->arr_len);
+    pushi(array_len(o));
     DISPATCH
 }
 opc_athrow: {
-    jref eo = ostack_popr(frame); // exception object
+    jref eo = popr(); // exception object
     if (eo == NULL) {
         // 异常对象有可能为空
         // 比如下面的Java代码:
@@ -1404,13 +1626,17 @@ opc_athrow: {
              * 跳转到异常处理代码之前
              */
             clear_frame_stack(frame);
-            ostack_pushr(frame, eo);
+            ostack = frame->ostack;
+            pushr(eo);
             reader->pc = (size_t) handler_pc;
 
             TRACE("athrow: find exception handler: %s", get_frame_info(frame));
             break;
         }
 
+        // frame 无法处理异常，释放 synchronized 方法持有的锁
+        UNLOCK_SYNC_OBJ(frame);
+
         if (frame->vm_invoke) {
             // frame 由虚拟机调用，将异常交由虚拟机处理
             *excep = eo;
@@ -1418,7 +1644,7 @@ opc_athrow: {
             // throw UncaughtException(eo);
         }
 
-        // frame 无法处理异常，弹出
+        // 弹出
         pop_frame(thread);
 
         if (frame->prev == NULL) {
@@ -1435,7 +1661,8 @@ opc_athrow: {
 }
 
 opc_checkcast: {
-    jref obj = slot_get_ref(frame->ostack - 1); // 不改变操作数栈
+    SAVE_STATE;
+    jref obj = slot_get_ref(ostack - 1); // 不改变操作数栈
     index = bcr_readu2(reader);
 
     // 如果引用是null，则指令执行结束。也就是说，null 引用可以转换成任何类型
@@ -1451,27 +1678,32 @@ opc_checkcast: {
 }
 
 opc_instanceof: {
+    SAVE_STATE;
     index =  bcr_readu2(reader);
     Class *c = resolve_class(cp, index);
 
-    jref obj = ostack_popr(frame);
+    jref obj = popr();
     if (obj == NULL) {
-        ostack_pushi(frame, 0);
+        pushi(0);
     } else {
-        ostack_pushi(frame, checkcast(obj->clazz, c) ? 1 : 0);
+        pushi(checkcast(obj->clazz, c) ? 1 : 0);
     }
     DISPATCH
 }
 opc_monitorenter: {
-    jref o = ostack_popr(frame);
+    SAVE_STATE;
+    jref o = popr();
     NULL_POINTER_CHECK(o);
-//                o->lock();
+    object_lock(o);
     DISPATCH
 }
 opc_monitorexit: {
-    jref o = ostack_popr(frame);
+    SAVE_STATE;
+    jref o = popr();
     NULL_POINTER_CHECK(o);
-//                o->unlock();
+    if (!object_unlock(o)) {
+        HANDLE_EXCEPTION(S(java_lang_IllegalMonitorStateException), NULL);
+    }
     DISPATCH
 }
 opc_wide:
@@ -1497,15 +1729,15 @@ opc_wide:
     }  
 opc_ifnull: {
     s2 offset = bcr_reads2(reader);
-    if (ostack_popr(frame) == NULL) {
-        bcr_skip(reader, offset - opcode_len[JVM_OPC_ifnull]);
+    if (popr() == NULL) {
+        BRANCH(offset, opcode_len[JVM_OPC_ifnull]);
     }
     DISPATCH
 }
 opc_ifnonnull: {
     s2 offset = bcr_reads2(reader);
-    if (ostack_popr(frame) != NULL) {
-        bcr_skip(reader, offset - opcode_len[JVM_OPC_ifnonnull]);
+    if (popr() != NULL) {
+        BRANCH(offset, opcode_len[JVM_OPC_ifnonnull]);
     }
     DISPATCH
 }
@@ -1554,6 +1786,60 @@ static bool checkcast(Class *s, Class *t)
     }
 }
 
+static u1 getfield_quick_opcode(const Field *f)
+{
+    assert(f != NULL);
+
+    switch (f->descriptor[0]) {
+        case 'Z': 
+        case 'B': return JVM_OPC_getfield_b_quick;
+        case 'C': return JVM_OPC_getfield_c_quick;
+        case 'S': return JVM_OPC_getfield_s_quick;
+        case 'I': 
+        case 'F': return JVM_OPC_getfield_i_quick;
+        case 'J': 
+        case 'D': return JVM_OPC_getfield_l_quick;
+        default:  return JVM_OPC_getfield_a_quick;
+    }
+}
+
+static u1 putfield_quick_opcode(const Field *f)
+{
+    assert(f != NULL);
+
+    switch (f->descriptor[0]) {
+        case 'Z': return JVM_OPC_putfield_z_quick;
+        case 'B': return JVM_OPC_putfield_b_quick;
+        case 'C': 
+        case 'S': return JVM_OPC_putfield_c_quick;
+        case 'I': 
+        case 'F': return JVM_OPC_putfield_i_quick;
+        case 'J': 
+        case 'D': return JVM_OPC_putfield_l_quick;
+        default:  return JVM_OPC_putfield_a_quick;
+    }
+}
+
+u1 original_opcode(u1 opcode)
+{
+    switch (opcode) {
+        case JVM_OPC_getfield_b_quick: case JVM_OPC_getfield_c_quick: case JVM_OPC_getfield_s_quick:
+        case JVM_OPC_getfield_i_quick: case JVM_OPC_getfield_l_quick: case JVM_OPC_getfield_a_quick:
+            return JVM_OPC_getfield;
+        case JVM_OPC_putfield_b_quick: case JVM_OPC_putfield_z_quick: case JVM_OPC_putfield_c_quick:
+        case JVM_OPC_putfield_i_quick: case JVM_OPC_putfield_l_quick: case JVM_OPC_putfield_a_quick:
+            return JVM_OPC_putfield;
+        case JVM_OPC_getstatic_quick:        return JVM_OPC_getstatic;
+        case JVM_OPC_putstatic_quick:        return JVM_OPC_putstatic;
+        case JVM_OPC_invokevirtual_quick:    return JVM_OPC_invokevirtual;
+        case JVM_OPC_invokestatic_quick:     return JVM_OPC_invokestatic;
+        case JVM_OPC_invokeinterface_quick:  return JVM_OPC_invokeinterface;
+        // 改写前也可能是调用 private 或 final 方法的 invokevirtual，两者都是静态绑定的
+        case JVM_OPC_invokenonvirtual_quick: return JVM_OPC_invokespecial;
+        default: return opcode;
+    }
+}
+
 slot_t *exec_java(Method *method, const slot_t *args)
 {
     assert(method != NULL);
@@ -1595,26 +1881,25 @@ slot_t *exec_java0(Method *m, jref this, jarrRef args)
     // Class[]
     jarrRef types = get_parameter_types(m);
     assert(types != NULL);
-    assert(types->arr_len == args->arr_len);
+    assert(array_len(types) == array_len(args));
 
     // 因为有 category two 的存在，result 的长度最大为 types_len * 2 + this_obj
-    slot_t *real_args = vm_malloc(sizeof(slot_t) * (2 * types->arr_len + 1));
+    slot_t *real_args = vm_malloc(sizeof(slot_t) * (2 * array_len(types) + 1));
     int k = 0;
     if (this != NULL) {
         assert(!IS_STATIC(m));
         slot_set_ref(real_args, this);
         k++;
     }
-    for (int i = 0; i < types->arr_len; i++) {
-        Class *c = array_get(jclsRef, types, i)->jvm_mirror;
-        jref o = array_get(jref, args, i);
+    for (int i = 0; i < array_len(types); i++) {
+        Class *c = jvm_mirror(array_get_ref(types, i));
+        jref o = array_get_ref(args, i);
 
         if (is_prim_class(c)) {
-            const slot_t *unbox = prim_wrapper_obj_unbox(o);
-            real_args[k++] = *unbox;
-            if (strcmp(o->clazz->class_name, "long") == 0
-                || strcmp(o->clazz->class_name, "double") == 0) // category_two
-                real_args[k++] = *++unbox;
+            prim_wrapper_obj_unbox(o, real_args + k);
+            k++;
+            if (is_long_class(c) || is_double_class(c)) // category_two
+                k++;
         } else {
             slot_set_ref(real_args + k, o);
             k++;
@@ -15,4 +15,10 @@ slot_t *exec_java(Method *, const slot_t *args);
 // Object[] args;
 slot_t *exec_java0(Method *, jref _this, jarrRef args);
 
+/*
+ * 解释器执行过的指令可能被改写为快速指令（见 interpreter.c 中的 Quickening），
+ * 分析字节码时用此函数得到原来的指令，快速指令的操作数和原指令相同。
+ */
+u1 original_opcode(u1 opcode);
+
 #endif // CABIN_INTERPRETER_H
\ No newline at end of file
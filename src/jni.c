@@ -2,27 +2,81 @@
 #include "jni.h"
 #include "object.h"
 #include "thread.h"
+#include "monitor.h"
 #include "exception.h"
 
 
-#define JVM_MIRROR(_jclass) ((jclsRef) _jclass)->jvm_mirror
+#define JVM_MIRROR(_jclass) jvm_mirror((jclsRef) _jclass)
+
+/*
+ * JNI 全局引用表，作为 GC Roots.
+ * jobject 就是 jref，同一对象可以多次加入，每次 delete 只移除其中一个。
+ */
+static jref *global_refs;
+static int global_refs_count;
+static int global_refs_capacity;
+static pthread_mutex_t global_refs_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static jobject addJNIGlobalRef(Object *ref)
 {
-    // todo 
+    if (ref == NULL)
+        return NULL;
+
+    // jobject 就是对象的地址，被本地代码持有
+    pin_object(ref);
+
+    pthread_mutex_lock(&global_refs_mutex);
+
+    // 优先复用已删除的位置
+    for (int i = 0; i < global_refs_count; i++) {
+        if (global_refs[i] == NULL) {
+            global_refs[i] = ref;
+            goto over;
+        }
+    }
+
+    if (global_refs_count == global_refs_capacity) {
+        global_refs_capacity = global_refs_capacity == 0 ? 64 : global_refs_capacity*2;
+        global_refs = vm_realloc(global_refs, global_refs_capacity*sizeof(*global_refs));
+    }
+    global_refs[global_refs_count++] = ref;
+
+over:
+    pthread_mutex_unlock(&global_refs_mutex);
     return (jobject) ref;
 }
 
 static void deleteJNIGlobalRef(Object *ref)
 {
-    // todo
+    if (ref == NULL)
+        return;
+
+    pthread_mutex_lock(&global_refs_mutex);
+    for (int i = global_refs_count - 1; i >= 0; i--) {
+        if (global_refs[i] == ref) {
+            global_refs[i] = NULL;
+            if (i == global_refs_count - 1)
+                global_refs_count--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&global_refs_mutex);
+}
+
+void visit_jni_global_refs(void (* visit)(jref *))
+{
+    // gc 期间所有线程都已停止，无需加锁
+    for (int i = 0; i < global_refs_count; i++) {
+        if (global_refs[i] != NULL)
+            visit(global_refs + i);
+    }
 }
 
 static slot_t *execJavaV(Method *m, jref this, va_list args)
 {
     // Class[]
     jarrRef types = get_parameter_types(m);
-    jsize args_count = types->arr_len;
+    jsize args_count = array_len(types);
     
     // 因为有 category two 的存在，result 的长度最大为 types_len * 2 + this_obj
     slot_t *real_args = vm_malloc(sizeof(slot_t)*(2*args_count + 1));
@@ -34,7 +88,7 @@ static slot_t *execJavaV(Method *m, jref this, va_list args)
     }
 
     for (int i = 0; i < args_count; i++, k++) {
-        Class *c = array_get(jclsRef, types, i)->jvm_mirror;
+        Class *c = jvm_mirror(array_get_ref(types, i));
 
         // 可变长参数列表误区与陷阱——va_arg不可接受的类型：
         // https://www.cnblogs.com/shiweihappy/p/4246442.html
@@ -66,7 +120,7 @@ static slot_t *execJavaA(Method *m, jref this, const jvalue *args)
 {
     // Class[]
     jarrRef types = get_parameter_types(m);
-    jsize args_count = types->arr_len;
+    jsize args_count = array_len(types);
     
     // 因为有 category two 的存在，result 的长度最大为 types_len * 2 + this_obj
     slot_t *real_args = vm_malloc(sizeof(slot_t)*(2*args_count + 1));
@@ -78,7 +132,7 @@ static slot_t *execJavaA(Method *m, jref this, const jvalue *args)
     }
 
     for (int i = 0; i < args_count; i++, k++) {
-        Class *c = array_get(jclsRef, types, i)->jvm_mirror;
+        Class *c = jvm_mirror(array_get_ref(types, i));
 
         if (is_boolean_class(c)) {
             slot_set_bool(real_args + k, args[i].z);
@@ -173,9 +227,9 @@ jobject JNICALL Cabin_ToReflectedMethod(JNIEnv *env, jclass cls, jmethodID metho
 jclass JNICALL Cabin_GetSuperclass(JNIEnv *env, jclass sub)
 {
     // jclsRef c = (jclsRef) sub;
-    // return c->jvm_mirror->super_class;
+    // return jvm_mirror(c)->super_class;
 
-    Class *c = ((jclsRef) sub)->jvm_mirror;
+    Class *c = jvm_mirror((jclsRef) sub);
     if (IS_INTERFACE(c) || is_prim_class(c) || is_void_class(c))
         return NULL;
     if (c->super_class == NULL)
@@ -258,12 +312,8 @@ jobject JNICALL Cabin_NewGlobalRef(JNIEnv *env, jobject gref)
 
 void JNICALL Cabin_DeleteGlobalRef(JNIEnv *env, jobject gref)
 {
-    // todo
-    JVM_PANIC("not implement.");
-    // assert(env != NULL && gref != NULL);
-    // auto o = to_object_ref(gref);
-    // if (o->jni_obj_ref_type == JNIGlobalRefType)
-    //     deleteJNIGlobalRef(o);
+    assert(env != NULL);
+    deleteJNIGlobalRef((jref) gref);
 }
 
 void JNICALL Cabin_DeleteLocalRef(JNIEnv *env, jobject obj)
@@ -618,6 +668,7 @@ jobject JNICALL Cabin_GetStaticObjectField(JNIEnv *env, jclass clazz, jfieldID f
 
 void JNICALL Cabin_SetStaticObjectField(JNIEnv *env, jclass clazz, jfieldID fieldID, jobject value)
 {
+    pre_write_barrier_static(&((Field *) fieldID)->static_value.r);
     ((Field *) fieldID)->static_value.r = (jref) value;
 }
 
@@ -692,7 +743,7 @@ void JNICALL Cabin_ReleaseStringUTFChars(JNIEnv *env, jstring str, const char *c
 jsize JNICALL Cabin_GetArrayLength(JNIEnv *env, jarray arr)
 {
     jarrRef array = (jarrRef) arr;
-    return array->arr_len;
+    return array_len(array);
 }
 
 jobjectArray JNICALL Cabin_NewObjectArray(JNIEnv *env, jsize len, jclass elementClass, jobject init)
@@ -715,17 +766,17 @@ jobjectArray JNICALL Cabin_NewObjectArray(JNIEnv *env, jsize len, jclass element
 jobject JNICALL Cabin_GetObjectArrayElement(JNIEnv *env, jobjectArray array, jsize index)
 {
     jarrRef ao = (jarrRef) array;
-    if (index <= 0 || index >= ao->arr_len) {
+    if (index <= 0 || index >= array_len(ao)) {
         // todo error
     }
 
-    return (jobject) array_get(jref, ao, index);
+    return (jobject) array_get_ref(ao, index);
 }
 
 void JNICALL Cabin_SetObjectArrayElement(JNIEnv *env, jobjectArray array, jsize index, jobject val)
 {
     jarrRef ao = (jarrRef) array;
-    if (index < 0 || index >= ao->arr_len) {
+    if (index < 0 || index >= array_len(ao)) {
         JNI_THROW_ArrayIndexOutOfBoundsException(env, NULL); // todo msg
         return;
     }
@@ -761,7 +812,7 @@ raw_type* JNICALL Cabin_Get##Type##ArrayElements(JNIEnv *env, jarray array, jboo
     if (isCopy != NULL) \
         *isCopy = JNI_FALSE; \
     addJNIGlobalRef(arr); \
-    return (raw_type *) arr->data; \
+    return (raw_type *) array_data(arr); \
 }
 
 getTypeArrayElements(Byte, jbyte)
@@ -793,7 +844,7 @@ releaseTypeArrayElements(Double, jdouble)
 void JNICALL Cabin_Get##Type##ArrayRegion(JNIEnv *env, jarray array, jsize start, jsize len, raw_type *buf) \
 { \
     jarrRef arr = (jarrRef) array; \
-    assert(start + len <= arr->arr_len); \
+    assert(start + len <= array_len(arr)); \
     assert(get_ele_size(arr->clazz) == sizeof(raw_type)); \
     memcpy(buf, array_index(arr, start), len*sizeof(raw_type)); \
 } \
@@ -801,7 +852,7 @@ void JNICALL Cabin_Get##Type##ArrayRegion(JNIEnv *env, jarray array, jsize start
 void JNICALL Cabin_Set##Type##ArrayRegion(JNIEnv *env, jarray array, jsize start, jsize len, const raw_type *buf) \
 { \
     jarrRef arr = (jarrRef) array; \
-    assert(start + len <= arr->arr_len); \
+    assert(start + len <= array_len(arr)); \
     assert(get_ele_size(arr->clazz) == sizeof(raw_type)); \
     memcpy(array_index(arr, start), buf, len*sizeof(raw_type)); \
 }
@@ -844,20 +895,19 @@ jint JNICALL Cabin_UnregisterNatives(JNIEnv *env, jclass clazz)
 
 jint JNICALL Cabin_MonitorEnter(JNIEnv *env, jobject obj)
 {
-    // todo
-//    jref o = to_object_ref(obj);
-//    o->lock();
-// return JNI_OK;
-    JVM_PANIC("not implement.");
+    assert(obj != NULL);
+    object_lock((jref) obj);
+    return JNI_OK;
 }
 
 jint JNICALL Cabin_MonitorExit(JNIEnv *env, jobject obj)
 {
-    // todo
-//    jref o = to_object_ref(obj);
-//    o->unlock();
-// return JNI_OK;
-    JVM_PANIC("not implement.");
+    assert(obj != NULL);
+    if (!object_unlock((jref) obj)) {
+        JNI_THROW_IllegalMonitorStateException(env, NULL);
+        return JNI_ERR;
+    }
+    return JNI_OK;
 }
 
 static JavaVM java_vm;
@@ -891,7 +941,7 @@ void* JNICALL Cabin_GetPrimitiveArrayCritical(JNIEnv *env, jarray array, jboolea
 
     /* Pin the array */ //  todo
     addJNIGlobalRef(arr);
-    return arr->data;
+    return array_data(arr);
 }
 
 void JNICALL Cabin_ReleasePrimitiveArrayCritical(JNIEnv *env, jarray array, void *carray, jint mode)
@@ -1316,7 +1366,7 @@ const static struct _JNIInvokeInterface Cabin_JNIInvokeInterface = {
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void init_jvm(JavaVMInitArgs *);
+void init_jvm(const InitArgs *);
 
 jint JNICALL JNI_CreateJavaVM(JavaVM **pvm, void **penv, void *args) 
 {
@@ -1327,9 +1377,50 @@ jint JNICALL JNI_CreateJavaVM(JavaVM **pvm, void **penv, void *args)
     *penv = &jni_env;
 
     JavaVMInitArgs *vm_init_args = (JavaVMInitArgs *) args;
-    InitArgs init_args;
+    InitArgs init_args = {
+        .init_heap_size = VM_INIT_HEAP_SIZE,
+        .max_heap_size = VM_MAX_HEAP_SIZE,
+    };
+    bool xms_set = false, xmx_set = false;
+
+    if (vm_init_args != NULL) {
+        for (jint i = 0; i < vm_init_args->nOptions; i++) {
+            const char *option = vm_init_args->options[i].optionString;
+            if (strncmp(option, "-Xms", 4) == 0) {
+                init_args.init_heap_size = parse_memory_size(option + 4);
+                xms_set = true;
+            } else if (strncmp(option, "-Xmx", 4) == 0) {
+                init_args.max_heap_size = parse_memory_size(option + 4);
+                xmx_set = true;
+            } else if (strcmp(option, "-XX:+UseStringDeduplication") == 0) {
+                init_args.string_dedup = true;
+            } else if (strcmp(option, "-XX:-UseStringDeduplication") == 0) {
+                init_args.string_dedup = false;
+            } else if (strcmp(option, "-XX:+UseEpsilonGC") == 0) {
+                init_args.epsilon_gc = true;
+            } else if (strcmp(option, "-XX:-UseEpsilonGC") == 0) {
+                init_args.epsilon_gc = false;
+            } else if (strcmp(option, "-XX:+PrintInlineCacheStatistics") == 0) {
+                init_args.print_ic_stats = true;
+            } else if (strcmp(option, "-XX:-PrintInlineCacheStatistics") == 0) {
+                init_args.print_ic_stats = false;
+            } else if (!vm_init_args->ignoreUnrecognized) {
+                return JNI_ERR;
+            }
+        }
+    }
+
+    if (init_args.init_heap_size == 0 || init_args.max_heap_size == 0)
+        return JNI_ERR;
+    // 只指定了 -Xms 或 -Xmx 其中一个时，另一个随之调整
+    if (init_args.init_heap_size > init_args.max_heap_size) {
+        if (xms_set && !xmx_set)
+            init_args.max_heap_size = init_args.init_heap_size;
+        else if (xmx_set && !xms_set)
+            init_args.init_heap_size = init_args.max_heap_size;
+    }
 
-    init_jvm(vm_init_args);
+    init_jvm(&init_args);
     return JNI_OK;
 }
 
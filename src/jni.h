@@ -462,4 +462,10 @@ jint JNICALL JNI_GetCreatedJavaVMs(JavaVM **, jsize, jsize *);
 #define JNI_THROW_ArrayIndexOutOfBoundsException(_env, msg) \
     JNI_THROW(_env, S(java_lang_ArrayIndexOutOfBoundsException), msg)
 
+#define JNI_THROW_IllegalMonitorStateException(_env, msg) \
+    JNI_THROW(_env, S(java_lang_IllegalMonitorStateException), msg)
+
+// 遍历所有的 JNI 全局引用（GC Roots）
+void visit_jni_global_refs(void (* visit)(jref *));
+
 #endif //CABIN_JNI_H
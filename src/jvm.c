@@ -6,14 +6,16 @@
 #include "cabin.h"
 #include "jni.h"
 #include "heap.h"
+#include "gc.h"
 #include "symbol.h"
 #include "hash.h"
 #include "thread.h"
 #include "meta.h"
 #include "object.h"
+#include "monitor.h"
 
 
-#define JVM_MIRROR(_jclass) ((jclsRef) _jclass)->jvm_mirror
+#define JVM_MIRROR(_jclass) jvm_mirror((jclsRef) _jclass)
 
 /*
  * This file contains additional functions exported from the VM.
@@ -62,28 +64,37 @@ JNIEXPORT jint JNICALL
 JVM_IHashCode(JNIEnv *env, jobject obj)
 {
     TRACE("JVM_IHashCode(env=%p, obj=%p)", env, obj);
-    return (jint)(intptr_t)obj; // todo 实现错误。改成当前的时间如何。
+    return object_identity_hash((jref) obj);
 }
 
 JNIEXPORT void JNICALL
 JVM_MonitorWait(JNIEnv *env, jobject obj, jlong ms)
 {
     TRACE("JVM_MonitorWait(env=%p, obj=%p, ms=%ld)", env, obj, ms);
-    // JVM_PANIC("unimplemented"); // todo
+    WaitResult r = object_wait((jref) obj, ms);
+    if (r == WAIT_NOT_OWNER) {
+        JNI_THROW_IllegalMonitorStateException(env, "current thread is not owner");
+    } else if (r == WAIT_INTERRUPTED) {
+        JNI_THROW(env, S(java_lang_InterruptedException), NULL);
+    }
 }
 
 JNIEXPORT void JNICALL
 JVM_MonitorNotify(JNIEnv *env, jobject obj)
 {
     TRACE("JVM_MonitorNotify(env=%p, obj=%p)", env, obj);
-    // JVM_PANIC("unimplemented"); // todo
+    if (!object_notify((jref) obj, false)) {
+        JNI_THROW_IllegalMonitorStateException(env, "current thread is not owner");
+    }
 }
 
 JNIEXPORT void JNICALL
 JVM_MonitorNotifyAll(JNIEnv *env, jobject obj)
 {
     TRACE("JVM_MonitorNotifyAll(env=%p, obj=%p)", env, obj);
-    // JVM_PANIC("unimplemented"); // todo
+    if (!object_notify((jref) obj, true)) {
+        JNI_THROW_IllegalMonitorStateException(env, "current thread is not owner");
+    }
 }
 
 JNIEXPORT jobject JNICALL
@@ -257,7 +268,7 @@ JNIEXPORT void JNICALL
 JVM_GC(void)
 {
     TRACE("JVM_GC()");
-    JVM_PANIC("unimplemented"); // todo
+    gc();
 }
 
 /* Returns the number of real-time milliseconds that have elapsed since the
@@ -302,7 +313,7 @@ JNIEXPORT jlong JNICALL
 JVM_TotalMemory(void)
 {
     TRACE("JVM_TotalMemory()");
-    return g_heap->size;
+    return g_heap->size + g_heap->los_bytes;
 }
 
 JNIEXPORT jlong JNICALL
@@ -312,14 +323,12 @@ JVM_FreeMemory(void)
     return heap_free_memory(g_heap);
 }
 
-/* todo
- * maxMemory()这个方法返回的是java虚拟机（这个进程）能构从操作系统那里挖到的最大的内存，以字节为单位，如果在运行java程序的时 候，没有添加-Xmx参数，那么就是64兆，也就是说maxMemory()返回的大约是64*1024*1024字节，这是java虚拟机默认情况下能 从操作系统那里挖到的最大的内存。如果添加了-Xmx参数，将以这个参数后面的值为准，例如java -cp ClassPath -Xmx512m ClassName，那么最大内存就是512*1024*0124字节。
- */
+// 最大堆内存，由 -Xmx 指定
 JNIEXPORT jlong JNICALL
 JVM_MaxMemory(void)
 {
     TRACE("JVM_MaxMemory()");
-    return VM_HEAP_SIZE; // todo
+    return g_heap->max_size;
 }
 
 JNIEXPORT jint JNICALL
@@ -509,13 +518,12 @@ JVM_FillInStackTrace(JNIEnv *env, jobject _throwable)
     }
 
     jarrRef backtrace = alloc_object_array(num);
-    Object **trace = (Object **) backtrace->data;
 
     Class *c = load_boot_class(S(java_lang_StackTraceElement));
     for (int i = 0; f != NULL; f = f->prev) {
         Object *o = alloc_object(c);
         assert(i < num);
-        trace[i++] = o;
+        array_set_ref(backtrace, i++, o);
 
         // public StackTraceElement(String declaringClass, String methodName, String fileName, int lineNumber)
         // may be should call <init>, but 直接赋值 is also ok. todo
@@ -548,7 +556,7 @@ JVM_FillInStackTrace(JNIEnv *env, jobject _throwable)
      * todo test on jdk15
      * private transient int depth;
      */
-    set_int_field(throwable, "depth", backtrace->arr_len);
+    set_int_field(throwable, "depth", array_len(backtrace));
 }
 
 // JNIEXPORT jint JNICALL
@@ -557,7 +565,7 @@ JVM_FillInStackTrace(JNIEnv *env, jobject _throwable)
 //     TRACE("JVM_GetStackTraceDepth(env=%p, throwable=%p)", env, throwable);
 //     jarrRef backtrace = get_ref_field((jref) throwable, S(backtrace), S(sig_java_lang_Object));
 //     assert(backtrace != NULL);
-//     return backtrace->arr_len;
+//     return array_len(backtrace);
 // }
 
 // JNIEXPORT jobject JNICALL
@@ -566,7 +574,7 @@ JVM_FillInStackTrace(JNIEnv *env, jobject _throwable)
 //     TRACE("JVM_GetStackTraceElement(env=%p, throwable=%p, index=%d)", env, throwable, index);
 //     jarrRef backtrace = get_ref_field((jref) throwable, S(backtrace), S(sig_java_lang_Object));
 //     assert(backtrace != NULL);
-//     return array_get(jref, backtrace, index);
+//     return array_get_ref(backtrace, index);
 // }
 
 /*
@@ -586,8 +594,8 @@ JVM_InitStackTraceElementArray(JNIEnv *env, jobjectArray _elements, jobject thro
         JVM_PANIC("error"); // todo
     }
 
-    assert(elements->arr_len <= backtrace->arr_len);
-    memcpy(elements->data, backtrace->data, elements->arr_len*sizeof(jref));
+    assert(array_len(elements) <= array_len(backtrace));
+    memcpy(array_data(elements), array_data(backtrace), array_len(elements)*sizeof(heapref_t));
 }
 
 // Sets the given stack trace element with the given StackFrameInfo
@@ -707,8 +715,10 @@ static void *thread_run_func(void *thread)
             = lookup_inst_method(load_boot_class(S(java_lang_Thread)), S(run), S(___V));
 
     jref o = (jref) thread;
-    create_thread(o, THREAD_NORM_PRIORITY); // todo
-    return (void *) exec_java(run_method, (slot_t[]) { rslot(o) });
+    Thread *t = create_thread(o, THREAD_NORM_PRIORITY); // todo
+    exec_java(run_method, (slot_t[]) { rslot(o) });
+    detach_thread(t);
+    return NULL;
 }
 
 JNIEXPORT void JNICALL
@@ -717,6 +727,9 @@ JVM_StartThread(JNIEnv *env, jobject thread)
     TRACE("JVM_StartThread(env=%p, thread=%p)", env, thread);
     // createCustomerThread(_this);
 
+    // 新线程注册（create_thread）之前，只有 pthread 持有 thread 的地址
+    pin_object((jref) thread);
+
     pthread_t th; 
     if (pthread_create(&th, NULL, thread_run_func, thread) != 0) {
         // todo error
@@ -833,8 +846,11 @@ JNIEXPORT void JNICALL
 JVM_Interrupt(JNIEnv *env, jobject thread)
 {
     TRACE("JVM_Interrupt(env=%p, thread=%p)", env, thread);
+    // Thread.interrupt 已经设置了中断状态，线程还未启动时不用唤醒
     Thread *t = thread_from_tobj((jref) thread);
-    t->interrupted = true;
+    if (t != NULL) {
+        interrupt_wait(t);
+    }
 }
 
 // /*
@@ -857,7 +873,11 @@ JNIEXPORT jboolean JNICALL
 JVM_HoldsLock(JNIEnv *env, jclass threadClass, jobject obj)
 {
     TRACE("JVM_HoldsLock(env=%p, threadClass=%p, obj=%p)", env, threadClass, obj);
-    JVM_PANIC("unimplemented"); // todo
+    if (obj == NULL) {
+        JNI_THROW_NPE(env, NULL);
+        return JNI_FALSE;
+    }
+    return object_holds_lock((jref) obj, get_current_thread()) ? JNI_TRUE : JNI_FALSE;
 }
 
 JNIEXPORT void JNICALL
@@ -896,11 +916,11 @@ JVM_DumpThreads(JNIEnv *env, jclass threadClass, jobjectArray _threads)
     jarrRef threads = (jarrRef) (_threads);
     assert(is_array_object(threads));
 
-    size_t len = threads->arr_len;
+    size_t len = array_len(threads);
     jarrRef result = alloc_array0(BOOT_CLASS_LOADER, "[[java/lang/StackTraceElement", len);
 
     for (size_t i = 0; i < len; i++) {
-        jref jThread = array_get(jref, threads, i);
+        jref jThread = array_get_ref(threads, i);
         Thread *thread = thread_from_tobj(jThread);
         jarrRef arr = dump_thread(thread, -1);
         array_set_ref(result, i, arr);
@@ -980,9 +1000,9 @@ JVM_GetSystemPackages(JNIEnv *env)
     int size = phs_size(packages);
     
     jarrRef ao = alloc_string_array(size);
-    Object **p = (Object **) ao->data;
+    int i = 0;
     PHS_TRAVERSAL(packages, const char *, pkg, {
-        *p++ = alloc_string(pkg);
+        array_set_ref(ao, i++, alloc_string(pkg));
     });
 
     return (jobjectArray) ao;
@@ -995,21 +1015,21 @@ JNIEXPORT jobject JNICALL
 JVM_GetAndClearReferencePendingList(JNIEnv *env)
 {
     TRACE("JVM_GetAndClearReferencePendingList(env=%p)", env);
-    JVM_PANIC("unimplemented"); // todo
+    return (jobject) get_and_clear_pending_references();
 }
 
 JNIEXPORT jboolean JNICALL
 JVM_HasReferencePendingList(JNIEnv *env)
 {
     TRACE("JVM_HasReferencePendingList(env=%p)", env);
-    JVM_PANIC("unimplemented"); // todo
+    return has_pending_references();
 }
 
 JNIEXPORT void JNICALL
 JVM_WaitForReferencePendingList(JNIEnv *env)
 {
     TRACE("JVM_WaitForReferencePendingList(env=%p)", env);
-    JVM_PANIC("unimplemented"); // todo
+    wait_for_pending_references();
 }
 
 JNIEXPORT jboolean JNICALL
@@ -1019,21 +1039,16 @@ JVM_ReferenceRefersTo(JNIEnv *env, jobject _ref, jobject _o)
 
     jref ref = (jref) _ref;
     jref o = (jref) _o;
-
-    // todo
-    return true;
-
-    // JVM_PANIC("unimplemented"); // todo
+    return get_ref_field(ref, "referent", S(sig_java_lang_Object)) == o;
 }
 
 JNIEXPORT void JNICALL
 JVM_ReferenceClear(JNIEnv *env, jobject ref)
 {
-    TRACE("JVM_ReferenceClear(env=%p)", env); // todo
-
-    // todo
+    TRACE("JVM_ReferenceClear(env=%p)", env);
 
-    // JVM_PANIC("unimplemented"); // todo
+    jref r = (jref) ref;
+    set_ref_field(r, "referent", S(sig_java_lang_Object), NULL);
 }
 
 /*
@@ -1042,8 +1057,8 @@ JVM_ReferenceClear(JNIEnv *env, jobject ref)
 JNIEXPORT jboolean JNICALL
 JVM_PhantomReferenceRefersTo(JNIEnv *env, jobject ref, jobject o)
 {
-    TRACE("JVM_PhantomReferenceRefersTo(env=%p)", env); // todo
-    JVM_PANIC("unimplemented"); // todo
+    TRACE("JVM_PhantomReferenceRefersTo(env=%p)", env);
+    return JVM_ReferenceRefersTo(env, ref, o);
 }
 
 /*
@@ -1099,7 +1114,7 @@ JVM_GetArrayLength(JNIEnv *env, jobject arr)
         JNI_THROW_IllegalArgumentException(env, "Argument is not an array");
         return -1;
     }
-    return array->arr_len;
+    return array_len(array);
 }
 
 JNIEXPORT jobject JNICALL
@@ -1117,7 +1132,7 @@ JVM_GetArrayElement(JNIEnv *env, jobject arr, jint index)
         return NULL;
     }
 
-    if (index < 0 || index >= array->arr_len) {
+    if (index < 0 || index >= array_len(array)) {
         JNI_THROW_ArrayIndexOutOfBoundsException(env, NULL); // todo msg
         return NULL;
     }
@@ -1140,7 +1155,7 @@ JVM_GetArrayElement(JNIEnv *env, jobject arr, jint index)
     case 'D': // double[]
         return (jobject) double_box(array_get(jdouble, array, index));
     default:  // reference array
-        return (jobject) array_get(jref, array, index);
+        return (jobject) array_get_ref(array, index);
     }
 }
 
@@ -1170,7 +1185,7 @@ JVM_SetArrayElement(JNIEnv *env, jobject arr, jint index, jobject val)
         return;
     }
 
-    if (index < 0 || index >= array->arr_len) {
+    if (index < 0 || index >= array_len(array)) {
         JNI_THROW_NegativeArraySizeException(env, NULL); // todo msg
         return;
     }
@@ -1181,13 +1196,14 @@ JVM_SetArrayElement(JNIEnv *env, jobject arr, jint index, jobject val)
         return;
     }
 
+    slot_t unbox[2];
     switch (array->clazz->class_name[1]) {
     case 'Z': // boolean[]
         if (!utf8_equals(value->clazz->class_name, S(java_lang_Boolean))) {
             JNI_THROW_IllegalArgumentException(env, "argument type mismatch");
             return;
         } else {
-            array_set_boolean(array, index, slot_get_bool(prim_wrapper_obj_unbox(value)));
+            array_set_boolean(array, index, slot_get_bool(prim_wrapper_obj_unbox(value, unbox)));
         }
         return;
     case 'B': // byte[]
@@ -1195,7 +1211,7 @@ JVM_SetArrayElement(JNIEnv *env, jobject arr, jint index, jobject val)
             JNI_THROW_IllegalArgumentException(env, "argument type mismatch");
             return;
         } else {
-            array_set_byte(array, index, slot_get_byte(prim_wrapper_obj_unbox(value)));
+            array_set_byte(array, index, slot_get_byte(prim_wrapper_obj_unbox(value, unbox)));
         }
         return;
     case 'C': // char[]
@@ -1203,7 +1219,7 @@ JVM_SetArrayElement(JNIEnv *env, jobject arr, jint index, jobject val)
             JNI_THROW_IllegalArgumentException(env, "argument type mismatch");
             return;
         } else {
-            array_set_char(array, index, slot_get_char(prim_wrapper_obj_unbox(value)));
+            array_set_char(array, index, slot_get_char(prim_wrapper_obj_unbox(value, unbox)));
         } 
         return;
     case 'S': // short[]
@@ -1211,7 +1227,7 @@ JVM_SetArrayElement(JNIEnv *env, jobject arr, jint index, jobject val)
             JNI_THROW_IllegalArgumentException(env, "argument type mismatch");
             return;
         } else {
-            array_set_short(array, index, slot_get_short(prim_wrapper_obj_unbox(value)));
+            array_set_short(array, index, slot_get_short(prim_wrapper_obj_unbox(value, unbox)));
         } 
         return;
     case 'I': // int[]
@@ -1219,7 +1235,7 @@ JVM_SetArrayElement(JNIEnv *env, jobject arr, jint index, jobject val)
             JNI_THROW_IllegalArgumentException(env, "argument type mismatch");
             return;
         } else {
-            array_set_int(array, index, slot_get_int(prim_wrapper_obj_unbox(value)));
+            array_set_int(array, index, slot_get_int(prim_wrapper_obj_unbox(value, unbox)));
         } 
         return;    
     case 'J': // long[]
@@ -1227,7 +1243,7 @@ JVM_SetArrayElement(JNIEnv *env, jobject arr, jint index, jobject val)
             JNI_THROW_IllegalArgumentException(env, "argument type mismatch");
             return;
         } else {
-            array_set_long(array, index, slot_get_long(prim_wrapper_obj_unbox(value)));
+            array_set_long(array, index, slot_get_long(prim_wrapper_obj_unbox(value, unbox)));
         } 
         return;    
     case 'F': // float[]
@@ -1235,7 +1251,7 @@ JVM_SetArrayElement(JNIEnv *env, jobject arr, jint index, jobject val)
             JNI_THROW_IllegalArgumentException(env, "argument type mismatch");
             return;
         } else {
-            array_set_float(array, index, slot_get_float(prim_wrapper_obj_unbox(value)));
+            array_set_float(array, index, slot_get_float(prim_wrapper_obj_unbox(value, unbox)));
         } 
         return;    
     case 'D': // double[]
@@ -1243,7 +1259,7 @@ JVM_SetArrayElement(JNIEnv *env, jobject arr, jint index, jobject val)
             JNI_THROW_IllegalArgumentException(env, "argument type mismatch");
             return;
         } else {
-            array_set_double(array, index, slot_get_double(prim_wrapper_obj_unbox(value)));
+            array_set_double(array, index, slot_get_double(prim_wrapper_obj_unbox(value, unbox)));
         } 
         return;    
     default:  // reference array
@@ -1274,7 +1290,7 @@ JVM_NewArray(JNIEnv *env, jclass _eltClass, jint length)
         JNI_THROW_NegativeArraySizeException(env,  NULL);  // todo msg
         return NULL;
     }
-    return (jobject) alloc_array(array_class(eltClass->jvm_mirror), length);
+    return (jobject) alloc_array(array_class(jvm_mirror(eltClass)), length);
 }
 
 JNIEXPORT jobject JNICALL
@@ -1829,7 +1845,7 @@ JVM_IsHiddenClass(JNIEnv *env, jclass cls)
 // JVM_GetComponentType(JNIEnv *env, jclass cls)
 // {
 //     TRACE("JVM_GetComponentType(env=%p, cls=%p)", env, cls);
-//     Class *c = ((jclsRef) cls)->jvm_mirror;
+//     Class *c = jvm_mirror((jclsRef) cls);
 //     if (is_array_class(c)) {
 //         return component_class(c)->java_mirror;
 //     } else {
@@ -2009,7 +2025,7 @@ JVM_GetClassDeclaredMethods(JNIEnv *env, jclass _ofClass, jboolean publicOnly)
     TRACE("JVM_GetClassDeclaredMethods(env=%p, ofClass=%p, publicOnly=%d)", env, _ofClass, publicOnly);
 
     jclsRef ofClass = (jclsRef) _ofClass;
-    Class *cls = ofClass->jvm_mirror;
+    Class *cls = jvm_mirror(ofClass);
     // jint count = public_only ? cls->public_methods_count : cls->methods.size();
 
     Class *method_class = load_boot_class(S(java_lang_reflect_Method));
@@ -2067,7 +2083,7 @@ JVM_GetClassDeclaredFields(JNIEnv *env, jclass _ofClass, jboolean publicOnly)
     TRACE("JVM_GetClassDeclaredFields(env=%p, ofClass=%p, publicOnly=%d)", env, _ofClass, publicOnly);
     
     jclsRef ofClass = (jclsRef) _ofClass;
-    Class *cls = ofClass->jvm_mirror;
+    Class *cls = jvm_mirror(ofClass);
     // jint count = public_only ? cls->public_fields_count : cls->fields.size();
 
     Class *field_class = load_boot_class(S(java_lang_reflect_Field));
@@ -2119,7 +2135,7 @@ JVM_GetClassDeclaredConstructors(JNIEnv *env, jclass _ofClass, jboolean publicOn
     TRACE("JVM_GetClassDeclaredConstructors(env=%p, ofClass=%p, publicOnly=%d)", env, _ofClass, publicOnly);
     
     jclsRef ofClass = (jclsRef) _ofClass;
-    Class *cls = ofClass->jvm_mirror;
+    Class *cls = jvm_mirror(ofClass);
 
     // std::vector<Method *> constructors = get_constructors(cls, public_only);
     // int count = constructors.size();
@@ -2239,7 +2255,7 @@ JVM_InvokeMethod(JNIEnv *env, jobject _method, jobject obj, jobjectArray args0)
     // private String     name;
     // private Class<?>   returnType;
     // private Class<?>[] parameterTypes;
-    Class *c = get_ref_field(method, S(clazz), S(sig_java_lang_Class))->jvm_mirror;
+    Class *c = jvm_mirror(get_ref_field(method, S(clazz), S(sig_java_lang_Class)));
     jstrRef name = get_ref_field(method, S(name), S(sig_java_lang_String));
     jref rtype = get_ref_field(method, S(returnType), S(sig_java_lang_Class));
     jref ptypes = get_ref_field(method, S(parameterTypes), S(array_java_lang_Class));
@@ -2297,7 +2313,7 @@ JVM_GetClassConstantPool(JNIEnv *env, jclass cls)
     TRACE("JVM_GetClassConstantPool(env=%p, cls=%p)", env, cls);
     Class *c = load_boot_class("jdk/internal/reflect/ConstantPool");
     jref cp = alloc_object(c);
-    set_ref_field(cp, "constantPoolOop", "Ljava/lang/Object;", (jref) &(((jclsRef) cls)->jvm_mirror->cp));
+    set_ref_field(cp, "constantPoolOop", "Ljava/lang/Object;", (jref) &(jvm_mirror((jclsRef) cls)->cp));
     return (jobject) cp;
 }
 
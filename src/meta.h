@@ -90,6 +90,15 @@ typedef enum ClassState {
     CLASS_INITED
 } ClassState;
 
+// java.lang.ref.Reference 的子类的引用强度，由 gc 处理（见 gc.c 中的 Reference processing）
+typedef enum RefType {
+    REF_NONE, // 不是 Reference
+    REF_SOFT,
+    REF_WEAK,
+    REF_FINAL,
+    REF_PHANTOM
+} RefType;
+
 typedef struct class Class;
 
 /*
@@ -155,12 +164,27 @@ struct class {
     Field *fields;
     u2 fields_count; // declared fields count
 
-    // instFieldsCount 有可能大于 fieldsCount，因为 instFieldsCount 包含了继承过来的 field.
-    // 类型二统计为两个数量
-    int inst_fields_count;
+    // 实例对象（非数组）中对象头和所有实例变量（包括继承来的）所占的字节数，未对齐
+    int inst_size;
+
+    // 此类 @Contended 实例变量所在区域（包括填充）的起始偏移，到 inst_size 为止，子类不能使用其中的空隙。
+    // 0 表示没有 @Contended 实例变量。
+    int contended_start;
+
+    // 所有引用类型实例变量的 id（包括继承而来的），gc 扫描对象时使用。
+    // 由 gc 第一次扫描此类的对象时生成。
+    int *ref_field_ids;
+    int ref_fields_count;
 
-    // vtable 只保存虚方法。
-    // 该类所有函数自有函数（除了private, static, final, abstract）和 父类的函数虚拟表。
+    RefType ref_type;
+
+    // 此类（或父类）重写了 Object.finalize()，并且方法体不为空。
+    // 这样的对象创建时注册到 java.lang.ref.Finalizer，gc 发现其不可达后调用 finalize()。
+    bool has_finalizer;
+
+    // vtable 只保存虚方法（除了 private, static 和构造函数），父类的 vtable 在前面，
+    // 子类重写的方法替换父类的项，新方法和没有实现的接口方法加到后面。
+    // invokevirtual 按 Method.vtable_index 分派。接口没有 vtable。
     Method **vtable;
     size_t vtable_len;
     
@@ -171,21 +195,19 @@ struct class {
     * 而对继承一个类只能继承一个父亲，子类只要包含父类vtable，
     * 并且和父类的函数包含部分编号是一致的，就可以直接使用父类的函数编号找到对应的子类实现函数。
     */
-
-#if 0
-    std::vector<Method *> vtable;
-
-    struct ITable {
-        std::vector<std::pair<Class *, size_t /* offset */>> interfaces;
-        std::vector<Method *> methods;
-
-        ITable() = default;
-        ITable(const ITable &itable);
-        ITable& operator=(const ITable &itable);
-        void add(const ITable &itable);
+    struct itable {
+        // 此类实现的所有接口（包括父类实现的和父接口），及其方法在 methods 中的起始位置
+        struct itable_interface {
+            Class *clazz;
+            size_t offset;
+        } *interfaces;
+        u2 interfaces_count;
+
+        // 接口 I 中 itable_index 为 i 的方法在此类中的实现是 methods[offset(I) + i]。
+        // 接口的 itable 只有 methods_count，是它可以被 invokeinterface 分派的方法的数量。
+        Method **methods;
+        size_t methods_count;
     } itable;
-    Method *findFromITable(Class *interface_class, int index);
-#endif
 
     struct {
         Class *clazz;       // the immediately enclosing class
@@ -280,6 +302,12 @@ TJE Method *lookup_method(Class *, const char *name, const char *descriptor);
 TJE Method *lookup_static_method(Class *, const char *name, const char *descriptor); 
 TJE Method *lookup_inst_method(Class *, const char *name, const char *descriptor); 
 
+// 在 vtable 中查找，包括从接口继承的 default 方法和 miranda 方法（见 class.c 中的 create_vtable）
+Method *lookup_vtable_method(Class *, const utf8_t *name, const utf8_t *descriptor);
+
+// 接口方法 @m 在类 @c 中的实现，@c 没有实现 @m 的接口时返回 NULL（见 class.c 中的 create_itable）
+Method *lookup_itable_method(Class *c, const Method *m);
+
 /*
  * get在本类中定义的类，不包括继承的。
  */
@@ -461,6 +489,12 @@ struct method {
         } *catch_type;
     } *exception_tables;
     u2 exception_tables_len;
+
+    // 逃逸分析的结果（见 escape.h），还未分析时为 NULL
+    struct escape_info *escape_info;
+
+    // 按 pc 索引的调用点的 inline cache（见 inline_cache.h），还没有执行过虚方法调用时为 NULL
+    struct inline_cache **inline_caches;
 };
 
 void init_method(Method *m, Class *c, BytecodeReader *r);
@@ -535,6 +569,7 @@ struct field {
         } static_value;
 
         // Present if instance field
+        // 在对象中的字节偏移（从对象头开始），见 class.c 中的 layout_fields
         int id;
     };
 
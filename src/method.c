@@ -352,11 +352,11 @@ bool is_signature_polymorphic(const Method *m)
         return false;
 
     jarrRef ptypes = get_parameter_types(m); // Class<?>[]
-    if (ptypes->arr_len != 1)
+    if (array_len(ptypes) != 1)
         return false;
 
-    jclsRef ptype = array_get(jclsRef, ptypes, 0);
-    if (!utf8_equals(ptype->jvm_mirror->class_name, S(array_java_lang_Object))) 
+    jclsRef ptype = array_get_ref(ptypes, 0);
+    if (!utf8_equals(jvm_mirror(ptype)->class_name, S(array_java_lang_Object))) 
         return false;
 
     if (!(IS_VARARGS(m) && IS_NATIVE(m)))
@@ -52,7 +52,7 @@ void init_method_handle()
     // public String getSignature();
     MN_getSignature_method = get_declared_inst_method(MN_class, "getSignature", S(___java_lang_String));
 
-    RMN_vmtarget_field = get_declared_field0(RMN_class, "vmtarget", S(sig_java_lang_Object));
+    RMN_vmtarget_field = get_declared_field0(RMN_class, "vmtarget", S(J));
     RMN_vmholder_field = get_declared_field0(RMN_class, "vmholder", S(sig_java_lang_Class));
 
     // final LambdaForm form;
@@ -252,7 +252,7 @@ void init_member_name(jref member_name, jref target)
 
     if (target->clazz == method_reflect_class) {
         // private Class<?> clazz;
-        Class *decl_class = get_ref_field(target, "clazz", "Ljava/lang/Class;")->jvm_mirror;
+        Class *decl_class = jvm_mirror(get_ref_field(target, "clazz", "Ljava/lang/Class;"));
         // private int slot;
         int slot = get_int_field(target, "slot");
 
@@ -274,7 +274,7 @@ void init_member_name(jref member_name, jref target)
         set_int_field0(member_name, MN_flags_field, flags);
 
         jref resolved_method_name = alloc_object(RMN_class);
-        set_ref_field0(resolved_method_name, RMN_vmtarget_field, (jref) (void *) m);
+        set_long_field0(resolved_method_name, RMN_vmtarget_field, (jlong) (intptr_t) m);
         // set_ref_field0(resolved_method_name, RMN_vmholder_field, ); // todo RMN_vmholder_field怎么设置
         
         set_ref_field0(member_name, MN_method_field, resolved_method_name);
@@ -364,6 +364,16 @@ void init_member_name(jref member_name, jref target)
     raise_exception(S(java_lang_InternalError), NULL);  // todo msg
 }
 
+Method *member_name_vmtarget(jref member_name)
+{
+    assert(member_name != NULL);
+
+    jref resolved = get_ref_field0(member_name, MN_method_field);
+    if (resolved == NULL)
+        return NULL;
+    return (Method *) (intptr_t) get_long_field0(resolved, RMN_vmtarget_field);
+}
+
 void expand_member_name(jref member_name)
 {
     assert(member_name != NULL);
@@ -373,7 +383,7 @@ void expand_member_name(jref member_name)
         JVM_PANIC("java_lang_IllegalArgumentException");   // todo
     }
 
-    Method *vmtarget = (Method *) get_ref_field0(resolved, RMN_vmtarget_field);
+    Method *vmtarget = (Method *) (intptr_t) get_long_field0(resolved, RMN_vmtarget_field);
     jclsRef vmholder = get_ref_field0(resolved, RMN_vmholder_field);
     assert(vmtarget != NULL && vmholder != NULL);
 
@@ -461,7 +471,7 @@ Object *resolve_member_name(jref member_name, Class *caller)
     assert(member_name != NULL);
 
     jstrRef name_str = get_ref_field0(member_name, MN_name_field);
-    Class *clazz = get_ref_field0(member_name, MN_clazz_field)->jvm_mirror;
+    Class *clazz = jvm_mirror(get_ref_field0(member_name, MN_clazz_field));
     jref type = get_ref_field0(member_name, MN_type_field);
     jint flags = get_int_field0(member_name, MN_flags_field);
 
@@ -573,8 +583,8 @@ jint get_members(jclsRef defc, jstrRef match_name,
     if(match_flags & (IS_METHOD | IS_CONSTRUCTOR)) {
         int count = 0;
 
-        for (u2 i = 0; i < defc->jvm_mirror->methods_count; i++) {
-            Method *m = defc->jvm_mirror->methods + i;
+        for (u2 i = 0; i < jvm_mirror(defc)->methods_count; i++) {
+            Method *m = jvm_mirror(defc)->methods + i;
             if(m->name == SYMBOL(class_init))
                 continue;
             if(m->name == SYMBOL(object_init))
@@ -582,8 +592,8 @@ jint get_members(jclsRef defc, jstrRef match_name,
             if(skip-- > 0)
                 continue;
 
-            if(count < results->arr_len) {
-                Object *member_name = array_get(jref, results, count);
+            if(count < array_len(results)) {
+                Object *member_name = array_get_ref(results, count);
                 count++;
                 int flags = methodFlags(m) | IS_METHOD;
 
@@ -612,7 +622,7 @@ jint get_members(jclsRef defc, jstrRef match_name,
 
 jlong member_name_object_field_offset(jref member_name)
 {
-    Class *clazz = get_ref_field0(member_name, MN_clazz_field)->jvm_mirror;
+    Class *clazz = jvm_mirror(get_ref_field0(member_name, MN_clazz_field));
     jstrRef name = get_ref_field0(member_name, MN_name_field);
     jref type = get_ref_field0(member_name, MN_type_field);
 
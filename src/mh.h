@@ -37,6 +37,9 @@ jint get_members(jclsRef defc, jstrRef match_name,
                 jstrRef match_sig, jint match_flags, jclsRef caller, jint skip, jref _results);
 TJE jlong member_name_object_field_offset(jref member_name); 
 
+// 已解析的 MemberName 的目标方法（MemberName.method.vmtarget），未解析时返回 NULL
+Method *member_name_vmtarget(jref member_name);
+
 // java/lang/invoke/MethodHandles 类的便利操作函数
 // namespace method_handles {
     jref getCaller();
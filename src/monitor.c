@@ -0,0 +1,403 @@
+#include <assert.h>
+#include <sys/time.h>
+#include "cabin.h"
+#include "monitor.h"
+#include "object.h"
+#include "thread.h"
+
+struct monitor {
+    pthread_mutex_t mutex; // 保护下面的字段，持有期间不会进入安全点
+    pthread_cond_t entry_cond; // 等待获取锁的线程
+    pthread_cond_t wait_cond;  // Object.wait
+
+    Thread *owner;
+    jlong recursions;
+
+    jint hash; // 对象的 identity hash，0表示还未生成
+
+    jref obj; // 所属的对象
+    Monitor *next;
+};
+
+// 所有的 Monitor
+static pthread_mutex_t monitors_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Monitor *monitors;
+
+#define thin_owner(m) ((Thread *) ((m) & MARK_PTR_MASK))
+#define thin_recursions(m) ((m) >> MARK_RECURSION_SHIFT) // 重入次数-1
+#define THIN_RECURSION_ONE ((uintptr_t) 1 << MARK_RECURSION_SHIFT)
+#define THIN_RECURSION_MAX (((uintptr_t) 1 << (64 - MARK_RECURSION_SHIFT)) - 1)
+#define mark_monitor(m) ((Monitor *) ((m) & MARK_PTR_MASK))
+#define mark_hash(m) ((jint) (((m) & MARK_HASH_MASK) >> MARK_HASH_SHIFT))
+
+#define load_mark(o) __atomic_load_n(&(o)->mark, __ATOMIC_ACQUIRE)
+
+// gc 位可能被其他线程同时修改（见 remember_object），所以修改锁状态总是使用 CAS
+#define cas_mark(o, expected, desired) \
+    __atomic_compare_exchange_n(&(o)->mark, (expected), (desired), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+static Monitor *new_monitor(Object *o)
+{
+    Monitor *mon = vm_malloc(sizeof(Monitor));
+    assert(((uintptr_t) mon & ~MARK_PTR_MASK) == 0);
+    pthread_mutex_init(&mon->mutex, NULL);
+    pthread_cond_init(&mon->entry_cond, NULL);
+    pthread_cond_init(&mon->wait_cond, NULL);
+    mon->owner = NULL;
+    mon->recursions = 0;
+    mon->hash = 0;
+    mon->obj = o;
+    mon->next = NULL;
+    return mon;
+}
+
+static void delete_monitor(Monitor *mon)
+{
+    pthread_mutex_destroy(&mon->mutex);
+    pthread_cond_destroy(&mon->entry_cond);
+    pthread_cond_destroy(&mon->wait_cond);
+    free(mon);
+}
+
+// 将 @o 的锁膨胀为重量锁，轻量锁的持有者成为 Monitor 的持有者
+static Monitor *inflate(Object *o)
+{
+    Monitor *mon = NULL;
+    uintptr_t m = load_mark(o);
+
+    for (;;) {
+        uintptr_t state = m & MARK_LOCK_MASK;
+        assert(state != MARK_FORWARDED);
+        if (state == MARK_INFLATED) {
+            // 被其他线程膨胀了
+            if (mon != NULL)
+                delete_monitor(mon);
+            return mark_monitor(m);
+        }
+
+        if (mon == NULL)
+            mon = new_monitor(o);
+        if (state == MARK_THIN) {
+            mon->owner = thin_owner(m);
+            mon->recursions = thin_recursions(m) + 1;
+        } else {
+            mon->owner = NULL;
+            mon->recursions = 0;
+            mon->hash = mark_hash(m);
+        }
+
+        if (cas_mark(o, &m, (uintptr_t) mon | MARK_INFLATED | (m & MARK_GC_BITS)))
+            break;
+    }
+
+    pthread_mutex_lock(&monitors_mutex);
+    mon->next = monitors;
+    monitors = mon;
+    pthread_mutex_unlock(&monitors_mutex);
+    return mon;
+}
+
+static void monitor_enter(Monitor *mon, Thread *self)
+{
+    pthread_mutex_lock(&mon->mutex);
+    if (mon->owner == self) {
+        mon->recursions++;
+        pthread_mutex_unlock(&mon->mutex);
+        return;
+    }
+
+    if (mon->owner != NULL) {
+        // 阻塞期间处于安全区域，gc 可以进行
+        enter_safe_region(self);
+        while (mon->owner != NULL) {
+            pthread_cond_wait(&mon->entry_cond, &mon->mutex);
+        }
+        mon->owner = self;
+        mon->recursions = 1;
+        pthread_mutex_unlock(&mon->mutex);
+        // 可能要等待 gc 结束，此时不能持有 mon->mutex
+        leave_safe_region(self);
+        return;
+    }
+
+    mon->owner = self;
+    mon->recursions = 1;
+    pthread_mutex_unlock(&mon->mutex);
+}
+
+static bool monitor_exit(Monitor *mon, Thread *self)
+{
+    pthread_mutex_lock(&mon->mutex);
+    if (mon->owner != self) {
+        pthread_mutex_unlock(&mon->mutex);
+        return false;
+    }
+    if (--mon->recursions == 0) {
+        mon->owner = NULL;
+        pthread_cond_signal(&mon->entry_cond);
+    }
+    pthread_mutex_unlock(&mon->mutex);
+    return true;
+}
+
+void object_lock(Object *o)
+{
+    assert(o != NULL);
+    Thread *self = get_current_thread();
+    assert(self != NULL && ((uintptr_t) self & ~MARK_PTR_MASK) == 0);
+
+    uintptr_t m = load_mark(o);
+    for (;;) {
+        switch (m & MARK_LOCK_MASK) {
+            case MARK_UNLOCKED:
+                if ((m & MARK_HASH_MASK) != 0) {
+                    // 轻量锁会覆盖 hash
+                    monitor_enter(inflate(o), self);
+                    return;
+                }
+                if (cas_mark(o, &m, (uintptr_t) self | MARK_THIN | (m & MARK_GC_BITS)))
+                    return;
+                break; // m 已被更新，重试
+            case MARK_THIN:
+                if (thin_owner(m) == self && thin_recursions(m) < THIN_RECURSION_MAX) {
+                    if (cas_mark(o, &m, m + THIN_RECURSION_ONE))
+                        return;
+                    break;
+                }
+                // 有竞争，或者重入次数溢出
+                monitor_enter(inflate(o), self);
+                return;
+            case MARK_INFLATED:
+                monitor_enter(mark_monitor(m), self);
+                return;
+            default:
+                JVM_PANIC("forwarded object: %p", o);
+        }
+    }
+}
+
+bool object_unlock(Object *o)
+{
+    assert(o != NULL);
+    Thread *self = get_current_thread();
+
+    uintptr_t m = load_mark(o);
+    for (;;) {
+        switch (m & MARK_LOCK_MASK) {
+            case MARK_THIN: {
+                if (thin_owner(m) != self)
+                    return false;
+                uintptr_t n = thin_recursions(m) > 0 ? m - THIN_RECURSION_ONE : (m & MARK_GC_BITS) | MARK_UNLOCKED;
+                if (cas_mark(o, &m, n))
+                    return true;
+                break;
+            }
+            case MARK_INFLATED:
+                return monitor_exit(mark_monitor(m), self);
+            default:
+                return false;
+        }
+    }
+}
+
+bool object_holds_lock(Object *o, Thread *t)
+{
+    assert(o != NULL);
+    uintptr_t m = load_mark(o);
+    switch (m & MARK_LOCK_MASK) {
+        case MARK_THIN:
+            return thin_owner(m) == t;
+        case MARK_INFLATED:
+            // 只有 t 自己可以把 owner 改为或者改离 t
+            return __atomic_load_n(&mark_monitor(m)->owner, __ATOMIC_RELAXED) == t;
+        default:
+            return false;
+    }
+}
+
+/*
+ * 中断状态保存在 java.lang.Thread 的 interrupted 字段中，
+ * Thread.interrupt 先设置它，再调用 JVM_Interrupt（见 interrupt_wait）。
+ */
+static bool clear_interrupted(Thread *t)
+{
+    if (!get_bool_field(t->tobj, "interrupted"))
+        return false;
+    set_bool_field(t->tobj, "interrupted", false);
+    return true;
+}
+
+WaitResult object_wait(Object *o, jlong ms)
+{
+    assert(o != NULL && ms >= 0);
+    Thread *self = get_current_thread();
+    if (!object_holds_lock(o, self))
+        return WAIT_NOT_OWNER;
+    if (clear_interrupted(self))
+        return WAIT_INTERRUPTED;
+
+    Monitor *mon = inflate(o);
+    pthread_mutex_lock(&mon->mutex);
+    assert(mon->owner == self);
+
+    // 释放锁
+    jlong recursions = mon->recursions;
+    mon->owner = NULL;
+    mon->recursions = 0;
+    pthread_cond_signal(&mon->entry_cond);
+
+    /*
+     * 先发布 wait_monitor 再检查中断状态，与 interrupt_wait 的顺序相反，
+     * 所以要么这里看到中断，要么 interrupt_wait 看到 wait_monitor 并唤醒这里。
+     * 检查和等待之间一直持有 mon->mutex，唤醒不会丢失。
+     */
+    __atomic_store_n(&self->wait_monitor, mon, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    // 进入安全区域之后不能再访问堆
+    bool interrupted = get_bool_field(self->tobj, "interrupted");
+
+    enter_safe_region(self);
+    if (!interrupted) {
+        if (ms == 0) {
+            pthread_cond_wait(&mon->wait_cond, &mon->mutex);
+        } else {
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            struct timespec deadline;
+            deadline.tv_sec = now.tv_sec + ms / 1000;
+            deadline.tv_nsec = now.tv_usec * 1000L + (ms % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&mon->wait_cond, &mon->mutex, &deadline);
+        }
+    }
+    __atomic_store_n(&self->wait_monitor, NULL, __ATOMIC_SEQ_CST);
+
+    // 重新获取锁
+    while (mon->owner != NULL) {
+        pthread_cond_wait(&mon->entry_cond, &mon->mutex);
+    }
+    mon->owner = self;
+    mon->recursions = recursions;
+    pthread_mutex_unlock(&mon->mutex);
+    leave_safe_region(self);
+    return clear_interrupted(self) ? WAIT_INTERRUPTED : WAIT_NOTIFIED;
+}
+
+void interrupt_wait(Thread *t)
+{
+    assert(t != NULL);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    Monitor *mon = __atomic_load_n(&t->wait_monitor, __ATOMIC_SEQ_CST);
+    if (mon == NULL)
+        return;
+
+    // Monitor 只在 stop-the-world 中释放，当前线程不在安全区域，所以 mon 仍然有效
+    pthread_mutex_lock(&mon->mutex);
+    pthread_cond_broadcast(&mon->wait_cond);
+    pthread_mutex_unlock(&mon->mutex);
+}
+
+bool object_notify(Object *o, bool all)
+{
+    assert(o != NULL);
+    Thread *self = get_current_thread();
+    if (!object_holds_lock(o, self))
+        return false;
+
+    uintptr_t m = load_mark(o);
+    if ((m & MARK_LOCK_MASK) != MARK_INFLATED)
+        return true; // 调用 wait 时锁已膨胀，所以没有等待的线程
+
+    Monitor *mon = mark_monitor(m);
+    pthread_mutex_lock(&mon->mutex);
+    if (all)
+        pthread_cond_broadcast(&mon->wait_cond);
+    else
+        pthread_cond_signal(&mon->wait_cond);
+    pthread_mutex_unlock(&mon->mutex);
+    return true;
+}
+
+// Marsaglia xor-shift, 状态只被当前线程访问
+static jint next_hash(Thread *self)
+{
+    u4 *state = self->hash_state;
+    u4 t = state[0];
+    t ^= t << 11;
+    state[0] = state[1];
+    state[1] = state[2];
+    state[2] = state[3];
+    u4 v = state[3];
+    v = (v ^ (v >> 19)) ^ (t ^ (t >> 8));
+    state[3] = v;
+
+    v &= 0x7fffffff;
+    return v != 0 ? (jint) v : 0xbad;
+}
+
+jint object_identity_hash(Object *o)
+{
+    assert(o != NULL);
+    Thread *self = get_current_thread();
+    assert(self != NULL);
+
+    uintptr_t m = load_mark(o);
+    for (;;) {
+        switch (m & MARK_LOCK_MASK) {
+            case MARK_UNLOCKED: {
+                jint hash = mark_hash(m);
+                if (hash != 0)
+                    return hash;
+                hash = next_hash(self);
+                if (cas_mark(o, &m, m | ((uintptr_t) hash << MARK_HASH_SHIFT)))
+                    return hash;
+                break; // m 已被更新，重试
+            }
+            case MARK_THIN:
+                // 轻量锁的 mark word 中没有空间保存 hash
+                inflate(o);
+                m = load_mark(o);
+                break;
+            case MARK_INFLATED: {
+                Monitor *mon = mark_monitor(m);
+                jint hash = __atomic_load_n(&mon->hash, __ATOMIC_ACQUIRE);
+                if (hash != 0)
+                    return hash;
+                hash = next_hash(self);
+                jint expected = 0;
+                if (__atomic_compare_exchange_n(&mon->hash, &expected, hash,
+                                                false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                    return hash;
+                return expected; // 被其他线程设置了
+            }
+            default:
+                JVM_PANIC("forwarded object: %p", o);
+        }
+    }
+}
+
+void sweep_monitors(jref (* update)(jref o))
+{
+    assert(update != NULL);
+    pthread_mutex_lock(&monitors_mutex);
+
+    Monitor **prev = &monitors;
+    while (*prev != NULL) {
+        Monitor *mon = *prev;
+        jref o = update(mon->obj);
+        if (o != NULL) {
+            mon->obj = o;
+            prev = &mon->next;
+            continue;
+        }
+
+        // 等待此锁的线程都持有对象的引用，所以对象死亡时没有线程在使用此 Monitor
+        *prev = mon->next;
+        delete_monitor(mon);
+    }
+
+    pthread_mutex_unlock(&monitors_mutex);
+}
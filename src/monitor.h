@@ -0,0 +1,56 @@
+#ifndef CABIN_MONITOR_H
+#define CABIN_MONITOR_H
+
+#include "cabin.h"
+
+/*
+ * Object monitor
+ *
+ * 锁状态保存在对象头的 mark word 中（见 object.h）。
+ * 没有竞争时使用轻量锁（thin lock）：以 CAS 将当前线程写入 mark word，重入时只增加计数。
+ * 发生竞争，重入次数溢出，或者调用 wait/notify 时膨胀为重量锁：
+ * 分配一个 Monitor（mutex + 条件变量），mark word 改为指向它，此后不再收缩。
+ *
+ * Monitor 属于其对象，gc 之后由 sweep_monitors 更新对象的地址，对象死亡后释放。
+ */
+
+typedef struct monitor Monitor;
+
+// 阻塞时当前线程处于安全区域
+void object_lock(Object *o);
+
+// 当前线程不持有 @o 的锁时返回 false（IllegalMonitorStateException）
+bool object_unlock(Object *o);
+
+bool object_holds_lock(Object *o, struct vm_thread *t);
+
+typedef enum {
+    WAIT_NOTIFIED,    // 被唤醒或超时
+    WAIT_NOT_OWNER,   // 当前线程不持有锁（IllegalMonitorStateException）
+    WAIT_INTERRUPTED, // 等待之前或期间被中断，中断状态已清除（InterruptedException）
+} WaitResult;
+
+/*
+ * Object.wait/notify/notifyAll
+ * 当前线程不持有 @o 的锁时 object_notify 返回 false（IllegalMonitorStateException）。
+ * @ms: 等待的毫秒数，0 表示一直等待。
+ */
+WaitResult object_wait(Object *o, jlong ms);
+bool object_notify(Object *o, bool all);
+
+// Thread.interrupt：唤醒正在 object_wait 中等待的线程 @t
+void interrupt_wait(struct vm_thread *t);
+
+/*
+ * Object.hashCode/System.identityHashCode
+ * 第一次调用时由当前线程的 xor-shift 随机数生成（非0，非负），保存在对象头中，此后不变，与对象的地址无关。
+ */
+jint object_identity_hash(Object *o);
+
+/*
+ * 在 stop-the-world 中调用。
+ * @update 返回 Monitor 所属对象的新地址，对象已死亡时返回 NULL，此时 Monitor 被释放。
+ */
+void sweep_monitors(jref (* update)(jref o));
+
+#endif // CABIN_MONITOR_H
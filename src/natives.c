@@ -56,24 +56,47 @@ static void unpark(JNIEnv *env, jref this, jref thread)
  * public final native boolean compareAndSwapInt(Object o, long offset, int expected, int x);
  */
 
-#define COMPARE_AND_SWAP(Type, jypte) \
+// @stype: 值在对象中保存的类型，@encode: 转换为 stype
+#define COMPARE_AND_SWAP(Type, jypte, stype, encode) \
 static jboolean compareAndSwap##Type(JNIEnv *env, jref _this, jref o, jlong offset, jypte expected, jypte x) \
 { \
-    jypte *old; \
+    stype *old; \
     if (is_array_object(o)) { \
-        old = (jypte *)(array_index(o, offset)); \
+        old = (stype *)(array_index(o, (jint) offset)); \
     } else { \
-        assert(0 <= offset && offset < o->clazz->inst_fields_count); \
-        old = (jypte *) (o->data + offset); \
+        assert((jlong) sizeof(Object) <= offset && offset < (jlong) o->clazz->inst_size); \
+        old = (stype *) ((u1 *) o + offset); \
     } \
  \
-    bool b = __sync_bool_compare_and_swap(old, expected, x); \
+    PRE_WRITE_BARRIER_##Type(old); \
+    bool b = __sync_bool_compare_and_swap(old, encode(expected), encode(x)); \
+    if (b) \
+        WRITE_BARRIER_##Type(o, x); \
     return b ? jtrue : jfalse; \
 }
 
-COMPARE_AND_SWAP(Int, jint)
-COMPARE_AND_SWAP(Long, jlong)
-COMPARE_AND_SWAP(Object, jref)
+// 非引用类型不需要 barrier
+#define PRE_WRITE_BARRIER_Int(p) do { } while (0)
+#define PRE_WRITE_BARRIER_Long(p) do { } while (0)
+#define PRE_WRITE_BARRIER_Object(p) pre_write_barrier(p)
+#define WRITE_BARRIER_Int(o, x) do { } while (0)
+#define WRITE_BARRIER_Long(o, x) do { } while (0)
+#define WRITE_BARRIER_Object(o, x) write_barrier(o, x)
+
+#define NO_ENCODE(x) (x)
+
+COMPARE_AND_SWAP(Int, jint, jint, NO_ENCODE)
+COMPARE_AND_SWAP(Long, jlong, jlong, NO_ENCODE)
+COMPARE_AND_SWAP(Object, jref, heapref_t, encode_ref)
+
+#undef NO_ENCODE
+
+#undef PRE_WRITE_BARRIER_Int
+#undef PRE_WRITE_BARRIER_Long
+#undef PRE_WRITE_BARRIER_Object
+#undef WRITE_BARRIER_Int
+#undef WRITE_BARRIER_Long
+#undef WRITE_BARRIER_Object
 
 #undef COMPARE_AND_SWAP
 
@@ -96,7 +119,7 @@ static jclsRef defineClass(JNIEnv *env, jref _this, jstrRef name,
 // public native void ensureClassInitialized(Class<?> c);
 static void ensureClassInitialized(JNIEnv *env, jref _this, jclsRef c)
 {
-    init_class(c->jvm_mirror);
+    init_class(jvm_mirror(c));
 //    c->clinit(); // todo 是不是这样搞？
 }
 
@@ -107,7 +130,7 @@ static jlong staticFieldOffset(JNIEnv *env, jref _this, jref f)
     utf8_t *name = string_to_utf8(get_ref_field(f, "name", "Ljava/lang/String;"));
 
     // private Class<?> clazz;
-    Class *c = get_ref_field(f, "clazz", "Ljava/lang/Class;")->jvm_mirror;
+    Class *c = jvm_mirror(get_ref_field(f, "clazz", "Ljava/lang/Class;"));
     for (int i = 0; i < c->fields_count; i++) {
         // Field *field = c->fields[i];
         if (utf8_equals(c->fields[i].name, name))
@@ -150,7 +173,7 @@ static jlong objectFieldOffset(JNIEnv *env, jref _this, jref field)
 // private native long objectFieldOffset1(Class<?> c, String name);
 static jlong objectFieldOffset1(JNIEnv *env, jref _this, jclsRef c, jstrRef name)
 {
-    Field *f = get_declared_field(c->jvm_mirror, string_to_utf8(name));
+    Field *f = get_declared_field(jvm_mirror(c), string_to_utf8(name));
     return f->id;
 }
 
@@ -162,17 +185,17 @@ static j##type _obj_get_##type##_(JNIEnv *env, jref _this, jref o, jlong offset)
         return *(j##type *) (intptr_t) offset; \
     } \
     if (is_array_object(o)) { /* get value from array */ \
-        assert(0 <= offset && offset < o->arr_len); \
-        return array_get(j##type, o, offset); \
+        assert(0 <= offset && offset < array_len(o)); \
+        return ARRAY_GET_##type(o, offset); \
     } else if (is_class_object(o)) { /* get static filed value */ \
-        Class *c = o->jvm_mirror; \
+        Class *c = jvm_mirror(o); \
         init_class(c);  \
         assert(0 <= offset && offset < c->fields_count); \
         Field *f = c->fields + offset; \
         return f->static_value.t; \
     } else { \
-        assert(0 <= offset && offset < o->clazz->inst_fields_count); \
-        return slot_get_##type(o->data + offset); \
+        assert((jlong) sizeof(Object) <= offset && offset < (jlong) o->clazz->inst_size); \
+        return LOAD_##type((u1 *) o + offset); \
     } \
 } \
 \
@@ -184,20 +207,81 @@ static void _obj_put_##type##_(JNIEnv *env, jref _this, jref o, jlong offset, j#
         return; \
     } \
     if (is_array_object(o)) { /* set value to array */ \
-        assert(0 <= offset && offset < o->arr_len); \
+        assert(0 <= offset && offset < array_len(o)); \
         array_set_##type(o, offset, x); \
     } else if (is_class_object(o)) { /* set static filed value */ \
-        Class *c = o->jvm_mirror; \
+        Class *c = jvm_mirror(o); \
         init_class(c); \
         assert(0 <= offset && offset < c->fields_count); \
         Field *f = c->fields + offset; \
+        PRE_WRITE_BARRIER_STATIC_##type(&f->static_value.r); \
         f->static_value.t = x; \
     } else { \
-        assert(0 <= offset && offset < o->clazz->inst_fields_count); \
-        slot_set_##type(o->data + offset, x); \
+        assert((jlong) sizeof(Object) <= offset && offset < (jlong) o->clazz->inst_size); \
+        PRE_WRITE_BARRIER_##type((heapref_t *) ((u1 *) o + offset)); \
+        STORE_##type((u1 *) o + offset, x); \
+        WRITE_BARRIER_##type(o, x); \
     } \
 }
 
+// 数组中的元素，引用数组中是压缩的引用
+#define ARRAY_GET_boolean(a, i) array_get(jboolean, a, i)
+#define ARRAY_GET_byte(a, i) array_get(jbyte, a, i)
+#define ARRAY_GET_char(a, i) array_get(jchar, a, i)
+#define ARRAY_GET_short(a, i) array_get(jshort, a, i)
+#define ARRAY_GET_int(a, i) array_get(jint, a, i)
+#define ARRAY_GET_long(a, i) array_get(jlong, a, i)
+#define ARRAY_GET_float(a, i) array_get(jfloat, a, i)
+#define ARRAY_GET_double(a, i) array_get(jdouble, a, i)
+#define ARRAY_GET_ref(a, i) array_get_ref(a, i)
+
+// 对象中的实例变量
+#define LOAD_boolean(p) (*(jboolean *) (p))
+#define LOAD_byte(p) (*(jbyte *) (p))
+#define LOAD_char(p) (*(jchar *) (p))
+#define LOAD_short(p) (*(jshort *) (p))
+#define LOAD_int(p) (*(jint *) (p))
+#define LOAD_long(p) (*(jlong *) (p))
+#define LOAD_float(p) (*(jfloat *) (p))
+#define LOAD_double(p) (*(jdouble *) (p))
+#define LOAD_ref(p) load_ref(p)
+#define STORE_boolean(p, x) (*(jboolean *) (p) = (x))
+#define STORE_byte(p, x) (*(jbyte *) (p) = (x))
+#define STORE_char(p, x) (*(jchar *) (p) = (x))
+#define STORE_short(p, x) (*(jshort *) (p) = (x))
+#define STORE_int(p, x) (*(jint *) (p) = (x))
+#define STORE_long(p, x) (*(jlong *) (p) = (x))
+#define STORE_float(p, x) (*(jfloat *) (p) = (x))
+#define STORE_double(p, x) (*(jdouble *) (p) = (x))
+#define STORE_ref(p, x) store_ref(p, x)
+#define PRE_WRITE_BARRIER_STATIC_boolean(p)
+#define PRE_WRITE_BARRIER_STATIC_byte(p)
+#define PRE_WRITE_BARRIER_STATIC_char(p)
+#define PRE_WRITE_BARRIER_STATIC_short(p)
+#define PRE_WRITE_BARRIER_STATIC_int(p)
+#define PRE_WRITE_BARRIER_STATIC_long(p)
+#define PRE_WRITE_BARRIER_STATIC_float(p)
+#define PRE_WRITE_BARRIER_STATIC_double(p)
+#define PRE_WRITE_BARRIER_STATIC_ref(p) pre_write_barrier_static(p)
+#define PRE_WRITE_BARRIER_boolean(p)
+#define PRE_WRITE_BARRIER_byte(p)
+#define PRE_WRITE_BARRIER_char(p)
+#define PRE_WRITE_BARRIER_short(p)
+#define PRE_WRITE_BARRIER_int(p)
+#define PRE_WRITE_BARRIER_long(p)
+#define PRE_WRITE_BARRIER_float(p)
+#define PRE_WRITE_BARRIER_double(p)
+#define PRE_WRITE_BARRIER_ref(p) pre_write_barrier(p)
+#define WRITE_BARRIER_boolean(o, x)
+#define WRITE_BARRIER_byte(o, x)
+#define WRITE_BARRIER_char(o, x)
+#define WRITE_BARRIER_short(o, x)
+#define WRITE_BARRIER_int(o, x)
+#define WRITE_BARRIER_long(o, x)
+#define WRITE_BARRIER_float(o, x)
+#define WRITE_BARRIER_double(o, x)
+#define WRITE_BARRIER_ref(o, x) write_barrier(o, x)
+
 OBJ_SETTER_AND_GETTER(boolean, z)
 OBJ_SETTER_AND_GETTER(byte, b)
 OBJ_SETTER_AND_GETTER(char, c)
@@ -209,6 +293,60 @@ OBJ_SETTER_AND_GETTER(double, d)
 OBJ_SETTER_AND_GETTER(ref, r)
 
 #undef OBJ_SETTER_AND_GETTER
+#undef ARRAY_GET_boolean
+#undef ARRAY_GET_byte
+#undef ARRAY_GET_char
+#undef ARRAY_GET_short
+#undef ARRAY_GET_int
+#undef ARRAY_GET_long
+#undef ARRAY_GET_float
+#undef ARRAY_GET_double
+#undef ARRAY_GET_ref
+#undef LOAD_boolean
+#undef LOAD_byte
+#undef LOAD_char
+#undef LOAD_short
+#undef LOAD_int
+#undef LOAD_long
+#undef LOAD_float
+#undef LOAD_double
+#undef LOAD_ref
+#undef STORE_boolean
+#undef STORE_byte
+#undef STORE_char
+#undef STORE_short
+#undef STORE_int
+#undef STORE_long
+#undef STORE_float
+#undef STORE_double
+#undef STORE_ref
+#undef PRE_WRITE_BARRIER_STATIC_boolean
+#undef PRE_WRITE_BARRIER_STATIC_byte
+#undef PRE_WRITE_BARRIER_STATIC_char
+#undef PRE_WRITE_BARRIER_STATIC_short
+#undef PRE_WRITE_BARRIER_STATIC_int
+#undef PRE_WRITE_BARRIER_STATIC_long
+#undef PRE_WRITE_BARRIER_STATIC_float
+#undef PRE_WRITE_BARRIER_STATIC_double
+#undef PRE_WRITE_BARRIER_STATIC_ref
+#undef PRE_WRITE_BARRIER_boolean
+#undef PRE_WRITE_BARRIER_byte
+#undef PRE_WRITE_BARRIER_char
+#undef PRE_WRITE_BARRIER_short
+#undef PRE_WRITE_BARRIER_int
+#undef PRE_WRITE_BARRIER_long
+#undef PRE_WRITE_BARRIER_float
+#undef PRE_WRITE_BARRIER_double
+#undef PRE_WRITE_BARRIER_ref
+#undef WRITE_BARRIER_boolean
+#undef WRITE_BARRIER_byte
+#undef WRITE_BARRIER_char
+#undef WRITE_BARRIER_short
+#undef WRITE_BARRIER_int
+#undef WRITE_BARRIER_long
+#undef WRITE_BARRIER_float
+#undef WRITE_BARRIER_double
+#undef WRITE_BARRIER_ref
 
 
 #define OBJ_SETTER_AND_GETTER_VOLATILE(type) \
@@ -242,15 +380,15 @@ static jref getObjectVolatile(JNIEnv *env, jref _this, jref o, jlong offset)
     // todo Volatile
 
     if (is_array_object(o)) {
-        return array_get(jref, o, offset);
+        return array_get_ref(o, offset);
     } else if (is_class_object(o)) {
-        Class *c = o->jvm_mirror;
+        Class *c = jvm_mirror(o);
         assert(0 <= offset && offset < c->fields_count);
         // Field *f = c->fields[offset];
         return c->fields[offset].static_value.r;
     } else {
-        assert(0 <= offset && offset < o->clazz->inst_fields_count);
-        return *(jref *)(o->data + offset);//o->getInstFieldValue<jref>(offset);  // todo
+        assert(sizeof(Object) <= offset && offset < o->clazz->inst_size);
+        return load_ref((u1 *) o + offset);//o->getInstFieldValue<jref>(offset);  // todo
     }
 }
 
@@ -305,8 +443,8 @@ static void *_getPoint(jref o, jlong offset)
         // offset 在这里表示数组下标(index)
         p = array_index(o, offset);
     } else {
-        // offset 在这里表示 slot id.
-        p = o->data;
+        // offset 在这里表示字段在对象中的字节偏移
+        p = (u1 *) o + offset;
     }
 
     return p;
@@ -395,7 +533,7 @@ static jint getLoadAverage(JNIEnv *env, jref _this, jref loadavg, jint nelems)
 static jboolean shouldBeInitialized(JNIEnv *env, jref _this, jclsRef c)
 {
     // todo
-    return c->jvm_mirror->state >= CLASS_INITED ? jtrue : jfalse;
+    return jvm_mirror(c)->state >= CLASS_INITED ? jtrue : jfalse;
 }
 
 /**
@@ -420,13 +558,13 @@ static jclsRef defineAnonymousClass(JNIEnv *env, jref _this, jclsRef host_class,
     assert(data != NULL && is_array_object(data));
     assert(cp_patches == NULL || is_array_object(cp_patches));
 
-    Class *c = define_class(host_class->jvm_mirror->loader, (u1 *) data->data, data->arr_len);
+    Class *c = define_class(jvm_mirror(host_class)->loader, (u1 *) array_data(data), array_len(data));
     if (c == NULL)
         return NULL; // todo
 
-    int cp_patches_len = cp_patches == NULL ? 0 : cp_patches->arr_len;
+    int cp_patches_len = cp_patches == NULL ? 0 : array_len(cp_patches);
     for (int i = 0; i < cp_patches_len; i++) {
-        jref o = array_get(jref, cp_patches, i);
+        jref o = array_get_ref(cp_patches, i);
         if (o != NULL) {
             u1 type = cp_get_type(&c->cp, i);
             if (type == JVM_CONSTANT_String) {
@@ -438,7 +576,7 @@ static jclsRef defineAnonymousClass(JNIEnv *env, jref _this, jclsRef host_class,
         }
     }
 
-    c->nest_host = host_class->jvm_mirror;
+    c->nest_host = jvm_mirror(host_class);
     link_class(c);
 
     return c->java_mirror;
@@ -580,7 +718,7 @@ static jref MH_invokeExact(const slot_t *args)
 
     jref form = get_ref_field(_this, S(form), "Ljava/lang/invoke/LambdaForm;");
     jref entry = get_ref_field(form, S(vmentry), "Ljava/lang/invoke/MemberName;");
-    Method *target = (Method *) (void *) get_ref_field(entry, S(vmtarget), S(sig_java_lang_Object));
+    Method *target = member_name_vmtarget(entry);
 
     return exec_java_r(target, args);
 }
@@ -630,7 +768,7 @@ static jref MH_invoke(const slot_t *args)
 
     jref form = get_ref_field(_this, S(form), "Ljava/lang/invoke/LambdaForm;");
     jref entry = get_ref_field(form, S(vmentry), "Ljava/lang/invoke/MemberName;");
-    Method *target = (Method *) (void *) get_ref_field(entry, S(vmtarget), S(sig_java_lang_Object));
+    Method *target = member_name_vmtarget(entry);
 
     return exec_java_r(target, args);
 
@@ -730,7 +868,7 @@ static jref MH_invokeBasic(const slot_t *args)
 
     jref form = get_ref_field(_this, S(form), "Ljava/lang/invoke/LambdaForm;");
     jref entry = get_ref_field(form, S(vmentry), "Ljava/lang/invoke/MemberName;");
-    Method *target = (Method *) (void *) get_ref_field(entry, S(vmtarget), S(sig_java_lang_Object));
+    Method *target = member_name_vmtarget(entry);
 
     return exec_java_r(target, args);
 }
@@ -759,7 +897,7 @@ static jref MH_linkToVirtual(u2 args_slots_count, const slot_t *args)
 static jref MH_linkToStatic(u2 args_slots_count, const slot_t *args)
 {
     Object *member_name = slot_get_ref(args + args_slots_count - 1);
-    Method *target = (Method *) (void *) get_ref_field(member_name, S(vmtarget), S(sig_java_lang_Object));
+    Method *target = member_name_vmtarget(member_name);
     assert(target != NULL);
 
     return exec_java_r(target, args);
@@ -824,7 +962,7 @@ static jref MHN_resolve(JNIEnv *env, jclsRef cls, jref self/*MemberName*/,
                         jclsRef caller, int lookupMode, jboolean speculativeResolve)
 {
     // todo speculative_resolve
-    return resolve_member_name(self, caller != NULL ? caller->jvm_mirror : NULL);
+    return resolve_member_name(self, caller != NULL ? jvm_mirror(caller) : NULL);
 }
 
 // static native int getMembers(Class<?> defc, String matchName, String matchSig,
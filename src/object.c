@@ -4,35 +4,78 @@
 #include "heap.h"
 #include "object.h"
 #include "encoding.h"
+#include "thread.h"
+#include "interpreter.h"
 
 
+// 优先在当前线程的 TLAB 中分配
+static inline void *alloc_in_heap(size_t size)
+{
+    Thread *thrd = get_current_thread();
+    if (thrd == NULL) // vm 初始化时还没有线程
+        return heap_malloc(g_heap, size);
+    return tlab_alloc(g_heap, &thrd->tlab, size);
+}
+
+// 并发标记期间在老年代（包括大对象空间）中分配的对象直接标记为存活
+static inline void allocate_black(Object *o)
+{
+    if (g_concurrent_marking) {
+        if (is_in_old(g_heap, (address) o))
+            heap_mark(g_heap, o);
+        else if (is_in_los(g_heap, (address) o))
+            los_mark((address) o);
+    }
+}
+
 static inline void init(Object *o, Class *c)
 {
+    allocate_black(o);
+    o->mark = MARK_UNLOCKED;
     o->clazz = c;
-    pthread_mutex_init(&o->mutex, &g_pthread_mutexattr_recursive);
 }
 
-static Object *create_non_array_object(Class *c, bool is_in_heap)
-{
-    assert(!is_array_class(c));
+static Method *finalizer_register;
 
-    size_t size = non_array_object_size(c);
-    Object *o = (is_in_heap ? heap_malloc(g_heap, size) : vm_calloc(size));
-    init(o, c);
-    o->data = (slot_t *) (o + 1);
-    return o;
+// 类有 finalize() 方法（见 Class.has_finalizer）的新对象注册到 java.lang.ref.Finalizer,
+// gc 发现其不可达后由 Finalizer 线程调用 finalize()（见 gc.c 中的 Reference processing）
+static void register_finalizer(Object *o)
+{
+    Method *m = __atomic_load_n(&finalizer_register, __ATOMIC_ACQUIRE);
+    if (m == NULL) {
+        Class *c = load_boot_class(S(java_lang_ref_Finalizer));
+        init_class(c);
+        m = lookup_static_method(c, "register", "(Ljava/lang/Object;)V");
+        __atomic_store_n(&finalizer_register, m, __ATOMIC_RELEASE);
+    }
+    exec_java(m, (slot_t[]) { rslot(o) });
 }
 
 Object *alloc_object(Class *c)
 {
     assert(!is_array_class(c));
-    return create_non_array_object(c, true);
+
+    Object *o = alloc_in_heap(non_array_object_size(c));
+    init(o, c);
+    if (c->has_finalizer)
+        register_finalizer(o);
+    return o;
 }
 
-Object *create_local_object(Class *c)
+Object *create_class_object(Class *c)
 {
-    assert(!is_array_class(c));
-    return create_non_array_object(c, false);
+    assert(c != NULL && g_class_class != NULL);
+
+    // 对象之前保留16字节（保持对象的对齐），其中的最后一个字保存 Class *（见 jvm_mirror）
+    // 在永久区中分配，保证对象中的引用可以指向它（见 Compressed oops）
+    u1 *p = perm_malloc(g_heap, 2*sizeof(Class *) + non_array_object_size(g_class_class));
+    if (p == NULL) {
+        JVM_PANIC("permanent space is exhausted");
+    }
+    Object *o = (Object *) (p + 2*sizeof(Class *));
+    init(o, g_class_class);
+    jvm_mirror(o) = c;
+    return o;
 }
 
 Object *alloc_array(Class *ac, jint arr_len)
@@ -42,13 +85,12 @@ Object *alloc_array(Class *ac, jint arr_len)
     assert(arr_len >= 0); // 长度为0的array是合法的
 
     size_t size = array_object_size(ac, arr_len);
-    Object *o = (Object *) heap_malloc(g_heap, size);
+    Object *o = (Object *) alloc_in_heap(size);
     init(o, ac);
 
-    o->arr_len = arr_len;
+    array_len(o) = arr_len;
     // java 数组创建后要赋默认值，0, 0.0, false,'\0', NULL 之类的
     // heap 申请对象时已经清零了。
-    o->data = (slot_t *) (o + 1);
     return o;
 }
 
@@ -59,16 +101,14 @@ Object *alloc_multi_array(Class *ac, jint dim, const jint lens[])
     assert(is_array_class(ac));
 
     size_t size = array_object_size(ac, lens[0]);
-    Object *o = (Object *) heap_malloc(g_heap, size);
+    Object *o = (Object *) alloc_in_heap(size);
     init(o, ac);
 
-    o->arr_len = lens[0];
-    assert(o->arr_len >= 0); // 长度为0的array是合法的
-
-    o->data = (slot_t *) (o + 1);
+    array_len(o) = lens[0];
+    assert(array_len(o) >= 0); // 长度为0的array是合法的
 
     for (int d = 1; d < dim; d++) {
-        for (int i = 0; i < o->arr_len; i++) {
+        for (int i = 0; i < array_len(o); i++) {
             array_set_ref(o, i, alloc_multi_array(component_class(ac), dim - 1, lens + 1));
         }
     }
@@ -85,13 +125,19 @@ Object *clone_object(const Object *o)
     }
 
     size_t s = object_size(o);
-    void *p = heap_malloc(g_heap, s);
+    void *p = alloc_in_heap(s);
     memcpy(p, o, s);
 
-    // todo mutex 怎么处理
-
+    // 新对象没有被锁住，也不在 remembered set 中
     Object *clone = (Object *) p;
-    clone->data = (slot_t *) (clone + 1);
+    clone->mark = MARK_UNLOCKED;
+    allocate_black(clone);
+    if (!is_in_young(g_heap, (address) clone)) {
+        // 大对象直接在老年代中分配，可能引用了新生代中的对象
+        remember_object(clone);
+    }
+    if (clone->clazz->has_finalizer)
+        register_finalizer(clone);
     return clone;
 }
 
@@ -99,9 +145,33 @@ void set_field_value0(Object *o, Field *f, const slot_t *value)
 {
     assert(o != NULL && f != NULL && !IS_STATIC(f) && value != NULL);
 
-    o->data[f->id] = value[0];
-    if (f->category_two) {
-        o->data[f->id + 1] = value[1];
+    switch (f->descriptor[0]) {
+        case 'Z': set_bool_field0(o, f, slot_get_bool(value)); break;
+        case 'B': set_byte_field0(o, f, slot_get_byte(value)); break;
+        case 'C': set_char_field0(o, f, slot_get_char(value)); break;
+        case 'S': set_short_field0(o, f, slot_get_short(value)); break;
+        case 'I': set_int_field0(o, f, slot_get_int(value)); break;
+        case 'F': set_float_field0(o, f, slot_get_float(value)); break;
+        case 'J': set_long_field0(o, f, slot_get_long(value)); break;
+        case 'D': set_double_field0(o, f, slot_get_double(value)); break;
+        default:  set_ref_field0(o, f, slot_get_ref(value)); break;
+    }
+}
+
+void get_field_value0(const Object *o, const Field *f, slot_t *value)
+{
+    assert(o != NULL && f != NULL && !IS_STATIC(f) && value != NULL);
+
+    switch (f->descriptor[0]) {
+        case 'Z': slot_set_bool(value, get_bool_field0(o, f)); break;
+        case 'B': slot_set_byte(value, get_byte_field0(o, f)); break;
+        case 'C': slot_set_char(value, get_char_field0(o, f)); break;
+        case 'S': slot_set_short(value, get_short_field0(o, f)); break;
+        case 'I': slot_set_int(value, get_int_field0(o, f)); break;
+        case 'F': slot_set_float(value, get_float_field0(o, f)); break;
+        case 'J': slot_set_long(value, get_long_field0(o, f)); break;
+        case 'D': slot_set_double(value, get_double_field0(o, f)); break;
+        default:  slot_set_ref(value, get_ref_field0(o, f)); break;
     }
 }
 
@@ -111,10 +181,8 @@ void set_field_value1(Object *o, int id, jref value)
     Field *f = lookup_inst_field(o->clazz, id);
 
     if (is_prim_field(f)) {
-        const slot_t *unbox = prim_wrapper_obj_unbox(value);
-        o->data[id] = *unbox;
-        if (f->category_two)
-            o->data[id+1] = *++unbox;
+        slot_t unbox[2];
+        set_field_value0(o, f, prim_wrapper_obj_unbox(value, unbox));
     } else {
         set_ref_field0(o, f, value);
     }
@@ -128,7 +196,7 @@ bool is_instance_of(const Object *o, Class *c)
     return is_subclass_of(o->clazz, c);
 }
 
-const slot_t *prim_wrapper_obj_unbox(const Object *box) 
+const slot_t *prim_wrapper_obj_unbox(const Object *box, slot_t value[2])
 {
     assert(box != NULL && box->clazz!= NULL && is_prim_wrapper_class(box->clazz));
 
@@ -142,7 +210,8 @@ const slot_t *prim_wrapper_obj_unbox(const Object *box)
     if (f == NULL) {
         JVM_PANIC("error, %s, %s\n", S(value), c->class_name); // todo
     }
-    return box->data + f->id;
+    get_field_value0(box, f, value);
+    return value;
 }
 
 size_t object_size(const Object *o) 
@@ -150,7 +219,7 @@ size_t object_size(const Object *o)
     assert(o != NULL && o->clazz != NULL);
 
     if (is_array_object(o)) {
-        return array_object_size(o->clazz, o->arr_len);
+        return array_object_size(o->clazz, array_len(o));
     } else {
         return non_array_object_size(o->clazz);
     }
@@ -168,13 +237,13 @@ const char *get_object_info(const Object *o)
 
 bool array_check_bounds(const jarrRef a, jint index)
 {
-    return 0 <= index && index < a->arr_len;
+    return 0 <= index && index < array_len(a);
 }
 
 void *array_index(const jarrRef a, jint index0)
 {
-    assert(0 <= index0 && index0 < a->arr_len);
-    return ((u1 *) (a->data)) + get_ele_size(a->clazz)*index0;
+    assert(0 <= index0 && index0 < array_len(a));
+    return ((u1 *) array_data(a)) + get_ele_size(a->clazz)*index0;
 }
 
 #define ARRAY_SET(jtype, type) \
@@ -182,7 +251,7 @@ void *array_index(const jarrRef a, jint index0)
     { \
         assert(a != NULL); \
         assert(is_##type##_array_class(a->clazz)); \
-        assert(0 <= i && i < a->arr_len); \
+        assert(0 <= i && i < array_len(a)); \
         *(jtype *)array_index(a, i) = v; \
     }
 
@@ -200,19 +269,21 @@ ARRAY_SET(jdouble, double)
 void array_set_ref(jarrRef a, int i, jref value)
 {
     assert(a != NULL);
-    assert(0 <= i && i < a->arr_len);
+    assert(0 <= i && i < array_len(a));
     assert(is_ref_array_class(a->clazz));
 
-    slot_t *data = (slot_t *) array_index(a, i);
+    void *data = array_index(a, i);
     if (value == NULL) {
-        *data = rslot(NULL);
+        pre_write_barrier((heapref_t *) data);
+        store_ref(data, NULL);
     } else if (is_prim_array(a)) {
-        const slot_t *unbox = prim_wrapper_obj_unbox(value);
-        *data = *unbox;
-        if (a->clazz->array.ele_size > sizeof(slot_t)) // todo
-            *++data = *++unbox;
+        slot_t buf[2];
+        const slot_t *unbox = prim_wrapper_obj_unbox(value, buf);
+        memcpy(data, unbox, a->clazz->array.ele_size);
     } else {
-        *data = rslot(value);
+        pre_write_barrier((heapref_t *) data);
+        store_ref(data, value);
+        write_barrier(a, value);
     }
 }
 
@@ -241,13 +312,24 @@ void array_copy(jarrRef dst, jint dst_pos, const jarrRef src, jint src_pos, jint
     if (src_pos < 0
         || dst_pos < 0
         || len < 0
-        || src_pos + len > src->arr_len
-        || dst_pos + len > dst->arr_len) {
+        || src_pos + len > array_len(src)
+        || dst_pos + len > array_len(dst)) {
         // throw java_lang_ArrayIndexOutOfBoundsException();
         raise_exception(S(java_lang_ArrayIndexOutOfBoundsException), NULL);
     }
 
-    memcpy(array_index(dst, dst_pos), array_index(src, src_pos), get_ele_size(src->clazz) * len);
+    if (g_concurrent_marking && is_ref_array_class(dst->clazz)) {
+        heapref_t *p = (heapref_t *) array_index(dst, dst_pos);
+        for (jint i = 0; i < len; i++) {
+            pre_write_barrier(p + i);
+        }
+    }
+
+    // src 和 dst 可能是同一个数组，复制的区间可能重叠
+    memmove(array_index(dst, dst_pos), array_index(src, src_pos), get_ele_size(src->clazz) * len);
+    if (is_ref_array_class(dst->clazz) && !is_in_young(g_heap, (address) dst)) {
+        remember_object(dst);
+    }
 }
 
 const char *arr_class_name_to_ele_class_name(const utf8_t *arr_class_name)
@@ -296,13 +378,13 @@ utf8_t *string_to_utf8(jstrRef so)
     
     jbyte code = get_byte_field(so, S(coder));
     if (code == STRING_CODE_LATIN1) {
-        utf8_t *utf8 = vm_malloc(sizeof(utf8_t) * (value->arr_len + 1));
-        utf8[value->arr_len] = 0;
-        memcpy(utf8, value->data, value->arr_len * sizeof(jbyte));
+        utf8_t *utf8 = vm_malloc(sizeof(utf8_t) * (array_len(value) + 1));
+        utf8[array_len(value)] = 0;
+        memcpy(utf8, array_data(value), array_len(value) * sizeof(jbyte));
         return utf8;
     }
     if (code == STRING_CODE_UTF16) {
-        utf8_t *u = unicode_to_utf8((unicode_t *)value->data, value->arr_len);
+        utf8_t *u = unicode_to_utf8((unicode_t *)array_data(value), array_len(value));
         return u;
     }
 
@@ -320,13 +402,13 @@ unicode_t *string_to_unicode(jstrRef so)
 
     jbyte code = get_byte_field(so, S(coder));
     if (code == STRING_CODE_LATIN1) {
-        unicode_t *u = utf8_to_unicode((utf8_t *)value->data, value->arr_len);
+        unicode_t *u = utf8_to_unicode((utf8_t *)array_data(value), array_len(value));
         return u;
     }
     if (code == STRING_CODE_UTF16) {
-        unicode_t *u = vm_malloc(sizeof(unicode_t) * (value->arr_len + 1));
-        u[value->arr_len] = 0;
-        memcpy(u, value->data, value->arr_len * sizeof(jbyte));
+        unicode_t *u = vm_malloc(sizeof(unicode_t) * (array_len(value) + 1));
+        u[array_len(value)] = 0;
+        memcpy(u, array_data(value), array_len(value) * sizeof(jbyte));
         return u;
     }
 
@@ -346,7 +428,7 @@ jstrRef alloc_string(const utf8_t *str)
     // set java/lang/String 的 value 变量赋值
     // private final byte[] value;
     jarrRef value = alloc_array0(BOOT_CLASS_LOADER, S(array_B), len); // [B
-    memcpy(value->data, str, len);
+    memcpy(array_data(value), str, len);
     set_ref_field(so, S(value), S(array_B), value);
 
     set_byte_field(so, S(coder), STRING_CODE_LATIN1);
@@ -396,7 +478,7 @@ jsize get_string_length(jstrRef so)
     } else {
         // private final byte[] value;
         jarrRef value = get_ref_field(so, S(value), S(array_B));
-        return value->arr_len;
+        return array_len(value);
     }
 }
 
@@ -414,7 +496,7 @@ jsize get_string_uft_length(jstrRef so)
     } else {
         // private final byte[] value;
         jarrRef value = get_ref_field(so, S(value), S(array_B));
-        return value->arr_len;
+        return array_len(value);
     }
 }
 
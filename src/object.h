@@ -8,45 +8,140 @@
 #include "slot.h"
 #include "symbol.h"
 #include "class_loader.h"
+#include "heap.h"
+#include "gc.h"
 
+/*
+ * 对象头：mark word 和 class 指针。
+ *
+ * Mark word 的布局（64位）：
+ *  ---------------------------------------------------------------------
+ *  | 63 ... 48 | 47 ... 4              | 3 2      | 1      | 0          |
+ *  ---------------------------------------------------------------------
+ *  | 0 | identity hash(46..16) | 0    | 00 无锁   | pinned | remembered |
+ *  | 重入次数-1 | 持有锁的线程（Thread *） | 01 轻量锁 | pinned | remembered |
+ *  | 0         | Monitor *             | 10 重量锁 | pinned | remembered |
+ *  | 对象的新地址（只在 gc 期间）           | 11 已移动              (无)   |
+ *  ---------------------------------------------------------------------
+ * Thread 和 Monitor 按16字节对齐，用户空间地址不超过48位。
+ * gc 位由 gc 原子的设置，锁状态由 mutator 以 CAS 修改（见 monitor.c），两者互不干扰。
+ * identity hash 为0表示还未生成。已生成 hash 的对象不再使用轻量锁，膨胀后 hash 保存在 Monitor 中。
+ * gc 移动对象时保留 mark word（见 gc.c 中的 preserve_mark），所以 hash 不变。
+ *
+ * 对象头之后是实例变量的值（见 field_addr），包括此Object中定义的和继承来的，按大小紧凑排列（见 class.c 中的 layout_fields）。
+ * 数组对象在对象头之后是数组的长度（见 array_len）和数组的值（见 array_data）。
+ * java.lang.Class 对象对应的 Class * 保存在对象之前（见 create_class_object）。
+ */
 struct object {
-    // 对象头，放在Object类的最开始处
-    union {
-        struct {
-            unsigned int accessible: 1; // gc时判断对象是否可达
-            unsigned int marked: 2;
-        };
-        uintptr_t all_flags; // 以指针的大小对齐 todo 这样对齐有什么用
-    };
-
+    uintptr_t mark;
     Class *clazz;
-    pthread_mutex_t mutex;
+};
 
- //   union {
-        Class *jvm_mirror; // present only if Object of java.lang.Class
+#define MARK_REMEMBERED  ((uintptr_t) 1) // 已在 remembered set 中
+#define MARK_PINNED      ((uintptr_t) 2) // gc 不能移动此对象
+#define MARK_GC_BITS     (MARK_REMEMBERED | MARK_PINNED)
 
-        jsize arr_len; // present only if Object of Array
+#define MARK_LOCK_MASK   ((uintptr_t) 0xc)
+#define MARK_UNLOCKED    ((uintptr_t) 0x0)
+#define MARK_THIN        ((uintptr_t) 0x4)
+#define MARK_INFLATED    ((uintptr_t) 0x8)
+#define MARK_FORWARDED   ((uintptr_t) 0xc)
 
-        // present only if object of java/lang/ClassLoader
-        // save the all loaded classes by this ClassLoader
-        struct point_hash_map *classes;
-        // std::unordered_map<const utf8_t *, Class *, Utf8Hash, Utf8Comparator> *classes = NULL;
- //   }
+#define MARK_PTR_MASK    ((((uintptr_t) 1 << 48) - 1) & ~(uintptr_t) 0xf)
+#define MARK_RECURSION_SHIFT 48
 
-    // 保存所有实例变量的值
-    // 包括此Object中定义的和继承来的。
-    // 特殊的，对于数组对象，保存数组的值
-    slot_t *data;
-};
+#define MARK_HASH_SHIFT  16
+#define MARK_HASH_MASK   ((uintptr_t) 0x7fffffff << MARK_HASH_SHIFT)
 
-#define lock_object(o) pthread_mutex_lock(&(o->mutex))
-#define unlock_object(o) pthread_mutex_unlock(&(o->mutex))
+#define is_remembered(o) (((o)->mark & MARK_REMEMBERED) != 0)
+#define is_pinned(o)     (((o)->mark & MARK_PINNED) != 0)
+
+// 数组的长度，按8字节占用空间，保证数组元素按8字节对齐
+#define ARRAY_LENGTH_SIZE 8
+#define array_len(a) (*(jsize *) ((Object *) (a) + 1))
+
+// java.lang.Class 对象 @co 所表示的类
+#define jvm_mirror(co) (((Class **) (co))[-1])
+
+// 对象 @o 中实例变量 @f 的地址
+#define field_addr(o, f) ((void *) ((u1 *) (o) + (f)->id))
+
+// 数组 @a 的元素
+#define array_data(a) ((void *) ((u1 *) ((Object *) (a) + 1) + ARRAY_LENGTH_SIZE))
+
+/*
+ * Compressed oops
+ *
+ * 对象中保存的引用（引用类型的实例变量和引用数组的元素）类型为 heapref_t，只能通过 load_ref/store_ref 访问。
+ * 定义了 COMPRESSED_OOPS 时（见 cabin.h）压缩为32位：对象相对 g_narrow_oop_base 的偏移右移 HEAP_ALIGNMENT_SHIFT 位，
+ * 0 表示 NULL。所有对象都在堆保留的地址空间中（见 heap.h），所以都可以被压缩。
+ * 对象之外的引用（操作数栈，局部变量表，静态变量，JNI 引用等）不压缩。
+ */
+#ifdef COMPRESSED_OOPS
+typedef uint32_t heapref_t;
+
+static inline jref decode_ref(heapref_t n)
+{
+    return n == 0 ? NULL : (jref) (g_narrow_oop_base + ((address) n << HEAP_ALIGNMENT_SHIFT));
+}
+
+static inline heapref_t encode_ref(jref o)
+{
+    assert(o == NULL || ((address) o - g_narrow_oop_base) >> HEAP_ALIGNMENT_SHIFT <= UINT32_MAX);
+    return o == NULL ? 0 : (heapref_t) (((address) o - g_narrow_oop_base) >> HEAP_ALIGNMENT_SHIFT);
+}
+#else
+typedef jref heapref_t;
+#define decode_ref(n) (n)
+#define encode_ref(o) (o)
+#endif
+
+// @p: heapref_t 的地址
+#define load_ref(p) decode_ref(*(heapref_t *) (p))
+#define store_ref(p, o) (*(heapref_t *) (p) = encode_ref(o))
+
+/*
+ * Write barrier.
+ * 在对象 @o 中写入引用 @v 之后调用，记录老年代对象到新生代对象的引用。
+ * 类的静态属性，以及堆外的对象（类对象，栈上的对象）在 minor gc 时作为根被扫描，不需要 write barrier.
+ */
+static inline void write_barrier(Object *o, jref v)
+{
+    if (v != NULL && is_in_young(g_heap, (address) v)
+                && (is_in_old(g_heap, (address) o) || is_in_los(g_heap, (address) o)) && !is_remembered(o)) {
+        remember_object(o);
+    }
+}
+
+/*
+ * Pre-write barrier (SATB).
+ * 并发标记期间，在对象中的引用槽 @slot 被覆盖之前调用，记录其中的旧值（见 gc.h）。
+ * 新生代中的对象不需要记录，它们在 initial mark 时已被扫描，或者是标记开始后才分配的。
+ */
+static inline void satb_record(jref old)
+{
+    if (old != NULL && (is_in_old(g_heap, (address) old) || is_in_los(g_heap, (address) old)))
+        satb_enqueue(old);
+}
+
+static inline void pre_write_barrier(heapref_t *slot)
+{
+    if (g_concurrent_marking)
+        satb_record(load_ref(slot));
+}
+
+// 静态变量 @slot 被覆盖之前调用
+static inline void pre_write_barrier_static(jref *slot)
+{
+    if (g_concurrent_marking)
+        satb_record(*slot);
+}
 
 // alloc non array object
 Object *alloc_object(Class *); 
 
-// create local(non Heap) non array object
-Object *create_local_object(Class *);
+// 创建类 @c 的 java.lang.Class 对象，在永久区（见 heap.h）中分配，此对象无需 gc.
+Object *create_class_object(Class *c);
 
 // 一维数组
 Object *alloc_array(Class *, jint arr_len);
@@ -66,15 +161,21 @@ jsize stringGetUTFLength(jstrRef so);
 
 /* Set field value */
 
-#define set_byte_field0(obj, field, v) slot_set_byte((obj)->data + (field)->id, v)
-#define set_bool_field0(obj, field, v) slot_set_bool((obj)->data + (field)->id, v)
-#define set_char_field0(obj, field, v) slot_set_char((obj)->data + (field)->id, v)
-#define set_short_field0(obj, field, v) slot_set_short((obj)->data + (field)->id, v)
-#define set_int_field0(obj, field, v) slot_set_int((obj)->data + (field)->id, v)
-#define set_long_field0(obj, field, v) slot_set_long((obj)->data + (field)->id, v)
-#define set_float_field0(obj, field, v) slot_set_float((obj)->data + (field)->id, v)
-#define set_double_field0(obj, field, v) slot_set_double((obj)->data + (field)->id, v)
-#define set_ref_field0(obj, field, v) slot_set_ref((obj)->data + (field)->id, v)
+#define set_byte_field0(obj, field, v) (*(jbyte *) field_addr(obj, field) = (v))
+#define set_bool_field0(obj, field, v) (*(jbool *) field_addr(obj, field) = (v))
+#define set_char_field0(obj, field, v) (*(jchar *) field_addr(obj, field) = (v))
+#define set_short_field0(obj, field, v) (*(jshort *) field_addr(obj, field) = (v))
+#define set_int_field0(obj, field, v) (*(jint *) field_addr(obj, field) = (v))
+#define set_long_field0(obj, field, v) (*(jlong *) field_addr(obj, field) = (v))
+#define set_float_field0(obj, field, v) (*(jfloat *) field_addr(obj, field) = (v))
+#define set_double_field0(obj, field, v) (*(jdouble *) field_addr(obj, field) = (v))
+#define set_ref_field0(obj, field, v) \
+do { \
+    jref __v = (v); \
+    pre_write_barrier((heapref_t *) field_addr(obj, field)); \
+    store_ref(field_addr(obj, field), __v); \
+    write_barrier(obj, __v); \
+} while(false)
 
 #define set_byte_field(obj, name, v) set_byte_field0(obj, lookup_inst_field0((obj)->clazz, name, S(B)), v)
 #define set_bool_field(obj, name, v) set_bool_field0(obj, lookup_inst_field0((obj)->clazz, name, S(Z)), v)
@@ -82,20 +183,24 @@ jsize stringGetUTFLength(jstrRef so);
 #define set_long_field(obj, name, v) set_long_field0(obj, lookup_inst_field0((obj)->clazz, name, S(J)), v)
 #define set_ref_field(obj, name, descriptor, v) set_ref_field0(obj, lookup_inst_field0((obj)->clazz, name, descriptor), v)
 
+// @value 按 slot 保存（与操作数栈相同，类型二占两个 slot）
 void set_field_value0(Object *o, Field *f, const slot_t *value);
 void set_field_value1(Object *o, int id, jref value);
 
 /* Get field value */
 
-#define get_byte_field0(obj, field)   slot_get_byte((obj)->data + (field)->id)
-#define get_bool_field0(obj, field)   slot_get_bool((obj)->data + (field)->id)
-#define get_char_field0(obj, field)   slot_get_char((obj)->data + (field)->id)
-#define get_short_field0(obj, field)  slot_get_short((obj)->data + (field)->id)
-#define get_int_field0(obj, field)    slot_get_int((obj)->data + (field)->id)
-#define get_float_field0(obj, field)  slot_get_float((obj)->data + (field)->id)
-#define get_long_field0(obj, field)   slot_get_long((obj)->data + (field)->id)
-#define get_double_field0(obj, field) slot_get_double((obj)->data + (field)->id)
-#define get_ref_field0(obj, field)    slot_get_ref((obj)->data + (field)->id)
+// 读取对象 @o 中实例变量 @f 的值到 @value（格式同 set_field_value0）
+void get_field_value0(const Object *o, const Field *f, slot_t *value);
+
+#define get_byte_field0(obj, field)   (*(jbyte *) field_addr(obj, field))
+#define get_bool_field0(obj, field)   (*(jbool *) field_addr(obj, field))
+#define get_char_field0(obj, field)   (*(jchar *) field_addr(obj, field))
+#define get_short_field0(obj, field)  (*(jshort *) field_addr(obj, field))
+#define get_int_field0(obj, field)    (*(jint *) field_addr(obj, field))
+#define get_float_field0(obj, field)  (*(jfloat *) field_addr(obj, field))
+#define get_long_field0(obj, field)   (*(jlong *) field_addr(obj, field))
+#define get_double_field0(obj, field) (*(jdouble *) field_addr(obj, field))
+#define get_ref_field0(obj, field)    load_ref(field_addr(obj, field))
 
 #define get_byte_field(obj, name)   get_byte_field0(obj, lookup_inst_field0((obj)->clazz, name, S(B)))
 #define get_bool_field(obj, name)   get_bool_field0(obj, lookup_inst_field0((obj)->clazz, name, S(Z)))
@@ -114,7 +219,8 @@ void set_field_value1(Object *o, int id, jref value);
 
 bool is_instance_of(const Object *o, Class *c);
 
-const slot_t *prim_wrapper_obj_unbox(const Object *box);
+// 拆箱，值保存在 @value 中（类型二占两个 slot），返回 @value
+const slot_t *prim_wrapper_obj_unbox(const Object *box, slot_t value[2]);
 
 size_t object_size(const Object *);
 
@@ -144,7 +250,10 @@ void array_set_float(jarrRef a, int i, jfloat value);
 void array_set_double(jarrRef a, int i, jdouble value);
 void array_set_ref(jarrRef a, int i, jref value);
 
+// 基本类型数组
 #define array_get(__jtype, __array, __index) (*(__jtype *) array_index(__array, __index))
+// 引用数组
+#define array_get_ref(__array, __index) load_ref(array_index(__array, __index))
 
 TJE void array_copy(jarrRef dst, jint dst_pos, const jarrRef src, jint src_pos, jint len);
 
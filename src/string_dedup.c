@@ -0,0 +1,193 @@
+#include <assert.h>
+#include <string.h>
+#include "cabin.h"
+#include "string_dedup.h"
+#include "gc.h"
+#include "heap.h"
+#include "object.h"
+#include "thread.h"
+
+bool g_string_dedup = false;
+
+// 每处理这么多个字符串检查一次安全点
+#define DEDUP_STEP 256
+
+// 去重表中的数组数超过桶数的此倍数时扩容
+#define TABLE_LOAD_FACTOR 2
+
+/*
+ * 去重表只被去重线程访问（不在安全点时），以及 gc 在 stop-the-world 中访问，所以不需要加锁。
+ */
+typedef struct dedup_entry {
+    jarrRef value;
+    u4 hash;
+    jbyte coder;
+    struct dedup_entry *next;
+} DedupEntry;
+
+static DedupEntry **table;
+static size_t table_capacity; // 桶数，2的幂
+static size_t table_size;
+
+// 等待去重的字符串（都在老年代中）
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static jref *queue;
+static size_t queue_len;
+static size_t queue_capacity;
+
+// java.lang.String 中 value 和 coder 的偏移
+static int value_offset;
+static int coder_offset;
+
+void string_dedup_enqueue(jref s)
+{
+    assert(s != NULL && s->clazz == g_string_class);
+
+    pthread_mutex_lock(&queue_mutex);
+    if (queue_len == queue_capacity) {
+        queue_capacity = queue_capacity == 0 ? 1024 : queue_capacity*2;
+        queue = vm_realloc(queue, queue_capacity*sizeof(*queue));
+    }
+    queue[queue_len++] = s;
+    if (queue_len == 1)
+        pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+void string_dedup_sweep(jref (* new_address)(jref))
+{
+    for (size_t i = 0; i < table_capacity; i++) {
+        DedupEntry **prev = table + i;
+        while (*prev != NULL) {
+            DedupEntry *e = *prev;
+            e->value = new_address(e->value);
+            if (e->value != NULL) {
+                prev = &e->next; // 按内容散列，地址改变不影响所在的桶
+                continue;
+            }
+            *prev = e->next;
+            free(e);
+            table_size--;
+        }
+    }
+
+    pthread_mutex_lock(&queue_mutex);
+    size_t n = 0;
+    for (size_t i = 0; i < queue_len; i++) {
+        jref s = new_address(queue[i]);
+        if (s != NULL)
+            queue[n++] = s;
+    }
+    queue_len = n;
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+static u4 hash_value(const u1 *data, jsize len, jbyte coder)
+{
+    // FNV-1a
+    u4 h = 2166136261u ^ (u1) coder;
+    for (jsize i = 0; i < len; i++) {
+        h ^= data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void grow_table()
+{
+    size_t capacity = table_capacity == 0 ? 1024 : table_capacity*2;
+    DedupEntry **t = vm_calloc(capacity*sizeof(*t));
+    for (size_t i = 0; i < table_capacity; i++) {
+        DedupEntry *e = table[i];
+        while (e != NULL) {
+            DedupEntry *next = e->next;
+            DedupEntry **bucket = t + (e->hash & (capacity - 1));
+            e->next = *bucket;
+            *bucket = e;
+            e = next;
+        }
+    }
+    free(table);
+    table = t;
+    table_capacity = capacity;
+}
+
+// 返回和 @value 内容相同的数组，没有时将 @value 加入表中并返回 @value
+static jarrRef lookup_or_add(jarrRef value, jbyte coder)
+{
+    const u1 *data = array_data(value);
+    jsize len = array_len(value);
+    u4 hash = hash_value(data, len, coder);
+
+    if (table_size >= table_capacity*TABLE_LOAD_FACTOR)
+        grow_table();
+
+    DedupEntry **bucket = table + (hash & (table_capacity - 1));
+    for (DedupEntry *e = *bucket; e != NULL; e = e->next) {
+        if (e->hash == hash && e->coder == coder && array_len(e->value) == len
+                    && memcmp(array_data(e->value), data, len) == 0)
+            return e->value;
+    }
+
+    DedupEntry *e = vm_malloc(sizeof(*e));
+    e->value = value;
+    e->hash = hash;
+    e->coder = coder;
+    e->next = *bucket;
+    *bucket = e;
+    table_size++;
+    return value;
+}
+
+static void deduplicate(jref s)
+{
+    heapref_t *slot = (heapref_t *) ((u1 *) s + value_offset);
+    jarrRef value = load_ref(slot);
+    // 数组还在新生代中（被固定或被保守扫描到）的不处理，去重表中只有老年代中的数组
+    if (value == NULL || !is_in_old(g_heap, (address) value))
+        return;
+
+    jbyte coder = *(jbyte *) ((u1 *) s + coder_offset);
+    jarrRef canonical = lookup_or_add(value, coder);
+    if (canonical == value)
+        return;
+
+    // 并发标记期间 canonical 可能是标记开始时已不可达（但还未被清除）的数组，要保证它被标记
+    if (g_concurrent_marking)
+        satb_record(canonical);
+    pre_write_barrier(slot);
+    store_ref(slot, canonical); // 两个数组都在老年代中，无需 write barrier
+}
+
+void string_dedup_loop()
+{
+    Thread *self = get_current_thread();
+    assert(self != NULL && g_string_class != NULL);
+
+    value_offset = get_declared_field(g_string_class, S(value))->id;
+    coder_offset = get_declared_field(g_string_class, S(coder))->id;
+
+    for (;;) {
+        // 等待期间处于安全区域
+        enter_safe_region(self);
+        pthread_mutex_lock(&queue_mutex);
+        while (queue_len == 0) {
+            pthread_cond_wait(&queue_cond, &queue_mutex);
+        }
+        pthread_mutex_unlock(&queue_mutex);
+        leave_safe_region(self);
+
+        // 两次安全点之间 gc 不会执行，取出的字符串不会被移动或回收
+        for (int i = 0; i < DEDUP_STEP; i++) {
+            pthread_mutex_lock(&queue_mutex);
+            jref s = queue_len > 0 ? queue[--queue_len] : NULL;
+            pthread_mutex_unlock(&queue_mutex);
+            if (s == NULL)
+                break;
+            deduplicate(s);
+        }
+
+        safepoint_poll(self);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef CABIN_STRING_DEDUP_H
+#define CABIN_STRING_DEDUP_H
+
+#include "cabin.h"
+
+/*
+ * String deduplication（-XX:+UseStringDeduplication）
+ *
+ * minor gc 把晋升到老年代的 java.lang.String 交给去重线程（见 string_dedup_loop），
+ * 去重线程按 value（byte[]）的内容和 coder 在去重表中查找，找到内容相同的数组后，
+ * 把字符串的 value 指向表中的数组，原来的数组随后被 gc 回收；找不到时把自己的数组加入表中。
+ * String.value 是 final 的，数组创建后不再被修改，所以多个字符串可以共享同一个数组。
+ *
+ * 去重表中的数组都在老年代中，表对数组是弱引用，full gc（和并发标记的 remark）清除时
+ * 删除已死亡的数组，压缩时更新移动了的数组（见 string_dedup_sweep）。
+ */
+
+extern bool g_string_dedup;
+
+// 晋升到老年代的字符串 @s，由 minor gc 调用
+void string_dedup_enqueue(jref s);
+
+/*
+ * full gc 或 remark 清除死亡对象之前调用，更新去重表和等待去重的字符串。
+ * @new_address: 对象的新地址，已死亡返回 NULL.
+ */
+void string_dedup_sweep(jref (* new_address)(jref));
+
+// 去重线程的主循环，不返回
+void string_dedup_loop();
+
+#endif // CABIN_STRING_DEDUP_H
@@ -174,6 +174,8 @@ extern const char *symbol_values[];
     action(java_lang_reflect_Constructor, "java/lang/reflect/Constructor"), \
     action(java_lang_reflect_VMConstructor, "java/lang/reflect/VMConstructor"), \
     action(java_lang_ref_PhantomReference, "java/lang/ref/PhantomReference"), \
+    action(java_lang_ref_FinalReference, "java/lang/ref/FinalReference"), \
+    action(java_lang_ref_Finalizer, "java/lang/ref/Finalizer"), \
     action(java_nio_DirectByteBufferImpl_ReadWrite, "java/nio/DirectByteBufferImpl$ReadWrite"), \
     action(java_lang_ClassLoader_NativeLibrary, "java/lang/ClassLoader$NativeLibrary"), \
     \
@@ -253,6 +255,10 @@ extern const char *symbol_values[];
     action(sig_java_security_ProtectionDomain, "Ljava/security/ProtectionDomain;"), \
     action(sig_java_lang_Thread_UncaughtExceptionHandler, "Ljava/lang/Thread$UncaughtExceptionHandler;"), \
     \
+    /* Annotations */\
+    action(sig_jdk_internal_vm_annotation_Contended, "Ljdk/internal/vm/annotation/Contended;"), \
+    action(sig_sun_misc_Contended, "Lsun/misc/Contended;"), \
+    \
     /* Method signatures */\
     action(___V, "()V"), \
     action(___Z, "()Z"), \
@@ -1,11 +1,19 @@
+#ifdef __linux__
+#define _GNU_SOURCE // for pthread_getattr_np
+#endif
+
 #ifdef _WIN32
 #include <windows.h>
 #endif
 
 #ifdef __linux__
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #endif
 
+#include "sysinfo.h"
+
 int processor_number()
 {
 #ifdef _WIN32
@@ -28,7 +36,72 @@ int page_size()
 #endif
 
 #ifdef __linux__
-    JVM_PANIC("pageSize");
+    return (int) sysconf(_SC_PAGESIZE);
+#endif
+}
+
+void *os_reserve_memory(size_t size)
+{
+#ifdef _WIN32
+    return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#endif
+
+#ifdef __linux__
+    void *p = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+#endif
+}
+
+bool os_commit_memory(void *p, size_t size)
+{
+#ifdef _WIN32
+    return VirtualAlloc(p, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#endif
+
+#ifdef __linux__
+    return mprotect(p, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+void os_uncommit_memory(void *p, size_t size)
+{
+#ifdef _WIN32
+    VirtualFree(p, size, MEM_DECOMMIT);
+#endif
+
+#ifdef __linux__
+    madvise(p, size, MADV_DONTNEED);
+    mprotect(p, size, PROT_NONE);
+#endif
+}
+
+void os_release_memory(void *p, size_t size)
+{
+#ifdef _WIN32
+    VirtualFree(p, 0, MEM_RELEASE);
+#endif
+
+#ifdef __linux__
+    munmap(p, size);
+#endif
+}
+
+void *get_current_stack_base()
+{
+#ifdef _WIN32
+    NT_TIB *tib = (NT_TIB *) NtCurrentTeb();
+    return tib->StackBase;
+#endif
+
+#ifdef __linux__
+    pthread_attr_t attr;
+    void *addr;
+    size_t size;
+
+    pthread_getattr_np(pthread_self(), &attr);
+    pthread_attr_getstack(&attr, &addr, &size);
+    pthread_attr_destroy(&attr);
+    return (char *) addr + size;
 #endif
 }
 
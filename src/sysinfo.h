@@ -1,9 +1,25 @@
 #ifndef CABIN_SYSINFO_H
 #define CABIN_SYSINFO_H
 
+#include <stddef.h>
+#include <stdbool.h>
+
 int processor_number();
 int page_size();
 
+/*
+ * 虚拟内存
+ * 先保留一段地址空间（不占用物理内存），再按需提交（commit）其中的一部分。
+ * 新提交的内存已清零。
+ */
+void *os_reserve_memory(size_t size); // 失败返回 NULL
+bool os_commit_memory(void *p, size_t size);
+void os_uncommit_memory(void *p, size_t size); // 物理内存还给操作系统，地址空间仍然保留
+void os_release_memory(void *p, size_t size);
+
+// 返回当前线程本地栈的栈底（栈向低地址增长，所以是最高地址）。
+void *get_current_stack_base();
+
 // 返回操作系统的名称。e.g. window 10
 const char *os_name();
 
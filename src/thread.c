@@ -3,6 +3,7 @@
 #include "slot.h"
 #include "thread.h"
 #include "object.h"
+#include "sysinfo.h"
 
 static pthread_key_t key;
 
@@ -55,35 +56,43 @@ Thread *init_main_thread()
     return g_main_thread;
 }
 
+struct vm_thread_info {
+    void *(*start)(void *);
+    const utf8_t *thread_name;
+};
+
+static void *vm_thread_start(void *arg)
+{
+    struct vm_thread_info *info = arg;
+    void *(*start)(void *) = info->start;
+    const utf8_t *thread_name = info->thread_name;
+    free(info);
+
+    Thread *t = create_thread(NULL, THREAD_NORM_PRIORITY);
+    set_thread_group_and_name(t, g_sys_thread_group, thread_name);
+    return start(NULL);
+}
+
 void create_vm_thread(void *(*start)(void *), const utf8_t *thread_name)
 {
     assert(start != NULL && thread_name != NULL); // vm thread must have a name
 
-//    static auto start = [](void *args) {
-//        auto a = (VMThreadInitInfo *) args;
-//        auto newThread = new Thread();
-//        newThread->setThreadGroupAndName(sysThreadGroup, a->threadName);
-//        return a->start(NULL);
-//    };
-//
-//    pthread_t tid;
-//    int ret = pthread_create(&tid, NULL, start, (void *) info);
-//    if (ret != 0) {
-//        thread_throw(new InternalError("create Thread failed"));
-//    }
-
-//    static auto __start = [](void *(*start)(void *), const utf8_t *thread_name) {
-//        auto new_thread = new Thread();
-//        new_thread->setThreadGroupAndName(sysThreadGroup, thread_name);
-//        return start(NULL);
-//    };
-//
-//    std::thread t(__start, start, thread_name);
-//    t.detach();
+    struct vm_thread_info *info = vm_malloc(sizeof(*info));
+    info->start = start;
+    info->thread_name = thread_name;
+
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, vm_thread_start, info) != 0) {
+        JVM_PANIC("create vm thread failed: %s", thread_name);
+    }
+    pthread_detach(tid);
 }
 
 static pthread_mutex_t new_thread_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// 各线程 hash_state 的种子，由 new_thread_mutex 保护
+static u4 hash_seed = 0x2545f491;
+
 Thread *create_thread(Object *_tobj, jint priority)
 {
     assert(THREAD_MIN_PRIORITY <= priority && priority <= THREAD_MAX_PRIORITY);
@@ -94,10 +103,18 @@ Thread *create_thread(Object *_tobj, jint priority)
     pthread_mutex_lock(&new_thread_mutex);
 
     saveCurrentThread(t);
+    t->native_stack_base = get_current_stack_base();
     add_thread(t);
 
     t->tid = pthread_self();
 
+    // Marsaglia xor-shift 的初始状态，只有第一个分量因线程而异
+    hash_seed = hash_seed * 1103515245 + 12345;
+    t->hash_state[0] = hash_seed;
+    t->hash_state[1] = 842502087;
+    t->hash_state[2] = 0x8767;
+    t->hash_state[3] = 273326509;
+
     if (t->tobj == NULL)
         t->tobj = alloc_object(thread_class);
 
@@ -113,7 +130,7 @@ Thread *create_thread(Object *_tobj, jint priority)
 Thread *thread_from_tobj(Object *tobj)
 {
     assert(tobj != NULL);
-    assert(0 <= eetop_field->id && eetop_field->id < tobj->clazz->inst_fields_count);
+    assert(sizeof(Object) <= eetop_field->id && eetop_field->id < tobj->clazz->inst_size);
     jlong eetop = get_long_field0(tobj, eetop_field);
     return (Thread *)eetop;
 }
@@ -160,6 +177,127 @@ bool is_thread_alive(Thread *thrd)
     return false;
 }
 
+/* Safepoint */
+
+volatile bool g_safepoint_requested = false;
+
+static pthread_mutex_t safepoint_mutex = PTHREAD_MUTEX_INITIALIZER;
+// 线程进入安全点（或安全区域）时通知 gc
+static pthread_cond_t arrived_cond = PTHREAD_COND_INITIALIZER;
+// gc 结束时唤醒在安全点上等待的线程
+static pthread_cond_t resume_cond = PTHREAD_COND_INITIALIZER;
+
+// 返回一个比调用者的栈帧更低的地址，作为当前本地栈的栈顶。
+static __attribute__((noinline)) void *current_stack_top()
+{
+    return __builtin_frame_address(0);
+}
+
+void safepoint(Thread *thrd)
+{
+    assert(thrd != NULL);
+
+    // 将 callee-saved 寄存器压栈，gc 才能扫描到其中的引用
+    __builtin_unwind_init();
+    thrd->native_stack_top = current_stack_top();
+
+    pthread_mutex_lock(&safepoint_mutex);
+    thrd->in_safe_region = true;
+    pthread_cond_broadcast(&arrived_cond);
+    while (g_safepoint_requested) {
+        pthread_cond_wait(&resume_cond, &safepoint_mutex);
+    }
+    thrd->in_safe_region = false;
+    pthread_mutex_unlock(&safepoint_mutex);
+}
+
+void enter_safe_region0(Thread *thrd)
+{
+    assert(thrd != NULL);
+    thrd->native_stack_top = current_stack_top();
+
+    pthread_mutex_lock(&safepoint_mutex);
+    thrd->in_safe_region = true;
+    pthread_cond_broadcast(&arrived_cond);
+    pthread_mutex_unlock(&safepoint_mutex);
+}
+
+void leave_safe_region(Thread *thrd)
+{
+    assert(thrd != NULL);
+
+    pthread_mutex_lock(&safepoint_mutex);
+    while (g_safepoint_requested) {
+        pthread_cond_wait(&resume_cond, &safepoint_mutex);
+    }
+    thrd->in_safe_region = false;
+    pthread_mutex_unlock(&safepoint_mutex);
+}
+
+void stop_the_world(Thread *self)
+{
+    pthread_mutex_lock(&safepoint_mutex);
+    g_safepoint_requested = true;
+
+    for (;;) {
+        bool all_arrived = true;
+        for (int i = 0; i < g_all_threads_count; i++) {
+            Thread *t = g_all_threads[i];
+            if (t != self && !t->in_safe_region) {
+                all_arrived = false;
+                break;
+            }
+        }
+        if (all_arrived)
+            break;
+        pthread_cond_wait(&arrived_cond, &safepoint_mutex);
+    }
+
+    pthread_mutex_unlock(&safepoint_mutex);
+}
+
+void start_the_world(Thread *self)
+{
+    pthread_mutex_lock(&safepoint_mutex);
+    g_safepoint_requested = false;
+    pthread_cond_broadcast(&resume_cond);
+    pthread_mutex_unlock(&safepoint_mutex);
+}
+
+void safe_mutex_lock(pthread_mutex_t *mutex)
+{
+    assert(mutex != NULL);
+    if (pthread_mutex_trylock(mutex) == 0)
+        return;
+
+    Thread *thrd = get_current_thread();
+    if (thrd == NULL) {
+        pthread_mutex_lock(mutex);
+        return;
+    }
+
+    enter_safe_region(thrd);
+    pthread_mutex_lock(mutex);
+    leave_safe_region(thrd);
+}
+
+void detach_thread(Thread *thrd)
+{
+    assert(thrd != NULL);
+
+    tlab_retire(g_heap, &thrd->tlab);
+
+    pthread_mutex_lock(&safepoint_mutex);
+    thrd->top_frame = NULL;
+    thrd->native_stack_base = NULL;
+    thrd->native_stack_top = NULL;
+    thrd->detached = true;
+    // 永远处于安全区域
+    thrd->in_safe_region = true;
+    pthread_cond_broadcast(&arrived_cond);
+    pthread_mutex_unlock(&safepoint_mutex);
+}
+
 Frame *alloc_frame(Thread *thrd, Method *m, bool vm_invoke)
 {
     assert(thrd != NULL && m != NULL);
@@ -290,6 +428,8 @@ void init_frame(Frame *f, Method *m, bool vm_invoke, slot_t *lvars, slot_t *osta
     f->lvars = lvars;
     f->ostack = ostack;
     f->prev = prev;
+    f->sync_obj = NULL;
+    f->local_objs = f->local_objs_end = NULL;
 
     bcr_init(&f->reader, m->code, m->code_len);
 }
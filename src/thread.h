@@ -4,6 +4,7 @@
 #include "cabin.h"
 #include "slot.h"
 #include "bytecode_reader.h"
+#include "heap.h"
 
 /*
  * jvm中所定义的线程
@@ -78,9 +79,28 @@ typedef struct vm_thread {
     Object *tobj;  // 所关联的 Object of java.lang.Thread
     pthread_t tid; // 所关联的 local thread 对应的id
 
-    jbool interrupted;
-    
+    // 正在 Object.wait 的 Monitor（见 object_wait），中断状态保存在 tobj 中
+    struct monitor *wait_monitor;
+
     jref exception;
+
+    /*
+     * gc 相关。
+     * 线程在安全点（或安全区域）中时，gc 保守扫描 [native_stack_top, native_stack_base) 之间的本地栈。
+     */
+    void *native_stack_base; // 本地线程栈的栈底（高地址）
+    void *native_stack_top;  // 进入安全点时记录的栈顶（低地址）
+    volatile bool in_safe_region;
+    bool detached; // 线程已执行完毕，不再访问堆
+
+    // 并发标记期间记录被覆盖的引用（见 gc.h）
+    jref *satb_buf;
+    int satb_len;
+
+    // 生成 identity hash 的 xor-shift 随机数状态（见 object_identity_hash）
+    u4 hash_state[4];
+
+    TLAB tlab;
 } Thread;
 
 Thread *create_thread(Object *_tobj, jint priority);
@@ -89,6 +109,7 @@ extern Thread *g_main_thread;
 
 Thread *init_main_thread();
 
+// 创建一个虚拟机内部的线程（比如 gc 线程），属于 system thread group
 void create_vm_thread(void *(*start)(void *), const utf8_t *thread_name);
 
 Thread *get_current_thread();
@@ -103,6 +124,51 @@ jint get_thread_status(Thread *);
 
 bool is_thread_alive(Thread *);
 
+// 线程执行完毕，不再参与 gc 的 stop-the-world。
+void detach_thread(Thread *);
+
+/*
+ * Safepoint
+ *
+ * gc 需要 stop-the-world 时设置 g_safepoint_requested，
+ * Java 线程在方法调用、向后跳转以及分配内存时检查此标志，并在安全点上等待 gc 结束。
+ */
+extern volatile bool g_safepoint_requested;
+
+void safepoint(Thread *);
+
+#define safepoint_poll(_thread) \
+do { \
+    if (g_safepoint_requested) \
+        safepoint(_thread); \
+} while(false)
+
+/*
+ * 进入安全区域后，线程不再访问堆，gc 无需等待此线程到达安全点。
+ * 离开安全区域时如果 gc 正在进行，等待 gc 结束。
+ *
+ * 调用 enter_safe_region 的函数在安全区域中不能持有引用，
+ * 其调用者们保存在 callee-saved 寄存器中的引用由 __builtin_unwind_init 压入栈中。
+ */
+#define enter_safe_region(_thread) \
+do { \
+    __builtin_unwind_init(); \
+    enter_safe_region0(_thread); \
+} while(false)
+
+void enter_safe_region0(Thread *);
+void leave_safe_region(Thread *);
+
+/*
+ * 获取一个持有者可能在安全点上等待的锁（持有期间会分配内存或执行 Java 代码的锁），
+ * 阻塞期间处于安全区域，避免和 gc 互相等待。
+ */
+void safe_mutex_lock(pthread_mutex_t *);
+
+// 等待除 @self 外的所有线程都进入安全点（或安全区域）。
+void stop_the_world(Thread *self);
+void start_the_world(Thread *self);
+
 struct frame *alloc_frame(Thread *, Method *, bool vm_invoke);
 #define pop_frame(_thrd) (_thrd)->top_frame = (_thrd)->top_frame->prev
 
@@ -140,6 +206,12 @@ struct frame {
 
     slot_t *lvars;   // local variables
     slot_t *ostack;  // operand stack
+
+    jref sync_obj; // synchronized 方法持有的锁，方法退出（包括因异常退出）时释放
+
+    // 栈上分配的对象（见 escape.h），位于操作数栈之后，还没有时为 NULL
+    u1 *local_objs;
+    u1 *local_objs_end;
 };
 
 void init_frame(Frame *_this, Method *m, bool vm_invoke, slot_t *lvars, slot_t *ostack, Frame *prev);
@@ -160,7 +232,9 @@ static inline jdouble ostack_popd(Frame *f) { f->ostack -= 2; return slot_get_do
 static inline jref    ostack_popr(Frame *f) { f->ostack--;    return slot_get_ref(f->ostack); }
 
 // the end address of this frame
-#define get_frame_end_address(_frame) ((intptr_t)((_frame)->ostack + (_frame)->method->max_stack))
+#define get_frame_end_address(_frame) \
+    ((_frame)->local_objs != NULL ? (intptr_t) (_frame)->local_objs_end \
+                                  : (intptr_t)((_frame)->ostack + (_frame)->method->max_stack))
 
 #define clear_frame_stack(_frame) (_frame)->ostack = (slot_t *)((_frame) + 1)
 
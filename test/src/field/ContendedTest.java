@@ -0,0 +1,82 @@
+package field;
+
+import java.lang.reflect.Field;
+
+import jdk.internal.vm.annotation.Contended;
+import sun.misc.Unsafe;
+
+/**
+ * @Contended 实例变量按 contention group 分组，每组前后各填充一个缓存行（64 字节），
+ * 与其他实例变量和其他组隔开；子类的实例变量不能放在父类的填充中。
+ *
+ * 编译时需要 --add-exports java.base/jdk.internal.vm.annotation=ALL-UNNAMED
+ */
+public class ContendedTest {
+    private static final int CACHE_LINE_SIZE = 64;
+
+    static class Counters {
+        long a;
+        @Contended long b;
+        @Contended long c;
+        int d;
+        @Contended("g") int e;
+        @Contended("g") int f;
+    }
+
+    @Contended
+    static class Padded {
+        long x;
+        long y;
+    }
+
+    static class PaddedSub extends Padded {
+        long z;
+    }
+
+    private static Unsafe unsafe;
+
+    private static long offset(Class<?> c, String name) throws Exception {
+        return unsafe.objectFieldOffset(c.getDeclaredField(name));
+    }
+
+    private static boolean apart(long x, long y) {
+        return Math.abs(x - y) >= CACHE_LINE_SIZE;
+    }
+
+    public static void main(String[] args) throws Exception {
+        Field f = Unsafe.class.getDeclaredField("theUnsafe");
+        f.setAccessible(true);
+        unsafe = (Unsafe) f.get(null);
+
+        long a = offset(Counters.class, "a");
+        long b = offset(Counters.class, "b");
+        long c = offset(Counters.class, "c");
+        long d = offset(Counters.class, "d");
+        long e = offset(Counters.class, "e");
+        long g = offset(Counters.class, "f");
+        // 没有指定 group 的 @Contended 实例变量各自一组
+        System.out.println(apart(b, a) && apart(b, d) && apart(b, c) ? "Pass" : "Fail");
+        System.out.println(apart(c, a) && apart(c, d) ? "Pass" : "Fail");
+        // 同组的相邻，与其他组隔开
+        System.out.println(Math.abs(e - g) == 4 ? "Pass" : "Fail");
+        System.out.println(apart(e, a) && apart(e, b) && apart(e, c) && apart(e, d) ? "Pass" : "Fail");
+
+        // 类被 @Contended 注解时所有实例变量为一组，子类的实例变量在填充之后
+        long x = offset(Padded.class, "x");
+        long y = offset(Padded.class, "y");
+        long z = offset(PaddedSub.class, "z");
+        System.out.println(Math.abs(x - y) == 8 && x >= CACHE_LINE_SIZE ? "Pass" : "Fail");
+        System.out.println(z >= Math.max(x, y) + 8 + CACHE_LINE_SIZE ? "Pass" : "Fail");
+
+        // 填充不影响读写
+        Counters counters = new Counters();
+        counters.a = 1;
+        counters.b = 2;
+        counters.c = 3;
+        counters.d = 4;
+        counters.e = 5;
+        counters.f = 6;
+        System.out.println(counters.a + counters.b + counters.c + counters.d + counters.e + counters.f == 21
+                ? "Pass" : "Fail");
+    }
+}
@@ -0,0 +1,74 @@
+package field;
+
+import java.lang.reflect.Field;
+
+/**
+ * 紧凑的字段布局：不同大小的字段（包括父类中的）填充彼此的空隙，
+ * 写一个字段不能影响相邻的字段。
+ */
+public class PackedFieldsTest {
+
+    static class Base {
+        byte b1;
+        long l1;
+        boolean z1;
+    }
+
+    static class Mixed extends Base {
+        short s1;
+        byte b2;
+        int i1;
+        char c1;
+        double d1;
+        Object o1;
+        boolean z2;
+        float f1;
+        byte b3;
+    }
+
+    public static void main(String[] args) throws Exception {
+        Mixed m = new Mixed();
+        System.out.println(m.b1 == 0 && m.l1 == 0 && !m.z1 && m.s1 == 0 && m.b2 == 0 && m.i1 == 0 && m.c1 == 0
+                && m.d1 == 0 && m.o1 == null && !m.z2 && m.f1 == 0 && m.b3 == 0 ? "Pass" : "Fail");
+
+        // 全1的值，覆盖到相邻字段时容易发现
+        m.b1 = -1;
+        m.l1 = -1L;
+        m.z1 = true;
+        m.s1 = -1;
+        m.b2 = -1;
+        m.i1 = -1;
+        m.c1 = '\uffff';
+        m.d1 = -1.5;
+        m.o1 = m;
+        m.z2 = true;
+        m.f1 = -2.5f;
+        m.b3 = -1;
+        System.out.println(allSet(m) ? "Pass" : "Fail");
+
+        // 逐个改写，其他字段不变
+        m.b2 = 0x12;
+        System.out.println(m.s1 == -1 && m.i1 == -1 && m.b1 == -1 && m.b3 == -1 ? "Pass" : "Fail");
+        m.b2 = -1;
+        m.s1 = 0x1234;
+        System.out.println(m.b2 == -1 && m.c1 == '\uffff' && m.i1 == -1 ? "Pass" : "Fail");
+        m.s1 = -1;
+        m.z1 = false;
+        System.out.println(m.b1 == -1 && m.z2 ? "Pass" : "Fail");
+        m.z1 = true;
+        System.out.println(allSet(m) ? "Pass" : "Fail");
+
+        // 反射访问同样的字段
+        Field f = Mixed.class.getDeclaredField("c1");
+        System.out.println(f.getChar(m) == '\uffff' ? "Pass" : "Fail");
+        f.setChar(m, 'x');
+        System.out.println(m.c1 == 'x' && m.s1 == -1 && m.b2 == -1 ? "Pass" : "Fail");
+        f = Base.class.getDeclaredField("l1");
+        System.out.println(f.getLong(m) == -1L ? "Pass" : "Fail");
+    }
+
+    private static boolean allSet(Mixed m) {
+        return m.b1 == -1 && m.l1 == -1L && m.z1 && m.s1 == -1 && m.b2 == -1 && m.i1 == -1
+                && m.c1 == '\uffff' && m.d1 == -1.5 && m.o1 == m && m.z2 && m.f1 == -2.5f && m.b3 == -1;
+    }
+}
@@ -0,0 +1,124 @@
+package gc;
+
+import java.lang.reflect.Field;
+import java.util.concurrent.atomic.AtomicReference;
+import java.util.concurrent.atomic.AtomicReferenceArray;
+
+import sun.misc.Unsafe;
+
+/**
+ * 压缩的引用：字段和引用数组中的引用在 gc 移动对象后仍然正确，
+ * CAS（compareAndSetReference）和 arraycopy 正确地读写压缩的引用。
+ */
+public class CompressedRefsTest {
+
+    static class Node {
+        final int value;
+        Node next;
+        Object[] payload;
+
+        Node(int value, Node next) {
+            this.value = value;
+            this.next = next;
+            this.payload = new Object[] { "v" + value, this };
+        }
+    }
+
+    public static void main(String[] args) throws Exception {
+        Node head = null;
+        for (int i = 0; i < 10000; i++) {
+            head = new Node(i, head);
+            // 垃圾，促使 minor gc 移动存活的节点
+            byte[] garbage = new byte[256];
+            garbage[0] = (byte) i;
+        }
+        System.gc();
+        System.out.println(verify(head, 10000) ? "Pass" : "Fail");
+
+        testCas();
+        testArrayCopy();
+        testUnsafe();
+        System.gc();
+        System.out.println(verify(head, 10000) ? "Pass" : "Fail");
+    }
+
+    private static boolean verify(Node head, int count) {
+        int expected = count - 1;
+        for (Node n = head; n != null; n = n.next, expected--) {
+            if (n.value != expected || !n.payload[0].equals("v" + expected) || n.payload[1] != n) {
+                return false;
+            }
+        }
+        return expected == -1;
+    }
+
+    private static void testCas() {
+        String a = new String("a");
+        String b = new String("b");
+        AtomicReference<String> ref = new AtomicReference<>(a);
+        System.out.println(!ref.compareAndSet(new String("a"), b) ? "Pass" : "Fail");
+        System.out.println(ref.compareAndSet(a, b) && ref.get() == b ? "Pass" : "Fail");
+        System.out.println(ref.compareAndSet(b, null) && ref.get() == null ? "Pass" : "Fail");
+        System.out.println(ref.compareAndSet(null, a) && ref.get() == a ? "Pass" : "Fail");
+
+        AtomicReferenceArray<Object> arr = new AtomicReferenceArray<>(8);
+        boolean set = true;
+        for (int i = 0; i < 8; i++) {
+            set &= arr.compareAndSet(i, null, Integer.valueOf(i));
+        }
+        System.gc();
+        boolean kept = true;
+        for (int i = 0; i < 8; i++) {
+            kept &= arr.get(i).equals(i);
+        }
+        System.out.println(set && kept ? "Pass" : "Fail");
+    }
+
+    private static void testArrayCopy() {
+        Object[] src = new Object[100];
+        for (int i = 0; i < src.length; i++) {
+            src[i] = "s" + i;
+        }
+        String[] dst = new String[100];
+        System.arraycopy(src, 0, dst, 0, src.length);
+        boolean pass = true;
+        for (int i = 0; i < dst.length; i++) {
+            pass &= dst[i] == src[i];
+        }
+        System.out.println(pass ? "Pass" : "Fail");
+
+        // 同一个数组中重叠的复制
+        System.arraycopy(src, 0, src, 1, src.length - 1);
+        pass = src[0] == src[1];
+        for (int i = 1; i < src.length; i++) {
+            pass &= src[i].equals("s" + (i - 1));
+        }
+        System.out.println(pass ? "Pass" : "Fail");
+    }
+
+    // Unsafe.getObject/putObject（getReference/putReference）读写引用数组中的元素
+    private static void testUnsafe() throws Exception {
+        Field f = Unsafe.class.getDeclaredField("theUnsafe");
+        f.setAccessible(true);
+        Unsafe unsafe = (Unsafe) f.get(null);
+
+        Object[] arr = new Object[8];
+        for (int i = 0; i < arr.length; i++) {
+            arr[i] = "e" + i;
+        }
+        boolean pass = true;
+        for (int i = 0; i < arr.length; i++) {
+            long offset = Unsafe.ARRAY_OBJECT_BASE_OFFSET + (long) i * Unsafe.ARRAY_OBJECT_INDEX_SCALE;
+            pass &= unsafe.getObject(arr, offset) == arr[i];
+        }
+        System.out.println(pass ? "Pass" : "Fail");
+
+        Object x = new Object();
+        long offset = Unsafe.ARRAY_OBJECT_BASE_OFFSET + 3L * Unsafe.ARRAY_OBJECT_INDEX_SCALE;
+        unsafe.putObject(arr, offset, x);
+        System.gc();
+        // 只改变了一个元素，相邻的元素不变
+        System.out.println(arr[3] == x && unsafe.getObject(arr, offset) == x
+                && arr[2].equals("e2") && arr[4].equals("e4") ? "Pass" : "Fail");
+    }
+}
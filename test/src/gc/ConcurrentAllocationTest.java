@@ -0,0 +1,43 @@
+package gc;
+
+/**
+ * 多个线程同时分配（各自使用 TLAB），期间触发 gc，每个线程保留的对象都完整。
+ */
+public class ConcurrentAllocationTest {
+    private static final int THREADS = 4;
+    private static final int LIVE_COUNT = 1000;
+
+    private static final boolean[] pass = new boolean[THREADS];
+
+    private static void allocate(int id) {
+        int[][] live = new int[LIVE_COUNT][];
+        for (int i = 0; i < 200000; i++) {
+            int[] a = new int[i % 13 + 2];
+            a[0] = id;
+            a[a.length - 1] = i;
+            live[i % LIVE_COUNT] = a;
+        }
+
+        boolean b = true;
+        for (int i = 0; i < LIVE_COUNT; i++) {
+            int[] a = live[i];
+            b &= a[0] == id && a[a.length - 1] % LIVE_COUNT == i;
+        }
+        pass[id] = b;
+    }
+
+    public static void main(String[] args) throws InterruptedException {
+        Thread[] threads = new Thread[THREADS];
+        for (int i = 0; i < THREADS; i++) {
+            final int id = i;
+            threads[i] = new Thread(() -> allocate(id));
+            threads[i].start();
+        }
+        for (Thread t : threads) {
+            t.join();
+        }
+        for (boolean b : pass) {
+            System.out.println(b ? "Pass" : "Fail");
+        }
+    }
+}
@@ -0,0 +1,42 @@
+package gc;
+
+import java.lang.ref.WeakReference;
+
+/**
+ * Epsilon 模式只分配不回收：System.gc() 不回收任何对象，
+ * 堆用完后虚拟机以 OutOfMemoryError 终止，最后输出
+ * "Terminating due to java.lang.OutOfMemoryError: Java heap space ..."
+ *
+ * 运行时需要 -XX:+UseEpsilonGC -Xmx64m
+ */
+public class EpsilonTest {
+
+    public static void main(String[] args) {
+        // 不可达的对象也不会被清除
+        WeakReference<Object> weak = new WeakReference<>(new Object());
+        System.gc();
+        System.out.println(weak.get() != null ? "Pass" : "Fail");
+
+        // 已分配的内存不会因为 gc 而减少
+        Runtime rt = Runtime.getRuntime();
+        for (int i = 0; i < 16; i++) {
+            byte[] garbage = new byte[1024 * 1024];
+            garbage[0] = (byte) i;
+        }
+        long used = rt.totalMemory() - rt.freeMemory();
+        System.gc();
+        System.out.println(rt.totalMemory() - rt.freeMemory() >= used ? "Pass" : "Fail");
+
+        // 一直分配垃圾，直到堆被用完
+        long allocated = 0;
+        for (;;) {
+            byte[] garbage = new byte[64 * 1024];
+            garbage[0] = 1;
+            allocated += garbage.length;
+            if (allocated > rt.maxMemory()) {
+                System.out.println("Fail");
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,145 @@
+package gc;
+
+/**
+ * 逃逸分析：不逃逸的对象分配在栈上，每次执行 new 都得到一个新的（已清零的）对象；
+ * 逃逸的对象（写入属性、数组，被返回、抛出或用作锁）不受影响；
+ * 栈上对象中的引用在 gc 期间是根；被调用者的局部变量不会覆盖调用者的栈上对象。
+ */
+public class EscapeAnalysisTest {
+
+    static class Point {
+        int x;
+        int y;
+        Object ref;
+
+        Point(int x, int y) {
+            this.x = x;
+            this.y = y;
+        }
+
+        int sum() {
+            return x + y;
+        }
+    }
+
+    static class PointException extends RuntimeException {
+        final Point p;
+
+        PointException(Point p) {
+            this.p = p;
+        }
+    }
+
+    private static Object sink;
+    private static final Object[] SINK_ARRAY = new Object[1];
+
+    public static void main(String[] args) {
+        System.out.println(noEscape(1000) == 3L * 999 * 1000 / 2 ? "Pass" : "Fail");
+        System.out.println(freshObjects() ? "Pass" : "Fail");
+        System.out.println(passToStatic(100) == 100 * 3 ? "Pass" : "Fail");
+        testEscapes();
+        testRootsInLocalObjects();
+        System.out.println(callManyLocals() ? "Pass" : "Fail");
+    }
+
+    // 循环中的 Point 不逃逸
+    private static long noEscape(int n) {
+        long s = 0;
+        for (int i = 0; i < n; i++) {
+            Point p = new Point(i, 2 * i);
+            s += p.sum();
+        }
+        return s;
+    }
+
+    // 复用的分配点上每次都是清零的新对象
+    private static boolean freshObjects() {
+        for (int i = 0; i < 100; i++) {
+            Point p = new Point(0, 0);
+            if (p.ref != null || p.x != 0) {
+                return false;
+            }
+            p.x = i;
+            p.ref = p;
+        }
+        return true;
+    }
+
+    private static int plus(Point p) {
+        return p.x + p.y;
+    }
+
+    private static int passToStatic(int n) {
+        int s = 0;
+        for (int i = 0; i < n; i++) {
+            s += plus(new Point(1, 2));
+        }
+        return s;
+    }
+
+    private static Point returned(int x) {
+        return new Point(x, x);
+    }
+
+    private static void testEscapes() {
+        Point[] kept = new Point[10];
+        for (int i = 0; i < 10; i++) {
+            Point p = new Point(i, i);
+            if (i % 2 == 0) {
+                kept[i] = p; // 逃逸到数组中
+            } else {
+                kept[i] = returned(i);
+            }
+        }
+        boolean pass = true;
+        for (int i = 0; i < 10; i++) {
+            pass &= kept[i].x == i && kept[i].y == i;
+        }
+        System.out.println(pass ? "Pass" : "Fail");
+
+        sink = new Point(5, 6);
+        SINK_ARRAY[0] = new Point(7, 8);
+        for (int i = 0; i < 100; i++) {
+            new Point(i, i).sum();
+        }
+        System.out.println(((Point) sink).sum() == 11 && ((Point) SINK_ARRAY[0]).sum() == 15 ? "Pass" : "Fail");
+
+        Point locked = new Point(1, 1);
+        synchronized (locked) {
+            locked.x = 2;
+        }
+        System.out.println(locked.sum() == 3 ? "Pass" : "Fail");
+
+        try {
+            throw new PointException(new Point(3, 4));
+        } catch (PointException e) {
+            System.out.println(e.p.sum() == 7 ? "Pass" : "Fail");
+        }
+    }
+
+    // 栈上对象引用的堆中对象在 gc 之后仍然存活
+    private static void testRootsInLocalObjects() {
+        Point p = new Point(1, 2);
+        p.ref = new StringBuilder("alive");
+        for (int i = 0; i < 1000; i++) {
+            byte[] garbage = new byte[1024];
+            garbage[0] = (byte) i;
+        }
+        System.gc();
+        System.out.println(p.ref.toString().equals("alive") ? "Pass" : "Fail");
+    }
+
+    // 操作数栈很浅的方法调用局部变量很多的方法，栈上的 Point 不被覆盖
+    private static boolean callManyLocals() {
+        Point p = new Point(3, 4);
+        int r = manyLocals(1);
+        return p.x == 3 && p.y == 4 && r == -15;
+    }
+
+    private static int manyLocals(int a) {
+        long l0 = -1, l1 = -1, l2 = -1, l3 = -1, l4 = -1, l5 = -1, l6 = -1, l7 = -1;
+        long l8 = -1, l9 = -1, l10 = -1, l11 = -1, l12 = -1, l13 = -1, l14 = -1, l15 = -1;
+        return (int) (a + l0 + l1 + l2 + l3 + l4 + l5 + l6 + l7
+                + l8 + l9 + l10 + l11 + l12 + l13 + l14 + l15);
+    }
+}
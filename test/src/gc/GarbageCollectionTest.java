@@ -0,0 +1,28 @@
+package gc;
+
+/**
+ * 分配的总量远大于堆的大小（512M），但存活的对象是有限的。
+ */
+public class GarbageCollectionTest {
+    private static final int LIVE_COUNT = 1024;
+
+    public static void main(String[] args) {
+        Object[] live = new Object[LIVE_COUNT];
+
+        for (int i = 0; i < 4 * 1024 * 1024; i++) {
+            byte[] garbage = new byte[1024];
+            garbage[0] = (byte) i;
+            live[i % LIVE_COUNT] = "str" + i;
+        }
+
+        for (int i = 0; i < LIVE_COUNT; i++) {
+            if (!(live[i] instanceof String)) {
+                throw new RuntimeException("live object lost: " + i);
+            }
+        }
+
+        System.gc();
+        System.out.println(live[LIVE_COUNT - 1]);
+        System.out.println("freeMemory: " + Runtime.getRuntime().freeMemory());
+    }
+}
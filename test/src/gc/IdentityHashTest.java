@@ -0,0 +1,57 @@
+package gc;
+
+import java.util.Arrays;
+
+/**
+ * identity hash 在对象被 gc 移动（minor gc 复制、full gc 压缩）之后保持不变，
+ * 并且与对象的地址无关：不同的对象大多有不同的 hash.
+ */
+public class IdentityHashTest {
+    private static final int COUNT = 10000;
+
+    public static void main(String[] args) {
+        Object[] objs = new Object[COUNT];
+        int[] hashes = new int[COUNT];
+        for (int i = 0; i < COUNT; i++) {
+            // 不同大小的对象，交错地产生垃圾
+            objs[i] = (i % 3 == 0) ? new Object() : (i % 3 == 1) ? new int[i % 17] : new StringBuilder("x" + i);
+            hashes[i] = System.identityHashCode(objs[i]);
+            byte[] garbage = new byte[512];
+            garbage[0] = (byte) i;
+        }
+
+        for (int round = 0; round < 3; round++) {
+            // 释放一半的对象，让 full gc 压缩剩下的
+            if (round == 1) {
+                for (int i = 0; i < COUNT; i += 2) {
+                    objs[i] = null;
+                }
+            }
+            System.gc();
+            boolean pass = true;
+            for (int i = 0; i < COUNT; i++) {
+                pass &= objs[i] == null || System.identityHashCode(objs[i]) == hashes[i];
+            }
+            System.out.println(pass ? "Pass" : "Fail");
+        }
+
+        // Object.hashCode() 和 System.identityHashCode() 相同
+        Object o = objs[1];
+        System.out.println(o.hashCode() == System.identityHashCode(o) ? "Pass" : "Fail");
+
+        // 不同的对象大多有不同的 hash
+        System.out.println(countDistinct(hashes) >= COUNT * 9 / 10 ? "Pass" : "Fail");
+    }
+
+    private static int countDistinct(int[] a) {
+        int[] s = a.clone();
+        Arrays.sort(s);
+        int n = s.length == 0 ? 0 : 1;
+        for (int i = 1; i < s.length; i++) {
+            if (s[i] != s[i - 1]) {
+                n++;
+            }
+        }
+        return n;
+    }
+}
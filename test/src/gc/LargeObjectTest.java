@@ -0,0 +1,45 @@
+package gc;
+
+/**
+ * 大数组（不小于 512K）在大对象空间中分配：存活的大数组在 gc 后内容不变，
+ * 死亡的大数组被回收，分配的总量远大于堆的大小也不会 OutOfMemoryError.
+ */
+public class LargeObjectTest {
+    private static final int LIVE_COUNT = 8;
+
+    public static void main(String[] args) {
+        long[][] live = new long[LIVE_COUNT][];
+        for (int i = 0; i < LIVE_COUNT; i++) {
+            live[i] = new long[128 * 1024 + i]; // 1M 多
+            live[i][0] = i;
+            live[i][live[i].length - 1] = -i;
+        }
+
+        // 共分配约 4G 的大数组，只有最后一个是存活的
+        Object[] refs = new Object[1];
+        for (int i = 0; i < 4096; i++) {
+            Object[] garbage = new Object[256 * 1024 + i % 7]; // 引用数组，1M 多
+            garbage[0] = live;
+            garbage[garbage.length - 1] = refs;
+            refs[0] = garbage;
+        }
+        System.gc();
+
+        boolean pass = true;
+        for (int i = 0; i < LIVE_COUNT; i++) {
+            pass &= live[i].length == 128 * 1024 + i && live[i][0] == i && live[i][live[i].length - 1] == -i;
+        }
+        System.out.println(pass ? "Pass" : "Fail");
+
+        Object[] last = (Object[]) refs[0];
+        System.out.println(last[0] == live && last[last.length - 1] == refs ? "Pass" : "Fail");
+
+        // 释放所有的大数组后，使用的内存减少
+        Runtime rt = Runtime.getRuntime();
+        long used = rt.totalMemory() - rt.freeMemory();
+        live = null;
+        refs[0] = null;
+        System.gc();
+        System.out.println(rt.totalMemory() - rt.freeMemory() < used ? "Pass" : "Fail");
+    }
+}
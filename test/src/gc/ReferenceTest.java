@@ -0,0 +1,79 @@
+package gc;
+
+import java.lang.ref.PhantomReference;
+import java.lang.ref.Reference;
+import java.lang.ref.ReferenceQueue;
+import java.lang.ref.SoftReference;
+import java.lang.ref.WeakReference;
+
+/**
+ * Reference processing：referent 不可达后 WeakReference 被清除并放入 ReferenceQueue，
+ * 内存充足时 SoftReference 保留，finalize() 由 Finalizer 线程执行，之后 PhantomReference 入队。
+ */
+public class ReferenceTest {
+
+    static class Finalizable {
+        static volatile int finalized;
+
+        @Override
+        protected void finalize() {
+            finalized++;
+        }
+    }
+
+    public static void main(String[] args) throws InterruptedException {
+        testWeak();
+        testSoft();
+        testFinalizer();
+        testPhantom();
+    }
+
+    private static void testWeak() throws InterruptedException {
+        ReferenceQueue<Object> queue = new ReferenceQueue<>();
+        Object strong = new Object();
+        WeakReference<Object> kept = new WeakReference<>(strong, queue);
+        WeakReference<Object> cleared = new WeakReference<>(new Object(), queue);
+
+        System.gc();
+        System.out.println(cleared.get() == null ? "Pass" : "Fail");
+        System.out.println(kept.get() == strong ? "Pass" : "Fail");
+
+        // Reference Handler 线程把清除了的 WeakReference 放入队列
+        Reference<?> r = queue.remove(5000);
+        System.out.println(r == cleared && queue.poll() == null ? "Pass" : "Fail");
+        System.out.println(kept.get() == strong ? "Pass" : "Fail");
+    }
+
+    private static void testSoft() {
+        SoftReference<byte[]> soft = new SoftReference<>(new byte[1024]);
+        System.gc();
+        // 内存充足，软引用不会被清除
+        System.out.println(soft.get() != null ? "Pass" : "Fail");
+    }
+
+    private static void testFinalizer() throws InterruptedException {
+        Finalizable.finalized = 0;
+        for (int i = 0; i < 10; i++) {
+            new Finalizable();
+        }
+        for (int i = 0; i < 50 && Finalizable.finalized < 10; i++) {
+            System.gc();
+            Thread.sleep(20);
+        }
+        System.out.println(Finalizable.finalized == 10 ? "Pass" : "Fail");
+    }
+
+    private static void testPhantom() throws InterruptedException {
+        ReferenceQueue<Object> queue = new ReferenceQueue<>();
+        PhantomReference<Object> phantom = new PhantomReference<>(new Finalizable(), queue);
+        System.out.println(phantom.get() == null ? "Pass" : "Fail");
+
+        Reference<?> r = null;
+        for (int i = 0; i < 50 && r == null; i++) {
+            System.gc();
+            r = queue.remove(20);
+        }
+        // finalize() 执行之后才入队
+        System.out.println(r == phantom ? "Pass" : "Fail");
+    }
+}
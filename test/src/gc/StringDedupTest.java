@@ -0,0 +1,48 @@
+package gc;
+
+import java.lang.reflect.Field;
+
+import sun.misc.Unsafe;
+
+/**
+ * String deduplication：内容相同的两个字符串晋升到老年代后共享同一个 value 数组。
+ *
+ * 运行时需要 -XX:+UseStringDeduplication
+ */
+public class StringDedupTest {
+    private static Unsafe unsafe;
+    private static long valueOffset;
+
+    private static Object value(String s) {
+        return unsafe.getObject(s, valueOffset);
+    }
+
+    public static void main(String[] args) throws Exception {
+        Field f = Unsafe.class.getDeclaredField("theUnsafe");
+        f.setAccessible(true);
+        unsafe = (Unsafe) f.get(null);
+        valueOffset = unsafe.objectFieldOffset(String.class.getDeclaredField("value"));
+
+        // 两个内容相同的字符串，各自有自己的数组
+        char[] chars = "deduplicate me".toCharArray();
+        String s1 = new String(chars);
+        String s2 = new String(chars);
+        String other = new String("something else");
+        System.out.println(s1 != s2 && value(s1) != value(s2) ? "Pass" : "Fail");
+
+        // 产生垃圾触发 minor gc，字符串晋升到老年代后由去重线程处理
+        for (int i = 0; i < 200 && value(s1) != value(s2); i++) {
+            for (int j = 0; j < 10000; j++) {
+                byte[] garbage = new byte[1024];
+                garbage[0] = (byte) j;
+            }
+            Thread.sleep(10);
+        }
+        System.out.println(value(s1) == value(s2) ? "Pass" : "Fail");
+        System.out.println(value(other) != value(s1) ? "Pass" : "Fail");
+
+        // 共享数组后字符串的内容不变
+        System.out.println(s1.equals("deduplicate me") && s2.equals(s1) && other.equals("something else")
+                ? "Pass" : "Fail");
+    }
+}
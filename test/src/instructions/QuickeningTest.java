@@ -0,0 +1,78 @@
+package instructions;
+
+/**
+ * 字段和 invoke 指令第一次解析后被改写为快速指令，
+ * 之后重复执行（包括对不同的对象、子类的对象）的结果不变。
+ */
+public class QuickeningTest {
+
+    static class Base {
+        int i = 1;
+        long l = 2;
+        double d = 3.5;
+        Object o = "o";
+        byte b = 4;
+        char c = 'c';
+
+        int value() {
+            return i;
+        }
+    }
+
+    static class Sub extends Base {
+        short s = 5;
+
+        @Override
+        int value() {
+            return i + s;
+        }
+    }
+
+    static class Init {
+        static int inits;
+        static int counter;
+
+        static {
+            inits++;
+        }
+
+        static int next() {
+            return ++counter;
+        }
+    }
+
+    public static void main(String[] args) {
+        Base[] objs = { new Base(), new Sub(), new Base(), new Sub() };
+
+        long sum = 0;
+        boolean objectField = true;
+        for (int n = 0; n < 100; n++) {
+            for (Base x : objs) {
+                // 同一条指令作用于不同类的对象
+                x.i += 1;
+                x.l += 2;
+                x.d += 0.5;
+                x.b += 1;
+                x.c += 1;
+                sum += x.value();
+                objectField &= x.o == "o";
+            }
+        }
+        System.out.println(objs[0].i == 101 && objs[1].i == 101 ? "Pass" : "Fail");
+        System.out.println(objs[0].l == 202 && objs[3].l == 202 ? "Pass" : "Fail");
+        System.out.println(objs[2].d == 53.5 ? "Pass" : "Fail");
+        System.out.println(objs[1].b == 104 && objs[1].c == 'c' + 100 ? "Pass" : "Fail");
+        System.out.println(((Sub) objs[1]).s == 5 && objectField ? "Pass" : "Fail");
+        // value() 的结果：Base 为 i，Sub 为 i + 5
+        long expected = 0;
+        for (int n = 1; n <= 100; n++) {
+            expected += 4L * (1 + n) + 2 * 5;
+        }
+        System.out.println(sum == expected ? "Pass" : "Fail");
+
+        for (int n = 0; n < 100; n++) {
+            Init.next();
+        }
+        System.out.println(Init.counter == 100 && Init.inits == 1 ? "Pass" : "Fail");
+    }
+}
@@ -0,0 +1,54 @@
+package interface0;
+
+/**
+ * 子接口重写了父接口的 default 方法，类的 vtable 中应该是子接口中的方法（最具体的）。
+ */
+public class DefaultMethodOverrideTest {
+    interface I1 {
+        default String f() {
+            return "I1";
+        }
+    }
+
+    interface I2 extends I1 {
+        default String f() {
+            return "I2";
+        }
+    }
+
+    // 父类实现了 I1，子类实现了 I2
+    static class S implements I1 { }
+
+    static class C extends S implements I2 { }
+
+    // 一个类同时实现 I1 和 I2，两种顺序
+    static class D implements I1, I2 { }
+
+    static class E implements I2, I1 { }
+
+    // 没有重写关系的两个接口，类自己解决冲突
+    interface J {
+        default String f() {
+            return "J";
+        }
+    }
+
+    static class F implements I1, J {
+        public String f() {
+            return "F";
+        }
+    }
+
+    public static void main(String[] args) {
+        System.out.println(new S().f() == "I1" ? "Pass" : "Fail");
+        System.out.println(new C().f() == "I2" ? "Pass" : "Fail");
+        System.out.println(new D().f() == "I2" ? "Pass" : "Fail");
+        System.out.println(new E().f() == "I2" ? "Pass" : "Fail");
+        System.out.println(new F().f() == "F" ? "Pass" : "Fail");
+
+        // 通过父类类型调用，同一个调用点分派到不同的类
+        S[] ss = { new S(), new C() };
+        System.out.println(ss[0].f() == "I1" ? "Pass" : "Fail");
+        System.out.println(ss[1].f() == "I2" ? "Pass" : "Fail");
+    }
+}
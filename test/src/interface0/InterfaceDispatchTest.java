@@ -0,0 +1,69 @@
+package interface0;
+
+/**
+ * invokeinterface 通过 itable 分派：以父接口的类型调用时，也要执行子接口重写的 default 方法。
+ */
+public class InterfaceDispatchTest {
+    interface I1 {
+        default String f() {
+            return "I1";
+        }
+
+        String g();
+    }
+
+    interface I2 extends I1 {
+        default String f() {
+            return "I2";
+        }
+    }
+
+    static class S implements I1 {
+        public String g() {
+            return "S";
+        }
+    }
+
+    static class C extends S implements I2 { }
+
+    static class D implements I1, I2 {
+        public String g() {
+            return "D";
+        }
+    }
+
+    // 类自己的实现优先于 default 方法
+    static class E extends C {
+        public String f() {
+            return "E";
+        }
+    }
+
+    public static void main(String[] args) {
+        I1 s = new S();
+        I1 c = new C();
+        I1 d = new D();
+        I1 e = new E();
+        I2 c2 = new C();
+
+        System.out.println(s.f() == "I1" ? "Pass" : "Fail");
+        System.out.println(c.f() == "I2" ? "Pass" : "Fail");
+        System.out.println(d.f() == "I2" ? "Pass" : "Fail");
+        System.out.println(e.f() == "E" ? "Pass" : "Fail");
+        System.out.println(c2.f() == "I2" ? "Pass" : "Fail");
+
+        System.out.println(c.g() == "S" ? "Pass" : "Fail");
+        System.out.println(d.g() == "D" ? "Pass" : "Fail");
+
+        // 同一个调用点多次执行，经过 quickening 和 inline cache 后结果不变
+        I1[] all = { s, c, d, e };
+        String[] expected = { "I1", "I2", "I2", "E" };
+        boolean pass = true;
+        for (int n = 0; n < 3; n++) {
+            for (int i = 0; i < all.length; i++) {
+                pass &= all[i].f() == expected[i];
+            }
+        }
+        System.out.println(pass ? "Pass" : "Fail");
+    }
+}
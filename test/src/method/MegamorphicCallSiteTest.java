@@ -0,0 +1,83 @@
+package method;
+
+/**
+ * 调用点的 inline cache：同一个 invokevirtual/invokeinterface 调用点先后遇到一种、几种
+ * 以及很多种接收者类（单态、多态、超多态），并在之后回到单态时仍然分派到正确的方法。
+ */
+public class MegamorphicCallSiteTest {
+
+    interface Shape {
+        int id();
+    }
+
+    static abstract class Base implements Shape {
+        abstract int area();
+    }
+
+    static class S0 extends Base { int area() { return 0; } public int id() { return 100; } }
+    static class S1 extends Base { int area() { return 1; } public int id() { return 101; } }
+    static class S2 extends Base { int area() { return 2; } public int id() { return 102; } }
+    static class S3 extends Base { int area() { return 3; } public int id() { return 103; } }
+    static class S4 extends Base { int area() { return 4; } public int id() { return 104; } }
+    static class S5 extends Base { int area() { return 5; } public int id() { return 105; } }
+    static class S6 extends Base { int area() { return 6; } public int id() { return 106; } }
+    static class S7 extends Base { int area() { return 7; } public int id() { return 107; } }
+
+    // 只实现接口，不是 Base 的子类
+    static class Other implements Shape {
+        public int id() {
+            return 200;
+        }
+    }
+
+    // 所有的调用都经过这两个调用点
+    private static int area(Base b) {
+        return b.area();
+    }
+
+    private static int id(Shape s) {
+        return s.id();
+    }
+
+    public static void main(String[] args) {
+        Base[] all = { new S0(), new S1(), new S2(), new S3(), new S4(), new S5(), new S6(), new S7() };
+
+        // 单态
+        boolean pass = true;
+        for (int n = 0; n < 100; n++) {
+            pass &= area(all[3]) == 3 && id(all[3]) == 103;
+        }
+        System.out.println(pass ? "Pass" : "Fail");
+
+        // 多态
+        pass = true;
+        for (int n = 0; n < 100; n++) {
+            Base b = all[n % 2 + 1];
+            pass &= area(b) == n % 2 + 1 && id(b) == 101 + n % 2;
+        }
+        System.out.println(pass ? "Pass" : "Fail");
+
+        // 超多态
+        pass = true;
+        for (int n = 0; n < 1000; n++) {
+            Base b = all[n % all.length];
+            pass &= area(b) == n % all.length && id(b) == 100 + n % all.length;
+        }
+        System.out.println(pass ? "Pass" : "Fail");
+
+        // 接口调用点遇到不在 Base 继承体系中的类
+        Shape other = new Other();
+        pass = true;
+        for (int n = 0; n < 100; n++) {
+            pass &= id(other) == 200 && id(all[n % all.length]) == 100 + n % all.length;
+        }
+        System.out.println(pass ? "Pass" : "Fail");
+
+        // 再次只遇到一种接收者类
+        pass = true;
+        for (int n = 0; n < 100; n++) {
+            pass &= area(all[7]) == 7 && id(all[0]) == 100;
+        }
+        System.out.println(pass ? "Pass" : "Fail");
+    }
+}
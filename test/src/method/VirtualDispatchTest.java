@@ -0,0 +1,100 @@
+package method;
+
+/**
+ * invokevirtual 通过 vtable 分派：重写、super 调用、final 和 private 方法，
+ * 以及子类中新增的方法不影响父类方法的 vtable 下标。
+ */
+public class VirtualDispatchTest {
+
+    static class A {
+        String f() {
+            return "A.f";
+        }
+
+        String g() {
+            return "A.g";
+        }
+
+        final String h() {
+            return "A.h";
+        }
+
+        private String p() {
+            return "A.p";
+        }
+
+        String callP() {
+            return p();
+        }
+
+        @Override
+        public String toString() {
+            return "A";
+        }
+    }
+
+    static class B extends A {
+        String extra() {
+            return "B.extra";
+        }
+
+        @Override
+        String g() {
+            return "B.g";
+        }
+
+        // 不重写 A.p
+        private String p() {
+            return "B.p";
+        }
+    }
+
+    static class C extends B {
+        @Override
+        String f() {
+            return "C.f/" + super.f();
+        }
+
+        @Override
+        String g() {
+            return "C.g/" + super.g();
+        }
+
+        @Override
+        String extra() {
+            return "C.extra";
+        }
+
+        @Override
+        public String toString() {
+            return "C";
+        }
+    }
+
+    public static void main(String[] args) {
+        A[] objs = { new A(), new B(), new C() };
+        String[][] expected = {
+                { "A.f", "A.g", "A.h", "A.p", "A" },
+                { "A.f", "B.g", "A.h", "A.p", "A" },
+                { "C.f/A.f", "C.g/B.g", "A.h", "A.p", "C" },
+        };
+        for (int i = 0; i < objs.length; i++) {
+            boolean pass = true;
+            // 同一个调用点执行多次
+            for (int n = 0; n < 3; n++) {
+                A a = objs[i];
+                pass &= a.f().equals(expected[i][0]);
+                pass &= a.g().equals(expected[i][1]);
+                pass &= a.h().equals(expected[i][2]);
+                pass &= a.callP().equals(expected[i][3]);
+                pass &= a.toString().equals(expected[i][4]);
+                // 通过 Object 调用
+                Object o = a;
+                pass &= o.toString().equals(expected[i][4]);
+            }
+            System.out.println(pass ? "Pass" : "Fail");
+        }
+        System.out.println(((B) objs[1]).extra().equals("B.extra") ? "Pass" : "Fail");
+        System.out.println(((B) objs[2]).extra().equals("C.extra") ? "Pass" : "Fail");
+    }
+}
@@ -0,0 +1,171 @@
+package thread;
+
+/**
+ * 对象锁：无竞争的轻量锁、重入、多线程竞争时膨胀的锁、wait/notify，
+ * 中断正在 wait 的线程，以及计算过 identity hash 的对象的加锁。
+ */
+public class MonitorTest {
+    private static final int THREADS = 4;
+    private static final int INCREMENTS = 100000;
+
+    private static int counter;
+
+    public static void main(String[] args) throws InterruptedException {
+        testRecursive();
+        testContended();
+        testWaitNotify();
+        testInterrupt();
+        testHashedObject();
+    }
+
+    private static void testRecursive() throws InterruptedException {
+        Object lock = new Object();
+        int depth = 0;
+        synchronized (lock) {
+            synchronized (lock) {
+                synchronized (lock) {
+                    depth = 3;
+                }
+            }
+        }
+        System.out.println(depth == 3 ? "Pass" : "Fail");
+        // 解锁后其他线程可以获得锁
+        System.out.println(lockInOtherThread(lock) ? "Pass" : "Fail");
+    }
+
+    private static void testContended() throws InterruptedException {
+        final Object lock = new Object();
+        Thread[] threads = new Thread[THREADS];
+        for (int i = 0; i < THREADS; i++) {
+            threads[i] = new Thread(() -> {
+                for (int j = 0; j < INCREMENTS; j++) {
+                    synchronized (lock) {
+                        counter++;
+                    }
+                }
+            });
+            threads[i].start();
+        }
+        for (Thread t : threads) {
+            t.join();
+        }
+        System.out.println(counter == THREADS * INCREMENTS ? "Pass" : "Fail");
+    }
+
+    private static final Object queueLock = new Object();
+    private static int queued;
+    private static int consumed;
+
+    // 生产者和消费者通过 wait/notifyAll 交替，队列最多容纳 4 个
+    private static void testWaitNotify() throws InterruptedException {
+        final int items = 1000;
+        Thread consumer = new Thread(() -> {
+            for (int i = 0; i < items; i++) {
+                synchronized (queueLock) {
+                    while (queued == 0) {
+                        try {
+                            queueLock.wait();
+                        } catch (InterruptedException e) {
+                            return;
+                        }
+                    }
+                    queued--;
+                    consumed++;
+                    queueLock.notifyAll();
+                }
+            }
+        });
+        consumer.start();
+
+        for (int i = 0; i < items; i++) {
+            synchronized (queueLock) {
+                while (queued == 4) {
+                    queueLock.wait();
+                }
+                queued++;
+                queueLock.notifyAll();
+            }
+        }
+        consumer.join();
+        System.out.println(consumed == items && queued == 0 ? "Pass" : "Fail");
+
+        // 超时返回
+        long start = System.currentTimeMillis();
+        synchronized (queueLock) {
+            queueLock.wait(50);
+        }
+        System.out.println(System.currentTimeMillis() - start >= 40 ? "Pass" : "Fail");
+
+        // 没有持有锁时调用 notify
+        try {
+            queueLock.notify();
+            System.out.println("Fail");
+        } catch (IllegalMonitorStateException e) {
+            System.out.println("Pass");
+        }
+    }
+
+    private static boolean waiting;
+
+    private static void testInterrupt() throws InterruptedException {
+        final Object lock = new Object();
+        boolean[] interrupted = new boolean[2];
+        Thread waiter = new Thread(() -> {
+            synchronized (lock) {
+                waiting = true;
+                try {
+                    lock.wait();
+                } catch (InterruptedException e) {
+                    interrupted[0] = true;
+                    // 抛出 InterruptedException 时中断状态已被清除
+                    interrupted[1] = Thread.currentThread().isInterrupted();
+                }
+            }
+        });
+        waiter.start();
+        synchronized (lock) {
+            // waiter 只在 wait 中释放锁，所以持有锁时 waiting 为 true 表示 waiter 正在等待
+            while (!waiting) {
+                lock.wait(10);
+            }
+            waiter.interrupt();
+        }
+        waiter.join();
+        System.out.println(interrupted[0] && !interrupted[1] ? "Pass" : "Fail");
+
+        // 调用 wait 之前已被中断
+        Thread.currentThread().interrupt();
+        synchronized (lock) {
+            try {
+                lock.wait();
+                System.out.println("Fail");
+            } catch (InterruptedException e) {
+                System.out.println(!Thread.interrupted() ? "Pass" : "Fail");
+            }
+        }
+    }
+
+    private static void testHashedObject() throws InterruptedException {
+        Object o = new Object();
+        int hash = System.identityHashCode(o);
+        synchronized (o) {
+            System.out.println(System.identityHashCode(o) == hash ? "Pass" : "Fail");
+            o.notifyAll(); // 膨胀
+            System.out.println(System.identityHashCode(o) == hash ? "Pass" : "Fail");
+        }
+        System.out.println(lockInOtherThread(o) ? "Pass" : "Fail");
+        System.out.println(System.identityHashCode(o) == hash ? "Pass" : "Fail");
+    }
+
+    private static boolean lockInOtherThread(Object lock) throws InterruptedException {
+        boolean[] locked = new boolean[1];
+        Thread t = new Thread(() -> {
+            synchronized (lock) {
+                locked[0] = true;
+            }
+        });
+        t.start();
+        t.join();
+        return locked[0];
+    }
+}